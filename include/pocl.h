@@ -70,20 +70,54 @@ struct _build_program_callback
 
 // Command Queue datatypes
 
+/* A kernel argument whose value a work-group function is specialized on. */
+typedef struct
+{
+  unsigned arg_index;
+  /* POCL_ARG_TYPE_IMAGE, POCL_ARG_TYPE_SAMPLER or POCL_ARG_TYPE_NONE for
+     the scalars */
+  int type;
+  /* The size of a scalar value in bytes, at most 8. */
+  unsigned size;
+  /* Images: the channel order, the channel data type, the number of
+     channels and the element size. Samplers: the sampler bits in the
+     first element. Scalars: the bytes of the value. */
+  int value[4];
+} pocl_arg_specialization;
+
+typedef struct
+{
+  unsigned num_args;
+  pocl_arg_specialization *args;
+  /* Hash of the specialized values, names the kernel cache directory. */
+  char key[17];
+} pocl_kernel_specialization;
+
 // clEnqueueNDRangeKernel
 typedef struct
 {
   void *data;
   char *tmp_dir; 
-  pocl_workgroup wg;
+  pocl_workgroup_blob wg;
+  /* Bytes of context arena needed by the work-group function. */
+  size_t context_arena_size;
   cl_kernel kernel;
   size_t local_x;
   size_t local_y;
   size_t local_z;
   struct pocl_context pc;
   struct pocl_argument *arguments;
+  /* The argument values, laid out by kernel->arg_blob_offsets. The values
+     of ARGUMENTS point to their slots. */
+  void *arg_blob;
   /* Can be used to store/cache device-specific data. */
   void **device_data;
+  /* Max number of work-groups a worker takes at a time, 0 = device default.
+     Only meaningful for devices with wg_chunking set. */
+  unsigned wg_chunk;
+  /* Autotuning bookkeeping, set only for launches that are tuning trials. */
+  void *autotune_entry;
+  unsigned autotune_trial;
 } _cl_command_run;
 
 // clEnqueueNativeKernel
@@ -41,6 +41,15 @@ extern "C" {
 
 void pocl_cache_init_topdir();
 
+/* Returns nonzero if the file PATH exists in the writable kernel cache.
+   If it does not, but one of the read-only cache layers listed in
+   POCL_CACHE_LAYERS has the same file, the file is first copied to PATH
+   from the first such layer. */
+int pocl_cache_exists(const char *path);
+
+/* Returns the number of read-only cache layers in use. */
+unsigned pocl_cache_num_layers();
+
 int
 pocl_cache_create_program_cachedir(cl_program program, unsigned device_i,
                                    const char* preprocessed_source, size_t source_len,
@@ -97,6 +106,31 @@ void pocl_cache_kernel_cachedir_path (char* kernel_cachedir_path,
                                       size_t local_y,
                                       size_t local_z);
 
+/* As above, for a work-group function specialized on the kernel argument
+   values hashed to SPEC_KEY. A NULL SPEC_KEY means no specialization. */
+void pocl_cache_specialized_kernel_cachedir_path (char* kernel_cachedir_path,
+                                                  cl_program program,
+                                                  unsigned device_i,
+                                                  cl_kernel kernel,
+                                                  char* append_str,
+                                                  size_t local_x,
+                                                  size_t local_y,
+                                                  size_t local_z,
+                                                  const char *spec_key);
+
+/* Evicts the least recently used specialized variants of KERNEL for the
+   local size from the writable cache layer until there are less than
+   MAX_VARIANTS of them. Returns the number of variants left. */
+unsigned pocl_cache_evict_specialized_variants (cl_program program,
+                                                unsigned device_i,
+                                                cl_kernel kernel,
+                                                size_t local_x,
+                                                size_t local_y,
+                                                size_t local_z,
+                                                unsigned max_variants);
+
+/* Marks the specialized variant in VARIANT_DIR as used now. */
+int pocl_cache_update_variant_last_access (const char *variant_dir);
 
 int pocl_cache_write_kernel_parallel_bc(void*        bc,
                                         cl_program   program,
@@ -104,7 +138,8 @@ int pocl_cache_write_kernel_parallel_bc(void*        bc,
                                         cl_kernel    kernel,
                                         size_t       local_x,
                                         size_t       local_y,
-                                        size_t       local_z);
+                                        size_t       local_z,
+                                        const char*  spec_key);
 
 
 // required by pocl_binary.c
@@ -126,6 +161,10 @@ void pocl_cache_work_group_function_path(char* parallel_bc_path, cl_program prog
                               unsigned device_i, cl_kernel kernel,
                               size_t local_x, size_t local_y, size_t local_z);
 
+void pocl_cache_autotune_db_path(char*        autotune_db_path,
+                                 cl_program   program,
+                                 unsigned     device_i);
+
 void pocl_cache_final_binary_path(char* final_binary_path, cl_program program,
                                unsigned device_i, cl_kernel kernel,
                                size_t local_x, size_t local_y,
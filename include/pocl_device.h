@@ -37,10 +37,29 @@ struct pocl_context {
   size_t group_id[3];
   size_t global_offset[3];
   size_t local_size[3];
+  /* Storage for the context data of the work-item loops of work-group
+     functions with the dynamic local size, see
+     struct pocl_context_arena_layout. Allocated by the device for each
+     worker thread. */
+  void *context_arena;
 };
 
 typedef void (*pocl_workgroup) (void **, struct pocl_context *);
 
+/* The _workgroup launcher of a kernel, which reads the kernel arguments
+   from a single argument blob, see struct _cl_kernel. */
+typedef void (*pocl_workgroup_blob) (void *, struct pocl_context *);
+
+/* The context arena need of a work-group function with the dynamic
+   local size: local_size[0] * local_size[1] * local_size[2]
+   * per_work_item + fixed bytes. The kernel binary exports it as
+   _pocl_context_arena_<kernel name>, the symbol is missing if the
+   context arena is not used. */
+struct pocl_context_arena_layout {
+  size_t per_work_item;
+  size_t fixed;
+};
+
 #define MAX_KERNEL_ARGS 64
 #define MAX_KERNEL_NAME_LENGTH 64
 
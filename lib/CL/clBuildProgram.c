@@ -68,6 +68,10 @@ static const char cl_parameters_supported_after_clang_3_9[] =
   "-cl-denorms-are-zero "
   "-cl-no-signed-zeros ";
 
+/* Names the scalar kernel arguments to specialize the work-group
+   functions on the launch values of, e.g. "-pocl-specialize-args=n,stride". */
+#define SPECIALIZE_ARGS_OPTION "-pocl-specialize-args="
+
 static const char cl_parameters_not_yet_supported_by_clang[] =
   "-cl-uniform-work-group-size ";
 
@@ -215,6 +219,7 @@ CL_API_SUFFIX__VERSION_1_0
 
   size_t i = 1; /* terminating char */
   modded_options = (char*) calloc (512, 1);
+  POCL_MEM_FREE (program->specialize_args);
 
   if (options != NULL)
     {
@@ -297,6 +302,16 @@ CL_API_SUFFIX__VERSION_1_0
               token = strtok_r (NULL, " ", &saveptr);
               continue;
             }
+          else if (strncmp (token, SPECIALIZE_ARGS_OPTION,
+                            strlen (SPECIALIZE_ARGS_OPTION)) == 0)
+            {
+              /* pocl's own option, not passed to the frontend */
+              POCL_MEM_FREE (program->specialize_args);
+              program->specialize_args =
+                strdup (token + strlen (SPECIALIZE_ARGS_OPTION));
+              token = strtok_r (NULL, " ", &saveptr);
+              continue;
+            }
           else if (memcmp (token, "-spir-std=1.2", 13) == 0)
             {
               /* "-spir-std=" flags are not valid when building from source */
@@ -148,6 +148,7 @@ POname(clCreateBuffer)(cl_context   context,
   mem->context = context;
   mem->mem_host_ptr = host_ptr;
   mem->shared_mem_allocation_owner = NULL;
+  mem->zero_copy_read_only = 0;
 
   /* if there is a "special needs" device (hsa) operating in the host memory 
      let it alloc memory first for shared memory use */
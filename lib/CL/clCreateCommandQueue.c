@@ -69,12 +69,15 @@ POname(clCreateCommandQueue)(cl_context context,
   command_queue->context = context;
   command_queue->device = device;
   command_queue->properties = properties;
+  command_queue->priority = CL_QUEUE_PRIORITY_MED_KHR;
   command_queue->barrier = NULL;
   command_queue->events = NULL;
   command_queue->command_count = 0;
   command_queue->last_event.event = NULL;
   command_queue->last_event.event_id = -1;
   command_queue->last_event.next = NULL;
+  memset (&command_queue->stream, 0, sizeof (pocl_in_order_stream));
+  pocl_signal_init (&command_queue->finished);
 
   POCL_RETAIN_OBJECT(context);
   POCL_RETAIN_OBJECT(device);
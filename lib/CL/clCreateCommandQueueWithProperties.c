@@ -36,6 +36,8 @@ POname(clCreateCommandQueueWithProperties)(cl_context context,
   cl_command_queue_properties queue_props = 0;
   int queue_props_set = 0;
   cl_uint queue_size = 0;
+  cl_queue_priority_khr priority = CL_QUEUE_PRIORITY_MED_KHR;
+  cl_command_queue command_queue;
   const cl_command_queue_properties valid_prop_flags =
       (CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE
        | CL_QUEUE_PROFILING_ENABLE
@@ -69,6 +71,15 @@ POname(clCreateCommandQueueWithProperties)(cl_context context,
           queue_size = (cl_uint)properties[i+1];
           i+=2;
           break;
+        case CL_QUEUE_PRIORITY_KHR:
+          priority = (cl_queue_priority_khr)properties[i+1];
+          POCL_GOTO_ERROR_ON((priority != CL_QUEUE_PRIORITY_HIGH_KHR &&
+                              priority != CL_QUEUE_PRIORITY_MED_KHR &&
+                              priority != CL_QUEUE_PRIORITY_LOW_KHR),
+                             CL_INVALID_VALUE,
+                             "Invalid CL_QUEUE_PRIORITY_KHR value\n");
+          i+=2;
+          break;
         default:
           POCL_GOTO_ERROR_ON(1, CL_INVALID_VALUE, "Invalid values it properties\n");
         }
@@ -96,7 +107,11 @@ POname(clCreateCommandQueueWithProperties)(cl_context context,
     }
 
   // currently thhere's only support for host side queues.
-  return POname(clCreateCommandQueue)(context, device, queue_props, errcode_ret);
+  command_queue = POname(clCreateCommandQueue)(context, device, queue_props,
+                                               errcode_ret);
+  if (command_queue)
+    command_queue->priority = priority;
+  return command_queue;
 
 ERROR:
   if(errcode_ret)
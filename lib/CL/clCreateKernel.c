@@ -39,6 +39,37 @@
 
 #define COMMAND_LENGTH 1024
 
+/* Marks the scalar arguments named in the comma separated NAMES for the
+   specialization of the work-group functions on their values. */
+static void
+mark_specialized_args (cl_kernel kernel, const char *names)
+{
+  unsigned i;
+  for (i = 0; i < kernel->num_args; ++i)
+    {
+      struct pocl_argument_info *ai = &kernel->arg_info[i];
+      const char *name = names;
+      size_t len;
+      if (ai->name == NULL || ai->type != POCL_ARG_TYPE_NONE || ai->is_local)
+        continue;
+      len = strlen (ai->name);
+      while (name != NULL)
+        {
+          if (strncmp (name, ai->name, len) == 0
+              && (name[len] == ',' || name[len] == 0))
+            {
+              ai->specialize = 1;
+              POCL_MSG_PRINT_INFO ("Specializing kernel %s on argument %s\n",
+                                   kernel->name, ai->name);
+              break;
+            }
+          name = strchr (name, ',');
+          if (name != NULL)
+            ++name;
+        }
+    }
+}
+
 CL_API_ENTRY cl_kernel CL_API_CALL
 POname(clCreateKernel)(cl_program program,
                const char *kernel_name,
@@ -144,6 +175,16 @@ POname(clCreateKernel)(cl_program program,
         }
     }
 
+  /* The argument layout comes with the metadata of the devices the program
+     is built for. clSetKernelArg and the enqueue rely on it. */
+  POCL_GOTO_ERROR_ON ((kernel->arg_blob_offsets == NULL),
+                      CL_INVALID_PROGRAM_EXECUTABLE,
+                      "No metadata for kernel %s on any device\n",
+                      kernel_name);
+
+  if (program->specialize_args != NULL)
+    mark_specialized_args (kernel, program->specialize_args);
+
   /* default kernels don't go on the program-kernels linked list,
    * and they don't increase the program refcount. */
   if (!program->operating_on_default_kernels)
@@ -164,6 +205,7 @@ ERROR:
     {
       POCL_MEM_FREE(kernel->reqd_wg_size);
       POCL_MEM_FREE(kernel->dyn_arguments);
+      POCL_MEM_FREE(kernel->arg_blob_offsets);
       POCL_MEM_FREE(kernel->arg_info);
       POCL_MEM_FREE(kernel);
     }
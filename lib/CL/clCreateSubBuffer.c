@@ -67,6 +67,7 @@ POname(clCreateSubBuffer)(cl_mem                   buffer,
   mem->mappings = NULL;
   mem->destructor_callbacks = NULL;
   mem->parent = buffer;
+  mem->zero_copy_read_only = buffer->zero_copy_read_only;
   mem->type = CL_MEM_OBJECT_BUFFER;
   mem->size = info->size;
   mem->origin = info->origin;
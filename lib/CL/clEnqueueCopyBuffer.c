@@ -60,6 +60,9 @@ CL_API_SUFFIX__VERSION_1_0
       (command_queue->context != dst_buffer->context)), CL_INVALID_CONTEXT,
       "src_buffer, dst_buffer and command_queue are not from the same context\n");
 
+  POCL_RETURN_ERROR_ON(dst_buffer->zero_copy_read_only, CL_INVALID_OPERATION,
+      "dst_buffer uses the host memory without a copy (POCL_ZERO_COPY_READ_ONLY)\n");
+
   POCL_RETURN_ERROR_COND((size == 0), CL_INVALID_VALUE);
 
   errcode = pocl_check_event_wait_list (command_queue, num_events_in_wait_list,
@@ -49,6 +49,10 @@ CL_API_SUFFIX__VERSION_1_2
   POCL_RETURN_ERROR_ON((command_queue->context != buffer->context), CL_INVALID_CONTEXT,
                        "buffer and command_queue are not from the same context\n");
 
+  POCL_RETURN_ERROR_ON(buffer->zero_copy_read_only, CL_INVALID_OPERATION,
+                       "buffer uses the host memory without a copy "
+                       "(POCL_ZERO_COPY_READ_ONLY)\n");
+
   errcode = pocl_check_event_wait_list (command_queue, num_events_in_wait_list,
                                         event_wait_list);
   if (errcode != CL_SUCCESS)
@@ -77,6 +77,11 @@ POname(clEnqueueMapBuffer)(cl_command_queue command_queue,
       "buffer has been created with CL_MEM_HOST_READ_ONL or CL_MEM_HOST_NO_ACCESS "
       "and CL_MAP_WRITE or CL_MAP_WRITE_INVALIDATE_REGION is set in map_flags\n");
 
+  POCL_GOTO_ERROR_ON((buffer->zero_copy_read_only &&
+      map_flags & (CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)), CL_INVALID_OPERATION,
+      "buffer uses the host memory without a copy (POCL_ZERO_COPY_READ_ONLY) "
+      "and CL_MAP_WRITE or CL_MAP_WRITE_INVALIDATE_REGION is set in map_flags\n");
+
   POCL_CHECK_DEV_IN_CMDQ;
 
   /* Ensure the parent buffer is not freed prematurely. */
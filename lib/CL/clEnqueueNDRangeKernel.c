@@ -29,6 +29,7 @@
 #include "pocl_cache.h"
 #include "utlist.h"
 #include "pocl_binary.h"
+#include "pocl_autotune.h"
 #ifndef _MSC_VER
 #  include <unistd.h>
 #else
@@ -102,6 +103,10 @@ POname(clEnqueueNDRangeKernel)(cl_command_queue command_queue,
   /* cached values for max_work_group_size,
    * since we are going to access them repeatedly */
   size_t max_group_size;
+  /* work-group chunk size and autotuning trial of this launch, if any */
+  unsigned wg_chunk = 0;
+  void *autotune_entry = NULL;
+  unsigned autotune_trial = 0;
 
   int b_migrate_count, buffer_count;
   unsigned i;
@@ -441,6 +446,21 @@ if (local_##c1 > 1 && local_##c1 <= local_##c2 && local_##c1 <= local_##c3 && \
 #undef TRY_LEAST_DIM
 #undef TRY_SPLIT
         }
+
+      /* The heuristic is only a starting point: with autotuning enabled,
+       * try the nearby local sizes (and work-group chunk sizes) during the
+       * first launches and stick to the fastest one. */
+      if (pocl_autotune_enabled ())
+        {
+          const size_t global[3] = { global_x, global_y, global_z };
+          size_t local[3] = { local_x, local_y, local_z };
+          autotune_entry = pocl_autotune_select (kernel, realdev, global,
+                                                 local, &wg_chunk,
+                                                 &autotune_trial);
+          local_x = local[0];
+          local_y = local[1];
+          local_z = local[2];
+        }
     }
 
   POCL_MSG_PRINT_INFO("Queueing kernel %s with local size %u x %u x %u group "
@@ -478,7 +498,7 @@ if (local_##c1 > 1 && local_##c1 <= local_##c2 && local_##c1 <= local_##c3 && \
       if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE ||
           (!kernel->arg_info[i].is_local
            && kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER
-           && al->value != NULL))
+           && al->value != NULL && !al->is_svm))
         {
           cl_mem buf = *(cl_mem *) (al->value);
           mem_list[buffer_count++] = buf;
@@ -531,27 +551,36 @@ if (local_##c1 > 1 && local_##c1 <= local_##c2 && local_##c1 <= local_##c3 && \
   pc.global_offset[0] = offset_x;
   pc.global_offset[1] = offset_y;
   pc.global_offset[2] = offset_z;
+  pc.context_arena = NULL;
 
   command_node->type = CL_COMMAND_NDRANGE_KERNEL;
   command_node->command.run.data = command_queue->device->data;
   command_node->command.run.tmp_dir = strdup (cachedir);
   command_node->command.run.kernel = kernel;
   command_node->command.run.pc = pc;
+  command_node->command.run.context_arena_size = 0;
   command_node->command.run.local_x = local_x;
   command_node->command.run.local_y = local_y;
   command_node->command.run.local_z = local_z;
+  command_node->command.run.wg_chunk = wg_chunk;
+  command_node->command.run.autotune_entry = autotune_entry;
+  command_node->command.run.autotune_trial = autotune_trial;
 
   /* Copy the currently set kernel arguments because the same kernel
-     object can be reused for new launches with different arguments. */
+     object can be reused for new launches with different arguments.
+     The values are copied to their slots of a single argument blob. */
   command_node->command.run.arguments =
     (struct pocl_argument *) malloc ((kernel->num_args + kernel->num_locals) *
                                      sizeof (struct pocl_argument));
+  command_node->command.run.arg_blob =
+    pocl_aligned_malloc (MAX_EXTENDED_ALIGNMENT,
+                         kernel->arg_blob_size > 0 ? kernel->arg_blob_size : 1);
 
   for (i = 0; i < kernel->num_args + kernel->num_locals; ++i)
     {
       struct pocl_argument *arg = &command_node->command.run.arguments[i];
-      size_t arg_alloc_size = kernel->dyn_arguments[i].size;
-      arg->size = arg_alloc_size;
+      arg->size = kernel->dyn_arguments[i].size;
+      arg->is_svm = kernel->dyn_arguments[i].is_svm;
 
       if (kernel->dyn_arguments[i].value == NULL)
         {
@@ -559,16 +588,8 @@ if (local_##c1 > 1 && local_##c1 <= local_##c2 && local_##c1 <= local_##c3 && \
         }
       else
         {
-          /* FIXME: this is a cludge to determine an acceptable alignment,
-           * we should probably extract the argument alignment from the
-           * LLVM bytecode during kernel header generation. */
-          size_t arg_alignment = pocl_size_ceil2(arg_alloc_size);
-          if (arg_alignment >= MAX_EXTENDED_ALIGNMENT)
-            arg_alignment = MAX_EXTENDED_ALIGNMENT;
-          if (arg_alloc_size < arg_alignment)
-            arg_alloc_size = arg_alignment;
-
-          arg->value = pocl_aligned_malloc (arg_alignment, arg_alloc_size);
+          arg->value = (char *)command_node->command.run.arg_blob
+                       + kernel->arg_blob_offsets[i];
           memcpy (arg->value, kernel->dyn_arguments[i].value, arg->size);
         }
     }
@@ -578,9 +599,11 @@ if (local_##c1 > 1 && local_##c1 <= local_##c2 && local_##c1 <= local_##c3 && \
   POname(clRetainKernel) (kernel);
 
   pocl_command_enqueue (command_queue, command_node);
-  errcode = CL_SUCCESS;
+  return CL_SUCCESS;
 
 ERROR:
+  if (autotune_entry != NULL)
+    pocl_autotune_trial_released (autotune_entry, autotune_trial);
   return errcode;
 
 }
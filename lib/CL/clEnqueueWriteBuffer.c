@@ -55,6 +55,10 @@ POname(clEnqueueWriteBuffer)(cl_command_queue command_queue,
       "buffer has been created with CL_MEM_HOST_READ_ONLY "
       "or CL_MEM_HOST_NO_ACCESS\n");
 
+  POCL_RETURN_ERROR_ON (buffer->zero_copy_read_only, CL_INVALID_OPERATION,
+                        "buffer uses the host memory without a copy "
+                        "(POCL_ZERO_COPY_READ_ONLY)\n");
+
   POCL_RETURN_ERROR_COND((ptr == NULL), CL_INVALID_VALUE);
 
   if (pocl_buffer_boundcheck(buffer, offset, cb) != CL_SUCCESS)
@@ -57,6 +57,9 @@ POname(clEnqueueWriteBufferRect)(cl_command_queue command_queue,
     CL_INVALID_OPERATION, "buffer has been created with CL_MEM_HOST_READ_ONLY "
     "or CL_MEM_HOST_NO_ACCESS\n");
 
+  POCL_RETURN_ERROR_ON(buffer->zero_copy_read_only, CL_INVALID_OPERATION,
+    "buffer uses the host memory without a copy (POCL_ZERO_COPY_READ_ONLY)\n");
+
   POCL_RETURN_ERROR_ON((command_queue->context != buffer->context),
     CL_INVALID_CONTEXT, "buffer and command_queue are not from the same context\n");
 
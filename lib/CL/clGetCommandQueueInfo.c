@@ -50,6 +50,9 @@ POname(clGetCommandQueueInfo)(cl_command_queue      command_queue ,
       POCL_RETURN_GETINFO( cl_command_queue_properties, 
                               command_queue->properties );
       break;
+    case CL_QUEUE_PRIORITY_KHR:
+      POCL_RETURN_GETINFO( cl_queue_priority_khr, command_queue->priority );
+      break;
   }
   return CL_INVALID_VALUE;
 }
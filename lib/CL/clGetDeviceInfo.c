@@ -92,9 +92,9 @@ POname(clGetDeviceInfo)(cl_device_id   device,
       /* Allow overriding the max WG size to reduce compilation time
          for cases which use the maximum. This is needed until pocl has
          the WI loops.  */
-      if (getenv ("POCL_MAX_WORK_GROUP_SIZE") != NULL)
+      if (pocl_is_option_set ("POCL_MAX_WORK_GROUP_SIZE"))
         {
-          size_t from_env = atoi (getenv ("POCL_MAX_WORK_GROUP_SIZE"));
+          size_t from_env = pocl_get_int_option ("POCL_MAX_WORK_GROUP_SIZE", 0);
           if (from_env < max_wg_size) max_wg_size = from_env;
         }
       POCL_RETURN_GETINFO(size_t, max_wg_size);
@@ -44,6 +44,7 @@ POname(clReleaseCommandQueue)(cl_command_queue command_queue) CL_API_SUFFIX__VER
       POname(clFinish)(command_queue);
       if (command_queue->device->ops->free_queue)
         command_queue->device->ops->free_queue (command_queue);
+      pocl_signal_destroy (&command_queue->finished);
       pocl_queue_list_delete(command_queue);
       POCL_MEM_FREE(command_queue);
 
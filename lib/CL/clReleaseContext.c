@@ -22,6 +22,7 @@
 */
 
 #include "pocl_cl.h"
+#include "common.h"
 
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clReleaseContext)(cl_context context) CL_API_SUFFIX__VERSION_1_0
@@ -52,6 +53,7 @@ POname(clReleaseContext)(cl_context context) CL_API_SUFFIX__VERSION_1_0
       POCL_MEM_FREE(context->devices);
       POCL_MEM_FREE(context->properties);
       POCL_MEM_FREE(context);
+      pocl_print_system_memory_stats ();
     }
   return CL_SUCCESS;
 }
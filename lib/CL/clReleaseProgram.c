@@ -31,6 +31,7 @@
 #endif
 
 #include "pocl_cl.h"
+#include "pocl_autotune.h"
 #include "pocl_util.h"
 #include "pocl_cache.h"
 #include "devices.h"
@@ -77,6 +78,8 @@ POname(clReleaseProgram)(cl_program program) CL_API_SUFFIX__VERSION_1_0
 
       pocl_cache_cleanup_cachedir(program);
 
+      pocl_autotune_release_program (program);
+
       if (program->build_log)
         for (i = 0; i < program->num_devices; ++i)
           POCL_MEM_FREE(program->build_log[i]);
@@ -98,6 +101,7 @@ POname(clReleaseProgram)(cl_program program) CL_API_SUFFIX__VERSION_1_0
 
       POCL_MEM_FREE(program->build_hash);
       POCL_MEM_FREE(program->compiler_options);
+      POCL_MEM_FREE(program->specialize_args);
       POCL_MEM_FREE(program->llvm_irs);
       POCL_MEM_FREE(program);
 
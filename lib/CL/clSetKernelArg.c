@@ -66,6 +66,19 @@ POname(clSetKernelArg)(cl_kernel kernel,
     CL_INVALID_ARG_SIZE, "Arg %u is sampler, but arg_size is "
     "not sizeof(cl_sampler)", arg_index);
 
+  /* The values are copied to their slots of the argument blob at
+     enqueue, see _cl_kernel. */
+  if (pi->type == POCL_ARG_TYPE_NONE)
+    {
+      size_t slot_end = (arg_index + 1 < kernel->num_args + kernel->num_locals)
+        ? kernel->arg_blob_offsets[arg_index + 1] : kernel->arg_blob_size;
+      POCL_RETURN_ERROR_ON(
+        (arg_size > slot_end - kernel->arg_blob_offsets[arg_index]),
+        CL_INVALID_ARG_SIZE, "Arg %u is larger than the kernel argument "
+        "type (%zu bytes)\n", arg_index,
+        slot_end - kernel->arg_blob_offsets[arg_index]);
+    }
+
   p = &(kernel->dyn_arguments[arg_index]); 
   POCL_LOCK_OBJ (kernel);
   pi->is_set = 0;
@@ -111,6 +124,7 @@ POname(clSetKernelArg)(cl_kernel kernel,
 #endif
 
   p->size = arg_size;
+  p->is_svm = 0;
   pi->is_set = 1;
 
   POCL_UNLOCK_OBJ (kernel);
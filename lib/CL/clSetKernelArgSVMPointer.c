@@ -25,38 +25,51 @@
 #include "pocl_cl.h"
 #include "pocl_util.h"
 #include "devices.h"
+#include <string.h>
 
 CL_API_ENTRY cl_int CL_API_CALL
 POname(clSetKernelArgSVMPointer)(cl_kernel kernel,
                                  cl_uint arg_index,
                                  const void *arg_value) CL_API_SUFFIX__VERSION_2_0
 {
-  POCL_RETURN_ERROR_COND((kernel == NULL), CL_INVALID_VALUE);
+  struct pocl_argument *p;
+  struct pocl_argument_info *pi;
+  void *value;
+
+  POCL_RETURN_ERROR_COND((kernel == NULL), CL_INVALID_KERNEL);
 
   POCL_RETURN_ERROR_ON((!kernel->context->svm_allocdev), CL_INVALID_CONTEXT,
                        "None of the devices in this context is SVM-capable\n");
 
-  cl_mem mem = malloc(sizeof(struct _cl_mem));
-  POCL_INIT_OBJECT(mem);
-  mem->mem_host_ptr = (void*)arg_value;
-  mem->parent = NULL;
-  mem->map_count = 0;
-  mem->mappings = NULL;
-  mem->type = CL_MEM_OBJECT_BUFFER;
-  mem->flags = CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE;
-  mem->device_ptrs = NULL;
-  mem->latest_event = NULL;
-  mem->owning_device = NULL;
-  mem->is_image = CL_FALSE;
-  mem->is_pipe = 0;
-  mem->pipe_packet_size = 0;
-  mem->pipe_max_packets = 0;
-  //mem->size = size;  TODO
-  mem->context = kernel->context;
-
-  POCL_MSG_PRINT_INFO("Setting kernel ARG %i to SVM %p using cl_mem: %p\n", arg_index, arg_value, mem);
-
-  return POname(clSetKernelArg)(kernel, arg_index, sizeof(cl_mem), &mem);
+  POCL_RETURN_ERROR_ON((arg_index >= kernel->num_args), CL_INVALID_ARG_INDEX,
+    "This kernel has %u args, cannot set arg %u\n",
+    (unsigned)kernel->num_args, (unsigned)arg_index);
+
+  pi = &(kernel->arg_info[arg_index]);
+
+  POCL_RETURN_ERROR_ON((pi->type != POCL_ARG_TYPE_POINTER || pi->is_local),
+    CL_INVALID_ARG_VALUE, "Arg %u is not a global or constant pointer\n",
+    arg_index);
+
+  /* The SVM pointer is passed to the kernel as is, there is no cl_mem
+     behind it. The devices resolve the argument as a raw pointer. */
+  value = pocl_aligned_malloc (sizeof (void *), sizeof (void *));
+  if (value == NULL)
+    return CL_OUT_OF_HOST_MEMORY;
+  memcpy (value, &arg_value, sizeof (void *));
+
+  POCL_MSG_PRINT_INFO("Setting kernel ARG %i to SVM %p\n", arg_index,
+                      arg_value);
+
+  p = &(kernel->dyn_arguments[arg_index]);
+  POCL_LOCK_OBJ (kernel);
+  pocl_aligned_free (p->value);
+  p->value = value;
+  p->size = sizeof (void *);
+  p->is_svm = 1;
+  pi->is_set = 1;
+  POCL_UNLOCK_OBJ (kernel);
 
+  return CL_SUCCESS;
 }
 POsym(clSetKernelArgSVMPointer)
@@ -44,9 +44,25 @@ POname(clSetKernelExecInfo)(cl_kernel  kernel ,
         }
       case CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM:
         {
+        unsigned i;
+        POCL_RETURN_ERROR_COND((param_value == NULL
+                                || param_value_size != sizeof (cl_bool)),
+                               CL_INVALID_VALUE);
         cl_bool j = *(cl_bool*)param_value;
         POCL_MSG_PRINT_INFO("clSetKernelExecInfo called with CL_KERNEL_EXEC_INFO_SVM_FINE_GRAIN_SYSTEM: %i", j);
+        /* The system SVM pointers are always usable on the devices that
+           support them, there's nothing to set up. */
+        if (j == CL_TRUE)
+          for (i = 0; i < kernel->context->num_devices; i++)
+            POCL_RETURN_ERROR_ON(
+              (DEVICE_SVM_SYSTEM(kernel->context->devices[i]) == 0),
+              CL_INVALID_OPERATION, "One of the devices in the context "
+              "doesn't support fine-grained system SVM\n");
+        break;
         }
+      default:
+        POCL_RETURN_ERROR_ON(1, CL_INVALID_VALUE,
+                             "Unknown param_name %u\n", param_name);
     }
 
   return CL_SUCCESS;
@@ -61,6 +61,8 @@ struct data {
   /* List of commands not yet ready to be executed */
   _cl_command_node * volatile command_list;
   pocl_lock_t cq_lock;      /* Lock for command list related operations */
+  /* Context data of the work-item loops of the executed kernels */
+  pocl_context_arena context_arena;
 };
 
 static const cl_image_format supported_image_formats[] = {
@@ -243,9 +245,11 @@ pocl_basic_init_device_infos(unsigned j, struct _cl_device_id* dev)
   dev->global_as_id = dev->local_as_id = dev->constant_as_id = 0;
 
   dev->should_allocate_svm = 0;
-  /* OpenCL 2.0 properties */
+  /* OpenCL 2.0 properties. The kernels run in the host address space,
+     thus any host pointer can be passed to them as is. */
   dev->svm_caps = CL_DEVICE_SVM_COARSE_GRAIN_BUFFER
                   | CL_DEVICE_SVM_FINE_GRAIN_BUFFER
+                  | CL_DEVICE_SVM_FINE_GRAIN_SYSTEM
                   | CL_DEVICE_SVM_ATOMICS;
   /* TODO these are minimums, figure out whats a reasonable value */
   dev->max_events = 1024;
@@ -384,6 +388,21 @@ pocl_basic_alloc_mem_obj (cl_device_id device, cl_mem mem_obj, void* host_ptr)
       assert(host_ptr != NULL);
       b = host_ptr;
     }
+  else if ((flags & CL_MEM_COPY_HOST_PTR) && (flags & CL_MEM_READ_ONLY)
+           && ((uintptr_t)host_ptr % (device->mem_base_addr_align / 8)) == 0
+           && pocl_get_bool_option ("POCL_ZERO_COPY_READ_ONLY", 0))
+    {
+      /* The application has promised that the host memory stays valid and
+         unmodified, and that the buffer is not written to, while the
+         buffer exists: use the host memory in place of a copy. No device
+         owns the memory, so it is not freed with the buffer. */
+      POCL_MSG_PRINT_MEMORY ("BASIC: alloc_mem_obj %p dev %d, using the "
+                             "read-only host memory %p without a copy\n",
+                             mem_obj, device->dev_id, host_ptr);
+      b = host_ptr;
+      flags &= ~CL_MEM_COPY_HOST_PTR;
+      mem_obj->zero_copy_read_only = 1;
+    }
   else
     {
       b = pocl_memalign_alloc_global_mem (device, MAX_EXTENDED_ALIGNMENT,
@@ -463,9 +482,7 @@ pocl_basic_run
  _cl_command_node* cmd)
 {
   struct data *d;
-  struct pocl_argument *al;
   size_t x, y, z;
-  unsigned i;
   cl_kernel kernel = cmd->command.run.kernel;
   struct pocl_context *pc = &cmd->command.run.pc;
 
@@ -474,72 +491,21 @@ pocl_basic_run
 
   d->current_kernel = kernel;
 
-  void **arguments = (void**)malloc(
-      sizeof(void*) * (kernel->num_args + kernel->num_locals)
-    );
-
-  /* Process the kernel arguments. Convert the opaque buffer
-     pointers to real device pointers, allocate dynamic local 
-     memory buffers, etc. */
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      al = &(cmd->command.run.arguments[i]);
-      if (kernel->arg_info[i].is_local)
-        {
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = pocl_memalign_alloc(MAX_EXTENDED_ALIGNMENT, al->size);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER)
-        {
-          /* It's legal to pass a NULL pointer to clSetKernelArguments. In 
-             that case we must pass the same NULL forward to the kernel.
-             Otherwise, the user must have created a buffer with per device
-             pointers stored in the cl_mem. */
-          if (al->value == NULL)
-            {
-              arguments[i] = malloc (sizeof (void *));
-              *(void **)arguments[i] = NULL;
-            }
-          else
-            arguments[i] = &((*(cl_mem *) (al->value))->device_ptrs[cmd->device->dev_id].mem_ptr);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
-        {
-          dev_image_t di;
-          fill_dev_image_t (&di, al, cmd->device);
-
-          void* devptr = pocl_memalign_alloc(MAX_EXTENDED_ALIGNMENT,  sizeof(dev_image_t));
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = devptr; 
-          pocl_basic_write (data, &di, devptr, 0, sizeof(dev_image_t));
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
-        {
-          dev_sampler_t ds;
-          fill_dev_sampler_t(&ds, al);
-          
-          void* devptr = pocl_memalign_alloc(MAX_EXTENDED_ALIGNMENT, sizeof(dev_sampler_t));
-          arguments[i] = malloc (sizeof (void *));
-          *(void **)(arguments[i]) = devptr;
-          pocl_basic_write (data, &ds, devptr, 0, sizeof(dev_sampler_t));
-        }
-      else
-        {
-          arguments[i] = al->value;
-        }
-    }
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
-    {
-      al = &(cmd->command.run.arguments[i]);
-      arguments[i] = malloc (sizeof (void *));
-      *(void **)(arguments[i]) = pocl_memalign_alloc(MAX_EXTENDED_ALIGNMENT, al->size);
-    }
+  /* Convert the opaque buffer pointers to real device pointers, allocate
+     dynamic local memory buffers, etc. */
+  void *arg_blob = pocl_launcher_arg_blob (cmd);
+  void *arguments = pocl_local_arg_blob (cmd, arg_blob);
 
   pc->local_size[0] = cmd->command.run.local_x;
   pc->local_size[1] = cmd->command.run.local_y;
   pc->local_size[2] = cmd->command.run.local_z;
+
+  pc->context_arena =
+    pocl_reserve_context_arena (&d->context_arena,
+                                cmd->command.run.context_arena_size);
+  if (pc->context_arena == NULL && cmd->command.run.context_arena_size > 0)
+    POCL_ABORT ("basic: could not allocate a %zu byte context arena\n",
+                cmd->command.run.context_arena_size);
   
   for (z = 0; z < pc->num_groups[2]; ++z)
     {
@@ -556,32 +522,8 @@ pocl_basic_run
             }
         }
     }
-  for (i = 0; i < kernel->num_args; ++i)
-    {
-      if (kernel->arg_info[i].is_local)
-        {
-          POCL_MEM_FREE(*(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE ||
-                kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
-        {
-          POCL_MEM_FREE(*(void **)(arguments[i]));
-          POCL_MEM_FREE(arguments[i]);
-        }
-      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER && *(void**)arguments[i] == NULL)
-        {
-          POCL_MEM_FREE(arguments[i]);
-        }
-    }
-  for (i = kernel->num_args;
-       i < kernel->num_args + kernel->num_locals;
-       ++i)
-    {
-      POCL_MEM_FREE(*(void **)(arguments[i]));
-      POCL_MEM_FREE(arguments[i]);
-    }
-  free(arguments);
+  pocl_free_local_arg_blob (arguments, arg_blob);
+  POCL_MEM_FREE (arg_blob);
 }
 
 void
@@ -823,6 +765,7 @@ void
 pocl_basic_uninit (cl_device_id device)
 {
   struct data *d = (struct data*)device->data;
+  pocl_free_context_arena (&d->context_arena);
   POCL_MEM_FREE(d);
   device->data = NULL;
 }
@@ -43,10 +43,13 @@
  * lead to large physical chunks allocated for each kernel's buffers
  * which are also deallocated back to large region chunks.
  *
- * 2) The total number of allocations is not large.
+ * 2) The number of allocations can be large.
  *
- * Traversing through the list of chunk infos when searching for an
- * available freed chunk can be considered to be not very costly.
+ * The unallocated chunks are kept in segregated free lists by their size
+ * (two-level segregated fit, as in TLSF). A bitmap of the non-empty lists
+ * finds a large enough chunk with a couple of bit scans, and freeing a
+ * chunk merges it with its neighbours in the address order directly, so
+ * both take constant time regardless of the number of chunks.
  *
  * 3a) There is no lack of (global) memory.
  *
@@ -56,9 +59,9 @@
  *
  * 3b) The memory is more tight (e.g. when allocating from local memory).
  *
- * A slower but less wasteful strategy should be used. In this version
- * the list of old chunks should be traversed first and reused in case
- * a large enough unallocated one is found. This version can be used
+ * A less wasteful strategy should be used. In this version the free
+ * lists are searched first and a large enough unallocated chunk is
+ * reused, split in case it is larger than needed. This version can be used
  * also for the case where there's a single region (basically heap) that
  * grows towards the stack or the global data area of the memory.
  *
@@ -75,6 +78,7 @@
 
 
 #include <stdio.h>
+#include <string.h>
 
 void
 print_chunk (chunk_info_t *chunk)
@@ -94,17 +98,231 @@ print_chunks (chunk_info_t *first)
     }
 }
 
+/* Index of the highest set bit of a nonzero X. */
+static unsigned
+ba_fls (size_t x)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll ((unsigned long long)x);
+#else
+  unsigned i = 0;
+  while (x >>= 1)
+    ++i;
+  return i;
+#endif
+}
+
+/* Index of the lowest set bit of a nonzero X. */
+static unsigned
+ba_ffs (size_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll ((unsigned long long)x);
+#else
+  unsigned i = 0;
+  while (!(x & 1))
+    {
+      x >>= 1;
+      ++i;
+    }
+  return i;
+#endif
+}
+
+/* The free list of the chunks of SIZE bytes. */
+static void
+mapping_insert (size_t size, unsigned *fl, unsigned *sl)
+{
+  if (size < BA_SL_COUNT)
+    {
+      *fl = 0;
+      *sl = size;
+    }
+  else
+    {
+      *fl = ba_fls (size);
+      *sl = (size >> (*fl - BA_SL_LOG2)) ^ BA_SL_COUNT;
+    }
+}
+
+/* The first free list all of whose chunks have at least SIZE bytes.
+   Returns 0 if there is none. */
 static int
-chunk_slack (chunk_info_t* chunk, size_t size, size_t* last_chunk_size)
+mapping_search (size_t size, unsigned *fl, unsigned *sl)
+{
+  if (size >= BA_SL_COUNT)
+    {
+      size_t round = ((size_t)1 << (ba_fls (size) - BA_SL_LOG2)) - 1;
+      if (size + round < size)
+        return 0;
+      size += round;
+    }
+  mapping_insert (size, fl, sl);
+  return 1;
+}
+
+static void
+insert_free_chunk (memory_region_t *region, chunk_info_t *chunk)
+{
+  unsigned fl, sl;
+  mapping_insert (chunk->size, &fl, &sl);
+  chunk->prev_free = NULL;
+  chunk->next_free = region->free_lists[fl][sl];
+  if (chunk->next_free != NULL)
+    chunk->next_free->prev_free = chunk;
+  region->free_lists[fl][sl] = chunk;
+  region->fl_bitmap |= (size_t)1 << fl;
+  region->sl_bitmap[fl] |= 1u << sl;
+  ++region->stats.free_chunks;
+}
+
+static void
+remove_free_chunk (memory_region_t *region, chunk_info_t *chunk)
+{
+  unsigned fl, sl;
+  mapping_insert (chunk->size, &fl, &sl);
+  if (chunk->next_free != NULL)
+    chunk->next_free->prev_free = chunk->prev_free;
+  if (chunk->prev_free != NULL)
+    chunk->prev_free->next_free = chunk->next_free;
+  else
+    {
+      region->free_lists[fl][sl] = chunk->next_free;
+      if (region->free_lists[fl][sl] == NULL)
+        {
+          region->sl_bitmap[fl] &= ~(1u << sl);
+          if (region->sl_bitmap[fl] == 0)
+            region->fl_bitmap &= ~((size_t)1 << fl);
+        }
+    }
+  --region->stats.free_chunks;
+}
+
+/* Finds a free chunk of at least SIZE bytes from the free lists. */
+static chunk_info_t *
+find_free_chunk (memory_region_t *region, size_t size)
+{
+  unsigned fl, sl;
+  unsigned sl_map;
+  size_t fl_map;
+  chunk_info_t *chunk;
+
+  if (mapping_search (size, &fl, &sl) && fl < BA_FL_COUNT)
+    {
+      sl_map = region->sl_bitmap[fl] & (~0u << sl);
+      if (sl_map == 0 && fl + 1 < BA_FL_COUNT)
+        {
+          fl_map = region->fl_bitmap & (~(size_t)0 << (fl + 1));
+          if (fl_map != 0)
+            {
+              fl = ba_ffs (fl_map);
+              sl_map = region->sl_bitmap[fl];
+            }
+        }
+      if (sl_map != 0)
+        return region->free_lists[fl][ba_ffs (sl_map)];
+    }
+
+  /* The search above skips the list of SIZE itself, as not all of its
+     chunks are large enough. Its first chunk may be, e.g. the freed chunk
+     of an earlier buffer of the same size. */
+  mapping_insert (size, &fl, &sl);
+  chunk = region->free_lists[fl][sl];
+  if (chunk != NULL && chunk->size >= size)
+    return chunk;
+  return NULL;
+}
+
+/* Returns an unused chunk info of the region, or NULL if there is none
+   and no more can be allocated. */
+static chunk_info_t *
+new_chunk_info (memory_region_t *region)
+{
+  chunk_info_t *chunk = region->free_chunks;
+#ifndef BUFALLOC_STATIC_CHUNKS
+  if (chunk == NULL)
+    {
+      unsigned i;
+      chunk_info_block_t *block
+        = (chunk_info_block_t *)calloc (1, sizeof (chunk_info_block_t));
+      if (block == NULL)
+        return NULL;
+      block->next = region->chunk_blocks;
+      region->chunk_blocks = block;
+      for (i = 0; i < BA_CHUNKS_PER_BLOCK; ++i)
+        {
+          block->chunks[i].next = region->free_chunks;
+          region->free_chunks = &block->chunks[i];
+        }
+      region->stats.chunk_infos += BA_CHUNKS_PER_BLOCK;
+      chunk = region->free_chunks;
+    }
+#endif
+  if (chunk == NULL)
+    return NULL;
+  region->free_chunks = chunk->next;
+  chunk->parent_region = region;
+  chunk->children = NULL;
+  chunk->parent = NULL;
+  return chunk;
+}
+
+static void
+release_chunk_info (memory_region_t *region, chunk_info_t *chunk)
+{
+  chunk->next = region->free_chunks;
+  region->free_chunks = chunk;
+}
+
+/* Inserts NEW_CHUNK to the chunk list of the region before CHUNK. */
+static void
+insert_chunk_before (memory_region_t *region, chunk_info_t *chunk,
+                     chunk_info_t *new_chunk)
+{
+  if (chunk == region->chunks)
+    {
+      DL_PREPEND (region->chunks, new_chunk);
+      return;
+    }
+  new_chunk->prev = chunk->prev;
+  new_chunk->next = chunk;
+  chunk->prev->next = new_chunk;
+  chunk->prev = new_chunk;
+}
+
+/* Inserts NEW_CHUNK to the chunk list of the region after CHUNK. */
+static void
+insert_chunk_after (memory_region_t *region, chunk_info_t *chunk,
+                    chunk_info_t *new_chunk)
+{
+  new_chunk->prev = chunk;
+  new_chunk->next = chunk->next;
+  if (chunk->next != NULL)
+    chunk->next->prev = new_chunk;
+  else
+    region->chunks->prev = new_chunk;
+  chunk->next = new_chunk;
+}
+
+static size_t
+align_size (memory_region_t *region, size_t size)
+{
+  size_t aligned = (size + region->alignment - 1)
+                   & ~((size_t)region->alignment - 1);
+  if (aligned == 0)
+    aligned = region->alignment;
+  return aligned;
+}
+
+static void
+account_allocation (memory_region_t *region, chunk_info_t *chunk)
 {
-  memory_address_t aligned_start_addr =
-    (chunk->start_address + chunk->parent_region->alignment - 1) &
-    ~(chunk->parent_region->alignment - 1);
-  size_t end_chunk = chunk->start_address + chunk->size;
-  size_t end_addr = aligned_start_addr + size;
-  if(last_chunk_size)
-    *last_chunk_size = end_chunk - end_addr;
-  return end_chunk > end_addr;
+  region->stats.allocated_bytes += chunk->size;
+  region->stats.free_bytes -= chunk->size;
+  if (region->stats.allocated_bytes > region->stats.peak_allocated_bytes)
+    region->stats.peak_allocated_bytes = region->stats.allocated_bytes;
+  ++region->stats.allocated_chunks;
+  ++region->stats.allocations;
 }
 
 /**
@@ -113,68 +331,81 @@ chunk_slack (chunk_info_t* chunk, size_t size, size_t* last_chunk_size)
  * Assumes the last_chunk is always the last chunk in the region and
  * it is unallocated in case there is free space at the end.
  *
- * @return The address of the chunk if it fits, 0 otherwise.
+ * Must be called inside a locked region.
+ *
+ * @return The chunk if it fits, NULL otherwise.
  */
 static chunk_info_t *
 append_new_chunk (memory_region_t *region,
                   size_t size)
 {
-
-  chunk_info_t* new_chunk = NULL;
-  BA_LOCK (region->lock);
+  chunk_info_t *new_chunk = NULL;
+  chunk_info_t *last = region->last_chunk;
 
 #ifdef ENABLE_ASSERTS
-  assert (!region->last_chunk->is_allocated);
+  assert (!last->is_allocated);
 #endif
   /* if the last_chunk is too small we cannot append
      a new chunk before it */
-  if (!chunk_slack (region->last_chunk, size, NULL))
-    {
-      BA_UNLOCK (region->lock);
-      return NULL;
-    }
-
-  /* ok, there should be space at the end, create a new chunk
-     before the last_chunk */
-  new_chunk = region->free_chunks;
+  if (last->size < size)
+    return NULL;
 
+  new_chunk = new_chunk_info (region);
   if (new_chunk == NULL)
-    {
-      BA_UNLOCK (region->lock);
-      return NULL;
-    }
-  else
-    {
-      DL_DELETE (region->free_chunks, new_chunk);
-    }
+    return NULL;
 
-  /* Round the start address up towards the closest aligned
-     address. */
-  new_chunk->start_address =
-    (region->last_chunk->start_address + region->alignment - 1) &
-    ~(region->alignment - 1);
-  new_chunk->parent_region = region;
+  new_chunk->start_address = last->start_address;
   new_chunk->size = size;
   new_chunk->is_allocated = 1;
-  new_chunk->children = NULL;
+  last->start_address += size;
+  last->size -= size;
+  insert_chunk_before (region, last, new_chunk);
+
+#ifdef DEBUG_BUFALLOC
+  printf ("#### after append_new_chunk (%p, %zu)\n", region, size);
+  print_chunks (region->chunks);
+  printf ("\n");
+#endif
 
-  chunk_slack (region->last_chunk, size, (size_t*)&region->last_chunk->size);
-  region->last_chunk->start_address =
-    new_chunk->start_address + new_chunk->size;
+  return new_chunk;
+}
+
+/**
+ * Allocates a chunk from the free lists of the given region.
+ *
+ * The part of the found chunk not needed is split to a new free chunk.
+ * Must be called inside a locked region.
+ */
+static chunk_info_t *
+reuse_free_chunk (memory_region_t *region, size_t size)
+{
+  chunk_info_t *chunk = find_free_chunk (region, size);
+  chunk_info_t *rest;
 
-  DL_DELETE (region->chunks, region->last_chunk);
-  DL_APPEND (region->chunks, new_chunk);
-  DL_APPEND (region->chunks, region->last_chunk);
+  if (chunk == NULL)
+    return NULL;
+
+  remove_free_chunk (region, chunk);
+  chunk->is_allocated = 1;
+
+  /* Without a chunk info for the rest, give the whole chunk. */
+  if (chunk->size > size && (rest = new_chunk_info (region)) != NULL)
+    {
+      rest->start_address = chunk->start_address + size;
+      rest->size = chunk->size - size;
+      rest->is_allocated = 0;
+      chunk->size = size;
+      insert_chunk_after (region, chunk, rest);
+      insert_free_chunk (region, rest);
+    }
 
 #ifdef DEBUG_BUFALLOC
-  printf ("#### after append_new_chunk (%x, %u)\n", region, size);
+  printf ("#### after reusing a chunk in region %p\n", region);
   print_chunks (region->chunks);
   printf ("\n");
 #endif
 
-  BA_UNLOCK (region->lock);
-
-  return new_chunk;
+  return chunk;
 }
 
 /**
@@ -188,44 +419,33 @@ alloc_buffer_from_region (memory_region_t *region, size_t size)
 #ifdef ENABLE_ASSERTS
   assert (region != NULL);
 #endif
+  chunk_info_t* chunk = NULL;
+
+  size = align_size (region, size);
+
+  BA_LOCK (region->lock);
+
   /* The memory-wasteful but fast strategy:
 
      Assume there's plenty of memory so just try to append the
      buffer to the end of the region without trying to reuse
      unallocated ones first. */
-  chunk_info_t* chunk = NULL, *cursor;
   if (region->strategy == BALLOCS_WASTEFUL)
-    {
-      chunk = append_new_chunk(region, size);
-      if (chunk != NULL) return chunk;
-    }
+    chunk = append_new_chunk (region, size);
 
-  BA_LOCK (region->lock);
+  if (chunk == NULL)
+    chunk = reuse_free_chunk (region, size);
 
-  DL_FOREACH (region->chunks, cursor)
-    {
-      if (cursor == region->last_chunk ||
-          cursor->is_allocated ||
-          !chunk_slack (cursor, size, NULL))
-        continue; /* doesn't fit */
-      /* found one */
-      chunk = cursor;
-      chunk->is_allocated = 1;
+  if (chunk == NULL && region->strategy != BALLOCS_WASTEFUL)
+    chunk = append_new_chunk (region, size);
 
-#ifdef DEBUG_BUFALLOC
-      printf ("#### after reusing a chunk in region %x\n", region);
-      print_chunks (region->chunks);
-      printf ("\n");
-#endif
-      break;
-    }
+  if (chunk != NULL)
+    account_allocation (region, chunk);
+  else
+    ++region->stats.failed_allocations;
 
   BA_UNLOCK (region->lock);
 
-  if (chunk == NULL && region->strategy != BALLOCS_WASTEFUL)
-    {
-      return append_new_chunk (region, size);
-    }
   return chunk;
 }
 
@@ -277,29 +497,14 @@ create_sub_chunk (chunk_info_t *parent, size_t offset, size_t size)
 #endif
 
 /**
- * Merges two unallocated chunks together to a larger chunk, if both
- * are unallocated.
+ * Merges the unallocated chunk SECOND to the chunk FIRST preceding it.
  *
- * The first chunk must before the second chunk in the memory region.
  * Must be called inside a locked region.
- *
- * @return A pointer to the coalesced chunk, or the second chunk in case
- * coalsecing could not be done.
  */
-
-#ifndef BUFALLOC_NO_CHUNK_COALESCING
-static chunk_info_t * 
-coalesce_chunks (chunk_info_t* first, 
-                 chunk_info_t* second)
+static void
+merge_chunks (memory_region_t *region, chunk_info_t *first,
+              chunk_info_t *second)
 {
-  if (first == NULL) return second;
-  if (second == NULL) return first;
-  if (first->is_allocated || second->is_allocated) return second;
-
-  /* The linked list head has a prev pointing to the last (sentinel),
-     detect that here and do not merge first with the second. */
-  if (first->start_address > second->start_address) return second;
-
 #ifdef DEBUG_BUFALLOC
   printf ("### coalescing chunks:\n");
   print_chunk (first);
@@ -307,28 +512,68 @@ coalesce_chunks (chunk_info_t* first,
   puts ("\n");
 #endif
 
-  /* Should not just add the size of the second chunk as we might have
-     done alignment adjustment to the start address */
-  first->size = second->start_address + second->size - first->start_address;
-  DL_DELETE (first->parent_region->chunks, second);
-  DL_APPEND (first->parent_region->free_chunks, second);
+  first->size += second->size;
+  DL_DELETE (region->chunks, second);
 
   /* Did we coalesce away the sentinel chunk? Need to set it to
      a new valid one. */
-  if (second->parent_region->last_chunk == second)
-      second->parent_region->last_chunk = first;
+  if (region->last_chunk == second)
+    region->last_chunk = first;
 
-  return first;
+  release_chunk_info (region, second);
 }
+
+/**
+ * Frees the given chunk of the region.
+ *
+ * The chunk is merged with the unallocated chunks next to it, and the
+ * result is added to the free lists unless it ended up as the last chunk.
+ * Must be called inside a locked region.
+ */
+static void
+free_chunk_in_region (memory_region_t *region, chunk_info_t *chunk)
+{
+  chunk_info_t *prev = (chunk == region->chunks) ? NULL : chunk->prev;
+  chunk_info_t *next = chunk->next;
+
+  chunk->is_allocated = 0;
+  region->stats.allocated_bytes -= chunk->size;
+  region->stats.free_bytes += chunk->size;
+  --region->stats.allocated_chunks;
+  ++region->stats.frees;
+
+#ifndef BUFALLOC_NO_CHUNK_COALESCING
+  if (next != NULL && !next->is_allocated)
+    {
+      if (next != region->last_chunk)
+        remove_free_chunk (region, next);
+      merge_chunks (region, chunk, next);
+    }
+  if (prev != NULL && !prev->is_allocated)
+    {
+      remove_free_chunk (region, prev);
+      merge_chunks (region, prev, chunk);
+      chunk = prev;
+    }
 #endif
 
+  if (chunk != region->last_chunk)
+    insert_free_chunk (region, chunk);
+}
+
+/**
+ * Frees the chunk at the given address from one of the regions.
+ *
+ * Finding the chunk by its address walks through the chunks of the
+ * regions, free_chunk() should be preferred.
+ */
 memory_region_t *
 free_buffer (memory_region_t *regions, memory_address_t addr)
 {
   memory_region_t *region = NULL;
 
 #ifdef DEBUG_BUFALLOC
-  printf ("#### free_buffer(%p, %x)\n", regions, addr);
+  printf ("#### free_buffer(%p, %zx)\n", regions, addr);
 #endif
 
   LL_FOREACH (regions, region)
@@ -337,15 +582,12 @@ free_buffer (memory_region_t *regions, memory_address_t addr)
       BA_LOCK (region->lock);
       DL_FOREACH (region->chunks, chunk)
         {
-          if (chunk->start_address == addr)
+          if (chunk->start_address == addr && chunk->is_allocated)
             {
-              chunk->is_allocated = 0;
-#ifndef BUFALLOC_NO_CHUNK_COALESCING
-              coalesce_chunks (coalesce_chunks (chunk->prev, chunk), chunk->next);
-#endif
+              free_chunk_in_region (region, chunk);
               BA_UNLOCK (region->lock);
 #ifdef DEBUG_BUFALLOC
-              printf ("#### region %x after free_buffer at addr %x\n",
+              printf ("#### region %p after free_buffer at addr %zx\n",
                       region, addr);
               print_chunks (region->chunks);
               printf ("\n");
@@ -369,14 +611,11 @@ free_chunk (chunk_info_t* chunk)
 {
   memory_region_t *region = chunk->parent_region;
   BA_LOCK (region->lock);
-  chunk->is_allocated = 0;
-#ifndef BUFALLOC_NO_CHUNK_COALESCING
-  coalesce_chunks (coalesce_chunks (chunk->prev, chunk), chunk->next);
-#endif
+  free_chunk_in_region (region, chunk);
   BA_UNLOCK (region->lock);
 
 #ifdef DEBUG_BUFALLOC
-  printf ("#### after free_chunk (%x)\n", chunk);
+  printf ("#### after free_chunk (%p)\n", chunk);
   print_chunks (region->chunks);
   printf ("\n");
 #endif
@@ -391,7 +630,7 @@ free_chunk (chunk_info_t* chunk)
 void
 init_mem_region (memory_region_t *region, memory_address_t start, size_t size)
 {
-  int i;
+  memory_address_t aligned_start;
   BA_INIT_LOCK (region->lock);
 
   region->strategy = BALLOCS_WASTEFUL;
@@ -400,21 +639,81 @@ init_mem_region (memory_region_t *region, memory_address_t start, size_t size)
   region->alignment = 64;
   region->next = NULL;
   region->prev = NULL;
-  /* Create the "sentinel chunk" */
-  region->last_chunk = &region->all_chunks[0];
-  region->last_chunk->start_address = start;
+  memset ((void *)region->free_lists, 0, sizeof (region->free_lists));
+  memset ((void *)region->sl_bitmap, 0, sizeof (region->sl_bitmap));
+  region->fl_bitmap = 0;
+  memset ((void *)&region->stats, 0, sizeof (region->stats));
+
+  /* Setup the linked list of free chunk data structures */
+#ifdef BUFALLOC_STATIC_CHUNKS
+  int i;
+  for (i = MAX_CHUNKS_IN_REGION - 1; i >= 0; --i)
+    release_chunk_info (region, &region->all_chunks[i]);
+  region->stats.chunk_infos = MAX_CHUNKS_IN_REGION;
+#else
+  region->chunk_blocks = NULL;
+#endif
+
+  /* Create the "sentinel chunk". All the chunks are multiples of the
+     alignment, so they stay aligned if the first one is. */
+  aligned_start = (start + region->alignment - 1) & ~(region->alignment - 1);
+  size = (size > aligned_start - start) ? size - (aligned_start - start) : 0;
+  size &= ~((size_t)region->alignment - 1);
+
+  region->last_chunk = new_chunk_info (region);
+  region->last_chunk->start_address = aligned_start;
   region->last_chunk->size = size;
   region->last_chunk->is_allocated = 0;
-  region->last_chunk->parent_region = region;
+  region->stats.free_bytes = size;
 
   DL_APPEND(region->chunks, region->last_chunk);
 
-  /* Setup the linked list of free chunk data structures */
-  for (i = 1; i < MAX_CHUNKS_IN_REGION; ++i)
-    DL_APPEND (region->free_chunks, &region->all_chunks[i]);
-
 #ifdef DEBUG_BUFALLOC
-  printf ("#### memory region %x created. start: %x size: %u\n",
+  printf ("#### memory region %p created. start: %zx size: %zu\n",
           region, start, size);
 #endif
 }
+
+void
+uninit_mem_region (memory_region_t *region)
+{
+#ifndef BUFALLOC_STATIC_CHUNKS
+  chunk_info_block_t *block, *next;
+  for (block = region->chunk_blocks; block != NULL; block = next)
+    {
+      next = block->next;
+      free (block);
+    }
+  region->chunk_blocks = NULL;
+#endif
+  region->chunks = NULL;
+  region->free_chunks = NULL;
+  region->last_chunk = NULL;
+}
+
+void
+get_mem_region_stats (memory_region_t *region, struct mem_region_stats *stats)
+{
+  BA_LOCK (region->lock);
+  *stats = region->stats;
+  BA_UNLOCK (region->lock);
+}
+
+void
+print_mem_region_stats (memory_region_t *region)
+{
+  struct mem_region_stats stats;
+  size_t last_size;
+  BA_LOCK (region->lock);
+  stats = region->stats;
+  last_size = region->last_chunk->size;
+  BA_UNLOCK (region->lock);
+  printf ("### region %p: allocated %zu bytes in %u chunks (peak %zu), "
+          "free %zu bytes in %u chunks + %zu at the end, "
+          "%lu allocations, %lu failed, %lu frees, %u chunk infos\n",
+          region, stats.allocated_bytes, stats.allocated_chunks,
+          stats.peak_allocated_bytes,
+          stats.free_bytes - last_size, stats.free_chunks, last_size,
+          stats.allocations,
+          stats.failed_allocations, stats.frees, stats.chunk_infos);
+}
@@ -76,13 +76,24 @@ typedef tce_sm_lock ba_lock_t;
 
 #endif
 
-/* The number of chunks in a region should be scaled to an approximate
-   maximum number of kernel buffer arguments. Running out of chunk
-   data structures might leave region space unused due to that only. */
+/* In the TCE standalone mode there is no malloc: the chunk infos of a
+   region come from a fixed array of this many entries. Running out of
+   them leaves region space unused due to that only. On the host the chunk
+   infos are allocated as needed. */
+#ifdef __TCE_STANDALONE__
+#define BUFALLOC_STATIC_CHUNKS
+#endif
+
 #ifndef MAX_CHUNKS_IN_REGION
 #define MAX_CHUNKS_IN_REGION 1024
 #endif
 
+/* The free chunks are kept in segregated lists by their size: a first
+   level list per power of two, split to 2^BA_SL_LOG2 second level lists. */
+#define BA_SL_LOG2 3
+#define BA_SL_COUNT (1 << BA_SL_LOG2)
+#define BA_FL_COUNT (sizeof (size_t) * 8)
+
 /* address-space agnostic memory address */
 typedef size_t memory_address_t;
 
@@ -113,36 +124,76 @@ struct chunk_info
   memory_address_t start_address;
   int is_allocated;
   size_t size; /* size in bytes */
+  /* the chunks of the region in the address order */
   chunk_info_t* next;
   chunk_info_t* prev;
+  /* the segregated free list of an unallocated chunk */
+  chunk_info_t* next_free;
+  chunk_info_t* prev_free;
   chunk_info_t* children;
   chunk_info_t* parent;
   memory_region_t* parent_region;
 };
 
+#ifndef BUFALLOC_STATIC_CHUNKS
+/* A block of chunk infos allocated at once. */
+typedef struct chunk_info_block chunk_info_block_t;
+#define BA_CHUNKS_PER_BLOCK 64
+struct chunk_info_block
+{
+  struct chunk_info chunks[BA_CHUNKS_PER_BLOCK];
+  chunk_info_block_t *next;
+};
+#endif
+
+/* Allocation statistics of a memory region. */
+struct mem_region_stats
+{
+  size_t allocated_bytes;
+  size_t peak_allocated_bytes;
+  size_t free_bytes;
+  unsigned allocated_chunks;
+  unsigned free_chunks;
+  /* chunk infos in use or ready for use */
+  unsigned chunk_infos;
+  unsigned long allocations;
+  unsigned long failed_allocations;
+  unsigned long frees;
+};
+
 /* Represents a single continuous region of memory from which smaller
    "chunks" are allocated. Note: this doesn't include the memory space
-   itself. */
+   itself.
+
+   The unallocated chunks, apart from the last chunk, are in segregated
+   free lists indexed with bitmaps, which makes both allocating and
+   freeing a chunk constant time. Adjacent unallocated chunks are always
+   merged. */
 struct memory_region
 {
+#ifdef BUFALLOC_STATIC_CHUNKS
   chunk_info_t all_chunks[MAX_CHUNKS_IN_REGION];
+#else
+  chunk_info_block_t *chunk_blocks;
+#endif
   chunk_info_t *chunks;
   chunk_info_t *free_chunks; /* A pointer to a head of a linked list of
-                                chunk_info records that can be used for
-                                new allocations. This enables allocating
-                                the chunk infos statically at compile time,
-                                or dynamically. In the dynamic case, the
-                                client of the bufalloc should first ensure
-                                there is at least one free chunk info before
-                                trying the allocation. If not, create one. */
-  chunk_info_t *last_chunk; /* The last chunk in the region (a "sentinel"). In case
-                               the last chunk is allocated, the region
-                               is completely full. New chunks should be inserted
-                               before this chunk. */
+                                unused chunk_info records that can be used
+                                for new chunks. */
+  chunk_info_t *last_chunk; /* The last chunk in the region (a "sentinel").
+                               It is always unallocated, possibly empty, and
+                               not in the free lists. New chunks are
+                               appended before this chunk. */
+  chunk_info_t *free_lists[BA_FL_COUNT][BA_SL_COUNT];
+  size_t fl_bitmap;
+  unsigned sl_bitmap[BA_FL_COUNT];
+  struct mem_region_stats stats;
   memory_region_t *next;
   memory_region_t *prev;
   enum allocation_strategy strategy;
-  unsigned short alignment; /* alignment of the returned chunks in a 2's exponent byte count */
+  unsigned short alignment; /* alignment of the returned chunks in a 2's
+                               exponent byte count, can be changed only
+                               before the first allocation */
   ba_lock_t lock;
 };
 
@@ -159,6 +210,14 @@ void free_chunk(chunk_info_t* chunk);
 void init_mem_region (
     memory_region_t *region, memory_address_t start, size_t size);
 
+/* Releases the chunk infos allocated for the region. */
+void uninit_mem_region (memory_region_t *region);
+
+void get_mem_region_stats (memory_region_t *region,
+                           struct mem_region_stats *stats);
+
+void print_mem_region_stats (memory_region_t *region);
+
 chunk_info_t *create_sub_chunk (chunk_info_t *parent, size_t offset, size_t size);
 
 void
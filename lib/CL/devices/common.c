@@ -30,10 +30,12 @@
 #include <unistd.h>
 #include <utlist.h>
 #include <assert.h>
+#include <inttypes.h>
 
 #ifndef _MSC_VER
 #  include <sys/time.h>
 #  include <sys/resource.h>
+#  include <sys/mman.h>
 #  include <unistd.h>
 #else
 #  include "vccompat.hpp"
@@ -42,6 +44,7 @@
 #include "config.h"
 #include "config2.h"
 #include "devices.h"
+#include "pocl_autotune.h"
 #include "pocl_cache.h"
 #include "pocl_debug.h"
 #include "pocl_file_util.h"
@@ -72,7 +75,8 @@
 #ifdef OCS_AVAILABLE
 char*
 llvm_codegen (const char* tmpdir, cl_kernel kernel, cl_device_id device,
-              size_t local_x, size_t local_y, size_t local_z)
+              size_t local_x, size_t local_y, size_t local_z,
+              const pocl_kernel_specialization *spec)
 {
 
   char bytecode[POCL_FILENAME_LENGTH];
@@ -95,7 +99,7 @@ llvm_codegen (const char* tmpdir, cl_kernel kernel, cl_device_id device,
                    "%s/%s.so.o", tmpdir, kernel->name);
   assert (error >= 0);
 
-  if (pocl_exists(module))
+  if (pocl_cache_exists(module))
     return module;
 
   memcpy (tmp_module, module, file_name_alloc_size);
@@ -104,8 +108,9 @@ llvm_codegen (const char* tmpdir, cl_kernel kernel, cl_device_id device,
   void* write_lock = pocl_cache_acquire_writer_lock(kernel->program, device);
   assert(write_lock);
 
-  error = pocl_llvm_generate_workgroup_function (device, kernel,
-                                                 local_x, local_y, local_z);
+  error = pocl_llvm_generate_specialized_workgroup_function (device, kernel,
+                                                             local_x, local_y,
+                                                             local_z, spec);
   if (error)
     {
       POCL_MSG_PRINT_GENERAL ("pocl_llvm_generate_workgroup_function() failed"
@@ -247,14 +252,20 @@ pocl_migrate_mem_objects (_cl_command_node * volatile node)
 void
 pocl_ndrange_node_cleanup(_cl_command_node *node)
 {
-  cl_uint i;
   free (node->command.run.tmp_dir);
-  for (i = 0; i < node->command.run.kernel->num_args + 
-       node->command.run.kernel->num_locals; ++i)
+  pocl_aligned_free (node->command.run.arg_blob);
+  free (node->command.run.arguments);
+
+  /* An autotuning trial whose command failed never completes. The ones
+     that succeed are counted on their completion, which can come before
+     or after the cleanup depending on the device. */
+  if (node->command.run.autotune_entry != NULL && node->event != NULL
+      && node->event->status < 0)
     {
-      pocl_aligned_free (node->command.run.arguments[i].value);
+      pocl_autotune_trial_released (node->command.run.autotune_entry,
+                                    node->command.run.autotune_trial);
+      node->command.run.autotune_entry = NULL;
     }
-  free (node->command.run.arguments);
 
   POname(clReleaseKernel)(node->command.run.kernel);
 }
@@ -701,13 +712,176 @@ pocl_memalign_alloc(size_t align_width, size_t size)
 #endif
 }
 
+#define ALIGN_ARG_STORAGE(size)                                          \
+  (((size) + MAX_EXTENDED_ALIGNMENT - 1) & ~(size_t)(MAX_EXTENDED_ALIGNMENT - 1))
+
+void *
+pocl_launcher_arg_blob (_cl_command_node *cmd)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  struct pocl_argument *args = cmd->command.run.arguments;
+  size_t storage_size = ALIGN_ARG_STORAGE (kernel->arg_blob_size);
+  size_t storage_offset;
+  char *blob;
+  unsigned i;
+
+  for (i = 0; i < kernel->num_args; ++i)
+    {
+      if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
+        storage_size += ALIGN_ARG_STORAGE (sizeof (dev_image_t));
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
+        storage_size += ALIGN_ARG_STORAGE (sizeof (dev_sampler_t));
+    }
+
+  blob = pocl_memalign_alloc (MAX_EXTENDED_ALIGNMENT,
+                              storage_size > 0 ? storage_size : 1);
+  if (blob == NULL)
+    POCL_ABORT ("could not allocate the %zu byte argument blob\n",
+                storage_size);
+  memcpy (blob, cmd->command.run.arg_blob, kernel->arg_blob_size);
+  storage_offset = ALIGN_ARG_STORAGE (kernel->arg_blob_size);
+
+  /* Convert the opaque buffer, image and sampler handles to the device
+     pointers. */
+  for (i = 0; i < kernel->num_args; ++i)
+    {
+      void **slot = (void **)(blob + kernel->arg_blob_offsets[i]);
+      struct pocl_argument *al = &args[i];
+
+      if (kernel->arg_info[i].is_local)
+        *slot = NULL;
+      else if (al->is_svm)
+        ; /* the raw pointer is in the slot already */
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_POINTER)
+        {
+          /* It's legal to pass a NULL pointer to clSetKernelArguments. In
+             that case we must pass the same NULL forward to the kernel.
+             Otherwise, the user must have created a buffer with per device
+             pointers stored in the cl_mem. */
+          cl_mem m = (al->value == NULL) ? NULL : *(cl_mem *)al->value;
+          if (m == NULL)
+            *slot = NULL;
+          else if (m->device_ptrs)
+            *slot = m->device_ptrs[cmd->device->dev_id].mem_ptr;
+          else
+            *slot = m->mem_host_ptr;
+        }
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_IMAGE)
+        {
+          dev_image_t *di = (dev_image_t *)(blob + storage_offset);
+          fill_dev_image_t (di, al, cmd->device);
+          *slot = di;
+          storage_offset += ALIGN_ARG_STORAGE (sizeof (dev_image_t));
+        }
+      else if (kernel->arg_info[i].type == POCL_ARG_TYPE_SAMPLER)
+        {
+          dev_sampler_t *ds = (dev_sampler_t *)(blob + storage_offset);
+          fill_dev_sampler_t (ds, al);
+          *slot = ds;
+          storage_offset += ALIGN_ARG_STORAGE (sizeof (dev_sampler_t));
+        }
+    }
+
+  return blob;
+}
+
+void *
+pocl_local_arg_blob (_cl_command_node *cmd, void *blob)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  struct pocl_argument *args = cmd->command.run.arguments;
+  size_t storage_size = ALIGN_ARG_STORAGE (kernel->arg_blob_size);
+  size_t storage_offset;
+  int has_locals = 0;
+  char *local_blob;
+  unsigned i;
+
+  for (i = 0; i < kernel->num_args + kernel->num_locals; ++i)
+    {
+      if (i < kernel->num_args && !kernel->arg_info[i].is_local)
+        continue;
+      storage_size += ALIGN_ARG_STORAGE (args[i].size);
+      has_locals = 1;
+    }
+  if (!has_locals)
+    return blob;
+
+  local_blob = pocl_memalign_alloc (MAX_EXTENDED_ALIGNMENT, storage_size);
+  if (local_blob == NULL)
+    POCL_ABORT ("could not allocate %zu bytes of local memory\n",
+                storage_size);
+  memcpy (local_blob, blob, kernel->arg_blob_size);
+  storage_offset = ALIGN_ARG_STORAGE (kernel->arg_blob_size);
+
+  /* The automatic local buffers are implemented as implicit extra
+     arguments at the end of the kernel argument list. */
+  for (i = 0; i < kernel->num_args + kernel->num_locals; ++i)
+    {
+      if (i < kernel->num_args && !kernel->arg_info[i].is_local)
+        continue;
+      *(void **)(local_blob + kernel->arg_blob_offsets[i])
+        = local_blob + storage_offset;
+      storage_offset += ALIGN_ARG_STORAGE (args[i].size);
+    }
+
+  return local_blob;
+}
+
+void
+pocl_free_local_arg_blob (void *local_blob, void *blob)
+{
+  if (local_blob != blob)
+    POCL_MEM_FREE (local_blob);
+}
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+void *
+pocl_reserve_context_arena (pocl_context_arena *arena, size_t size)
+{
+  size_t align = MAX_EXTENDED_ALIGNMENT;
+
+  if (size <= arena->size)
+    return arena->ptr;
+
+  POCL_MEM_FREE (arena->ptr);
+  arena->size = 0;
+
+  /* Arenas that are large enough are backed by transparent huge pages
+     to reduce the TLB misses in the work-item loops. */
+  if (size >= HUGE_PAGE_SIZE)
+    {
+      align = HUGE_PAGE_SIZE;
+      size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+    }
+
+  arena->ptr = pocl_memalign_alloc (align, size);
+  if (arena->ptr == NULL)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  if (align == HUGE_PAGE_SIZE)
+    madvise (arena->ptr, size, MADV_HUGEPAGE);
+#endif
+  arena->size = size;
+  return arena->ptr;
+}
+
+void
+pocl_free_context_arena (pocl_context_arena *arena)
+{
+  POCL_MEM_FREE (arena->ptr);
+  arena->size = 0;
+}
+
 /* CPU driver stuff */
 typedef struct pocl_dlhandle_cache_item pocl_dlhandle_cache_item;
 struct pocl_dlhandle_cache_item
 {
   char *tmp_dir;
   char *function_name;
-  pocl_workgroup wg;
+  pocl_workgroup_blob wg;
+  /* NULL if the work-group function does not use the context arena */
+  const struct pocl_context_arena_layout *arena_layout;
   lt_dlhandle dlhandle;
   pocl_dlhandle_cache_item *next;
   pocl_dlhandle_cache_item *prev;
@@ -719,6 +893,8 @@ static pocl_lock_t pocl_dlhandle_cache_lock;
 static pocl_lock_t pocl_llvm_codegen_lock;
 static pocl_lock_t pocl_dlhandle_lock;
 static int pocl_dlhandle_cache_initialized;
+static int pocl_specialize_images;
+static int pocl_specialize_max_variants;
 
 /* only to be called in basic/pthread/<other cpu driver> init */
 void
@@ -729,33 +905,212 @@ pocl_init_dlhandle_cache ()
       POCL_INIT_LOCK (pocl_dlhandle_cache_lock);
       POCL_INIT_LOCK (pocl_llvm_codegen_lock);
       POCL_INIT_LOCK (pocl_dlhandle_lock);
+      pocl_specialize_images =
+        pocl_get_bool_option ("POCL_SPECIALIZE_IMAGES", 0);
+      /* 0 disables the specialization. */
+      pocl_specialize_max_variants =
+        max (pocl_get_int_option ("POCL_SPECIALIZE_MAX_VARIANTS", 8), 0);
       pocl_dlhandle_cache_initialized = 1;
    }
 }
 
+static void
+set_context_arena_size (_cl_command_node *cmd,
+                        const struct pocl_context_arena_layout *layout)
+{
+  _cl_command_run *run = &cmd->command.run;
+  if (layout == NULL)
+    run->context_arena_size = 0;
+  else
+    run->context_arena_size =
+      run->local_x * run->local_y * run->local_z * layout->per_work_item
+      + layout->fixed;
+}
+
+/* Collects the values of the specialized scalar arguments and, with
+   POCL_SPECIALIZE_IMAGES, the image formats and sampler values of the
+   kernel launch CMD to SPEC and hashes them to the SPEC key. Returns 0 if
+   there is nothing to specialize on. */
+static int
+pocl_specialize_kernel_args (_cl_command_node *cmd,
+                             pocl_kernel_specialization *spec)
+{
+  cl_kernel kernel = cmd->command.run.kernel;
+  struct pocl_argument *args = cmd->command.run.arguments;
+  unsigned i, j;
+  uint64_t hash = 14695981039346656037ULL;
+
+  spec->num_args = 0;
+  spec->args = NULL;
+  for (i = 0; i < kernel->num_args; ++i)
+    {
+      pocl_argument_type type = kernel->arg_info[i].type;
+      if (args[i].value == NULL)
+        continue;
+      if (type == POCL_ARG_TYPE_NONE)
+        {
+          if (!kernel->arg_info[i].specialize || args[i].size > 8)
+            continue;
+        }
+      else if (type != POCL_ARG_TYPE_IMAGE && type != POCL_ARG_TYPE_SAMPLER)
+        continue;
+      else if (!pocl_specialize_images)
+        continue;
+
+      if (spec->args == NULL)
+        spec->args = (pocl_arg_specialization *)
+          calloc (kernel->num_args, sizeof (pocl_arg_specialization));
+      pocl_arg_specialization *arg = &spec->args[spec->num_args++];
+      arg->arg_index = i;
+      arg->type = type;
+      if (type == POCL_ARG_TYPE_NONE)
+        {
+          arg->size = args[i].size;
+          memcpy (arg->value, args[i].value, args[i].size);
+        }
+      else if (type == POCL_ARG_TYPE_IMAGE)
+        {
+          cl_mem mem = *(cl_mem *)args[i].value;
+          arg->value[0] = mem->image_channel_order;
+          arg->value[1] = mem->image_channel_data_type;
+          pocl_get_image_information (mem->image_channel_order,
+                                      mem->image_channel_data_type,
+                                      &arg->value[2], &arg->value[3]);
+        }
+      else
+        fill_dev_sampler_t (&arg->value[0], &args[i]);
+
+      /* FNV-1a */
+      for (j = 0; j < sizeof (pocl_arg_specialization); ++j)
+        {
+          hash ^= ((unsigned char *)arg)[j];
+          hash *= 1099511628211ULL;
+        }
+    }
+
+  if (spec->num_args == 0)
+    return 0;
+
+  snprintf (spec->key, sizeof (spec->key), "%016" PRIx64, hash);
+  return 1;
+}
+
+static pocl_dlhandle_cache_item *
+pocl_find_dlhandle (const char *tmp_dir, const char *function_name)
+{
+  pocl_dlhandle_cache_item *ci = NULL;
+  DL_FOREACH (pocl_dlhandle_cache, ci)
+    {
+      if (strcmp (ci->tmp_dir, tmp_dir) == 0 &&
+          strcmp (ci->function_name, function_name) == 0)
+        return ci;
+    }
+  return NULL;
+}
+
 static int handle_count = 0;
 void
 pocl_check_dlhandle_cache (_cl_command_node *cmd)
 {
   char workgroup_string[256];
+  char spec_dir[POCL_FILENAME_LENGTH];
   pocl_dlhandle_cache_item *ci = NULL;
+  cl_kernel k = cmd->command.run.kernel;
+  cl_program p = k->program;
+  cl_device_id dev = cmd->device;
+  int dev_i = pocl_cl_device_to_index(p, dev);
+  int online_compiled = p->binaries[dev_i] && !p->pocl_binaries[dev_i];
+  pocl_kernel_specialization spec;
+  pocl_kernel_specialization *specialization = NULL;
+
+  /* Compile the launches to work-group functions specialized on their
+     argument values, in their own kernel cache directories next to the
+     generic one. Only the actual launches have the argument values. */
+  if (online_compiled && pocl_specialize_max_variants > 0
+      && cmd->command.run.arguments != NULL
+      && pocl_specialize_kernel_args (cmd, &spec))
+    {
+      pocl_cache_specialized_kernel_cachedir_path (spec_dir, p, dev_i, k, "",
+                                                   cmd->command.run.local_x,
+                                                   cmd->command.run.local_y,
+                                                   cmd->command.run.local_z,
+                                                   spec.key);
+      specialization = &spec;
+    }
 
   POCL_LOCK (pocl_dlhandle_cache_lock);
-  DL_FOREACH (pocl_dlhandle_cache, ci)
+  /* Bound the number of variants of a kernel and local size in the kernel
+     cache by evicting the least recently used ones. The work-group
+     functions of the evicted variants that are already loaded stay valid,
+     and the ones still being compiled are not evicted. If every variant is
+     still being compiled, the launches with new values use the generic
+     work-group function. */
+  if (specialization != NULL && !pocl_exists (spec_dir)
+      && pocl_cache_evict_specialized_variants (p, dev_i, k,
+                                                cmd->command.run.local_x,
+                                                cmd->command.run.local_y,
+                                                cmd->command.run.local_z,
+                                                pocl_specialize_max_variants)
+         >= (unsigned)pocl_specialize_max_variants)
     {
-      if (strcmp (ci->tmp_dir, cmd->command.run.tmp_dir) == 0 &&
-          strcmp (ci->function_name,
-                  cmd->command.run.kernel->name) == 0)
+      POCL_MSG_PRINT_INFO ("Kernel %s has %d specialized variants, using "
+                           "the generic one\n", k->name,
+                           pocl_specialize_max_variants);
+      free (spec.args);
+      specialization = NULL;
+    }
+  if (specialization != NULL)
+    {
+      /* Create the directory already under the lock so that the concurrent
+         launches with other values count the variant. */
+      pocl_mkdir_p (spec_dir);
+      free (cmd->command.run.tmp_dir);
+      cmd->command.run.tmp_dir = strdup (spec_dir);
+    }
+
+  /* With read-only cache layers, a launch with a local size that has no
+     binary in any layer uses the dynamic local size binary of a layer
+     instead of compiling a new one. */
+  if (online_compiled && specialization == NULL
+      && pocl_cache_num_layers () > 0)
+    {
+      char binary_path[POCL_FILENAME_LENGTH];
+      pocl_cache_final_binary_path (binary_path, p, dev_i, k,
+                                    cmd->command.run.local_x,
+                                    cmd->command.run.local_y,
+                                    cmd->command.run.local_z);
+      if (!pocl_cache_exists (binary_path))
         {
-          /* move to the front of the line */
-          DL_DELETE (pocl_dlhandle_cache, ci);
-          DL_PREPEND (pocl_dlhandle_cache, ci);
-          ++ci->ref_count;
-          POCL_UNLOCK (pocl_dlhandle_cache_lock);
-          cmd->command.run.wg = ci->wg;
-          return;
+          pocl_cache_final_binary_path (binary_path, p, dev_i, k, 0, 0, 0);
+          if (pocl_cache_exists (binary_path))
+            {
+              POCL_MSG_PRINT_INFO ("Using the dynamic local size binary "
+                                   "from the cache: %s\n", binary_path);
+              free (cmd->command.run.tmp_dir);
+              cmd->command.run.tmp_dir = malloc (POCL_FILENAME_LENGTH);
+              pocl_cache_kernel_cachedir_path (cmd->command.run.tmp_dir,
+                                               p, dev_i, k, "", 0, 0, 0);
+            }
         }
     }
+
+  ci = pocl_find_dlhandle (cmd->command.run.tmp_dir, k->name);
+  if (ci != NULL)
+    {
+      /* move to the front of the line */
+      DL_DELETE (pocl_dlhandle_cache, ci);
+      DL_PREPEND (pocl_dlhandle_cache, ci);
+      ++ci->ref_count;
+      POCL_UNLOCK (pocl_dlhandle_cache_lock);
+      cmd->command.run.wg = ci->wg;
+      set_context_arena_size (cmd, ci->arena_layout);
+      if (specialization)
+        {
+          pocl_cache_update_variant_last_access (cmd->command.run.tmp_dir);
+          free (spec.args);
+        }
+      return;
+    }
   if (handle_count == 128)
     {
       ci = pocl_dlhandle_cache->prev;
@@ -777,12 +1132,8 @@ pocl_check_dlhandle_cache (_cl_command_node *cmd)
   ci->ref_count = 1;
 
   char *module_fn = NULL;
-  cl_kernel k = cmd->command.run.kernel;
-  cl_program p = k->program;
-  cl_device_id dev = cmd->device;
-  int dev_i = pocl_cl_device_to_index(p, dev);
 
-  if (p->binaries[dev_i] && !p->pocl_binaries[dev_i])
+  if (online_compiled)
     {
 #ifdef OCS_AVAILABLE
       POCL_LOCK (pocl_llvm_codegen_lock);
@@ -791,8 +1142,11 @@ pocl_check_dlhandle_cache (_cl_command_node *cmd)
                                         cmd->device,
                                         cmd->command.run.local_x,
                                         cmd->command.run.local_y,
-                                        cmd->command.run.local_z);
+                                        cmd->command.run.local_z,
+                                        specialization);
       POCL_UNLOCK (pocl_llvm_codegen_lock);
+      if (specialization)
+        free (spec.args);
       POCL_MSG_PRINT_INFO("Using static WG size binary: %s\n", module_fn);
 #else
       POCL_ABORT("pocl built without online compiler support "
@@ -839,15 +1193,28 @@ pocl_check_dlhandle_cache (_cl_command_node *cmd)
 
   POCL_LOCK (pocl_dlhandle_lock);
   cmd->command.run.wg = ci->wg =
-    (pocl_workgroup) lt_dlsym (ci->dlhandle, workgroup_string);
+    (pocl_workgroup_blob) lt_dlsym (ci->dlhandle, workgroup_string);
   POCL_UNLOCK (pocl_dlhandle_lock);
 
   assert (cmd->command.run.wg != NULL);
 
+  snprintf (workgroup_string, 256, "_pocl_context_arena_%s",
+            cmd->command.run.kernel->name);
+
+  POCL_LOCK (pocl_dlhandle_lock);
+  ci->arena_layout = (const struct pocl_context_arena_layout *)
+    lt_dlsym (ci->dlhandle, workgroup_string);
+  POCL_UNLOCK (pocl_dlhandle_lock);
+  set_context_arena_size (cmd, ci->arena_layout);
+
   POCL_LOCK (pocl_dlhandle_cache_lock);
   assert (handle_count <= 128);
   DL_PREPEND (pocl_dlhandle_cache, ci);
   POCL_UNLOCK (pocl_dlhandle_cache_lock);
+
+  /* Only the loaded variants can be evicted. */
+  if (specialization)
+    pocl_cache_update_variant_last_access (cmd->command.run.tmp_dir);
 }
 
 /*
@@ -885,6 +1252,42 @@ pocl_free_dlhandle (_cl_command_node *cmd)
 /* accounting object for the main memory */
 static pocl_global_mem_t system_memory;
 
+/* The freed system memory blocks of at least this size are kept in a
+   pool for reuse, which saves the page faults of touching fresh memory. */
+#define POCL_MEM_POOL_MIN_SIZE (128 * 1024)
+/* The blocks are rounded up to one of this many size classes per power
+   of two so that the freed blocks fit later requests of a similar size. */
+#define POCL_MEM_POOL_CLASSES_LOG2 2
+#define POCL_MEM_POOL_CLASSES (1 << POCL_MEM_POOL_CLASSES_LOG2)
+#define POCL_MEM_POOL_OCTAVES (sizeof (size_t) * 8)
+
+/* A pooled block. The header is stored in the block itself. */
+typedef struct pocl_pooled_block pocl_pooled_block;
+struct pocl_pooled_block
+{
+  size_t size;
+  /* the blocks of the same size class, the most recently freed first */
+  pocl_pooled_block *class_next;
+  pocl_pooled_block *class_prev;
+  /* all the blocks, the least recently freed first */
+  pocl_pooled_block *lru_next;
+  pocl_pooled_block *lru_prev;
+};
+
+/* The pool of the system memory, protected by the system_memory lock. */
+static struct
+{
+  pocl_pooled_block *classes[POCL_MEM_POOL_OCTAVES][POCL_MEM_POOL_CLASSES];
+  pocl_pooled_block *lru_first;
+  pocl_pooled_block *lru_last;
+  /* bytes in the pooled blocks, and the maximum of them */
+  size_t cached;
+  size_t limit;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+} mem_pool;
+
 static size_t
 next_larger_pow2 (size_t in)
 {
@@ -933,6 +1336,21 @@ pocl_setup_device_for_system_memory(cl_device_id device)
                        limit_memory_gb, (device->global_mem_size >> 30));
     }
 
+  /* The pooled blocks are counted as allocated memory, so the pool can
+     take at most the given share of the global memory. */
+  size_t pool_limit = device->global_mem_size / 8;
+  if (pocl_is_option_set ("POCL_MEMORY_POOL_LIMIT"))
+    {
+      int pool_limit_mb = pocl_get_int_option ("POCL_MEMORY_POOL_LIMIT", 0);
+      pool_limit = pool_limit_mb > 0 ? (size_t)pool_limit_mb << 20 : 0;
+      if (pool_limit > device->global_mem_size)
+        pool_limit = device->global_mem_size;
+    }
+  POCL_LOCK_OBJ (&system_memory);
+  if (mem_pool.limit == 0 || pool_limit < mem_pool.limit)
+    mem_pool.limit = pool_limit;
+  POCL_UNLOCK_OBJ (&system_memory);
+
   if (device->global_mem_size < MIN_MAX_MEM_ALLOC_SIZE)
     POCL_ABORT("Not enough memory to run on this device.\n");
 
@@ -1020,24 +1438,144 @@ pocl_set_buffer_image_limits(cl_device_id device)
 
 }
 
+/* Returns nonzero if a block of SIZE bytes of the memory MEM goes through
+   the pool. The pooled blocks are aligned to MAX_EXTENDED_ALIGNMENT. */
+static int
+mem_pool_is_used (pocl_global_mem_t *mem, size_t size)
+{
+  return mem == &system_memory && mem_pool.limit > 0
+         && size >= POCL_MEM_POOL_MIN_SIZE;
+}
+
+/* Rounds SIZE up to its size class and returns the indices of the class. */
+static size_t
+mem_pool_class (size_t size, unsigned *octave, unsigned *cls)
+{
+  size_t ceil2 = pocl_size_ceil2 (size);
+  size_t step = ceil2 >> (POCL_MEM_POOL_CLASSES_LOG2 + 1);
+  size_t class_size = (size + step - 1) & ~(step - 1);
+  unsigned i = 0;
+  while (((size_t)1 << i) < ceil2)
+    ++i;
+  *octave = i;
+  *cls = class_size / step - POCL_MEM_POOL_CLASSES - 1;
+  return class_size;
+}
+
+/* Removes BLOCK from the pool. Must be called with the lock held. */
+static void
+mem_pool_remove (pocl_pooled_block *block)
+{
+  unsigned octave, cls;
+  mem_pool_class (block->size, &octave, &cls);
+
+  if (block->class_prev != NULL)
+    block->class_prev->class_next = block->class_next;
+  else
+    mem_pool.classes[octave][cls] = block->class_next;
+  if (block->class_next != NULL)
+    block->class_next->class_prev = block->class_prev;
+
+  if (block->lru_prev != NULL)
+    block->lru_prev->lru_next = block->lru_next;
+  else
+    mem_pool.lru_first = block->lru_next;
+  if (block->lru_next != NULL)
+    block->lru_next->lru_prev = block->lru_prev;
+  else
+    mem_pool.lru_last = block->lru_prev;
+
+  mem_pool.cached -= block->size;
+}
+
+/* Removes the least recently freed blocks from the pool until MEM_NEEDED
+   more bytes fit to the memory MEM and POOL_NEEDED more to the pool, and
+   returns them as a list linked with lru_next. Must be called with the
+   lock held. */
+static pocl_pooled_block *
+mem_pool_evict (pocl_global_mem_t *mem, size_t mem_needed, size_t pool_needed)
+{
+  pocl_pooled_block *evicted = NULL, *block;
+  while ((block = mem_pool.lru_first) != NULL
+         && (mem->currently_allocated + mem_pool.cached + mem_needed
+                 > mem->total_alloc_limit
+             || mem_pool.cached + pool_needed > mem_pool.limit))
+    {
+      mem_pool_remove (block);
+      block->lru_next = evicted;
+      evicted = block;
+      ++mem_pool.evictions;
+    }
+  return evicted;
+}
+
+static void
+mem_pool_free_evicted (pocl_pooled_block *evicted)
+{
+  while (evicted != NULL)
+    {
+      pocl_pooled_block *next = evicted->lru_next;
+      POCL_MEM_FREE (evicted);
+      evicted = next;
+    }
+}
+
 void*
 pocl_memalign_alloc_global_mem(cl_device_id device, size_t align, size_t size)
 {
   pocl_global_mem_t *mem = device->global_memory;
-  if ((mem->total_alloc_limit - mem->currently_allocated) < size)
-    return NULL;
+  pocl_pooled_block *evicted = NULL;
+  void *ptr = NULL;
+  int pooled = mem_pool_is_used (mem, size);
+  unsigned octave, cls;
 
-  void* ptr = pocl_memalign_alloc(align, size);
-  if (!ptr)
-    return NULL;
+  if (pooled)
+    {
+      assert (align <= MAX_EXTENDED_ALIGNMENT);
+      size = mem_pool_class (size, &octave, &cls);
+      align = MAX_EXTENDED_ALIGNMENT;
+    }
 
   POCL_LOCK_OBJ (mem);
+  if (pooled && mem_pool.classes[octave][cls] != NULL)
+    {
+      ptr = mem_pool.classes[octave][cls];
+      mem_pool_remove ((pocl_pooled_block *)ptr);
+      ++mem_pool.hits;
+    }
+  else if (mem == &system_memory)
+    {
+      if (pooled)
+        ++mem_pool.misses;
+      /* The pooled blocks give way to new allocations. */
+      evicted = mem_pool_evict (mem, size, 0);
+    }
+  if (ptr == NULL
+      && (mem->total_alloc_limit - mem->currently_allocated) < size)
+    {
+      POCL_UNLOCK_OBJ (mem);
+      mem_pool_free_evicted (evicted);
+      return NULL;
+    }
   mem->currently_allocated += size;
   if (mem->max_ever_allocated < mem->currently_allocated)
     mem->max_ever_allocated = mem->currently_allocated;
   assert(mem->currently_allocated <= mem->total_alloc_limit);
   POCL_UNLOCK_OBJ (mem);
 
+  mem_pool_free_evicted (evicted);
+  if (ptr != NULL)
+    return ptr;
+
+  ptr = pocl_memalign_alloc(align, size);
+  if (!ptr)
+    {
+      POCL_LOCK_OBJ (mem);
+      mem->currently_allocated -= size;
+      POCL_UNLOCK_OBJ (mem);
+      return NULL;
+    }
+
   return ptr;
 }
 
@@ -1045,12 +1583,42 @@ void
 pocl_free_global_mem(cl_device_id device, void* ptr, size_t size)
 {
   pocl_global_mem_t *mem = device->global_memory;
+  pocl_pooled_block *evicted = NULL;
+  int pooled = mem_pool_is_used (mem, size);
+  unsigned octave, cls;
+
+  if (pooled)
+    size = mem_pool_class (size, &octave, &cls);
 
   POCL_LOCK_OBJ (mem);
   assert(mem->currently_allocated >= size);
   mem->currently_allocated -= size;
+  if (pooled && size <= mem_pool.limit)
+    {
+      pocl_pooled_block *block = (pocl_pooled_block *)ptr;
+      evicted = mem_pool_evict (mem, 0, size);
+
+      block->size = size;
+      block->class_prev = NULL;
+      block->class_next = mem_pool.classes[octave][cls];
+      if (block->class_next != NULL)
+        block->class_next->class_prev = block;
+      mem_pool.classes[octave][cls] = block;
+
+      block->lru_next = NULL;
+      block->lru_prev = mem_pool.lru_last;
+      if (mem_pool.lru_last != NULL)
+        mem_pool.lru_last->lru_next = block;
+      else
+        mem_pool.lru_first = block;
+      mem_pool.lru_last = block;
+
+      mem_pool.cached += size;
+      ptr = NULL;
+    }
   POCL_UNLOCK_OBJ (mem);
 
+  mem_pool_free_evicted (evicted);
   POCL_MEM_FREE(ptr);
 }
 
@@ -1060,8 +1628,12 @@ pocl_print_system_memory_stats()
   POCL_MSG_PRINT_F (MEMORY, INFO, "",
   "____ Total available system memory  : %10zu KB\n"
   " ____ Currently used system memory   : %10zu KB\n"
-  " ____ Max used system memory         : %10zu KB\n",
+  " ____ Max used system memory         : %10zu KB\n"
+  " ____ Pooled system memory           : %10zu KB\n"
+  " ____ Pool hits / misses / evictions : %lu / %lu / %lu\n",
   system_memory.total_alloc_limit >> 10,
   system_memory.currently_allocated >> 10,
-  system_memory.max_ever_allocated >> 10);
+  system_memory.max_ever_allocated >> 10,
+  mem_pool.cached >> 10,
+  mem_pool.hits, mem_pool.misses, mem_pool.evictions);
 }
@@ -93,7 +93,8 @@ extern "C" {
 #endif
 
 char *llvm_codegen (const char *tmpdir, cl_kernel kernel, cl_device_id device,
-                    size_t local_x, size_t local_y, size_t local_z);
+                    size_t local_x, size_t local_y, size_t local_z,
+                    const pocl_kernel_specialization *spec);
 
 void fill_dev_image_t (dev_image_t* di, struct pocl_argument* parg, 
                        cl_device_id device);
@@ -102,6 +103,23 @@ void fill_dev_sampler_t (dev_sampler_t *ds, struct pocl_argument *parg);
 
 void* pocl_memalign_alloc(size_t align_width, size_t size);
 
+/* Builds the argument blob the _workgroup launcher of the kernel command
+   CMD reads the arguments from, in a single allocation: a copy of the
+   argument values of the command with the buffer, image and sampler
+   handles resolved to the device pointers. The device images and
+   samplers are stored after the argument slots. The local argument
+   slots are set by pocl_local_arg_blob(). Free with POCL_MEM_FREE. */
+void *pocl_launcher_arg_blob (_cl_command_node *cmd);
+
+/* Returns the launcher argument blob BLOB of CMD with the local argument
+   slots pointing to local buffers of the caller. That is BLOB itself if
+   the kernel has no local arguments, otherwise a copy with the local
+   buffers after the argument slots. Release with
+   pocl_free_local_arg_blob(). */
+void *pocl_local_arg_blob (_cl_command_node *cmd, void *blob);
+
+void pocl_free_local_arg_blob (void *local_blob, void *blob);
+
 void pocl_copy_mem_object (cl_device_id dest_dev, cl_mem dest, 
                            size_t dest_offset,
                            cl_device_id source_dev, cl_mem source,
@@ -120,6 +138,20 @@ void pocl_mem_objs_cleanup (cl_event event);
 
 void pocl_broadcast (cl_event event);
 
+/* A context arena of a worker thread of a CPU device, see
+   pocl_context::context_arena. */
+typedef struct
+{
+  void *ptr;
+  size_t size;
+} pocl_context_arena;
+
+/* Returns the context arena with at least SIZE bytes, growing it if
+   needed, or NULL if the allocation failed. */
+void *pocl_reserve_context_arena (pocl_context_arena *arena, size_t size);
+
+void pocl_free_context_arena (pocl_context_arena *arena);
+
 void pocl_init_dlhandle_cache ();
 
 void pocl_check_dlhandle_cache (_cl_command_node *cmd);
@@ -128,8 +160,12 @@ void pocl_setup_device_for_system_memory(cl_device_id device);
 
 void pocl_set_buffer_image_limits(cl_device_id device);
 
+/* Allocates global memory of the device. The large blocks of the system
+   memory are reused from the pool of freed blocks when possible. */
 void* pocl_memalign_alloc_global_mem(cl_device_id device, size_t align, size_t size);
 
+/* Frees global memory allocated with pocl_memalign_alloc_global_mem() with
+   the same SIZE. The large blocks of the system memory are pooled. */
 void pocl_free_global_mem(cl_device_id device, void *ptr, size_t size);
 
 void pocl_print_system_memory_stats();
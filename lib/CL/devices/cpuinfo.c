@@ -34,6 +34,14 @@
 #include "config.h"
 #include "cpuinfo.h"
 
+/* The x86 kernel library is built for several CPU variants, pick the
+   best one at runtime. */
+#if defined KERNELLIB_HOST_DISTRO_VARIANTS                               \
+    && (defined __x86_64__ || defined __i386__)
+#define DETECT_KERNELLIB_VARIANT
+#include <cpuid.h>
+#endif
+
 static const char* cpuinfo = "/proc/cpuinfo";
 #define MAX_CPUINFO_SIZE 64*1024
 //#define DEBUG_POCL_CPUINFO
@@ -321,6 +329,98 @@ pocl_cpuinfo_get_cpu_name_and_vendor(cl_device_id device)
 
 }
 
+#ifdef DETECT_KERNELLIB_VARIANT
+
+/* Reads the extended control register XCR0, which tells which register
+   states the OS saves on context switches. */
+static uint64_t
+pocl_cpuinfo_xgetbv (void)
+{
+  uint32_t eax, edx;
+  __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
+
+#define CPUID_BIT(reg, bit) (((reg) >> (bit)) & 1)
+
+/* Picks the best "distro" build of the host kernel library for the CPU,
+   from CPUID. The variants roughly follow the x86-64 micro-architecture
+   levels: sse42 is x86-64-v2, avx2 x86-64-v3 and avx512 x86-64-v4.
+   The names must match the ones in lib/kernel/host/CMakeLists.txt. */
+static const char *
+pocl_cpuinfo_detect_kernellib_variant (void)
+{
+  unsigned eax, ebx, ecx, edx;
+  unsigned ecx1, edx1, ebx7 = 0, ecx81 = 0;
+  int os_ymm = 0, os_zmm = 0;
+  const char *res = NULL;
+
+  if (!__get_cpuid (1, &eax, &ebx, &ecx1, &edx1))
+    return NULL;
+  if (__get_cpuid_max (0, NULL) >= 7)
+    {
+      __cpuid_count (7, 0, eax, ebx7, ecx, edx);
+    }
+  __get_cpuid (0x80000001, &eax, &ebx, &ecx81, &edx);
+
+  /* AVX registers are only usable when the OS has enabled their state */
+  if (CPUID_BIT (ecx1, 27))
+    {
+      uint64_t xcr0 = pocl_cpuinfo_xgetbv ();
+      os_ymm = (xcr0 & 0x6) == 0x6;
+      os_zmm = os_ymm && (xcr0 & 0xe0) == 0xe0;
+    }
+
+  int sse2 = CPUID_BIT (edx1, 26);
+  int ssse3 = CPUID_BIT (ecx1, 9);
+  int cx16 = CPUID_BIT (ecx1, 13);
+  int sse41 = CPUID_BIT (ecx1, 19);
+  int sse42 = CPUID_BIT (ecx1, 20);
+  int popcnt = CPUID_BIT (ecx1, 23);
+  int fma = CPUID_BIT (ecx1, 12) && os_ymm;
+  int avx = CPUID_BIT (ecx1, 28) && os_ymm;
+  int f16c = CPUID_BIT (ecx1, 29) && os_ymm;
+  int bmi = CPUID_BIT (ebx7, 3);
+  int avx2 = CPUID_BIT (ebx7, 5) && os_ymm;
+  int bmi2 = CPUID_BIT (ebx7, 8);
+  int avx512f = CPUID_BIT (ebx7, 16) && os_zmm;
+  int avx512dq = CPUID_BIT (ebx7, 17) && os_zmm;
+  int avx512cd = CPUID_BIT (ebx7, 28) && os_zmm;
+  int avx512bw = CPUID_BIT (ebx7, 30) && os_zmm;
+  int avx512vl = CPUID_BIT (ebx7, 31) && os_zmm;
+  int lzcnt = CPUID_BIT (ecx81, 5);
+  int xop = CPUID_BIT (ecx81, 11) && os_ymm;
+  int fma4 = CPUID_BIT (ecx81, 16) && os_ymm;
+
+  if (sse2)
+    res = "sse2";
+  else
+    POCL_ABORT ("Pocl on x86_64 requires at least SSE2\n");
+  if (ssse3 && cx16)
+    res = "ssse3";
+  if (sse41 && cx16)
+    res = "sse41";
+  if (sse42 && popcnt && cx16)
+    res = "sse42";
+  if (avx && sse42 && popcnt && cx16)
+    res = "avx";
+  if (avx && sse42 && popcnt && cx16 && xop && fma4)
+    res = "avx_fma4";
+  if (avx2 && fma && f16c && bmi && bmi2 && lzcnt && popcnt && cx16)
+    res = "avx2";
+  /* the avx512 variant is built for Skylake-SP, which also uses the
+     AVX-512 CD, BW, DQ and VL subsets */
+  if (avx512f && avx512cd && avx512bw && avx512dq && avx512vl
+      && avx2 && fma && bmi2)
+    res = "avx512";
+
+  return res;
+}
+
+#undef CPUID_BIT
+
+#endif
+
 void
 pocl_cpuinfo_detect_device_info(cl_device_id device) 
 {
@@ -341,4 +441,10 @@ pocl_cpuinfo_detect_device_info(cl_device_id device)
   device->max_clock_frequency = (res > 0) ? (cl_uint)res : 0;
 
   pocl_cpuinfo_get_cpu_name_and_vendor(device);
+
+#ifdef DETECT_KERNELLIB_VARIANT
+  device->kernellib_variant = pocl_cpuinfo_detect_kernellib_variant ();
+  POCL_MSG_PRINT_INFO ("Using the \"%s\" kernel library variant\n",
+                       device->kernellib_variant);
+#endif
 }
@@ -1084,8 +1084,8 @@ pocl_cuda_submit_node (_cl_command_node *node, cl_command_queue cq)
       CUDA_CHECK (result, "cuStreamWaitValue32");
     }
 
-  /* Create and record event for command start if profiling enabled */
-  if (cq->properties & CL_QUEUE_PROFILING_ENABLE)
+  /* Create and record event for command start if the command is timed */
+  if (POCL_EVENT_TIMED (node->event))
     {
       result = cuEventCreate (&event_data->start, CU_EVENT_DEFAULT);
       CUDA_CHECK (result, "cuEventCreate");
@@ -1231,7 +1231,7 @@ pocl_cuda_submit_node (_cl_command_node *node, cl_command_queue cq)
     }
 
   /* Create and record event for command end */
-  if (cq->properties & CL_QUEUE_PROFILING_ENABLE)
+  if (POCL_EVENT_TIMED (node->event))
     result = cuEventCreate (&event_data->end, CU_EVENT_DEFAULT);
   else
     result = cuEventCreate (&event_data->end, CU_EVENT_DISABLE_TIMING);
@@ -1392,8 +1392,8 @@ pocl_cuda_update_event (cl_device_id device, cl_event event, cl_int status)
     case CL_COMPLETE:
       pocl_mem_objs_cleanup (event);
 
-      /* Update timing info with CUDA event timers if profiling enabled */
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      /* Update timing info with CUDA event timers if the command is timed */
+      if (POCL_EVENT_TIMED (event))
         {
           /* CUDA doesn't provide a way to get event timestamps directly,
            * only the elapsed time between two events. We use the elapsed
@@ -1473,7 +1473,7 @@ pocl_cuda_free_event_data (cl_event event)
       pocl_cuda_event_data_t *event_data
           = (pocl_cuda_event_data_t *)event->data;
 
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      if (event_data->start)
         cuEventDestroy (event_data->start);
       cuEventDestroy (event_data->end);
       if (event_data->ext_event_flag)
@@ -96,7 +96,7 @@ static struct pocl_device_ops pocl_device_ops[POCL_NUM_DEVICE_TYPES];
  */
 int pocl_device_get_env_count(const char *dev_type)
 {
-  const char *dev_env = getenv(POCL_DEVICES_ENV);
+  const char *dev_env = pocl_get_string_option (POCL_DEVICES_ENV, NULL);
   char *ptr, *saveptr = NULL, *tofree, *token;
   unsigned int dev_count = 0;
   if (dev_env == NULL) 
@@ -339,12 +339,16 @@ pocl_init_devices()
       return pocl_num_devices ? CL_SUCCESS : CL_DEVICE_NOT_FOUND;
     }
 
+  pocl_init_runtime_config ();
+
   /* Set a global debug flag, so we don't have to call pocl_get_bool_option
    * everytime we use the debug macros */
 #ifdef POCL_DEBUG_MESSAGES
   const char* debug = pocl_get_string_option ("POCL_DEBUG", "0");
   pocl_debug_messages_setup (debug);
   stderr_is_a_tty = isatty(fileno(stderr));
+  if (pocl_debug_messages_filter & POCL_DEBUG_FLAG_GENERAL)
+    pocl_dump_runtime_config (stderr);
 #endif
 
 #ifdef __linux__
@@ -378,7 +382,7 @@ pocl_init_devices()
 
   if (pocl_num_devices == 0)
     {
-      const char *dev_env = getenv (POCL_DEVICES_ENV);
+      const char *dev_env = pocl_get_string_option (POCL_DEVICES_ENV, NULL);
       if (dev_env)
         POCL_MSG_WARN ("no devices found. %s=%s\n", POCL_DEVICES_ENV, dev_env);
       return CL_DEVICE_NOT_FOUND;
@@ -419,7 +423,8 @@ pocl_init_devices()
               POCL_MSG_ERR("Unable to generate the env string.");
               return CL_OUT_OF_HOST_MEMORY;
             }
-          ret = pocl_devices[dev_index].ops->init (j, &pocl_devices[dev_index], getenv(env_name));
+          ret = pocl_devices[dev_index].ops->init (j, &pocl_devices[dev_index],
+                                                   pocl_get_string_option (env_name, NULL));
           switch (ret)
           {
           case CL_OUT_OF_HOST_MEMORY:
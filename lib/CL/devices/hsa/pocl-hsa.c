@@ -870,6 +870,11 @@ setup_kernel_args (pocl_hsa_device_data_t *d,
               uint64_t temp = 0;
               memcpy (write_pos, &temp, sizeof (uint64_t));
             }
+          else if (al->is_svm)
+            {
+              uint64_t temp = (uint64_t)*(void **)al->value;
+              memcpy (write_pos, &temp, sizeof (uint64_t));
+            }
           else
             {
               cl_mem m = *(cl_mem *)al->value;
@@ -1682,7 +1687,7 @@ pocl_hsa_update_event (cl_device_id device, cl_event event, cl_int status)
       break;
     case CL_RUNNING:
       event->status = status;
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      if (POCL_EVENT_TIMED (event))
         event->time_start = device->ops->get_timer_value(device->data);
       break;
     case CL_COMPLETE:
@@ -1690,7 +1695,7 @@ pocl_hsa_update_event (cl_device_id device, cl_event event, cl_int status)
       pocl_mem_objs_cleanup (event);
       pocl_update_command_queue (event);
 
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      if (POCL_EVENT_TIMED (event))
         event->time_end = device->ops->get_timer_value(device->data);
 
       POCL_LOCK_OBJ (event);
@@ -35,6 +35,16 @@
 
 typedef struct pool_thread_data thread_data;
 
+/* Parses a chunking policy description of the form "static", "guided",
+   "fixed[:<work-groups>]" or "adaptive[:<microseconds>]" to CHUNKING.
+   Returns 0 on success. */
+int pthread_scheduler_parse_chunking (const char *str,
+                                      pthread_chunking *chunking);
+
+/* Returns the chunking configuration of the pthread device whose
+   device data is DATA. Implemented in pthread.c. */
+const pthread_chunking *pocl_pthread_get_chunking (void *data);
+
 /* Initializes scheduler. Must be called before any kernel enqueue */
 void pthread_scheduler_init (size_t num_worker_threads);
 
@@ -49,7 +59,11 @@ void pthread_scheduler_push_kernel (kernel_run_command *run_cmd);
 /* blocks until given command queue is empty == finished */
 void pthread_scheduler_wait_cq (cl_command_queue cq);
 
-void pthread_scheduler_release_host ();
+/* blocks until the command of the event is complete */
+void pthread_scheduler_wait_event (cl_event event);
+
+/* wakes up the host threads waiting for the queue to finish */
+void pthread_scheduler_release_host (cl_command_queue cq);
 
 int pthread_scheduler_get_work (thread_data *td, _cl_command_node **cmd_ptr);
 
@@ -18,6 +18,31 @@
 #pragma GCC visibility push(hidden)
 #endif
 
+/* How the work-groups of a kernel command are dealt to the worker threads. */
+typedef enum
+{
+  /* Each chunk is the remaining work-groups divided by the number of
+     threads, at most 256. */
+  POCL_PTHREAD_CHUNK_STATIC,
+  /* Chunks shrink with the remaining work-groups, half as fast as
+     the static ones. */
+  POCL_PTHREAD_CHUNK_GUIDED,
+  /* Constant size chunks. */
+  POCL_PTHREAD_CHUNK_FIXED,
+  /* Chunks sized from the measured work-group execution time so that
+     each chunk takes roughly a target time. */
+  POCL_PTHREAD_CHUNK_ADAPTIVE
+} pthread_chunk_policy;
+
+typedef struct
+{
+  pthread_chunk_policy policy;
+  /* Chunk size of the fixed policy. */
+  unsigned fixed_size;
+  /* Targeted chunk duration of the adaptive policy, in nanoseconds. */
+  uint64_t target_ns;
+} pthread_chunking;
+
 typedef struct kernel_run_command kernel_run_command;
 struct kernel_run_command
 {
@@ -31,8 +56,18 @@ struct kernel_run_command
   volatile unsigned group_idx[3];
   volatile unsigned remaining_wgs;
   volatile unsigned wgs_dealt;
-  pocl_workgroup workgroup;
-  struct pocl_argument *kernel_args;
+  /* max work-groups dealt at a time, 0 = use the chunking policy */
+  unsigned wg_chunk;
+  const pthread_chunking *chunking;
+  /* running average of the work-group execution time (adaptive policy) */
+  volatile uint64_t wg_time_ns;
+  /* priority rank of the command queue, 0 is the most urgent */
+  unsigned priority;
+  pocl_workgroup_blob workgroup;
+  /* bytes of context arena needed by the work-group function */
+  size_t context_arena_size;
+  /* the argument blob of the launcher, shared by the workers */
+  void *arg_blob;
   volatile int ref_count;
   kernel_run_command *volatile next;
 #ifdef POCL_PTHREAD_CACHE_MONITORING
@@ -44,8 +79,6 @@ void pocl_init_kernel_run_command_manager (void);
 void pocl_init_thread_argument_manager ();
 kernel_run_command* new_kernel_run_command ();
 void free_kernel_run_command (kernel_run_command *k);
-void setup_kernel_arg_array(void **arguments, kernel_run_command *k);
-void free_kernel_arg_array (void **arguments, kernel_run_command *k);
 
 #ifdef __GNUC__
 #pragma GCC visibility pop
@@ -93,13 +93,6 @@
    for the thread execution. */
 #define THREAD_COUNT_ENV "POCL_MAX_PTHREAD_COUNT"
 
-/**
- * Per event data.
- */
-struct event_data {
-  pthread_cond_t event_cond;
-};
-
 struct data {
   /* Currently loaded kernel. */
   cl_kernel current_kernel;
@@ -110,6 +103,8 @@ struct data {
   _cl_command_node * volatile command_list;
   pthread_mutex_t cq_lock;      /* Lock for command list related operations */
   volatile uint64_t total_cmd_exec_time;
+  /* How the work-groups of kernels are dealt to the worker threads. */
+  pthread_chunking chunking;
 
 #ifdef CUSTOM_BUFFER_ALLOCATOR
   /* Lock for protecting the mem_regions linked list. Held when new mem_regions
@@ -148,7 +143,7 @@ pocl_pthread_init_device_ops(struct pocl_device_ops *ops)
   ops->flush = pocl_pthread_flush;
   ops->wait_event = pocl_pthread_wait_event;
   ops->update_event = pocl_pthread_update_event;
-  ops->free_event_data = pocl_pthread_free_event_data;
+  ops->free_event_data = NULL;
   ops->build_hash = pocl_pthread_build_hash;
 }
 
@@ -219,6 +214,21 @@ pocl_pthread_init (unsigned j, cl_device_id device, const char* parameters)
   d->current_dlhandle = 0;
   device->data = d;
 
+  /* The work-group chunking policy can be given per device in
+     POCL_PTHREADn_PARAMETERS, and overridden for all pthread devices
+     with POCL_PTHREAD_CHUNK_POLICY. */
+  pthread_scheduler_parse_chunking ("static", &d->chunking);
+  if (parameters != NULL &&
+      pthread_scheduler_parse_chunking (parameters, &d->chunking))
+    POCL_MSG_WARN ("pthread: unknown chunking policy '%s'\n", parameters);
+  if (pocl_is_option_set ("POCL_PTHREAD_CHUNK_POLICY"))
+    {
+      const char *policy =
+        pocl_get_string_option ("POCL_PTHREAD_CHUNK_POLICY", "static");
+      if (pthread_scheduler_parse_chunking (policy, &d->chunking))
+        POCL_MSG_WARN ("pthread: unknown chunking policy '%s'\n", policy);
+    }
+
   device->address_bits = sizeof(void*) * 8;
 
   device->min_data_type_align_size = MAX_EXTENDED_ALIGNMENT; // this is in bytes
@@ -258,6 +268,11 @@ pocl_pthread_init (unsigned j, cl_device_id device, const char* parameters)
   device->num_partition_types = 0;
   device->partition_type = NULL;
 
+  /* the scheduler deals work-groups to the worker threads in chunks */
+  device->wg_chunking = 1;
+  /* commands are only pushed to the worker threads in submit */
+  device->in_order_streams = 1;
+
   if(device->llvm_cpu && (!strcmp(device->llvm_cpu, "(unknown)")))
     device->llvm_cpu = NULL;
 
@@ -280,6 +295,12 @@ pocl_pthread_init (unsigned j, cl_device_id device, const char* parameters)
   return ret;
 }
 
+const pthread_chunking *
+pocl_pthread_get_chunking (void *data)
+{
+  return &((struct data *)data)->chunking;
+}
+
 void
 pocl_pthread_uninit (cl_device_id device)
 {
@@ -440,21 +461,8 @@ pocl_pthread_notify (cl_device_id device, cl_event event, cl_event finished)
 
 void pocl_pthread_update_event (cl_device_id device, cl_event event, cl_int status)
 {
-  struct event_data *e_d = NULL;
   int cq_ready = 0;
 
-  if(event->data == NULL && status == CL_QUEUED)
-    {
-      e_d = malloc(sizeof(struct event_data));
-      assert(e_d);
-
-      pthread_cond_init(&e_d->event_cond, NULL);
-      event->data = (void *) e_d;
-    }
-  else
-    {
-      e_d = event->data;
-    }
   switch (status)
     {
     case CL_QUEUED:
@@ -469,7 +477,7 @@ void pocl_pthread_update_event (cl_device_id device, cl_event event, cl_int stat
       break;
     case CL_RUNNING:
       event->status = status;
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      if (POCL_EVENT_TIMED (event))
         event->time_start = device->ops->get_timer_value(device->data);
       break;
     case CL_COMPLETE:
@@ -478,18 +486,22 @@ void pocl_pthread_update_event (cl_device_id device, cl_event event, cl_int stat
       pocl_mem_objs_cleanup (event);
       cq_ready = pocl_update_command_queue (event);
 
-      if (event->queue->properties & CL_QUEUE_PROFILING_ENABLE)
+      if (POCL_EVENT_TIMED (event))
         event->time_end = device->ops->get_timer_value(device->data);
 
       POCL_LOCK_OBJ (event);
       event->status = CL_COMPLETE;
 
-      pthread_cond_signal(&e_d->event_cond);
+      pocl_signal_broadcast (&event->completion);
       if (cq_ready)
-        pthread_scheduler_release_host ();
+        pthread_scheduler_release_host (event->queue);
 
       device->ops->broadcast (event);
       POCL_UNLOCK_OBJ (event);
+
+      /* Start the next command of the stream only now, so that it does
+         not run before this one is seen as complete. */
+      pocl_in_order_stream_completed (event);
       break;
     default:
       assert("Invalid event status\n");
@@ -499,22 +511,6 @@ void pocl_pthread_update_event (cl_device_id device, cl_event event, cl_int stat
 
 void pocl_pthread_wait_event (cl_device_id device, cl_event event)
 {
-  struct event_data *e_d = event->data;
-
-  POCL_LOCK_OBJ (event);
-  while (event->status != CL_COMPLETE)
-    {
-      pthread_cond_wait(&e_d->event_cond, &event->pocl_lock);
-    }
-  POCL_UNLOCK_OBJ (event);
-}
-
-
-void pocl_pthread_free_event_data (cl_event event)
-{
-  assert(event->data != NULL);
-  free(event->data);
-  event->data = NULL;
-
+  pthread_scheduler_wait_event (event);
 }
 
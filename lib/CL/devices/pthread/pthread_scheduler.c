@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include "pocl-pthread_scheduler.h"
 #include "pocl_cl.h"
@@ -8,9 +9,13 @@
 #include "pocl_util.h"
 #include "common.h"
 #include "pocl_mem_management.h" 
+#include "pocl_timing.h"
 
 static void* pocl_pthread_driver_thread (void *p);
 
+/* Number of cl_khr_priority_hints priority levels. */
+#define POCL_PTHREAD_NUM_PRIORITIES 3
+
 struct pool_thread_data
 {
   pthread_t thread;
@@ -24,9 +29,17 @@ struct pool_thread_data
   volatile int stolen_commands;
   volatile int stolen_wgs;
   volatile unsigned lock_counter;
+  /* time the previously executed chunk of work-groups finished */
   volatile uint64_t prev_wg_finish_time;
+  /* statistics, printed in the debug output at exit */
+  volatile unsigned executed_chunks;
+  volatile unsigned executed_wgs;
+  volatile uint64_t idle_time;
   pthread_mutex_t kernel_q_lock;
   volatile int kernel_counter;
+  /* Context data of the work-item loops, allocated once and grown to
+     the largest need of the executed kernels. */
+  pocl_context_arena context_arena;
 };
 
 typedef struct scheduler_data_
@@ -36,12 +49,21 @@ typedef struct scheduler_data_
   kernel_run_command *volatile kernel_queue;
   volatile int num_threads;
   volatile int round_robin_index;
-  pthread_cond_t cq_finished_cond;
   pthread_cond_t wake_pool;
   pthread_mutex_t wq_lock;
-  pthread_mutex_t cq_finished_lock;
   volatile int thread_pool_shutdown_requested;
   cl_device_id *volatile pool_devices;
+  /* Spread the workers across all the ready kernels instead of serving
+     the kernel queue in FIFO order. */
+  int concurrent_kernels;
+  /* 0..100: how much of the workers are shared equally between the command
+     queues instead of in proportion to the remaining work-groups. */
+  unsigned queue_fairness;
+  /* Number of commands in work_queue per priority rank. */
+  volatile unsigned pending_commands[POCL_PTHREAD_NUM_PRIORITIES];
+  /* How long the host threads busy-wait for a command or a queue to
+     finish before going to sleep, in nanoseconds. */
+  uint64_t spin_wait_ns;
 } scheduler_data;
 
 static scheduler_data scheduler;
@@ -50,13 +72,19 @@ void pthread_scheduler_init (size_t num_worker_threads)
 {
   size_t i;
   pthread_mutex_init (&(scheduler.wq_lock), NULL);
-  pthread_mutex_init (&(scheduler.cq_finished_lock), NULL);
-  pthread_cond_init (&(scheduler.cq_finished_cond), NULL);
   pthread_cond_init (&(scheduler.wake_pool), NULL);
 
   scheduler.thread_pool = calloc
     (num_worker_threads, sizeof (struct pool_thread_data));
   scheduler.num_threads = num_worker_threads;
+  scheduler.concurrent_kernels =
+    pocl_get_bool_option ("POCL_PTHREAD_CONCURRENT_KERNELS", 0);
+  scheduler.queue_fairness =
+    min (100, max (0, pocl_get_int_option ("POCL_PTHREAD_QUEUE_FAIRNESS",
+                                           50)));
+  scheduler.spin_wait_ns =
+    (uint64_t)max (0, pocl_get_int_option ("POCL_PTHREAD_SPIN_WAIT", 0))
+    * 1000;
 
   for (i = 0; i < num_worker_threads; ++i)
     {
@@ -82,22 +110,130 @@ void pthread_scheduler_uinit ()
 
   for (i = 0; i < scheduler.num_threads; ++i)
     {
-      pthread_join (scheduler.thread_pool[i].thread, NULL);
+      struct pool_thread_data *td = &scheduler.thread_pool[i];
+      pthread_join (td->thread, NULL);
+      POCL_MSG_PRINT_INFO ("pthread: worker %zu executed %d commands, %u "
+                           "work-groups in %u chunks, idle %lu us\n",
+                           td->my_id, td->executed_commands,
+                           td->executed_wgs, td->executed_chunks,
+                           (unsigned long)(td->idle_time / 1000));
+      pocl_free_context_arena (&td->context_arena);
+    }
+}
+
+int
+pthread_scheduler_parse_chunking (const char *str, pthread_chunking *chunking)
+{
+  const char *arg = strchr (str, ':');
+  size_t len = arg ? (size_t)(arg - str) : strlen (str);
+  int value;
+
+  if (len == strlen ("static") && strncmp (str, "static", len) == 0)
+    {
+      chunking->policy = POCL_PTHREAD_CHUNK_STATIC;
+      return 0;
+    }
+  if (len == strlen ("guided") && strncmp (str, "guided", len) == 0)
+    {
+      chunking->policy = POCL_PTHREAD_CHUNK_GUIDED;
+      return 0;
+    }
+  if (len == strlen ("fixed") && strncmp (str, "fixed", len) == 0)
+    {
+      chunking->policy = POCL_PTHREAD_CHUNK_FIXED;
+      value = arg ? atoi (arg + 1) : 16;
+      chunking->fixed_size = max (value, 1);
+      return 0;
+    }
+  if (len == strlen ("adaptive") && strncmp (str, "adaptive", len) == 0)
+    {
+      chunking->policy = POCL_PTHREAD_CHUNK_ADAPTIVE;
+      value = arg ? atoi (arg + 1) : 100;
+      chunking->target_ns = (uint64_t)max (value, 1) * 1000;
+      return 0;
+    }
+  return 1;
+}
+
+/* Returns the rank of the priority of the command queue, the high
+   priority queues having rank 0. */
+static inline unsigned
+queue_priority_rank (cl_command_queue cq)
+{
+  switch (cq->priority)
+    {
+    case CL_QUEUE_PRIORITY_HIGH_KHR:
+      return 0;
+    case CL_QUEUE_PRIORITY_LOW_KHR:
+      return 2;
+    case CL_QUEUE_PRIORITY_MED_KHR:
+    default:
+      return 1;
     }
 }
 
+static inline unsigned
+command_priority (_cl_command_node *cmd)
+{
+  return queue_priority_rank (cmd->event->queue);
+}
+
+/* True if there are commands waiting in the work queue with a higher
+   priority than the given rank. Read without the lock, between chunks. */
+static inline int
+commands_pending_above (unsigned priority)
+{
+  unsigned i;
+  for (i = 0; i < priority && i < POCL_PTHREAD_NUM_PRIORITIES; ++i)
+    if (scheduler.pending_commands[i])
+      return 1;
+  return 0;
+}
+
+/* Removes and returns the oldest command of the highest priority from the
+   work queue. Called with wq_lock held. */
+static _cl_command_node *
+pop_command ()
+{
+  _cl_command_node *cmd, *best = NULL;
+  DL_FOREACH (scheduler.work_queue, cmd)
+    {
+      if (best == NULL || command_priority (cmd) < command_priority (best))
+        best = cmd;
+    }
+  if (best)
+    {
+      DL_DELETE (scheduler.work_queue, best);
+      --scheduler.pending_commands[command_priority (best)];
+    }
+  return best;
+}
+
 void pthread_scheduler_push_command (_cl_command_node *cmd)
 {
   PTHREAD_LOCK (&scheduler.wq_lock, NULL);
   DL_APPEND (scheduler.work_queue, cmd);
+  ++scheduler.pending_commands[command_priority (cmd)];
   pthread_cond_broadcast (&scheduler.wake_pool);
   PTHREAD_UNLOCK (&scheduler.wq_lock);
 }
 
 void pthread_scheduler_push_kernel (kernel_run_command *run_cmd)
 {
+  kernel_run_command *volatile *pos;
   PTHREAD_LOCK (&scheduler.wq_lock, NULL);
-  LL_APPEND (scheduler.kernel_queue, run_cmd);
+  /* The kernel queue holds a reference to the command until its last
+     work-group has been dealt, so that workers leaving it between chunks
+     cannot finalize it while it is still queued. */
+  run_cmd->ref_count = 1;
+  /* The kernel queue is kept sorted by priority, FIFO within a priority,
+     so its head is always the most urgent kernel. */
+  for (pos = &scheduler.kernel_queue;
+       *pos != NULL && (*pos)->priority <= run_cmd->priority;
+       pos = &(*pos)->next)
+    ;
+  run_cmd->next = *pos;
+  *pos = run_cmd;
   pthread_cond_broadcast (&scheduler.wake_pool);
   PTHREAD_UNLOCK (&scheduler.wq_lock);
 }
@@ -106,26 +242,27 @@ void pthread_scheduler_wait_cq (cl_command_queue cq)
 {
   while (1)
     {
-      pthread_mutex_lock (&scheduler.cq_finished_lock);
-      POCL_LOCK_OBJ (cq);
+      unsigned seq = pocl_signal_seq (&cq->finished);
       if (cq->command_count == 0)
-        {
-          POCL_UNLOCK_OBJ (cq);
-          pthread_mutex_unlock (&scheduler.cq_finished_lock);
-          return;
-        }
-      POCL_UNLOCK_OBJ (cq);
-      pthread_cond_wait (&scheduler.cq_finished_cond,
-                         &scheduler.cq_finished_lock);
-      pthread_mutex_unlock (&scheduler.cq_finished_lock);
+        return;
+      pocl_signal_wait (&cq->finished, seq, scheduler.spin_wait_ns);
     }
 }
 
-void pthread_scheduler_release_host ()
+void pthread_scheduler_wait_event (cl_event event)
 {
-  PTHREAD_LOCK (&scheduler.cq_finished_lock, NULL);
-  pthread_cond_signal (&scheduler.cq_finished_cond);
-  PTHREAD_UNLOCK (&scheduler.cq_finished_lock);
+  while (1)
+    {
+      unsigned seq = pocl_signal_seq (&event->completion);
+      if (event->status == CL_COMPLETE)
+        return;
+      pocl_signal_wait (&event->completion, seq, scheduler.spin_wait_ns);
+    }
+}
+
+void pthread_scheduler_release_host (cl_command_queue cq)
+{
+  pocl_signal_broadcast (&cq->finished);
 }
 
 static int
@@ -135,13 +272,118 @@ work_group_scheduler (kernel_run_command *k,
 static void finalize_kernel_command (thread_data *thread_data,
                               kernel_run_command *k);
 
+static inline cl_command_queue
+kernel_queue_of (kernel_run_command *k)
+{
+  return k->cmd->event->queue;
+}
+
+/* Picks the kernel the given worker should execute work-groups of next, in
+   the concurrent kernels mode. The workers are spread over the ready
+   kernels in proportion to their remaining work-groups: the worker i takes
+   the kernel at the point (i + 1/2) / num_threads of the concatenated
+   remaining work. The queue_fairness percentage of the weight is instead
+   split equally between the command queues, so that a huge NDRange in one
+   queue cannot starve the others. Only the kernels of the highest ready
+   priority are considered. Called with wq_lock held. */
+static kernel_run_command *
+pick_kernel (struct pool_thread_data *td)
+{
+  kernel_run_command *k, *other;
+  uint64_t total = 0, queue_remaining, weight, acc = 0, target;
+  unsigned num_queues = 0;
+  unsigned fairness = scheduler.queue_fairness;
+  unsigned priority;
+
+  k = scheduler.kernel_queue;
+  if (!scheduler.concurrent_kernels || k == NULL || k->next == NULL)
+    return k;
+  priority = k->priority;
+
+  LL_FOREACH (scheduler.kernel_queue, k)
+    {
+      if (k->priority != priority)
+        break;
+      total += k->remaining_wgs;
+      /* count each queue at its first kernel in the list */
+      for (other = scheduler.kernel_queue; other != k; other = other->next)
+        if (kernel_queue_of (other) == kernel_queue_of (k))
+          break;
+      if (other == k)
+        ++num_queues;
+    }
+  if (total == 0)
+    return scheduler.kernel_queue;
+
+  /* The weights sum up to 100 * total. */
+  target = (2 * td->my_id + 1) * 100 * total / (2 * scheduler.num_threads);
+  LL_FOREACH (scheduler.kernel_queue, k)
+    {
+      if (k->priority != priority)
+        break;
+      if (k->remaining_wgs == 0)
+        continue;
+      queue_remaining = 0;
+      LL_FOREACH (scheduler.kernel_queue, other)
+        if (kernel_queue_of (other) == kernel_queue_of (k))
+          queue_remaining += other->remaining_wgs;
+
+      weight = (100 - fairness) * k->remaining_wgs
+               + fairness * total * k->remaining_wgs
+                 / (num_queues * queue_remaining);
+      acc += weight;
+      if (acc > target)
+        return k;
+    }
+  return scheduler.kernel_queue;
+}
+
+/* True if the worker executing K should go back to pick_kernel() between
+   chunks because there are other kernels to share the workers with. */
+static inline int
+other_kernels_ready (kernel_run_command *k)
+{
+  kernel_run_command *head = scheduler.kernel_queue;
+  return scheduler.concurrent_kernels && head != NULL
+         && (head != k || head->next != NULL);
+}
+
+/* True if the worker executing K should leave it between chunks to serve
+   work from a higher priority command queue. */
+static inline int
+higher_priority_work (kernel_run_command *k)
+{
+  kernel_run_command *head = scheduler.kernel_queue;
+  return (head != NULL && head->priority < k->priority)
+         || commands_pending_above (k->priority);
+}
+
 int pthread_scheduler_get_work (thread_data *td, _cl_command_node **cmd_ptr)
 {
   _cl_command_node *cmd;
   kernel_run_command *run_cmd;
+
+  /* In the concurrent mode, get new NDRange commands prepared first so
+     that all ready kernels are available for pick_kernel(). Otherwise only
+     commands of a higher priority than the kernels being run go first. */
+  PTHREAD_LOCK (&scheduler.wq_lock, NULL);
+  run_cmd = scheduler.kernel_queue;
+  if (scheduler.concurrent_kernels
+      || commands_pending_above (run_cmd ? run_cmd->priority
+                                         : POCL_PTHREAD_NUM_PRIORITIES))
+    {
+      if ((cmd = pop_command ()))
+        {
+          PTHREAD_UNLOCK (&scheduler.wq_lock);
+          *cmd_ptr = cmd;
+          return 0;
+        }
+    }
+  PTHREAD_UNLOCK (&scheduler.wq_lock);
+
   // execute kernel if available
   PTHREAD_LOCK (&scheduler.wq_lock, NULL);
-  if ((run_cmd = scheduler.kernel_queue))
+  if ((run_cmd = pick_kernel (td)))
     {
       ++run_cmd->ref_count;
       PTHREAD_UNLOCK (&scheduler.wq_lock);
@@ -162,9 +404,8 @@ int pthread_scheduler_get_work (thread_data *td, _cl_command_node **cmd_ptr)
 
   // execute a command if available
   PTHREAD_LOCK (&scheduler.wq_lock, NULL);
-  if ((cmd = scheduler.work_queue))
+  if ((cmd = pop_command ()))
     {
-      DL_DELETE (scheduler.work_queue, cmd);
       PTHREAD_UNLOCK (&scheduler.wq_lock);
       *cmd_ptr = cmd;
       return 0;
@@ -175,18 +416,59 @@ int pthread_scheduler_get_work (thread_data *td, _cl_command_node **cmd_ptr)
 }
 
 static void
-pthread_scheduler_sleep()
+pthread_scheduler_sleep (struct pool_thread_data *td)
 {
   static struct timespec time_to_wait = {0, 0};
+  uint64_t sleep_start;
   time_to_wait.tv_sec = time(NULL) + 5;
 
   PTHREAD_LOCK (&scheduler.wq_lock, NULL);
   if (scheduler.work_queue == NULL && scheduler.kernel_queue == 0)
-    pthread_cond_timedwait (&scheduler.wake_pool, &scheduler.wq_lock, &time_to_wait);
+    {
+      sleep_start = pocl_gettimemono_ns ();
+      pthread_cond_timedwait (&scheduler.wake_pool, &scheduler.wq_lock,
+                              &time_to_wait);
+      td->idle_time += pocl_gettimemono_ns () - sleep_start;
+    }
   PTHREAD_UNLOCK (&scheduler.wq_lock);
 }
 
 #define POCL_PTHREAD_MAX_WGS 256
+
+/* Returns the number of work-groups to deal next according to the chunking
+   policy of the kernel command. Called with k->lock held. */
+static unsigned
+chunk_size (kernel_run_command *k)
+{
+  const pthread_chunking *chunking = k->chunking;
+  unsigned guided = 1 + k->remaining_wgs / (2 * scheduler.num_threads);
+  uint64_t size;
+
+  /* Per launch override, e.g. by autotuning. */
+  if (k->wg_chunk)
+    return k->wg_chunk;
+
+  switch (chunking->policy)
+    {
+    case POCL_PTHREAD_CHUNK_FIXED:
+      return chunking->fixed_size;
+    case POCL_PTHREAD_CHUNK_ADAPTIVE:
+      /* Deal single work-groups until there's a measurement. Never go above
+         the guided size to avoid imbalance at the tail. */
+      if (k->wg_time_ns == 0)
+        return 1;
+      size = chunking->target_ns / k->wg_time_ns;
+      size = max (size, 1);
+      return min (size, min (guided, POCL_PTHREAD_MAX_WGS));
+    case POCL_PTHREAD_CHUNK_GUIDED:
+      return min (guided, POCL_PTHREAD_MAX_WGS);
+    case POCL_PTHREAD_CHUNK_STATIC:
+    default:
+      return min (1 + k->remaining_wgs / scheduler.num_threads,
+                  POCL_PTHREAD_MAX_WGS);
+    }
+}
+
 static int get_wg_index_range (kernel_run_command *k, unsigned *start_index,
                                unsigned *end_index, char *last_wgs)
 {
@@ -198,9 +480,7 @@ static int get_wg_index_range (kernel_run_command *k, unsigned *start_index,
       PTHREAD_UNLOCK (&k->lock);
       return 0;
     }
-  max_wgs = min (POCL_PTHREAD_MAX_WGS,
-                 (1 + k->remaining_wgs / scheduler.num_threads));
-  max_wgs = min (max_wgs, k->remaining_wgs);
+  max_wgs = min (chunk_size (k), k->remaining_wgs);
 
   *start_index = k->wgs_dealt;
   *end_index = k->wgs_dealt + max_wgs-1;
@@ -213,6 +493,33 @@ static int get_wg_index_range (kernel_run_command *k, unsigned *start_index,
   return 1;
 }
 
+/* Updates the statistics and the work-group time estimate after a thread
+   has executed a chunk. */
+static void
+chunk_finished (kernel_run_command *k, struct pool_thread_data *td,
+                uint64_t start_time, unsigned num_wgs)
+{
+  uint64_t now = pocl_gettimemono_ns ();
+  uint64_t wg_time = (now - start_time) / num_wgs;
+
+  td->prev_wg_finish_time = now;
+  ++td->executed_chunks;
+  td->executed_wgs += num_wgs;
+
+  if (k->chunking->policy != POCL_PTHREAD_CHUNK_ADAPTIVE)
+    return;
+
+  if (wg_time == 0)
+    wg_time = 1;
+  PTHREAD_LOCK (&k->lock, NULL);
+  /* Exponential moving average, weighting the latest chunk by 1/4. */
+  if (k->wg_time_ns == 0)
+    k->wg_time_ns = wg_time;
+  else
+    k->wg_time_ns = (3 * k->wg_time_ns + wg_time) / 4;
+  PTHREAD_UNLOCK (&k->lock);
+}
+
 inline static void translate_wg_index_to_3d_index (kernel_run_command *k,
                                                    unsigned index,
                                                    size_t *index_3d)
@@ -227,7 +534,7 @@ static int
 work_group_scheduler (kernel_run_command *k,
                       struct pool_thread_data *thread_data)
 {
-  void *arguments[k->kernel->num_args + k->kernel->num_locals];
+  void *arguments;
   struct pocl_context pc;
   unsigned i;
   unsigned start_index;
@@ -237,14 +544,24 @@ work_group_scheduler (kernel_run_command *k,
   if (!get_wg_index_range (k, &start_index, &end_index,  &last_wgs))
     return 0;
 
-  setup_kernel_arg_array ((void**)&arguments, k);
+  arguments = pocl_local_arg_blob (k->cmd, k->arg_blob);
   memcpy (&pc, &k->pc, sizeof (struct pocl_context));
+  pc.context_arena =
+    pocl_reserve_context_arena (&thread_data->context_arena,
+                                k->context_arena_size);
+  if (pc.context_arena == NULL && k->context_arena_size > 0)
+    POCL_ABORT ("pthread: could not allocate a %zu byte context arena\n",
+                k->context_arena_size);
   do
     {
+      uint64_t start_time = pocl_gettimemono_ns ();
       if (last_wgs)
         {
           PTHREAD_LOCK (&scheduler.wq_lock, NULL);
           LL_DELETE (scheduler.kernel_queue, k);
+          /* Drop the reference of the kernel queue. This worker still
+             holds its own one, so the command stays alive. */
+          --k->ref_count;
           PTHREAD_UNLOCK (&scheduler.wq_lock);
         }
       for (i = start_index; i <= end_index; ++i)
@@ -257,11 +574,15 @@ work_group_scheduler (kernel_run_command *k,
 #endif
           k->workgroup (arguments, &pc);
         }
+      chunk_finished (k, thread_data, start_time,
+                      end_index - start_index + 1);
 
+      if (other_kernels_ready (k) || higher_priority_work (k))
+        break;
     }while (get_wg_index_range (k, &start_index, &end_index,  &last_wgs));
 
 
-  free_kernel_arg_array (arguments, k);
+  pocl_free_local_arg_blob (arguments, k->arg_blob);
 
   return 1;
 }
@@ -273,6 +594,7 @@ void finalize_kernel_command (struct pool_thread_data *thread_data,
   printf("### kernel %s finished\n", k->cmd->command.run.kernel->name);
 #endif
 
+  POCL_MEM_FREE (k->arg_blob);
   pocl_ndrange_node_cleanup (k->cmd);
   POCL_UPDATE_EVENT_COMPLETE (&k->cmd->event);
 
@@ -320,8 +642,12 @@ pocl_pthread_prepare_kernel
   run_cmd->pc.local_size[1] = cmd->command.run.local_y;
   run_cmd->pc.local_size[2] = cmd->command.run.local_z;
   run_cmd->remaining_wgs = num_groups;
+  run_cmd->wg_chunk = cmd->command.run.wg_chunk;
+  run_cmd->chunking = pocl_pthread_get_chunking (data);
+  run_cmd->priority = queue_priority_rank (cmd->event->queue);
   run_cmd->workgroup = cmd->command.run.wg;
-  run_cmd->kernel_args = cmd->command.run.arguments;
+  run_cmd->context_arena_size = cmd->command.run.context_arena_size;
+  run_cmd->arg_blob = pocl_launcher_arg_blob (cmd);
   run_cmd->next = NULL;
 
   pthread_scheduler_push_kernel (run_cmd);  
@@ -368,6 +694,6 @@ pocl_pthread_driver_thread (void *p)
           ++td->executed_commands;
         }
       // check if its time to sleep
-      pthread_scheduler_sleep();
+      pthread_scheduler_sleep (td);
     }
 }
@@ -83,6 +83,8 @@ TCEDevice::TCEDevice(cl_device_id dev, const char* adfName) :
 }
 
 TCEDevice::~TCEDevice() {
+  uninit_mem_region(&local_mem);
+  uninit_mem_region(&global_mem);
   parent->data = NULL;
 }
 
@@ -0,0 +1,408 @@
+/* pocl_autotune.c: online tuning of the launch configuration of kernels
+   enqueued without an explicit local size
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* When POCL_AUTOTUNE is enabled, the first launches of each (kernel, global
+   size) pair that leave the local size to the implementation are used as
+   tuning trials: each one runs a different candidate local size / work-group
+   chunk size, and its execution time is taken from the event timestamps.
+   Once all trials have completed, the fastest candidate is used for the
+   rest of the launches and appended to a small text database in the
+   program's cache directory, so that later processes start tuned. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pocl_autotune.h"
+#include "pocl_cache.h"
+#include "pocl_file_util.h"
+#include "pocl_runtime_config.h"
+#include "utlist.h"
+
+/* At most 3 local sizes times 3 chunk sizes. */
+#define AUTOTUNE_MAX_CANDIDATES 9
+
+/* The time of a trial whose command was released without completing. */
+#define AUTOTUNE_TIME_INFINITE ((cl_ulong)-1)
+
+typedef struct pocl_autotune_entry pocl_autotune_entry;
+struct pocl_autotune_entry
+{
+  /* NULL once the program is released. The entry is then freed when its
+     last trial in flight finishes, as the trial commands can complete after
+     they have released their kernel. */
+  cl_program program;
+  SHA1_digest_t build_hash;
+  char *kernel_name;
+  size_t global[3];
+  char db_path[POCL_FILENAME_LENGTH];
+
+  unsigned num_candidates;
+  size_t local[AUTOTUNE_MAX_CANDIDATES][3];
+  unsigned wg_chunk[AUTOTUNE_MAX_CANDIDATES];
+  /* Fastest measured time of each candidate, 0 if not measured yet and
+     AUTOTUNE_TIME_INFINITE if none of its trials completed. */
+  cl_ulong time[AUTOTUNE_MAX_CANDIDATES];
+
+  unsigned num_trials;
+  unsigned trials_issued;
+  unsigned trials_done;
+  unsigned trials_in_flight;
+  /* Index of the chosen candidate, -1 while still tuning. */
+  int winner;
+
+  pocl_autotune_entry *next;
+};
+
+static pocl_autotune_entry *autotune_entries = NULL;
+static pocl_lock_t autotune_lock = POCL_LOCK_INITIALIZER;
+
+int
+pocl_autotune_enabled ()
+{
+  return pocl_get_bool_option ("POCL_AUTOTUNE", 0);
+}
+
+static int
+local_size_ok (cl_device_id device, const size_t *global, const size_t *local)
+{
+  unsigned i;
+  for (i = 0; i < 3; ++i)
+    {
+      if (local[i] == 0 || global[i] % local[i] != 0
+          || local[i] > device->max_work_item_sizes[i])
+        return 0;
+    }
+  return (local[0] * local[1] * local[2] <= device->max_work_group_size);
+}
+
+static void
+add_local_candidate (size_t (*locals)[3], unsigned *num_locals,
+                     cl_device_id device, const size_t *global,
+                     const size_t *local)
+{
+  unsigned i;
+  if (*num_locals == 3 || !local_size_ok (device, global, local))
+    return;
+  for (i = 0; i < *num_locals; ++i)
+    if (memcmp (locals[i], local, 3 * sizeof (size_t)) == 0)
+      return;
+  memcpy (locals[*num_locals], local, 3 * sizeof (size_t));
+  ++*num_locals;
+}
+
+/* The candidates are the heuristic local size and the ones with x (or, if
+   x cannot be varied, y) doubled and halved, each combined with the device
+   default chunk size, single work-group chunks and chunks of 64. */
+static void
+setup_candidates (pocl_autotune_entry *e, cl_device_id device,
+                  const size_t *heuristic_local)
+{
+  static const unsigned chunks[] = { 0, 1, 64 };
+  size_t locals[3][3];
+  size_t l[3];
+  unsigned num_locals = 0;
+  unsigned num_chunks = device->wg_chunking ? 3 : 1;
+  unsigned d, i, j;
+
+  add_local_candidate (locals, &num_locals, device, e->global,
+                       heuristic_local);
+  for (d = 0; d < 2 && num_locals < 3; ++d)
+    {
+      memcpy (l, heuristic_local, sizeof (l));
+      l[d] *= 2;
+      add_local_candidate (locals, &num_locals, device, e->global, l);
+      memcpy (l, heuristic_local, sizeof (l));
+      if (l[d] % 2 == 0)
+        {
+          l[d] /= 2;
+          add_local_candidate (locals, &num_locals, device, e->global, l);
+        }
+    }
+
+  e->num_candidates = 0;
+  for (i = 0; i < num_locals; ++i)
+    for (j = 0; j < num_chunks; ++j)
+      {
+        memcpy (e->local[e->num_candidates], locals[i], 3 * sizeof (size_t));
+        e->wg_chunk[e->num_candidates] = chunks[j];
+        e->time[e->num_candidates] = 0;
+        ++e->num_candidates;
+      }
+
+  /* The first launch of a new local size includes the work-group function
+     JIT compilation, so each candidate is run a few times and the fastest
+     run is kept. */
+  e->num_trials = e->num_candidates
+                  * max (1, pocl_get_int_option ("POCL_AUTOTUNE_TRIALS", 2));
+}
+
+/* Looks up a previously stored winner from the cache directory. The last
+   matching line wins. */
+static int
+load_tuned_config (pocl_autotune_entry *e, cl_device_id device)
+{
+  char *content = NULL;
+  uint64_t size;
+  char *line, *save_ptr;
+  char name[POCL_FILENAME_LENGTH];
+  size_t g[3], l[3];
+  unsigned chunk;
+  int found = 0;
+
+  if (!pocl_exists (e->db_path)
+      || pocl_read_file (e->db_path, &content, &size) != 0
+      || content == NULL)
+    return 0;
+
+  for (line = strtok_r (content, "\n", &save_ptr); line != NULL;
+       line = strtok_r (NULL, "\n", &save_ptr))
+    {
+      if (sscanf (line, "%1023s %zu %zu %zu %zu %zu %zu %u", name,
+                  &g[0], &g[1], &g[2], &l[0], &l[1], &l[2], &chunk) != 8)
+        continue;
+      if (strcmp (name, e->kernel_name) != 0
+          || memcmp (g, e->global, sizeof (g)) != 0
+          || !local_size_ok (device, e->global, l))
+        continue;
+      memcpy (e->local[0], l, sizeof (l));
+      e->wg_chunk[0] = device->wg_chunking ? chunk : 0;
+      found = 1;
+    }
+  POCL_MEM_FREE (content);
+
+  if (found)
+    {
+      e->num_candidates = 1;
+      e->winner = 0;
+      POCL_MSG_PRINT_INFO ("Autotune: using stored config for %s: local "
+                           "%zu x %zu x %zu, chunk %u\n", e->kernel_name,
+                           e->local[0][0], e->local[0][1], e->local[0][2],
+                           e->wg_chunk[0]);
+    }
+  return found;
+}
+
+static void
+store_tuned_config (pocl_autotune_entry *e)
+{
+  char line[POCL_FILENAME_LENGTH + 200];
+  int w = e->winner;
+  int bytes_written = snprintf (line, sizeof (line),
+                                "%s %zu %zu %zu %zu %zu %zu %u\n",
+                                e->kernel_name, e->global[0], e->global[1],
+                                e->global[2], e->local[w][0], e->local[w][1],
+                                e->local[w][2], e->wg_chunk[w]);
+  assert (bytes_written > 0 && bytes_written < (int)sizeof (line));
+  if (pocl_write_file (e->db_path, line, bytes_written, 1, 0))
+    POCL_MSG_WARN ("Autotune: could not write %s\n", e->db_path);
+}
+
+static pocl_autotune_entry *
+find_entry (cl_kernel kernel, cl_device_id device, const size_t *global,
+            const size_t *heuristic_local)
+{
+  pocl_autotune_entry *e;
+  cl_program program = kernel->program;
+  int device_i = pocl_cl_device_to_index (program, device);
+  assert (device_i >= 0);
+
+  LL_FOREACH (autotune_entries, e)
+    {
+      if (e->program == program
+          && memcmp (e->global, global, sizeof (e->global)) == 0
+          && strcmp (e->kernel_name, kernel->name) == 0
+          && memcmp (e->build_hash, program->build_hash[device_i],
+                     sizeof (SHA1_digest_t)) == 0)
+        return e;
+    }
+
+  e = (pocl_autotune_entry *)calloc (1, sizeof (pocl_autotune_entry));
+  if (e == NULL)
+    return NULL;
+  e->program = program;
+  memcpy (e->build_hash, program->build_hash[device_i],
+          sizeof (SHA1_digest_t));
+  e->kernel_name = strdup (kernel->name);
+  memcpy (e->global, global, sizeof (e->global));
+  pocl_cache_autotune_db_path (e->db_path, program, device_i);
+  e->winner = -1;
+
+  if (!load_tuned_config (e, device))
+    setup_candidates (e, device, heuristic_local);
+
+  LL_PREPEND (autotune_entries, e);
+  return e;
+}
+
+void *
+pocl_autotune_select (cl_kernel kernel, cl_device_id device,
+                      const size_t *global, size_t *local,
+                      unsigned *wg_chunk, unsigned *trial)
+{
+  pocl_autotune_entry *e;
+  unsigned c;
+
+  *wg_chunk = 0;
+
+  POCL_LOCK (autotune_lock);
+  e = find_entry (kernel, device, global, local);
+  if (e == NULL)
+    {
+      POCL_UNLOCK (autotune_lock);
+      return NULL;
+    }
+
+  if (e->winner >= 0)
+    {
+      memcpy (local, e->local[e->winner], 3 * sizeof (size_t));
+      *wg_chunk = e->wg_chunk[e->winner];
+      POCL_UNLOCK (autotune_lock);
+      return NULL;
+    }
+
+  /* Trials still in flight: keep using the heuristic until they finish. */
+  if (e->trials_issued == e->num_trials)
+    {
+      POCL_UNLOCK (autotune_lock);
+      return NULL;
+    }
+
+  c = e->trials_issued++ % e->num_candidates;
+  ++e->trials_in_flight;
+  memcpy (local, e->local[c], 3 * sizeof (size_t));
+  *wg_chunk = e->wg_chunk[c];
+  *trial = c;
+  POCL_UNLOCK (autotune_lock);
+
+  POCL_MSG_PRINT_INFO ("Autotune: trial %u/%u of %s: local %zu x %zu x %zu, "
+                       "chunk %u\n", e->trials_issued, e->num_trials,
+                       kernel->name, local[0], local[1], local[2], *wg_chunk);
+  return e;
+}
+
+/* Records a finished trial of candidate C and picks the winner once all
+   the trials are in. Called with autotune_lock held. */
+static void
+trial_done (pocl_autotune_entry *e, unsigned c, cl_ulong elapsed)
+{
+  unsigned i;
+
+  if (e->time[c] == 0 || elapsed < e->time[c])
+    e->time[c] = elapsed;
+
+  if (++e->trials_done < e->num_trials)
+    return;
+
+  e->winner = 0;
+  for (i = 1; i < e->num_candidates; ++i)
+    if (e->time[i] < e->time[e->winner])
+      e->winner = i;
+
+  if (e->time[e->winner] == AUTOTUNE_TIME_INFINITE)
+    {
+      POCL_MSG_PRINT_INFO ("Autotune: no trial of %s completed, keeping "
+                           "local %zu x %zu x %zu\n", e->kernel_name,
+                           e->local[0][0], e->local[0][1], e->local[0][2]);
+      return;
+    }
+
+  POCL_MSG_PRINT_INFO ("Autotune: %s tuned to local %zu x %zu x %zu, "
+                       "chunk %u (%lu ns)\n", e->kernel_name,
+                       e->local[e->winner][0], e->local[e->winner][1],
+                       e->local[e->winner][2], e->wg_chunk[e->winner],
+                       (unsigned long)e->time[e->winner]);
+  store_tuned_config (e);
+}
+
+static void
+free_entry (pocl_autotune_entry *e)
+{
+  LL_DELETE (autotune_entries, e);
+  POCL_MEM_FREE (e->kernel_name);
+  POCL_MEM_FREE (e);
+}
+
+/* Records a trial that is no longer in flight, unless its program has
+   been released already. Called with autotune_lock held. */
+static void
+trial_finished (pocl_autotune_entry *e, unsigned c, cl_ulong elapsed)
+{
+  if (e->program != NULL)
+    trial_done (e, c, elapsed);
+  if (--e->trials_in_flight == 0 && e->program == NULL)
+    free_entry (e);
+}
+
+void
+pocl_autotune_event_updated (cl_event event, int status)
+{
+  _cl_command_run *run;
+  cl_ulong elapsed;
+
+  if (status != CL_COMPLETE
+      || event->command_type != CL_COMMAND_NDRANGE_KERNEL
+      || event->command == NULL
+      || event->command->command.run.autotune_entry == NULL)
+    return;
+
+  /* The device took the timestamps before signaling the completion, see
+     POCL_EVENT_TIMED. */
+  run = &event->command->command.run;
+  elapsed = event->time_end - event->time_start;
+  if (elapsed == 0)
+    elapsed = 1;
+
+  POCL_LOCK (autotune_lock);
+  trial_finished ((pocl_autotune_entry *)run->autotune_entry,
+                  run->autotune_trial, elapsed);
+  POCL_UNLOCK (autotune_lock);
+
+  run->autotune_entry = NULL;
+}
+
+void
+pocl_autotune_trial_released (void *entry, unsigned trial)
+{
+  POCL_LOCK (autotune_lock);
+  trial_finished ((pocl_autotune_entry *)entry, trial,
+                  AUTOTUNE_TIME_INFINITE);
+  POCL_UNLOCK (autotune_lock);
+}
+
+void
+pocl_autotune_release_program (cl_program program)
+{
+  pocl_autotune_entry *e, *tmp;
+
+  POCL_LOCK (autotune_lock);
+  LL_FOREACH_SAFE (autotune_entries, e, tmp)
+    {
+      if (e->program != program)
+        continue;
+      e->program = NULL;
+      if (e->trials_in_flight == 0)
+        free_entry (e);
+    }
+  POCL_UNLOCK (autotune_lock);
+}
@@ -0,0 +1,75 @@
+/* pocl_autotune.h: online tuning of the launch configuration of kernels
+   enqueued without an explicit local size
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_AUTOTUNE_H
+#define POCL_AUTOTUNE_H
+
+#include "pocl_cl.h"
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns non-zero if POCL_AUTOTUNE is enabled. */
+int pocl_autotune_enabled ();
+
+/* Picks the launch configuration for an enqueue of KERNEL with the given
+   global size and no user-given local size. LOCAL holds the heuristically
+   chosen local size on entry and is overwritten with the configuration to
+   launch with, WG_CHUNK receives the work-group chunk size to use (0 lets
+   the device choose). If the launch is one of the tuning trials, returns
+   the tuning entry and stores the trial index to TRIAL; the caller attaches
+   both to the command so the execution time is recorded on completion.
+   Returns NULL otherwise. */
+void *pocl_autotune_select (cl_kernel kernel, cl_device_id device,
+                            const size_t *global, size_t *local,
+                            unsigned *wg_chunk, unsigned *trial);
+
+/* Called from the event update path: records the execution time of
+   completed tuning trial commands and picks the winner once all trials are
+   in. */
+void pocl_autotune_event_updated (cl_event event, int status);
+
+/* Called when a tuning trial command fails, e.g. when the enqueue or the
+   command itself fails. The trial counts as done with an infinite time, so
+   that the tuning still finishes. */
+void pocl_autotune_trial_released (void *entry, unsigned trial);
+
+/* Frees the tuning entries of PROGRAM, or marks them to be freed by their
+   last trial in flight. Called when the program is freed. */
+void pocl_autotune_release_program (cl_program program);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
@@ -50,7 +50,7 @@
 /* pocl binary identifier */
 #define POCLCC_STRING_ID "poclbin"
 #define POCLCC_STRING_ID_LENGTH 8
-#define POCLCC_VERSION 1
+#define POCLCC_VERSION 2
 
 /* pocl binary structures */
 
@@ -85,11 +85,14 @@ typedef struct pocl_binary_kernel_s
   uint32_t num_args;
   // number of kernel local variables
   uint32_t num_locals;
+  // size of the argument blob of the _workgroup launcher
+  uint64_t arg_blob_size;
 
   /* arguments and argument metadata. Note that not everything is stored
    * in the serialized binary */
   struct pocl_argument *dyn_arguments;
   struct pocl_argument_info *arg_info;
+  size_t *arg_blob_offsets;
 } pocl_binary_kernel;
 
 typedef struct pocl_binary_s
@@ -374,10 +377,12 @@ pocl_binary_serialize_kernel_to_buffer(cl_kernel kernel,
 
   BUFFER_STORE(kernel->num_args, uint32_t);
   BUFFER_STORE(kernel->num_locals, uint32_t);
+  BUFFER_STORE(kernel->arg_blob_size, uint64_t);
 
   for (i=0; i < (kernel->num_args + kernel->num_locals); i++)
     {
       BUFFER_STORE(kernel->dyn_arguments[i].size, uint64_t);
+      BUFFER_STORE(kernel->arg_blob_offsets[i], uint64_t);
     }
 
   unsigned char *start = buffer;
@@ -494,6 +499,7 @@ pocl_binary_deserialize_kernel_from_buffer (unsigned char **buf,
   BUFFER_READ_STR2(kernel->kernel_name, kernel->sizeof_kernel_name);
   BUFFER_READ(kernel->num_args, uint32_t);
   BUFFER_READ(kernel->num_locals, uint32_t);
+  BUFFER_READ(kernel->arg_blob_size, uint64_t);
 
   if (name_len > 0 && name_match)
     {
@@ -506,10 +512,17 @@ pocl_binary_deserialize_kernel_from_buffer (unsigned char **buf,
       kernel->dyn_arguments = calloc ((kernel->num_args + kernel->num_locals),
                                       sizeof(struct pocl_argument));
       POCL_RETURN_ERROR_COND ((!kernel->dyn_arguments), CL_OUT_OF_HOST_MEMORY);
+      /* At least one slot, as for the kernels compiled from IR. */
+      kernel->arg_blob_offsets =
+        calloc (max (kernel->num_args + kernel->num_locals, 1),
+                sizeof (size_t));
+      POCL_RETURN_ERROR_COND ((!kernel->arg_blob_offsets),
+                              CL_OUT_OF_HOST_MEMORY);
 
       for (i=0; i < (kernel->num_args + kernel->num_locals); i++)
         {
           BUFFER_READ (kernel->dyn_arguments[i].size, uint64_t);
+          BUFFER_READ (kernel->arg_blob_offsets[i], uint64_t);
           kernel->dyn_arguments[i].value = NULL;
         }
 
@@ -531,7 +544,8 @@ pocl_binary_deserialize_kernel_from_buffer (unsigned char **buf,
     }
   else
     {
-      buffer += ((kernel->num_args + kernel->num_locals) * sizeof (uint64_t));
+      buffer += ((kernel->num_args + kernel->num_locals)
+                 * 2 * sizeof (uint64_t));
       buffer += kernel->arginfo_size;
       buffer =
         deserialize_kernel_cachedir (basedir, buffer, kernel->binaries_size);
@@ -681,6 +695,8 @@ pocl_binary_get_kernel_metadata (unsigned char *binary, const char *kernel_name,
   kernel->num_locals = k.num_locals;
   kernel->dyn_arguments = k.dyn_arguments;
   kernel->arg_info = k.arg_info;
+  kernel->arg_blob_offsets = k.arg_blob_offsets;
+  kernel->arg_blob_size = k.arg_blob_size;
   free (k.kernel_name);
 
   POCL_RETURN_ERROR_COND ((kernel->reqd_wg_size = calloc (3, sizeof (size_t)))
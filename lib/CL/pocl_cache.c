@@ -25,6 +25,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 #include "config.h"
 #include "pocl_build_timestamp.h"
@@ -48,9 +52,24 @@
 #define POCL_PROGRAM_CL_FILENAME "/program.cl"
 /* The filename in which the program LLVM bc is stored in the program's temp dir. */
 #define POCL_PROGRAM_BC_FILENAME "/program.bc"
+/* The filename in which the autotuned launch configurations are stored. */
+#define POCL_AUTOTUNE_DB_FILENAME "/autotune.db"
+
+/* The maximum number of read-only cache layers (POCL_CACHE_LAYERS). */
+#define POCL_MAX_CACHE_LAYERS 8
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#define POCL_CACHE_LAYER_SEPARATOR ";"
+#else
+#define POCL_CACHE_LAYER_SEPARATOR ":"
+#endif
 
+/* The writable top layer of the kernel cache. */
 static char cache_topdir[POCL_FILENAME_LENGTH];
 static int cache_topdir_initialized = 0;
+/* The read-only cache layers below it, searched in order. */
+static char cache_layers[POCL_MAX_CACHE_LAYERS][POCL_FILENAME_LENGTH];
+static unsigned num_cache_layers = 0;
 
 /* sanity check on SHA1 digest emptiness */
 static unsigned buildhash_is_valid(cl_program   program, unsigned     device_i)
@@ -104,14 +123,22 @@ void pocl_cache_program_bc_path(char*        program_bc_path,
                        device_i, POCL_PROGRAM_BC_FILENAME);
 }
 
-void pocl_cache_kernel_cachedir_path (char* kernel_cachedir_path,
-                                             cl_program program,
-                                             unsigned device_i,
-                                             cl_kernel kernel,
-                                             char* append_str,
-                                             size_t local_x,
-                                             size_t local_y,
-                                             size_t local_z)
+void pocl_cache_autotune_db_path(char*        autotune_db_path,
+                                 cl_program   program,
+                                 unsigned     device_i) {
+    program_device_dir(autotune_db_path, program,
+                       device_i, POCL_AUTOTUNE_DB_FILENAME);
+}
+
+void pocl_cache_specialized_kernel_cachedir_path (char* kernel_cachedir_path,
+                                                  cl_program program,
+                                                  unsigned device_i,
+                                                  cl_kernel kernel,
+                                                  char* append_str,
+                                                  size_t local_x,
+                                                  size_t local_y,
+                                                  size_t local_z,
+                                                  const char *spec_key)
 {
   int bytes_written;
   char tempstring[POCL_FILENAME_LENGTH];
@@ -121,6 +148,13 @@ void pocl_cache_kernel_cachedir_path (char* kernel_cachedir_path,
       bytes_written = snprintf(tempstring, POCL_FILENAME_LENGTH,
                                "/%s/SPMD%s", kernel->name, append_str);
     }
+  else if (spec_key != NULL)
+    {
+      bytes_written = snprintf(tempstring, POCL_FILENAME_LENGTH,
+                               "/%s/%zu-%zu-%zu-%s%s", kernel->name,
+                               local_x, local_y, local_z, spec_key,
+                               append_str);
+    }
   else
     {
       bytes_written = snprintf(tempstring, POCL_FILENAME_LENGTH,
@@ -134,6 +168,93 @@ void pocl_cache_kernel_cachedir_path (char* kernel_cachedir_path,
 
 }
 
+void pocl_cache_kernel_cachedir_path (char* kernel_cachedir_path,
+                                             cl_program program,
+                                             unsigned device_i,
+                                             cl_kernel kernel,
+                                             char* append_str,
+                                             size_t local_x,
+                                             size_t local_y,
+                                             size_t local_z)
+{
+  pocl_cache_specialized_kernel_cachedir_path (kernel_cachedir_path, program,
+                                               device_i, kernel, append_str,
+                                               local_x, local_y, local_z,
+                                               NULL);
+}
+
+unsigned pocl_cache_evict_specialized_variants (cl_program program,
+                                                unsigned device_i,
+                                                cl_kernel kernel,
+                                                size_t local_x,
+                                                size_t local_y,
+                                                size_t local_z,
+                                                unsigned max_variants)
+{
+  unsigned count = 0;
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+  char kernel_dir[POCL_FILENAME_LENGTH];
+  char prefix[POCL_FILENAME_LENGTH];
+  char path[POCL_FILENAME_LENGTH];
+  char oldest[POCL_FILENAME_LENGTH];
+  time_t oldest_time = 0;
+  struct stat st;
+  DIR *d;
+  struct dirent *entry;
+  /* The variants are named "<local size>-<spec key>", the generic one
+     just "<local size>". */
+  int prefix_len = snprintf (prefix, POCL_FILENAME_LENGTH, "%zu-%zu-%zu-",
+                             local_x, local_y, local_z);
+  assert (prefix_len > 0 && prefix_len < POCL_FILENAME_LENGTH);
+
+  pocl_cache_kernel_cachedir (kernel_dir, program, device_i, kernel);
+  for (;;)
+    {
+      count = 0;
+      oldest[0] = 0;
+      d = opendir (kernel_dir);
+      if (d == NULL)
+        return 0;
+      while ((entry = readdir (d)))
+        {
+          if (strncmp (entry->d_name, prefix, prefix_len) != 0)
+            continue;
+          ++count;
+          /* The variants still being compiled have no last access time
+             yet and are never evicted. */
+          snprintf (path, POCL_FILENAME_LENGTH, "%s/%s%s", kernel_dir,
+                    entry->d_name, POCL_LAST_ACCESSED_FILENAME);
+          if (stat (path, &st) == 0
+              && (oldest[0] == 0 || st.st_mtime < oldest_time))
+            {
+              snprintf (oldest, POCL_FILENAME_LENGTH, "%s/%s", kernel_dir,
+                        entry->d_name);
+              oldest_time = st.st_mtime;
+            }
+        }
+      closedir (d);
+
+      if (count < max_variants || oldest[0] == 0)
+        break;
+      POCL_MSG_PRINT_INFO ("Evicting the specialized variant %s\n", oldest);
+      if (pocl_rm_rf (oldest))
+        break;
+    }
+#endif
+  return count;
+}
+
+int pocl_cache_update_variant_last_access (const char *variant_dir)
+{
+  char last_accessed_path[POCL_FILENAME_LENGTH];
+  int bytes_written = snprintf (last_accessed_path, POCL_FILENAME_LENGTH,
+                                "%s%s", variant_dir,
+                                POCL_LAST_ACCESSED_FILENAME);
+  assert (bytes_written > 0 && bytes_written < POCL_FILENAME_LENGTH);
+
+  return pocl_touch_file (last_accessed_path);
+}
+
 void pocl_cache_kernel_cachedir(char* kernel_cachedir_path, cl_program   program,
                                 unsigned device_i, cl_kernel kernel)
 {
@@ -230,6 +351,75 @@ void* pocl_cache_acquire_reader_lock(cl_program program,
 
 /******************************************************************************/
 
+/* Copies the file LAYER_PATH of a read-only layer to PATH in the writable
+   layer. The copy is written to a temporary file first so that other
+   processes never see a partial file. */
+static int copy_up_from_layer(const char *layer_path, const char *path) {
+    char *content = NULL;
+    uint64_t size = 0;
+    char dir[POCL_FILENAME_LENGTH];
+    char tmp_path[POCL_FILENAME_LENGTH];
+
+    if (pocl_read_file(layer_path, &content, &size))
+        return 0;
+
+    strcpy(dir, path);
+    char *slash = strrchr(dir, '/');
+    if (slash != NULL) {
+        *slash = 0;
+        if (pocl_mkdir_p(dir)) {
+            free(content);
+            return 0;
+        }
+    }
+
+    int bytes_written = snprintf(tmp_path, POCL_FILENAME_LENGTH,
+                                 "%s.%d.tmp", path, (int)getpid());
+    assert(bytes_written > 0 && bytes_written < POCL_FILENAME_LENGTH);
+
+    int err = pocl_write_file(tmp_path, content, size, 0, 0);
+    free(content);
+    if (err == 0)
+        err = pocl_rename(tmp_path, path);
+    if (err) {
+        pocl_remove(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+int pocl_cache_exists(const char *path) {
+    unsigned i;
+    size_t topdir_len = strlen(cache_topdir);
+
+    if (pocl_exists(path))
+        return 1;
+
+    if (num_cache_layers == 0 || strncmp(path, cache_topdir, topdir_len))
+        return 0;
+
+    for (i = 0; i < num_cache_layers; ++i) {
+        char layer_path[POCL_FILENAME_LENGTH];
+        int bytes_written = snprintf(layer_path, POCL_FILENAME_LENGTH,
+                                     "%s%s", cache_layers[i],
+                                     path + topdir_len);
+        if (bytes_written >= POCL_FILENAME_LENGTH || !pocl_exists(layer_path))
+            continue;
+        if (copy_up_from_layer(layer_path, path)) {
+            POCL_MSG_PRINT_INFO("Using %s from the cache layer %s\n",
+                                path + topdir_len, cache_layers[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+unsigned pocl_cache_num_layers() {
+    return num_cache_layers;
+}
+
+/******************************************************************************/
+
 void pocl_cache_mk_temp_name(char* path) {
     assert(cache_topdir_initialized);
 #if defined(_MSC_VER) || defined(__MINGW32__)
@@ -315,7 +505,7 @@ char* pocl_cache_read_buildlog(cl_program program,
     program_device_dir(buildlog_path, program,
                        device_i, POCL_BUILDLOG_FILENAME);
 
-    if (!pocl_exists(buildlog_path))
+    if (!pocl_cache_exists(buildlog_path))
       return strdup("");
 
     char* res=NULL;
@@ -346,12 +536,14 @@ int pocl_cache_write_kernel_parallel_bc(void*        bc,
                                         cl_kernel    kernel,
                                         size_t       local_x,
                                         size_t       local_y,
-                                        size_t       local_z) {
+                                        size_t       local_z,
+                                        const char*  spec_key) {
     assert(bc);
 
     char kernel_parallel_path[POCL_FILENAME_LENGTH];
-    pocl_cache_kernel_cachedir_path(kernel_parallel_path, program, device_i,
-                                    kernel, "", local_x, local_y, local_z);
+    pocl_cache_specialized_kernel_cachedir_path(kernel_parallel_path, program,
+                                                device_i, kernel, "", local_x,
+                                                local_y, local_z, spec_key);
     int err = pocl_mkdir_p(kernel_parallel_path);
     if (err)
       return err;
@@ -408,6 +600,11 @@ build_program_compute_hash(cl_program program,
         pocl_get_string_option("POCL_WORK_GROUP_METHOD", "");
 
     pocl_SHA1_Update(&hash_ctx, (uint8_t*) wg_method, strlen(wg_method));
+
+    /* So does replacing the async copies with prefetches. */
+    if (pocl_get_bool_option("POCL_ASYNC_COPY_PREFETCH", 0))
+      pocl_SHA1_Update(&hash_ctx, (uint8_t*) "prefetch", 8);
+
     pocl_SHA1_Update(&hash_ctx, (uint8_t*) PACKAGE_VERSION,
                      strlen(PACKAGE_VERSION));
 #ifdef POCL_KCACHE_SALT
@@ -427,6 +624,11 @@ build_program_compute_hash(cl_program program,
         pocl_SHA1_Update(&hash_ctx, (const uint8_t *)dev_hash, strlen(dev_hash));
         free(dev_hash);
       }
+    /* the binaries are linked against the kernel library variant picked
+       for this CPU, and must not be reused on a CPU of another level */
+    if (device->kernellib_variant)
+      pocl_SHA1_Update(&hash_ctx, (const uint8_t *)device->kernellib_variant,
+                       strlen(device->kernellib_variant));
 
     uint8_t digest[SHA1_DIGEST_SIZE];
     pocl_SHA1_Final(&hash_ctx, digest);
@@ -478,6 +680,38 @@ char* pocl_get_process_name()
 
 /******************************************************************************/
 
+static void init_cache_layers() {
+    const char *layers = pocl_get_string_option("POCL_CACHE_LAYERS", NULL);
+    const char *start = layers;
+
+    if (layers == NULL)
+        return;
+
+    while (*start != '\0' && num_cache_layers < POCL_MAX_CACHE_LAYERS) {
+        size_t len = strcspn(start, POCL_CACHE_LAYER_SEPARATOR);
+        if (len > 0 && len < POCL_FILENAME_LENGTH) {
+            char *layer = cache_layers[num_cache_layers];
+            size_t layer_len = len;
+            memcpy(layer, start, len);
+            layer[len] = 0;
+            while (layer_len > 1 && layer[layer_len - 1] == '/')
+                layer[--layer_len] = 0;
+            if (!pocl_exists(layer))
+                POCL_MSG_WARN("Ignoring the nonexistent cache layer %s\n",
+                              layer);
+            else if (strcmp(layer, cache_topdir) != 0)
+                ++num_cache_layers;
+        }
+        start += len;
+        if (*start != '\0')
+            ++start;
+    }
+
+    if (*start != '\0')
+        POCL_MSG_WARN("Using only the first %u cache layers\n",
+                      POCL_MAX_CACHE_LAYERS);
+}
+
 void pocl_cache_init_topdir() {
 
     if (cache_topdir_initialized)
@@ -534,6 +768,7 @@ void pocl_cache_init_topdir() {
     assert(strlen(cache_topdir) > 0);
     if (pocl_mkdir_p(cache_topdir))
         POCL_ABORT("Could not create topdir %s for cache\n", cache_topdir);
+    init_cache_layers();
     cache_topdir_initialized = 1;
 
 }
@@ -47,6 +47,7 @@
 #include "pocl_debug.h"
 #include "pocl_hash.h"
 #include "pocl_runtime_config.h"
+#include "pocl_signal.h"
 #include "common.h"
 
 #if __STDC_VERSION__ < 199901L
@@ -182,6 +183,9 @@ typedef pthread_mutex_t pocl_lock_t;
 typedef struct pocl_argument {
   uint64_t size;
   void *value;
+  /* The value of a pointer argument is a raw SVM pointer set with
+     clSetKernelArgSVMPointer() instead of a cl_mem. */
+  int is_svm;
 } pocl_argument;
 
 
@@ -206,6 +210,9 @@ typedef struct pocl_argument_info {
   pocl_argument_type type;
   char is_local;
   char is_set;
+  /* The work-group functions are specialized on the value of the argument,
+     see -pocl-specialize-args. */
+  char specialize;
 } pocl_argument_info;
 
 struct pocl_device_ops {
@@ -453,6 +460,9 @@ struct _cl_device_id {
   void *data;
   const char* llvm_target_triplet; /* the llvm target triplet to use */
   const char* llvm_cpu; /* the llvm CPU variant to use */
+  /* the build of the host kernel library selected for the CPU at runtime,
+     NULL if the kernel library is built only for llvm_cpu */
+  const char *kernellib_variant;
   /* A running number (starting from zero) across all the device instances.
      Used for indexing arrays in data structures with device specific
      entries. */
@@ -463,6 +473,14 @@ struct _cl_device_id {
   int has_64bit_long;  /* Does the device have 64bit longs */
   /* Convert automatic local variables to kernel arguments? */
   int autolocals_to_args;
+  /* True if the device hands out the work-groups of an NDRange to its
+     workers in chunks, the size of which can be tuned per launch. */
+  int wg_chunking;
+  /* True if the device can execute the in-order queue fast path, where
+     the commands depending only on their predecessor in the queue are fed
+     from the queue's stream ring without event synchronizations.
+     ops->submit must not complete the command synchronously. */
+  int in_order_streams;
 
   /* The target specific IDs for the different OpenCL address spaces. */
   unsigned global_as_id;
@@ -491,6 +509,7 @@ struct _cl_device_id {
 #define DEVICE_SVM_FINEGR(dev) (dev->svm_caps & (CL_DEVICE_SVM_FINE_GRAIN_BUFFER \
                                               | CL_DEVICE_SVM_FINE_GRAIN_SYSTEM))
 #define DEVICE_SVM_ATOM(dev) (dev->svm_caps & CL_DEVICE_SVM_ATOMICS)
+#define DEVICE_SVM_SYSTEM(dev) (dev->svm_caps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM)
 
 #define DEVICE_IS_SVM_CAPABLE(dev) (dev->svm_caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER)
 
@@ -534,6 +553,23 @@ struct _pocl_data_sync_item {
   pocl_data_sync_item *volatile next;
 };
 
+/* Size of the in-order command stream ring of a command queue. */
+#define POCL_IN_ORDER_STREAM_SIZE 64
+
+/* Single-producer/single-consumer ring of the commands of an in-order
+   queue which have no other dependencies than the previous command.
+   The host enqueues at tail (under the queue lock), the device
+   advances head when the command at head completes and submits the
+   next one. count is the number of commands in the ring, including the
+   one being executed. */
+typedef struct _pocl_in_order_stream pocl_in_order_stream;
+struct _pocl_in_order_stream {
+  _cl_command_node *volatile ring[POCL_IN_ORDER_STREAM_SIZE];
+  volatile unsigned head;
+  volatile unsigned tail;
+  volatile unsigned count;
+};
+
 struct _cl_event;
 struct _cl_command_queue {
   POCL_ICD_OBJECT
@@ -542,11 +578,16 @@ struct _cl_command_queue {
   cl_context context;
   cl_device_id device;
   cl_command_queue_properties properties;
+  /* cl_khr_priority_hints priority, a hint to the device scheduler */
+  cl_queue_priority_khr priority;
   /* implementation */
   cl_event events; /* events of the enqueued commands in enqueue order */
   struct _cl_event * volatile barrier;
   volatile int command_count; /* counter for unfinished command enqueued */
   volatile pocl_data_sync_item last_event;
+  pocl_in_order_stream stream;
+  /* advanced by the device when command_count drops to zero */
+  pocl_signal finished;
 
   /* backend specific data */
   void *data;
@@ -586,6 +627,9 @@ struct _cl_mem {
   /* device that allocated, and is going to free, 
      the shared system mem allocation */
   cl_device_id shared_mem_allocation_owner;
+  /* The device uses the application's host memory in place of a copy
+     (POCL_ZERO_COPY_READ_ONLY), thus the buffer must not be written to */
+  int zero_copy_read_only;
   /* device where this mem obj resides */
   volatile cl_device_id owning_device;
   /* latest event assosiated with the buffer, set NULL when event completed */
@@ -638,6 +682,9 @@ struct _cl_program {
   char *source;
   /* The options in the last clBuildProgram call for this Program. */
   char *compiler_options;
+  /* The comma separated names of the scalar kernel arguments to specialize
+     the work-group functions on (-pocl-specialize-args=), or NULL. */
+  char *specialize_args;
   /* The binaries for each device.  Currently the binary is directly the
      sequential bitcode produced from the kernel sources.  */
   size_t *binary_sizes;
@@ -687,6 +734,12 @@ struct _cl_kernel {
   /* The kernel arguments that are set with clSetKernelArg().
      These are copied to the command queue command at enqueue. */
   struct pocl_argument *dyn_arguments;
+  /* Offsets of the argument and automatic local slots in the argument
+     blob, see layoutArgBlob() in LLVMUtils.h, and the size of the blob.
+     The argument values are copied to a blob of this layout at enqueue
+     and the _workgroup launchers read their arguments from one. */
+  size_t *arg_blob_offsets;
+  size_t arg_blob_size;
   struct _cl_kernel *next;
 
   /* backend specific data */
@@ -732,6 +785,8 @@ struct _cl_event {
 
   /* The execution status of the command this event is monitoring. */
   volatile cl_int status;
+  /* advanced by the device when the status becomes CL_COMPLETE */
+  pocl_signal completion;
 
   /* Profiling data: time stamps of the different phases of execution. */
   cl_ulong time_queue;  /* the enqueue time */
@@ -743,6 +798,9 @@ struct _cl_event {
 
   /* impicit event = an event for pocl's internal use, not visible to user */
   int implicit_event;
+  /* the command is ordered by the in-order stream of its queue instead of
+     an event synchronization to the previous command */
+  int in_order_stream;
   _cl_event * volatile next;
   _cl_event * volatile prev;
 };
@@ -758,6 +816,16 @@ struct _cl_sampler {
   cl_filter_mode      filter_mode;
 };
 
+/* The devices take the start and end timestamps of the commands of the
+   profiling queues, and of the kernel launches that are autotuning trials
+   whatever the queue, before signaling the completion. */
+#define POCL_EVENT_TIMED(__event)                                       \
+  (((__event)->queue != NULL                                            \
+    && ((__event)->queue->properties & CL_QUEUE_PROFILING_ENABLE))      \
+   || ((__event)->command_type == CL_COMMAND_NDRANGE_KERNEL             \
+       && (__event)->command != NULL                                    \
+       && (__event)->command->command.run.autotune_entry != NULL))
+
 #define POCL_UPDATE_EVENT_QUEUED(__event)                               \
   do {                                                                  \
     if ((__event) != NULL && (*(__event)) != NULL)                      \
@@ -803,7 +871,7 @@ struct _cl_sampler {
           (__cq)->device->ops->update_event((__cq)->device, (*(__event)), CL_RUNNING);    \
         else {                                                          \
           (*(__event))->status = CL_RUNNING;                            \
-          if (__cq && __cq->properties & CL_QUEUE_PROFILING_ENABLE)     \
+          if (__cq && POCL_EVENT_TIMED (*(__event)))                    \
             (*(__event))->time_start =                                  \
               __cq->device->ops->get_timer_value(__cq->device->data);   \
         }                                                               \
@@ -824,13 +892,14 @@ struct _cl_sampler {
           pocl_mem_objs_cleanup ((*__event));                           \
           POCL_LOCK_OBJ (*(__event));                                   \
           (*(__event))->status = CL_COMPLETE;                           \
-          if ((__cq)->properties & CL_QUEUE_PROFILING_ENABLE){          \
+          if (POCL_EVENT_TIMED (*(__event))){                           \
             (*(__event))->time_end =                                    \
             (__cq)->device->ops->get_timer_value((__cq)->device->data); \
           }                                                             \
           (__cq)->device->ops->broadcast(*(__event));                   \
           POCL_UNLOCK_OBJ (*(__event));                                 \
           pocl_update_command_queue(*(__event));                        \
+          pocl_in_order_stream_completed(*(__event));                   \
         }                                                               \
         pocl_event_updated(*(__event), CL_COMPLETE);                    \
         POname(clReleaseEvent) (*(__event));                            \
@@ -34,17 +34,19 @@ pocl_rm_rf(const char* path)
         {
           char *buf;
           if (!strcmp(p->d_name, ".") || !strcmp(p->d_name, ".."))
-            continue;
+            {
+              p = readdir(d);
+              continue;
+            }
           
           size_t len = path_len + strlen(p->d_name) + 2;
           buf = malloc(len);
-          buf[len] = '\0';
           if (buf)
             {
               struct stat statbuf;
               snprintf(buf, len, "%s/%s", path, p->d_name);
               
-              if (!stat(buf, &statbuf))
+              if (!lstat(buf, &statbuf) && S_ISDIR(statbuf.st_mode))
                 error = pocl_rm_rf(buf);
               else 
                 error = remove(buf);
@@ -70,6 +70,14 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
                                           cl_kernel kernel, size_t local_x,
                                           size_t local_y, size_t local_z);
 
+/* As above, with the image format and sampler kernel arguments of SPEC
+ * folded to constants in the work-group function, which is stored in
+ * the kernel cache directory of the SPEC key.
+ */
+int pocl_llvm_generate_specialized_workgroup_function
+  (cl_device_id device, cl_kernel kernel, size_t local_x, size_t local_y,
+   size_t local_z, const pocl_kernel_specialization *spec);
+
 /**
  * Free the LLVM IR of a program for a given device
  */
@@ -68,6 +68,7 @@ using llvm::legacy::PassManager;
 #include "llvm/PassAnalysisSupport.h"
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/DataLayout.h"
@@ -91,7 +92,10 @@ using llvm::legacy::PassManager;
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <vector>
+#include <deque>
+#include <set>
 #include <sstream>
 #include <string>
 #include <cstdio>
@@ -105,6 +109,7 @@ using llvm::legacy::PassManager;
 #include "linker.h"
 #include "pocl_file_util.h"
 #include "pocl_cache.h"
+#include "pocl_util.h"
 #include "TargetAddressSpaces.h"
 
 using namespace clang;
@@ -497,7 +502,7 @@ int pocl_llvm_build_program(cl_program program,
 
   POCL_MEM_FREE(PreprocessedOut);
 
-  if (pocl_exists(program_bc_path)) {
+  if (pocl_cache_exists(program_bc_path)) {
     unlink_source(fe);
     return CL_SUCCESS;
   }
@@ -982,6 +987,7 @@ int pocl_llvm_get_kernel_metadata(cl_program program,
     {
       kernel->dyn_arguments[i].value = NULL;
       kernel->dyn_arguments[i].size = 0;
+      kernel->dyn_arguments[i].is_svm = 0;
     }
 
   /* Fill up automatic local arguments. */
@@ -991,6 +997,7 @@ int pocl_llvm_get_kernel_metadata(cl_program program,
         TD->getTypeAllocSize(locals[i]->getInitializer()->getType());
       kernel->dyn_arguments[kernel->num_args + i].value = NULL;
       kernel->dyn_arguments[kernel->num_args + i].size = auto_local_size;
+      kernel->dyn_arguments[kernel->num_args + i].is_svm = 0;
 #ifdef DEBUG_POCL_LLVM_API
       printf("### automatic local %d size %u\n", i, auto_local_size);
 #endif
@@ -1039,6 +1046,25 @@ int pocl_llvm_get_kernel_metadata(cl_program program,
     }
     i++;
   }
+
+  /* Lay out the argument blob like the _workgroup launchers do: the
+     arguments, then the automatic locals passed as pointers. */
+  std::vector<llvm::Type *> SlotTypes;
+  for (llvm::Function::const_arg_iterator ii = KernelFunction->arg_begin(),
+                                          ee = KernelFunction->arg_end();
+       ii != ee; ii++)
+    SlotTypes.push_back(pocl::argBlobSlotType(*ii));
+  for (unsigned i = 0; i < kernel->num_locals; ++i)
+    SlotTypes.push_back(locals[i]->getType());
+
+  std::vector<size_t> Offsets;
+  kernel->arg_blob_size = pocl::layoutArgBlob(SlotTypes, *TD, Offsets);
+  // At least one slot, so that the offsets are allocated for kernels
+  // without arguments too.
+  kernel->arg_blob_offsets = (size_t *)calloc(
+      std::max(kernel->num_args + kernel->num_locals, 1u), sizeof(size_t));
+  for (unsigned i = 0; i < kernel->num_args + kernel->num_locals; ++i)
+    kernel->arg_blob_offsets[i] = Offsets[i];
   // fill 'kernel->reqd_wg_size'
   kernel->reqd_wg_size = (size_t *)malloc(3 * sizeof(size_t));
 
@@ -1098,7 +1124,7 @@ int pocl_llvm_get_kernel_metadata(cl_program program,
 
   content << std::endl << "#include <pocl_device.h>" << std::endl
           << "void _pocl_launcher_" << kernel_name
-          << "_workgroup(void** args, struct pocl_context*);" << std::endl
+          << "_workgroup(void* args, struct pocl_context*);" << std::endl
           << "void _pocl_launcher_" << kernel_name
           << "_workgroup_fast(void** args, struct pocl_context*);" << std::endl;
 
@@ -1186,37 +1212,6 @@ static llvm::TargetOptions GetTargetOptions() {
   return Options;
 }
 
-/* for "distro" style kernel libs, return which kernellib to use, at runtime */
-#ifdef KERNELLIB_HOST_DISTRO_VARIANTS
-static const char* getX86KernelLibName() {
-  StringMap<bool> Features;
-  llvm::sys::getHostCPUFeatures(Features);
-  const char *res = NULL;
-
-  if (Features["sse2"])
-    res = "sse2";
-  else
-    POCL_ABORT("Pocl on x86_64 requires at least SSE2");
-  if (Features["ssse3"] && Features["cx16"])
-    res = "ssse3";
-  if (Features["sse4.1"] && Features["cx16"])
-    res = "sse41";
-  if (Features["avx"] && Features["cx16"] && Features["popcnt"])
-    res = "avx";
-  if (Features["avx"] && Features["cx16"] && Features["popcnt"]
-      && Features["xop"] && Features["fma4"])
-    res = "avx_fma4";
-  if (Features["avx"] && Features["avx2"] && Features["cx16"]
-      && Features["popcnt"] && Features["lzcnt"] && Features["f16c"]
-      && Features["fma"] && Features["bmi"] && Features["bmi2"])
-    res = "avx2";
-  if (Features["avx512f"] )
-    res = "avx512";
-
-  return res;
-}
-#endif
-
 // Returns the TargetMachine instance or zero if no triple is provided.
 static TargetMachine* GetTargetMachine(cl_device_id device,
  const std::vector<std::string>& MAttrs=std::vector<std::string>()) {
@@ -1275,6 +1270,78 @@ static void InitializeLLVM() {
   LLVMInitialized = true;
 }
 
+static llvm::Module* kernel_library(cl_device_id device,
+                                    bool relaxed_math = false);
+
+// The names of the vector variants the loop vectorizer knows about.
+static std::set<std::string> vector_variant_names;
+
+#ifndef LLVM_OLDER_THAN_3_8
+/**
+ * Tell the loop vectorizer about the vector variants of the scalar math
+ * builtins in the kernel library (e.g. _cl_sin(float8) for _cl_sin(float)),
+ * so it can vectorize work-item loops calling them. The linker copies the
+ * variants to the kernel module along with the scalar builtins.
+ */
+static void
+add_vector_variant_mappings(TargetLibraryInfoImpl &TLII, llvm::Module *lib)
+{
+  // The VecDescs refer to the names, keep them alive. A deque does not
+  // move its elements when growing.
+  static std::deque<std::string> names;
+  std::vector<VecDesc> descs;
+
+  for (llvm::Module::iterator i = lib->begin(), e = lib->end(); i != e; ++i) {
+    llvm::Function &F = *i;
+    if (F.isDeclaration())
+      continue;
+    for (unsigned width = 2; width <= 16; width *= 2) {
+      llvm::Function *vecF = pocl::findVectorVariant(*lib, F, width);
+      if (vecF == NULL)
+        continue;
+      names.push_back(F.getName().str());
+      const char *scalar_name = names.back().c_str();
+      names.push_back(vecF->getName().str());
+      vector_variant_names.insert(names.back());
+      VecDesc desc = {scalar_name, names.back().c_str(), width};
+      descs.push_back(desc);
+    }
+  }
+  TLII.addVectorizableFunctions(descs);
+}
+#endif
+
+/**
+ * For POCL_VECTORIZER_REMARKS, tell which vector variants of the builtins
+ * the functions of the compiled kernel module M call, other than the
+ * variants themselves.
+ */
+static void
+print_vector_variant_calls(llvm::Module *M)
+{
+  std::set<std::pair<std::string, std::string> > printed;
+
+  for (llvm::Module::iterator i = M->begin(), e = M->end(); i != e; ++i) {
+    llvm::Function &F = *i;
+    if (F.isDeclaration() || vector_variant_names.count(F.getName().str()))
+      continue;
+    for (llvm::Function::iterator bb = F.begin(); bb != F.end(); ++bb) {
+      for (llvm::BasicBlock::iterator ii = bb->begin(); ii != bb->end();
+           ++ii) {
+        llvm::CallInst *call = dyn_cast<llvm::CallInst>(&*ii);
+        if (call == NULL || call->getCalledFunction() == NULL)
+          continue;
+        std::string callee = call->getCalledFunction()->getName().str();
+        if (vector_variant_names.count(callee) == 0 ||
+            !printed.insert(std::make_pair(F.getName().str(), callee)).second)
+          continue;
+        std::cerr << "pocl: " << F.getName().str()
+                  << " calls the vector variant " << callee << std::endl;
+      }
+    }
+  }
+}
+
 /**
  * Prepare the kernel compiler passes.
  *
@@ -1358,6 +1425,9 @@ static PassManager& kernel_compiler_passes
 #else
   TargetLibraryInfoImpl TLII(triple);
   TLII.disableAllFunctions();
+#ifndef LLVM_OLDER_THAN_3_8
+  add_vector_variant_mappings(TLII, kernel_library(device));
+#endif
   Passes->add(new TargetLibraryInfoWrapperPass(TLII));
 #endif
 
@@ -1377,7 +1447,20 @@ static PassManager& kernel_compiler_passes
 
      -phistoallocas before -workitemloops as otherwise it cannot inject context
      restore code (PHIs need to be at the beginning of the BB and so one cannot
-     context restore them with non-PHI code if the value is needed in another PHI). */
+     context restore them with non-PHI code if the value is needed in another PHI).
+
+     -lower-local-atomics only for non-SPMD devices where the work-items of a
+     work-group never run concurrently, after inlining so the atomics in the
+     kernel library builtins are seen as local.
+
+     -specialize-kernel-args after inlining so the image format and sampler
+     loads of the kernel library builtins are seen in the kernel, before the
+     work-item passes so the folded format switches do not end up in them
+     and the loops with specialized trip counts are seen as such.
+
+     -prefetch-async-copies before -automatic-locals and the inlining as it
+     recognizes the automatic local buffers and the async copy calls of the
+     kernel itself. */
 
   std::vector<std::string> passes;
   passes.push_back("remove-optnone");
@@ -1385,6 +1468,8 @@ static PassManager& kernel_compiler_passes
   passes.push_back("workitem-handler-chooser");
   passes.push_back("mem2reg");
   passes.push_back("domtree");
+  if (!SPMDDevice)
+    passes.push_back("prefetch-async-copies");
   if (device->autolocals_to_args)
 	  passes.push_back("automatic-locals");
   if (SPMDDevice)
@@ -1394,6 +1479,8 @@ static PassManager& kernel_compiler_passes
   passes.push_back("always-inline");
   passes.push_back("globaldce");
   if (!SPMDDevice) {
+    passes.push_back("specialize-kernel-args");
+    passes.push_back("lower-local-atomics");
     passes.push_back("simplifycfg");
     passes.push_back("loop-simplify");
     passes.push_back("uniformity");
@@ -1446,14 +1533,18 @@ static PassManager& kernel_compiler_passes
     // with different options to different devices at one run.
 
     llvm::cl::Option *O = nullptr;
-    if (wg_method == "loopvec") {
+    if (wg_method == "loopvec" || wg_method == "wfv") {
 
-      passes.push_back("scalarizer");
+      // The 'wfv' method has vectorized the work-item loops explicitly,
+      // the LLVM vectorizers are left to deal with the rest.
+      if (wg_method == "loopvec") {
+        passes.push_back("scalarizer");
 
-      O = opts["scalarize-load-store"];
-      assert(O && "could not find LLVM option 'scalarize-load-store'");
-      O->addOccurrence(1, StringRef("scalarize-load-store"),
-                       StringRef("1"), false);
+        O = opts["scalarize-load-store"];
+        assert(O && "could not find LLVM option 'scalarize-load-store'");
+        O->addOccurrence(1, StringRef("scalarize-load-store"),
+                         StringRef("1"), false);
+      }
 
       // LLVM inner loop vectorizer does not check whether the loop inside
       // another loop, in which case even a small trip count loops might be
@@ -1508,7 +1599,7 @@ static PassManager& kernel_compiler_passes
 
           // These need to be setup in addition to invoking the passes
           // to get the vectorizers initialized properly.
-          if (wg_method == "loopvec") {
+          if (wg_method == "loopvec" || wg_method == "wfv") {
             Builder.LoopVectorize = true;
             Builder.SLPVectorize = true;
 #ifdef LLVM_OLDER_THAN_3_7
@@ -1551,25 +1642,33 @@ namespace pocl {
     extern size_t WGLocalSizeY;
     extern size_t WGLocalSizeZ;
     extern bool WGDynamicLocalSize;
-} 
+}
+
+// Defined in llvmopencl/SpecializeKernelArgs.cc
+namespace pocl {
+    extern const pocl_kernel_specialization *KernelSpecialization;
+}
 
 /**
  * Return the OpenCL C built-in function library bitcode
- * for the given device.
+ * for the given device. With relaxed_math, the variant with
+ * reduced-precision math builtins is returned when there is one.
  */
 static llvm::Module*
 kernel_library
-(cl_device_id device)
+(cl_device_id device, bool relaxed_math)
 {
   llvm::MutexGuard lockHolder(kernelCompilerLock);
   InitializeLLVM();
 
-  static std::map<cl_device_id, llvm::Module*> libs;
+  typedef std::pair<cl_device_id, bool> lib_key;
+  static std::map<lib_key, llvm::Module*> libs;
 
   Triple triple(device->llvm_target_triplet);
 
-  if (libs.find(device) != libs.end())
-    return libs[device];
+  lib_key key(device, relaxed_math);
+  if (libs.find(key) != libs.end())
+    return libs[key];
 
   const char *subdir = "host";
   bool is_host = true;
@@ -1614,12 +1713,9 @@ kernel_library
       kernellib_fallback = kernellib;
       kernellib_fallback += OCL_KERNEL_TARGET_CPU;
       kernellib_fallback += ".bc";
-#ifdef KERNELLIB_HOST_DISTRO_VARIANTS
-      if (triple.getArch() == Triple::x86_64 ||
-          triple.getArch() == Triple::x86)
-        kernellib += getX86KernelLibName();
+      if (device->kernellib_variant)
+        kernellib += device->kernellib_variant;
       else
-#endif
         kernellib += device->llvm_cpu;
     }
   } else { // POCL_BUILDING == 0, use install dir
@@ -1631,16 +1727,22 @@ kernel_library
       kernellib_fallback = kernellib;
       kernellib_fallback += OCL_KERNEL_TARGET_CPU;
       kernellib_fallback += ".bc";
-#ifdef KERNELLIB_HOST_DISTRO_VARIANTS
-      if (triple.getArch() == Triple::x86_64 ||
-          triple.getArch() == Triple::x86)
-        kernellib += getX86KernelLibName();
+      if (device->kernellib_variant)
+        kernellib += device->kernellib_variant;
       else
-#endif
         kernellib += device->llvm_cpu;
     }
   }
-  kernellib += ".bc";
+  /* The host libraries have a reduced-precision variant when built with
+     vecmathlib. */
+  if (relaxed_math && is_host) {
+    std::string relaxed = kernellib + "-relaxed.bc";
+    if (pocl_exists(relaxed.c_str()))
+      kernellib = relaxed;
+    else
+      kernellib += ".bc";
+  } else
+    kernellib += ".bc";
 
   llvm::Module *lib;
   SMDiagnostic Err;
@@ -1662,7 +1764,7 @@ kernel_library
         POCL_ABORT("Kernel library file %s doesn't exist.", kernellib.c_str());
     }
   assert (lib != NULL);
-  libs[device] = lib;
+  libs[key] = lib;
 
   return lib;
 }
@@ -1673,6 +1775,13 @@ extern cl::opt<std::string> KernelName;
 int pocl_llvm_generate_workgroup_function(cl_device_id device,
                                           cl_kernel kernel, size_t local_x,
                                           size_t local_y, size_t local_z) {
+  return pocl_llvm_generate_specialized_workgroup_function
+    (device, kernel, local_x, local_y, local_z, NULL);
+}
+
+int pocl_llvm_generate_specialized_workgroup_function
+  (cl_device_id device, cl_kernel kernel, size_t local_x, size_t local_y,
+   size_t local_z, const pocl_kernel_specialization *spec) {
 
   pocl::WGDynamicLocalSize = (local_x == 0 && local_y == 0 && local_z == 0);
 
@@ -1682,17 +1791,27 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
   int device_i = pocl_cl_device_to_index(program, device);
   assert(device_i >= 0);
 
+  const char *spec_key = (spec != NULL) ? spec->key : NULL;
+
   char parallel_bc_path[POCL_FILENAME_LENGTH];
-  pocl_cache_work_group_function_path(parallel_bc_path, program, device_i, kernel, local_x, local_y, local_z);
+  pocl_cache_specialized_kernel_cachedir_path(parallel_bc_path, program,
+                                              device_i, kernel,
+                                              (char*)POCL_PARALLEL_BC_FILENAME,
+                                              local_x, local_y, local_z,
+                                              spec_key);
 
-  if (pocl_exists(parallel_bc_path))
+  if (pocl_cache_exists(parallel_bc_path))
     return CL_SUCCESS;
 
-  char final_binary_path[POCL_FILENAME_LENGTH];
-  pocl_cache_final_binary_path(final_binary_path, program, device_i, kernel, local_x, local_y, local_z);
+  // The prebuilt binaries are never specialized.
+  if (spec == NULL) {
+    char final_binary_path[POCL_FILENAME_LENGTH];
+    pocl_cache_final_binary_path(final_binary_path, program, device_i,
+                                 kernel, local_x, local_y, local_z);
 
-  if (pocl_exists(final_binary_path))
-    return CL_SUCCESS;
+    if (pocl_cache_exists(final_binary_path))
+      return CL_SUCCESS;
+  }
 
   llvm::MutexGuard lockHolder(kernelCompilerLock);
   InitializeLLVM();
@@ -1750,7 +1869,8 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
 
   // Later this should be replaced with indexed linking of source code
   // and/or bitcode for each kernel.
-  llvm::Module *libmodule = kernel_library(device);
+  llvm::Module *libmodule =
+    kernel_library(device, pocl_program_relaxed_math(program));
   assert (libmodule != NULL);
   link(input, libmodule);
 
@@ -1759,6 +1879,7 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
   pocl::WGLocalSizeX = local_x;
   pocl::WGLocalSizeY = local_y;
   pocl::WGLocalSizeZ = local_z;
+  pocl::KernelSpecialization = spec;
   KernelName = kernel->name;
 
 #ifdef LLVM_OLDER_THAN_3_7
@@ -1771,10 +1892,15 @@ int pocl_llvm_generate_workgroup_function(cl_device_id device,
       input->getDataLayout().getStringRepresentation())
       .run(*input);
 #endif
+  if (pocl_get_bool_option("POCL_VECTORIZER_REMARKS", 0) == 1)
+    print_vector_variant_calls(input);
 
   // TODO: don't write this once LLC is called via API, not system()
+  pocl::KernelSpecialization = NULL;
+
   int error = pocl_cache_write_kernel_parallel_bc(input, program, device_i,
-                                  kernel, local_x, local_y, local_z);
+                                  kernel, local_x, local_y, local_z,
+                                  spec_key);
   assert(error == 0);
 
   delete input;
@@ -1791,7 +1917,7 @@ pocl_update_program_llvm_irs(cl_program program,
   llvm::MutexGuard lockHolder(kernelCompilerLock);
   pocl_cache_program_bc_path(program_bc_path, program, device_i);
 
-  if (!pocl_exists(program_bc_path))
+  if (!pocl_cache_exists(program_bc_path))
     return -1;
 
   program->llvm_irs[device_i] =
@@ -75,6 +75,8 @@ cl_event pocl_mem_manager_new_event ()
 
   ev = (struct _cl_event*) calloc (1, sizeof (struct _cl_event));
   POCL_INIT_OBJECT(ev);
+  /* The events are recycled, not freed, so the signal lives as long. */
+  pocl_signal_init (&ev->completion);
   ev->pocl_refcount = 1;
   return ev;
 }
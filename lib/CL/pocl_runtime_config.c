@@ -22,79 +22,232 @@
 */
 
 #include "pocl_runtime_config.h"
-#include "utlist.h"
 #include "pocl_cl.h"
 
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* TODO: cache the options and to avoid calling getenv more than once 
-   per option. */
+#ifdef _MSC_VER
+#define environ _environ
+#else
+extern char **environ;
+#endif
 
-typedef struct env_data env_data;
-struct env_data
+/* The runtime configuration is read once, from the POCL_* environment
+   variables and the optional configuration file named by
+   POCL_CONFIG_FILE, to an immutable snapshot. The environment overrides
+   the file. The snapshot is published with a single atomic store after
+   which the options are looked up without locking. */
+
+/* Options are "KEY=VALUE" lines, '#' starts a comment line. */
+#define POCL_CONFIG_FILE_ENV "POCL_CONFIG_FILE"
+#define POCL_OPTION_PREFIX "POCL_"
+
+typedef enum
+{
+  POCL_OPTION_FROM_FILE,
+  POCL_OPTION_FROM_ENV
+} pocl_option_source;
+
+typedef struct pocl_option pocl_option;
+struct pocl_option
 {
-  char *env;
+  char *key;
   char *value;
-  env_data *next;
+  /* the value parsed as an integer and as a boolean */
+  int int_value;
+  int bool_value;
+  pocl_option_source source;
+};
+
+typedef struct pocl_config pocl_config;
+struct pocl_config
+{
+  /* sorted by the key */
+  pocl_option *options;
+  unsigned num_options;
+  unsigned capacity;
+  /* the configuration file and whether it could be read */
+  char *file;
+  int file_error;
 };
 
-static env_data *volatile env_cache = 0;
+static pocl_config *config = NULL;
 static pocl_lock_t lock = POCL_LOCK_INITIALIZER;
 
-static env_data* find_env (env_data* cache, const char* key)
+static int
+compare_options (const void *a, const void *b)
 {
-  env_data* ed;
-  char *value;
+  return strcmp (((const pocl_option *)a)->key, ((const pocl_option *)b)->key);
+}
+
+static pocl_option *
+find_option (const pocl_config *c, const char *key)
+{
+  pocl_option k;
+  k.key = (char *)key;
+  return (pocl_option *)bsearch (&k, c->options, c->num_options,
+                                 sizeof (pocl_option), compare_options);
+}
 
-  POCL_LOCK(lock);
-  LL_FOREACH(cache, ed)
+/* Adds or overrides the option KEY, of which LEN characters are used. */
+static void
+set_option (pocl_config *c, const char *key, size_t len, const char *value,
+            pocl_option_source source)
+{
+  unsigned i;
+  pocl_option *o = NULL;
+
+  for (i = 0; i < c->num_options; ++i)
+    if (strncmp (c->options[i].key, key, len) == 0
+        && c->options[i].key[len] == 0)
+      {
+        o = &c->options[i];
+        free (o->value);
+        break;
+      }
+  if (o == NULL)
     {
-      if (strcmp(ed->env, key) == 0)
+      if (c->num_options == c->capacity)
         {
-          POCL_UNLOCK(lock);
-          return ed;
+          c->capacity = c->capacity ? c->capacity * 2 : 32;
+          c->options = (pocl_option *)realloc (
+              c->options, c->capacity * sizeof (pocl_option));
         }
+      o = &c->options[c->num_options++];
+      o->key = strndup (key, len);
     }
-  if ((value = getenv(key)))
+  o->value = strdup (value);
+  o->int_value = atoi (value);
+  o->bool_value = (strncmp (value, "1", 1) == 0);
+  o->source = source;
+}
+
+static void
+read_config_file (pocl_config *c, const char *path)
+{
+  char line[1024];
+  FILE *f = fopen (path, "r");
+
+  c->file = strdup (path);
+  if (f == NULL)
     {
-      ed = (env_data*) malloc (sizeof (env_data));
-      ed->env = strdup (key);
-      ed->value = strdup (value);
-      ed->next = NULL;
-      LL_PREPEND(env_cache, ed);
-      POCL_UNLOCK(lock);
-      return ed;
+      c->file_error = 1;
+      return;
+    }
+
+  while (fgets (line, sizeof (line), f) != NULL)
+    {
+      char *start = line, *end, *eq;
+      while (isspace ((unsigned char)*start))
+        ++start;
+      if (*start == '#' || *start == 0)
+        continue;
+      end = start + strlen (start);
+      while (end > start && isspace ((unsigned char)end[-1]))
+        *--end = 0;
+      eq = strchr (start, '=');
+      if (eq == NULL || eq == start)
+        {
+          c->file_error = 1;
+          continue;
+        }
+      end = eq;
+      while (end > start && isspace ((unsigned char)end[-1]))
+        --end;
+      ++eq;
+      while (isspace ((unsigned char)*eq))
+        ++eq;
+      set_option (c, start, end - start, eq, POCL_OPTION_FROM_FILE);
     }
-  
-  POCL_UNLOCK(lock);
-  return NULL;
+  fclose (f);
 }
+
+void
+pocl_init_runtime_config ()
+{
+  char **env;
+  pocl_config *c;
+  const char *file;
+
+  POCL_LOCK (lock);
+  if (__atomic_load_n (&config, __ATOMIC_ACQUIRE) != NULL)
+    {
+      POCL_UNLOCK (lock);
+      return;
+    }
+
+  c = (pocl_config *)calloc (1, sizeof (pocl_config));
+  if ((file = getenv (POCL_CONFIG_FILE_ENV)) != NULL)
+    read_config_file (c, file);
+
+  for (env = environ; env != NULL && *env != NULL; ++env)
+    {
+      const char *eq = strchr (*env, '=');
+      if (eq != NULL
+          && strncmp (*env, POCL_OPTION_PREFIX,
+                      strlen (POCL_OPTION_PREFIX)) == 0)
+        set_option (c, *env, eq - *env, eq + 1, POCL_OPTION_FROM_ENV);
+    }
+
+  qsort (c->options, c->num_options, sizeof (pocl_option), compare_options);
+  __atomic_store_n (&config, c, __ATOMIC_RELEASE);
+  POCL_UNLOCK (lock);
+}
+
+static const pocl_config *
+get_config ()
+{
+  const pocl_config *c = __atomic_load_n (&config, __ATOMIC_ACQUIRE);
+  if (c == NULL)
+    {
+      /* Queried before the platform initialization, e.g. by the kernel
+         compiler run by a tool. */
+      pocl_init_runtime_config ();
+      c = __atomic_load_n (&config, __ATOMIC_ACQUIRE);
+    }
+  return c;
+}
+
+void
+pocl_dump_runtime_config (FILE *stream)
+{
+  const pocl_config *c = get_config ();
+  unsigned i;
+
+  if (c->file != NULL)
+    fprintf (stream, "pocl configuration file %s%s\n", c->file,
+             c->file_error ? " (could not be read fully)" : "");
+  for (i = 0; i < c->num_options; ++i)
+    fprintf (stream, "  %s=%s (%s)\n", c->options[i].key,
+             c->options[i].value,
+             c->options[i].source == POCL_OPTION_FROM_ENV ? "env" : "file");
+}
+
 /* Can be used to query if the given option has been set by the user. */
 int pocl_is_option_set(const char *key)
 {
-  env_data* ed = NULL;
-  return (ed = find_env (env_cache, key)) ? 1 : 0;
+  return find_option (get_config (), key) != NULL;
 }
 
 /* Returns an integer value for the option with the given key string. */
 int pocl_get_int_option(const char *key, int default_value)
 {
-  env_data *ed;
-  return (ed = find_env (env_cache, key)) ? atoi(ed->value) : default_value;
+  const pocl_option *o = find_option (get_config (), key);
+  return o ? o->int_value : default_value;
 }
 
 /* Returns a boolean value for the option with the given key string. */
-int pocl_get_bool_option(const char *key, int default_value) 
+int pocl_get_bool_option(const char *key, int default_value)
 {
-  env_data *ed;
-  if ((ed = find_env(env_cache, key))) 
-    return (strncmp(ed->value, "1", 1) == 0);
-  return default_value;
+  const pocl_option *o = find_option (get_config (), key);
+  return o ? o->bool_value : default_value;
 }
- 
-const char* pocl_get_string_option(const char *key, const char *default_value) 
+
+const char* pocl_get_string_option(const char *key, const char *default_value)
 {
-  env_data *ed;
-  return (ed = find_env (env_cache, key)) ? ed->value : default_value;
+  const pocl_option *o = find_option (get_config (), key);
+  return o ? o->value : default_value;
 }
@@ -24,10 +24,21 @@
 #ifndef _POCL_RUNTIME_CONFIG_H
 #define _POCL_RUNTIME_CONFIG_H
 
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Reads the runtime configuration from the POCL_* environment variables
+   and the POCL_CONFIG_FILE configuration file. Called at the platform
+   initialization, the first option query does it otherwise. The options
+   do not change afterwards. */
+void pocl_init_runtime_config ();
+
+/* Prints the options that have been set, and where from, to STREAM. */
+void pocl_dump_runtime_config (FILE *stream);
+
 int pocl_is_option_set(const char *key);
 int pocl_get_int_option(const char *key, int default_value);
 int pocl_get_bool_option(const char *key, int default_value);
@@ -0,0 +1,132 @@
+/* pocl_signal.c: a sequence counter threads can block on until another
+   thread advances it
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "config.h"
+
+#include <limits.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "pocl_signal.h"
+#include "pocl_timing.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_RELAX() __builtin_ia32_pause ()
+#else
+#define CPU_RELAX() do { } while (0)
+#endif
+
+/* How many spin iterations are done between the reads of the clock. */
+#define SPIN_CLOCK_INTERVAL 64
+
+void
+pocl_signal_init (pocl_signal *s)
+{
+  s->seq = 0;
+#ifdef __linux__
+  s->waiters = 0;
+#else
+  pthread_mutex_init (&s->lock, NULL);
+  pthread_cond_init (&s->cond, NULL);
+#endif
+}
+
+void
+pocl_signal_destroy (pocl_signal *s)
+{
+#ifndef __linux__
+  pthread_cond_destroy (&s->cond);
+  pthread_mutex_destroy (&s->lock);
+#endif
+}
+
+unsigned
+pocl_signal_seq (pocl_signal *s)
+{
+#ifdef __linux__
+  return __atomic_load_n (&s->seq, __ATOMIC_SEQ_CST);
+#else
+  unsigned seq;
+  pthread_mutex_lock (&s->lock);
+  seq = s->seq;
+  pthread_mutex_unlock (&s->lock);
+  return seq;
+#endif
+}
+
+static int
+spin (pocl_signal *s, unsigned seq, uint64_t spin_ns)
+{
+  uint64_t deadline = pocl_gettimemono_ns () + spin_ns;
+  unsigned i = 0;
+
+  while (s->seq == seq)
+    {
+      CPU_RELAX ();
+      if (++i % SPIN_CLOCK_INTERVAL == 0
+          && pocl_gettimemono_ns () >= deadline)
+        return 0;
+    }
+  return 1;
+}
+
+void
+pocl_signal_wait (pocl_signal *s, unsigned seq, uint64_t spin_ns)
+{
+  if (spin_ns > 0 && spin (s, seq, spin_ns))
+    return;
+
+#ifdef __linux__
+  /* The waiter count is raised before the futex checks the sequence
+     number, so the signaler either sees the waiter or the waiter sees
+     the new sequence number. */
+  __atomic_add_fetch (&s->waiters, 1, __ATOMIC_SEQ_CST);
+  syscall (SYS_futex, &s->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+  __atomic_sub_fetch (&s->waiters, 1, __ATOMIC_SEQ_CST);
+#else
+  pthread_mutex_lock (&s->lock);
+  while (s->seq == seq)
+    pthread_cond_wait (&s->cond, &s->lock);
+  pthread_mutex_unlock (&s->lock);
+#endif
+}
+
+void
+pocl_signal_broadcast (pocl_signal *s)
+{
+#ifdef __linux__
+  __atomic_add_fetch (&s->seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&s->waiters, __ATOMIC_SEQ_CST) > 0)
+    syscall (SYS_futex, &s->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+  pthread_mutex_lock (&s->lock);
+  ++s->seq;
+  pthread_cond_broadcast (&s->cond);
+  pthread_mutex_unlock (&s->lock);
+#endif
+}
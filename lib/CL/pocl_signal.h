@@ -0,0 +1,81 @@
+/* pocl_signal.h: a sequence counter threads can block on until another
+   thread advances it
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#ifndef POCL_SIGNAL_H
+#define POCL_SIGNAL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __GNUC__
+#pragma GCC visibility push(hidden)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The waiters read the sequence number, check their wake up condition and
+   wait for the sequence number to change. The signaling thread changes the
+   condition and then advances the sequence number, thus no wake up can be
+   lost in between. On Linux the waiting is done with a futex on the
+   sequence number, which needs no locking on either side, and no system
+   call at all for signaling when nobody is blocked. */
+typedef struct _pocl_signal pocl_signal;
+struct _pocl_signal
+{
+  volatile unsigned seq;
+#ifdef __linux__
+  volatile unsigned waiters;
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+};
+
+void pocl_signal_init (pocl_signal *s);
+
+void pocl_signal_destroy (pocl_signal *s);
+
+/* Returns the sequence number to wait against. Read it before checking
+   the wake up condition. */
+unsigned pocl_signal_seq (pocl_signal *s);
+
+/* Blocks until the sequence number differs from SEQ, or spuriously.
+   Busy-waits up to SPIN_NS nanoseconds before blocking, which avoids the
+   latency of a sleep and wake up for short waits. */
+void pocl_signal_wait (pocl_signal *s, unsigned seq, uint64_t spin_ns);
+
+/* Advances the sequence number and wakes up all the waiters. */
+void pocl_signal_broadcast (pocl_signal *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __GNUC__
+#pragma GCC visibility pop
+#endif
+
+#endif
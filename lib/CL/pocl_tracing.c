@@ -26,6 +26,7 @@
 #include "pocl_util.h"
 #include "pocl_tracing.h"
 #include "pocl_runtime_config.h"
+#include "pocl_autotune.h"
 
 #ifdef LTTNG_UST_AVAILABLE
 #include "pocl_lttng.h"
@@ -55,6 +56,8 @@ pocl_event_updated (cl_event event, int status)
 {
   event_callback_item *cb_ptr;
 
+  pocl_autotune_event_updated (event, status);
+
   /* event callback handling just call functions in the same order
    * they were added if the status match the specified one */
   for (cb_ptr = event->callback_list; cb_ptr; cb_ptr = cb_ptr->next)
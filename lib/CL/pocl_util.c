@@ -225,6 +225,7 @@ cl_int pocl_create_event (cl_event *event, cl_command_queue command_queue,
         (*event)->mem_objs = NULL;
       (*event)->status = CL_QUEUED;
       (*event)->implicit_event = 0;
+      (*event)->in_order_stream = 0;
       (*event)->next = NULL;
       (*event)->prev = NULL;
 
@@ -340,8 +341,15 @@ cl_int pocl_create_command (_cl_command_node **cmd,
   (*cmd)->ready = 0;
 
   /* in case of in-order queue, synchronize to previously enqueued command
-     if available */
-  if (!(command_queue->properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+     if available. Commands without other dependencies are candidates for
+     the in-order stream fast path, the decision is made at enqueue. */
+  if (!(command_queue->properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+      && command_queue->device->in_order_streams && num_events == 0
+      && command_type != CL_COMMAND_BARRIER
+      && command_type != CL_COMMAND_MARKER)
+    (*event)->in_order_stream = 1;
+  else if (!(command_queue->properties
+             & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
     {
       POCL_LOCK_OBJ (command_queue);
       if (command_queue->last_event.event)
@@ -367,10 +375,47 @@ cl_int pocl_create_command (_cl_command_node **cmd,
   return CL_SUCCESS;
 }
 
+/* Returns true if NODE can be appended to the in-order stream of the
+   queue: the ring must have room for it. A command following one that
+   is not in the stream restarts the stream, synchronized to the previous
+   command by an event dependency. Called with the queue locked. */
+static int
+pocl_in_order_stream_accepts (cl_command_queue command_queue,
+                              _cl_command_node *node)
+{
+  pocl_in_order_stream *stream = &command_queue->stream;
+
+  if (!node->event->in_order_stream || command_queue->barrier != NULL)
+    return 0;
+  return stream->tail - stream->head < POCL_IN_ORDER_STREAM_SIZE;
+}
+
+void
+pocl_in_order_stream_completed (cl_event event)
+{
+  cl_command_queue cq = event->queue;
+  pocl_in_order_stream *stream = &cq->stream;
+  _cl_command_node *next;
+
+  if (!event->in_order_stream)
+    return;
+
+  /* Only one command of the stream executes at a time, so this is the
+     only consumer. */
+  ++stream->head;
+  if (__sync_fetch_and_sub (&stream->count, 1) > 1)
+    {
+      next = stream->ring[stream->head % POCL_IN_ORDER_STREAM_SIZE];
+      cq->device->ops->submit (next, cq);
+    }
+}
+
 void pocl_command_enqueue (cl_command_queue command_queue,
                           _cl_command_node *node)
 {
-  cl_event event;
+  cl_event event, last;
+  pocl_in_order_stream *stream = &command_queue->stream;
+  int in_stream, start_stream = 0;
 
   POCL_LOCK_OBJ (node->event);
   assert(node->event->status == CL_QUEUED);
@@ -380,6 +425,20 @@ void pocl_command_enqueue (cl_command_queue command_queue,
 
   POCL_LOCK_OBJ (command_queue);
   ++command_queue->command_count;
+  in_stream = pocl_in_order_stream_accepts (command_queue, node);
+  last = command_queue->last_event.event;
+  /* Synchronize to the previous command when the stream does not order
+     them: when falling back to the event synchronization, or when
+     restarting the stream after a command outside it. */
+  if (node->event->in_order_stream && last != NULL
+      && !(in_stream && last->in_order_stream))
+    {
+      POCL_LOCK_OBJ (last);
+      pocl_create_event_sync (node->event, last, NULL);
+      POCL_UNLOCK_OBJ (last);
+    }
+  if (!in_stream)
+    node->event->in_order_stream = 0;
   if ((node->type == CL_COMMAND_BARRIER || node->type == CL_COMMAND_MARKER) &&
       node->command.barrier.has_wait_list == 0)
     {
@@ -404,11 +463,25 @@ void pocl_command_enqueue (cl_command_queue command_queue,
   DL_APPEND (command_queue->events, node->event);
   command_queue->last_event.event = node->event;
   command_queue->last_event.event_id = node->event->id;
+  if (in_stream)
+    {
+      /* The device may submit the command as soon as it is counted in the
+         stream, so it has to be queued first. */
+      POCL_UPDATE_EVENT_QUEUED (&node->event);
+      stream->ring[stream->tail % POCL_IN_ORDER_STREAM_SIZE] = node;
+      ++stream->tail;
+      /* If the stream was idle, the command is started here. */
+      start_stream = (__sync_fetch_and_add (&stream->count, 1) == 0);
+    }
   POCL_UNLOCK_OBJ (command_queue);
 
-  POCL_UPDATE_EVENT_QUEUED (&node->event);
+  if (!in_stream)
+    POCL_UPDATE_EVENT_QUEUED (&node->event);
 
-  command_queue->device->ops->submit(node, command_queue);
+  /* The rest of the in-order stream is submitted by the stream when their
+     predecessor completes. */
+  if (!in_stream || start_stream)
+    command_queue->device->ops->submit(node, command_queue);
 #ifdef POCL_DEBUG_BUILD
   if (pocl_is_option_set("POCL_IMPLICIT_FINISH"))
     POclFinish (command_queue);
@@ -460,6 +533,7 @@ int pocl_update_command_queue (cl_event event)
 
   cq_ready = (event->queue->command_count) ? 0: 1;
   POCL_UNLOCK_OBJ (event->queue);
+
   return cq_ready;
 }
 
@@ -789,6 +863,13 @@ pocl_check_event_wait_list (cl_command_queue command_queue,
   return CL_SUCCESS;
 }
 
+int
+pocl_program_relaxed_math (cl_program program)
+{
+  return program->compiler_options != NULL
+    && strstr (program->compiler_options, "-cl-fast-relaxed-math") != NULL;
+}
+
 const char*
 pocl_status_to_str (int status)
 {
@@ -116,6 +116,12 @@ pocl_command_is_ready(cl_event event)
 int
 pocl_update_command_queue (cl_event event);
 
+/* Submits the command following EVENT in the in-order stream of its
+   queue, if any. Called by the device after pocl_update_command_queue ()
+   once the status and the timestamps of EVENT are final. */
+void
+pocl_in_order_stream_completed (cl_event event);
+
 cl_int 
 pocl_update_mem_obj_sync (cl_command_queue cq, _cl_command_node *cmd, 
                           cl_mem mem, char operation);
@@ -153,6 +159,10 @@ pocl_command_to_str (cl_command_type cmd);
 int
 pocl_run_command(char * const *args);
 
+/* Returns 1 if the program is linked with the reduced-precision variant
+   of the kernel library (-cl-fast-relaxed-math). */
+int pocl_program_relaxed_math (cl_program program);
+
 uint16_t float_to_half (float value);
 
 float half_to_float (uint16_t value);
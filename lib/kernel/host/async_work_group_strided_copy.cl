@@ -0,0 +1,82 @@
+/* OpenCL built-in library: async_work_group_strided_copy() for the CPU devices
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include "../templates.h"
+
+/* See async_work_group_copy.cl. A unit stride is a block copy; otherwise
+   the copy is a gather (or a scatter) loop without loop-carried
+   dependencies, which the loop vectorizer can turn into vector gathers
+   on targets which have them. */
+
+#define IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE(GENTYPE)                    \
+  __attribute__ ((overloadable)) event_t async_work_group_strided_copy (      \
+      __local GENTYPE *dst, const __global GENTYPE *src, size_t num_gentypes, \
+      size_t src_stride, event_t event)                                       \
+  {                                                                           \
+    __SINGLE_WI                                                               \
+    {                                                                         \
+      if (src_stride == 1)                                                    \
+        __builtin_memcpy ((void *)(size_t)dst, (const void *)(size_t)src,     \
+                          num_gentypes * sizeof (GENTYPE));                   \
+      else                                                                    \
+        for (size_t i = 0; i < num_gentypes; ++i)                             \
+          dst[i] = src[i * src_stride];                                       \
+    }                                                                         \
+    return event;                                                             \
+  }                                                                           \
+                                                                              \
+  __attribute__ ((overloadable)) event_t async_work_group_strided_copy (      \
+      __global GENTYPE *dst, const __local GENTYPE *src, size_t num_gentypes, \
+      size_t dst_stride, event_t event)                                       \
+  {                                                                           \
+    __SINGLE_WI                                                               \
+    {                                                                         \
+      if (dst_stride == 1)                                                    \
+        __builtin_memcpy ((void *)(size_t)dst, (const void *)(size_t)src,     \
+                          num_gentypes * sizeof (GENTYPE));                   \
+      else                                                                    \
+        for (size_t i = 0; i < num_gentypes; ++i)                             \
+          dst[i * dst_stride] = src[i];                                       \
+    }                                                                         \
+    return event;                                                             \
+  }
+
+#define IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS(GENTYPE)                           \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE)                         \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE##2)                      \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE##3)                      \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE##4)                      \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE##8)                      \
+  IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS_SINGLE (GENTYPE##16)
+
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (char);
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (uchar);
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (short);
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (ushort);
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (int);
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (uint);
+__IF_INT64 (IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (long));
+__IF_INT64 (IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (ulong));
+__IF_FP16 (IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (half));
+IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (float);
+__IF_FP64 (IMPLEMENT_ASYNC_STRIDED_COPY_FUNCS (double));
@@ -1,5 +1,10 @@
 // -*-C++-*-
 
+// Reports the cost in cycles per element and the maximum error in ulps of
+// the math functions. Build it once with and once without
+// -DVML_RELAXED_MATH to compare the full and the reduced-precision
+// variants of the functions.
+
 #define VML_NODEBUG
 
 #include "vecmathlib.h"
@@ -8,6 +13,7 @@
 #include <cstdlib>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <string>
 
 #include <sys/time.h>
@@ -247,7 +253,47 @@ double run_bench() {
   t1 = getticks();
   save_result(y);
 
-  return cycles_per_tick * elapsed(t1, t0) * realvec_t::size / numiters;
+  return cycles_per_tick * elapsed(t1, t0) / realvec_t::size / numiters;
+}
+
+// Maximum error in units in the last place, compared to libm evaluated in
+// double precision (for double this is only as accurate as libm itself)
+template <typename realvec_t, template <typename> class func_t>
+double run_ulp_error() {
+  const int numpoints = 10000;
+
+  typedef typename realvec_t::real_t real_t;
+  typedef realpseudovec<double, 1> refvec_t;
+  const real_t xmin = func_t<realvec_t>::get_xmin();
+  const real_t xmax = func_t<realvec_t>::get_xmax();
+
+  func_t<realvec_t> func;
+  func_t<refvec_t> ref;
+  double max_error = 0.0;
+  for (int n = 0; n < numpoints; n += realvec_t::size) {
+    realvec_t x;
+    for (int i = 0; i < realvec_t::size; ++i)
+      x.set_elt(i, xmin + (xmax - xmin) / numpoints * (n + i));
+    realvec_t y = func(x);
+    for (int i = 0; i < realvec_t::size; ++i) {
+      double const yref = ref(refvec_t(x[i]))[0];
+      double const yi = y[i];
+      if (vml_std::isnan(yref) && vml_std::isnan(yi))
+        continue;
+      if (!vml_std::isfinite(yref) || !vml_std::isfinite(yi)) {
+        if (yref != yi)
+          return std::numeric_limits<double>::infinity();
+        continue;
+      }
+      real_t const r = vml_std::fabs(real_t(yref));
+      double const ulp =
+          vml_std::nextafter(r, std::numeric_limits<real_t>::max()) - r;
+      double const error = vml_std::fabs(yi - yref) / ulp;
+      if (error > max_error)
+        max_error = error;
+    }
+  }
+  return max_error;
 }
 
 template <typename realvec_t, template <typename> class func_t>
@@ -255,7 +301,8 @@ void bench_type_func() {
   cout << "   " << setw(-5) << func_t<realvec_t>::name() << " " << setw(18)
        << realvec_t::name() << ": " << flush;
   double const cycles = run_bench<realvec_t, func_t>();
-  cout << cycles << " cycles\n" << flush;
+  double const ulps = run_ulp_error<realvec_t, func_t>();
+  cout << cycles << " cycles/element, " << ulps << " ulp\n" << flush;
 }
 
 template <template <typename> class func_t> void bench_func() {
@@ -396,7 +443,13 @@ void bench() {
 }
 
 int main(int argc, char **argv) {
-  cout << "Benchmarking math functions:\n";
+  cout << "Benchmarking math functions:\n"
+#ifdef VML_RELAXED_MATH
+       << "Precision: relaxed\n"
+#else
+       << "Precision: full\n"
+#endif
+       << VECMATHLIB_CONFIGURATION << "\n";
   bench();
   return 0;
 }
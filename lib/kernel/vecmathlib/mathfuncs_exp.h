@@ -46,7 +46,15 @@ realvec_t mathfuncs<realvec_t>::vml_exp2(realvec_t x) {
   realvec_t r;
   switch (sizeof(real_t)) {
   case 4:
-#ifdef VML_HAVE_FP_CONTRACT
+#if defined VML_RELAXED_MATH
+    // float, error=7.49364704218877e-8
+    r = RV(0.0013276471979054984);
+    r = mad(r, x, RV(0.009675541334212934));
+    r = mad(r, x, RV(0.055507132735439044));
+    r = mad(r, x, RV(0.240221197238486));
+    r = mad(r, x, RV(0.6931469670647323));
+    r = mad(r, x, RV(1.0000000716546822));
+#elif defined VML_HAVE_FP_CONTRACT
     // float, error=4.55549108005200277750378992345e-9
     r = RV(0.000154653240842602623787395880898);
     r = mad(r, x, RV(0.00133952915439234389712105060319));
@@ -14,8 +14,21 @@ realvec_t mathfuncs<realvec_t>::vml_log2(realvec_t x) {
   // Algorithm inspired by SLEEF 2.80
 
   // Rescale
-  intvec_t ilogb_x = ilogb(x * RV(M_SQRT2));
-  x = ldexp(x, -ilogb_x);
+  intvec_t ilogb_x;
+#ifdef VML_RELAXED_MATH
+  // Manipulate the exponent bits directly, assuming x is positive and
+  // normal. The relaxed math bounds only apply to float.
+  if (sizeof(real_t) == sizeof(float)) {
+    ilogb_x = lsr(as_int(x * RV(M_SQRT2)) & IV(FP::exponent_mask),
+                  FP::mantissa_bits) -
+              IV(FP::exponent_offset);
+    x = as_float(as_int(x) - (ilogb_x << U(FP::mantissa_bits)));
+  } else
+#endif
+  {
+    ilogb_x = ilogb(x * RV(M_SQRT2));
+    x = ldexp(x, -ilogb_x);
+  }
   VML_ASSERT(all(x >= RV(M_SQRT1_2) && x <= RV(M_SQRT2)));
 
   realvec_t y = (x - RV(1.0)) / (x + RV(1.0));
@@ -52,10 +52,16 @@ realvec_t mathfuncs<realvec_t>::vml_sin(realvec_t d) {
   default:
     __builtin_unreachable();
   case sizeof(float):
+#ifdef VML_RELAXED_MATH
+    // float, absolute error=1.14008956531433e-4 (2^-11 is allowed)
+    u = RV(0.007633773375709119f);
+    u = mad(u, s, RV(-0.1660786242199114f));
+#else
     u = RV(2.6083159809786593541503e-06f);
     u = mad(u, s, RV(-0.0001981069071916863322258f));
     u = mad(u, s, RV(0.00833307858556509017944336f));
     u = mad(u, s, RV(-0.166666597127914428710938f));
+#endif
     break;
   case sizeof(double):
     u = RV(-7.97255955009037868891952e-18);
@@ -72,8 +78,10 @@ realvec_t mathfuncs<realvec_t>::vml_sin(realvec_t d) {
 
   u = mad(s, u * d, d);
 
+#ifndef VML_RELAXED_MATH
   const real_t nan = std::numeric_limits<real_t>::quiet_NaN();
   u = ifthen(isinf(d), RV(nan), u);
+#endif
 
   return u;
 }
@@ -121,10 +129,16 @@ realvec_t mathfuncs<realvec_t>::vml_cos(realvec_t d) {
   default:
     __builtin_unreachable();
   case sizeof(float):
+#ifdef VML_RELAXED_MATH
+    // float, absolute error=1.14008956531433e-4 (2^-11 is allowed)
+    u = RV(0.007633773375709119f);
+    u = mad(u, s, RV(-0.1660786242199114f));
+#else
     u = RV(2.6083159809786593541503e-06f);
     u = mad(u, s, RV(-0.0001981069071916863322258f));
     u = mad(u, s, RV(0.00833307858556509017944336f));
     u = mad(u, s, RV(-0.166666597127914428710938f));
+#endif
     break;
   case sizeof(double):
     u = RV(-7.97255955009037868891952e-18);
@@ -141,8 +155,10 @@ realvec_t mathfuncs<realvec_t>::vml_cos(realvec_t d) {
 
   u = mad(s, u * d, d);
 
+#ifndef VML_RELAXED_MATH
   const real_t nan = std::numeric_limits<real_t>::quiet_NaN();
   u = ifthen(isinf(d), RV(nan), u);
+#endif
 
   return u;
 }
@@ -0,0 +1,529 @@
+// -*-C++-*-
+
+#ifndef VEC_AVX512_FLOAT16_H
+#define VEC_AVX512_FLOAT16_H
+
+#include "floatprops.h"
+#include "mathfuncs.h"
+#include "vec_base.h"
+
+#include <cmath>
+
+// AVX-512 intrinsics
+#include <immintrin.h>
+
+namespace vecmathlib {
+
+#define VECMATHLIB_HAVE_VEC_FLOAT_16
+template <> struct boolvec<float, 16>;
+template <> struct intvec<float, 16>;
+template <> struct realvec<float, 16>;
+
+template <> struct boolvec<float, 16> : floatprops<float> {
+  static int const size = 16;
+  typedef bool scalar_t;
+  // One bit per element, living in a mask register
+  typedef __mmask16 bvector_t;
+  static int const alignment = sizeof(bvector_t);
+
+  static_assert(size == 8 * sizeof(bvector_t), "vector size is wrong");
+
+  typedef boolvec boolvec_t;
+  typedef intvec<real_t, size> intvec_t;
+  typedef realvec<real_t, size> realvec_t;
+
+  // Short names for type casts
+  typedef real_t R;
+  typedef int_t I;
+  typedef uint_t U;
+  typedef realvec_t RV;
+  typedef intvec_t IV;
+  typedef boolvec_t BV;
+  typedef floatprops<real_t> FP;
+  typedef mathfuncs<realvec_t> MF;
+
+  bvector_t v;
+
+  boolvec() {}
+  // Can't have a non-trivial copy constructor; if so, objects won't
+  // be passed in registers
+  // boolvec(boolvec const& x): v(x.v) {}
+  // boolvec& operator=(boolvec const& x) { return v=x.v, *this; }
+  boolvec(bvector_t x) : v(x) {}
+  boolvec(bool a) : v(a ? bvector_t(0xffff) : bvector_t(0)) {}
+  boolvec(bool const *as) : v(0) {
+    for (int d = 0; d < size; ++d)
+      v |= bvector_t(as[d]) << d;
+  }
+
+  operator bvector_t() const { return v; }
+  bool operator[](int n) const { return (v >> n) & 1; }
+  boolvec_t &set_elt(int n, bool a) {
+    return v = bvector_t((v & ~(1 << n)) | (int(a) << n)), *this;
+  }
+
+  intvec_t as_int() const;      // defined after intvec
+  intvec_t convert_int() const; // defined after intvec
+
+  boolvec_t operator!() const { return bvector_t(~v); }
+
+  boolvec_t operator&&(boolvec_t x) const { return bvector_t(v & x.v); }
+  boolvec_t operator||(boolvec_t x) const { return bvector_t(v | x.v); }
+  boolvec_t operator==(boolvec_t x) const { return bvector_t(~(v ^ x.v)); }
+  boolvec_t operator!=(boolvec_t x) const { return bvector_t(v ^ x.v); }
+
+  bool all() const { return v == bvector_t(0xffff); }
+  bool any() const { return v != bvector_t(0); }
+
+  // ifthen(condition, then-value, else-value)
+  boolvec_t ifthen(boolvec_t x, boolvec_t y) const {
+    return bvector_t((v & x.v) | (~v & y.v));
+  }
+  intvec_t ifthen(intvec_t x, intvec_t y) const;    // defined after intvec
+  realvec_t ifthen(realvec_t x, realvec_t y) const; // defined after realvec
+};
+
+template <> struct intvec<float, 16> : floatprops<float> {
+  static int const size = 16;
+  typedef int_t scalar_t;
+  typedef __m512i ivector_t;
+  static int const alignment = sizeof(ivector_t);
+
+  static_assert(size * sizeof(real_t) == sizeof(ivector_t),
+                "vector size is wrong");
+
+  typedef boolvec<real_t, size> boolvec_t;
+  typedef intvec intvec_t;
+  typedef realvec<real_t, size> realvec_t;
+
+  // Short names for type casts
+  typedef real_t R;
+  typedef int_t I;
+  typedef uint_t U;
+  typedef realvec_t RV;
+  typedef intvec_t IV;
+  typedef boolvec_t BV;
+  typedef floatprops<real_t> FP;
+  typedef mathfuncs<realvec_t> MF;
+
+  ivector_t v;
+
+  intvec() {}
+  // Can't have a non-trivial copy constructor; if so, objects won't
+  // be passed in registers
+  // intvec(intvec const& x): v(x.v) {}
+  // intvec& operator=(intvec const& x) { return v=x.v, *this; }
+  intvec(ivector_t x) : v(x) {}
+  intvec(int_t a) : v(_mm512_set1_epi32(a)) {}
+  intvec(int_t const *as) : v(_mm512_loadu_si512(as)) {}
+  static intvec_t iota() {
+    return _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1,
+                            0);
+  }
+
+  operator ivector_t() const { return v; }
+  int_t operator[](int n) const {
+    return vecmathlib::get_elt<IV, ivector_t, int_t>(v, n);
+  }
+  intvec_t &set_elt(int n, int_t a) {
+    return vecmathlib::set_elt<IV, ivector_t, int_t>(v, n, a), *this;
+  }
+
+  boolvec_t as_bool() const {
+    // boolvec_t values depend only on the sign bit
+    return _mm512_cmplt_epi32_mask(v, _mm512_setzero_si512());
+  }
+  boolvec_t convert_bool() const {
+    // Result: convert_bool(0)=false, convert_bool(else)=true
+    return _mm512_test_epi32_mask(v, v);
+  }
+  realvec_t as_float() const;      // defined after realvec
+  realvec_t convert_float() const; // defined after realvec
+
+  // Note: not all arithmetic operations are supported!
+
+  intvec_t operator+() const { return *this; }
+  intvec_t operator-() const { return IV(I(0)) - *this; }
+
+  intvec_t operator+(intvec_t x) const { return _mm512_add_epi32(v, x.v); }
+  intvec_t operator-(intvec_t x) const { return _mm512_sub_epi32(v, x.v); }
+
+  intvec_t &operator+=(intvec_t const &x) { return *this = *this + x; }
+  intvec_t &operator-=(intvec_t const &x) { return *this = *this - x; }
+
+  intvec_t operator~() const { return IV(~U(0)) ^ *this; }
+
+  intvec_t operator&(intvec_t x) const { return _mm512_and_si512(v, x.v); }
+  intvec_t operator|(intvec_t x) const { return _mm512_or_si512(v, x.v); }
+  intvec_t operator^(intvec_t x) const { return _mm512_xor_si512(v, x.v); }
+
+  intvec_t &operator&=(intvec_t const &x) { return *this = *this & x; }
+  intvec_t &operator|=(intvec_t const &x) { return *this = *this | x; }
+  intvec_t &operator^=(intvec_t const &x) { return *this = *this ^ x; }
+
+  intvec_t bitifthen(intvec_t x, intvec_t y) const;
+
+  intvec_t lsr(int_t n) const { return _mm512_srli_epi32(v, n); }
+  intvec_t rotate(int_t n) const;
+  intvec_t operator>>(int_t n) const { return _mm512_srai_epi32(v, n); }
+  intvec_t operator<<(int_t n) const { return _mm512_slli_epi32(v, n); }
+  intvec_t &operator>>=(int_t n) { return *this = *this >> n; }
+  intvec_t &operator<<=(int_t n) { return *this = *this << n; }
+
+  intvec_t lsr(intvec_t n) const { return _mm512_srlv_epi32(v, n.v); }
+  intvec_t rotate(intvec_t n) const;
+  intvec_t operator>>(intvec_t n) const { return _mm512_srav_epi32(v, n.v); }
+  intvec_t operator<<(intvec_t n) const { return _mm512_sllv_epi32(v, n.v); }
+  intvec_t &operator>>=(intvec_t n) { return *this = *this >> n; }
+  intvec_t &operator<<=(intvec_t n) { return *this = *this << n; }
+
+  intvec_t clz() const;
+  intvec_t popcount() const;
+
+  boolvec_t operator==(intvec_t const &x) const {
+    return _mm512_cmpeq_epi32_mask(v, x.v);
+  }
+  boolvec_t operator!=(intvec_t const &x) const {
+    return _mm512_cmpneq_epi32_mask(v, x.v);
+  }
+  boolvec_t operator<(intvec_t const &x) const {
+    return _mm512_cmplt_epi32_mask(v, x.v);
+  }
+  boolvec_t operator<=(intvec_t const &x) const {
+    return _mm512_cmple_epi32_mask(v, x.v);
+  }
+  boolvec_t operator>(intvec_t const &x) const { return x < *this; }
+  boolvec_t operator>=(intvec_t const &x) const { return x <= *this; }
+
+  intvec_t abs() const;
+  boolvec_t isignbit() const { return as_bool(); }
+  intvec_t max(intvec_t x) const;
+  intvec_t min(intvec_t x) const;
+};
+
+template <> struct realvec<float, 16> : floatprops<float> {
+  static int const size = 16;
+  typedef real_t scalar_t;
+  typedef __m512 vector_t;
+  static int const alignment = sizeof(vector_t);
+
+  static char const *name() { return "<AVX512:16*float>"; }
+  void barrier() { __asm__("" : "+v"(v)); }
+
+  static_assert(size * sizeof(real_t) == sizeof(vector_t),
+                "vector size is wrong");
+
+  typedef boolvec<real_t, size> boolvec_t;
+  typedef intvec<real_t, size> intvec_t;
+  typedef realvec realvec_t;
+
+  // Short names for type casts
+  typedef real_t R;
+  typedef int_t I;
+  typedef uint_t U;
+  typedef realvec_t RV;
+  typedef intvec_t IV;
+  typedef boolvec_t BV;
+  typedef floatprops<real_t> FP;
+  typedef mathfuncs<realvec_t> MF;
+
+  vector_t v;
+
+  realvec() {}
+  // Can't have a non-trivial copy constructor; if so, objects won't
+  // be passed in registers
+  // realvec(realvec const& x): v(x.v) {}
+  // realvec& operator=(realvec const& x) { return v=x.v, *this; }
+  realvec(vector_t x) : v(x) {}
+  realvec(real_t a) : v(_mm512_set1_ps(a)) {}
+  realvec(real_t const *as) : v(_mm512_loadu_ps(as)) {}
+
+  operator vector_t() const { return v; }
+  real_t operator[](int n) const {
+    return vecmathlib::get_elt<RV, vector_t, real_t>(v, n);
+  }
+  realvec_t &set_elt(int n, real_t a) {
+    return vecmathlib::set_elt<RV, vector_t, real_t>(v, n, a), *this;
+  }
+
+  typedef vecmathlib::mask_t<realvec_t> mask_t;
+
+  static realvec_t loada(real_t const *p) {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    return _mm512_load_ps(p);
+  }
+  static realvec_t loadu(real_t const *p) { return _mm512_loadu_ps(p); }
+  static realvec_t loadu(real_t const *p, std::ptrdiff_t ioff) {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    if (ioff % realvec::size == 0)
+      return loada(p + ioff);
+    return loadu(p + ioff);
+  }
+  // Masked loads and stores do not touch the disabled elements, so
+  // they are safe at the boundaries of an array
+  realvec_t loada(real_t const *p, mask_t const &m) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    return _mm512_mask_load_ps(v, m.m.v, p);
+  }
+  realvec_t loadu(real_t const *p, mask_t const &m) const {
+    return _mm512_mask_loadu_ps(v, m.m.v, p);
+  }
+  realvec_t loadu(real_t const *p, std::ptrdiff_t ioff, mask_t const &m) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    if (ioff % realvec::size == 0)
+      return loada(p + ioff, m);
+    return loadu(p + ioff, m);
+  }
+
+  void storea(real_t *p) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    _mm512_store_ps(p, v);
+  }
+  void storeu(real_t *p) const { return _mm512_storeu_ps(p, v); }
+  void storeu(real_t *p, std::ptrdiff_t ioff) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    if (ioff % realvec::size == 0)
+      return storea(p + ioff);
+    storeu(p + ioff);
+  }
+  void storea(real_t *p, mask_t const &m) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    _mm512_mask_store_ps(p, m.m.v, v);
+  }
+  void storeu(real_t *p, mask_t const &m) const {
+    _mm512_mask_storeu_ps(p, m.m.v, v);
+  }
+  void storeu(real_t *p, std::ptrdiff_t ioff, mask_t const &m) const {
+    VML_ASSERT(intptr_t(p) % alignment == 0);
+    if (ioff % realvec::size == 0)
+      return storea(p + ioff, m);
+    storeu(p + ioff, m);
+  }
+
+  intvec_t as_int() const { return _mm512_castps_si512(v); }
+  intvec_t convert_int() const { return _mm512_cvttps_epi32(v); }
+
+  realvec_t operator+() const { return *this; }
+  realvec_t operator-() const { return RV(0.0) - *this; }
+
+  realvec_t operator+(realvec_t x) const { return _mm512_add_ps(v, x.v); }
+  realvec_t operator-(realvec_t x) const { return _mm512_sub_ps(v, x.v); }
+  realvec_t operator*(realvec_t x) const { return _mm512_mul_ps(v, x.v); }
+  realvec_t operator/(realvec_t x) const { return _mm512_div_ps(v, x.v); }
+
+  realvec_t &operator+=(realvec_t const &x) { return *this = *this + x; }
+  realvec_t &operator-=(realvec_t const &x) { return *this = *this - x; }
+  realvec_t &operator*=(realvec_t const &x) { return *this = *this * x; }
+  realvec_t &operator/=(realvec_t const &x) { return *this = *this / x; }
+
+private:
+  // Reductions first fold the upper half onto the lower half, then
+  // continue with 256-bit AVX shuffles
+  __m256 lo() const { return _mm512_castps512_ps256(v); }
+  __m256 hi() const {
+    return _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+  }
+
+public:
+  real_t maxval() const {
+    __m256 x01234567 = _mm256_max_ps(lo(), hi());
+    __m256 x10325476 = _mm256_shuffle_ps(x01234567, x01234567, 0b10110001);
+    __m256 y00224466 = _mm256_max_ps(x01234567, x10325476);
+    __m256 y22006644 = _mm256_shuffle_ps(y00224466, y00224466, 0b01001110);
+    __m256 z00004444 = _mm256_max_ps(y00224466, y22006644);
+    return vml_std::fmax(_mm256_cvtss_f32(z00004444),
+                         _mm_cvtss_f32(_mm256_extractf128_ps(z00004444, 1)));
+  }
+  real_t minval() const {
+    __m256 x01234567 = _mm256_min_ps(lo(), hi());
+    __m256 x10325476 = _mm256_shuffle_ps(x01234567, x01234567, 0b10110001);
+    __m256 y00224466 = _mm256_min_ps(x01234567, x10325476);
+    __m256 y22006644 = _mm256_shuffle_ps(y00224466, y00224466, 0b01001110);
+    __m256 z00004444 = _mm256_min_ps(y00224466, y22006644);
+    return vml_std::fmin(_mm256_cvtss_f32(z00004444),
+                         _mm_cvtss_f32(_mm256_extractf128_ps(z00004444, 1)));
+  }
+  real_t prod() const {
+    __m256 x01234567 = _mm256_mul_ps(lo(), hi());
+    __m256 x10325476 = _mm256_shuffle_ps(x01234567, x01234567, 0b10110001);
+    __m256 y00224466 = _mm256_mul_ps(x01234567, x10325476);
+    __m256 y22006644 = _mm256_shuffle_ps(y00224466, y00224466, 0b01001110);
+    __m256 z00004444 = _mm256_mul_ps(y00224466, y22006644);
+    return _mm256_cvtss_f32(z00004444) *
+           _mm_cvtss_f32(_mm256_extractf128_ps(z00004444, 1));
+  }
+  real_t sum() const {
+    __m256 x = _mm256_add_ps(lo(), hi());
+    x = _mm256_hadd_ps(x, x);
+    x = _mm256_hadd_ps(x, x);
+    return _mm256_cvtss_f32(x) + _mm_cvtss_f32(_mm256_extractf128_ps(x, 1));
+  }
+
+  boolvec_t operator==(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_EQ_OQ);
+  }
+  boolvec_t operator!=(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_NEQ_UQ); // Note: _UQ here
+  }
+  boolvec_t operator<(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_LT_OQ);
+  }
+  boolvec_t operator<=(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_LE_OQ);
+  }
+  boolvec_t operator>(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_GT_OQ);
+  }
+  boolvec_t operator>=(realvec_t const &x) const {
+    return _mm512_cmp_ps_mask(v, x.v, _CMP_GE_OQ);
+  }
+
+  realvec_t acos() const { return MF::vml_acos(*this); }
+  realvec_t acosh() const { return MF::vml_acosh(*this); }
+  realvec_t asin() const { return MF::vml_asin(*this); }
+  realvec_t asinh() const { return MF::vml_asinh(*this); }
+  realvec_t atan() const { return MF::vml_atan(*this); }
+  realvec_t atan2(realvec_t y) const { return MF::vml_atan2(*this, y); }
+  realvec_t atanh() const { return MF::vml_atanh(*this); }
+  realvec_t cbrt() const { return MF::vml_cbrt(*this); }
+  realvec_t ceil() const {
+    return _mm512_roundscale_ps(v, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC);
+  }
+  realvec_t copysign(realvec_t y) const { return MF::vml_copysign(*this, y); }
+  realvec_t cos() const { return MF::vml_cos(*this); }
+  realvec_t cosh() const { return MF::vml_cosh(*this); }
+  realvec_t exp() const { return MF::vml_exp(*this); }
+  realvec_t exp10() const { return MF::vml_exp10(*this); }
+  realvec_t exp2() const { return MF::vml_exp2(*this); }
+  realvec_t expm1() const { return MF::vml_expm1(*this); }
+  realvec_t fabs() const { return MF::vml_fabs(*this); }
+  realvec_t fdim(realvec_t y) const { return MF::vml_fdim(*this, y); }
+  realvec_t floor() const {
+    return _mm512_roundscale_ps(v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  }
+  realvec_t fma(realvec_t y, realvec_t z) const {
+    return _mm512_fmadd_ps(v, y.v, z.v);
+  }
+  realvec_t fmax(realvec_t y) const { return _mm512_max_ps(v, y.v); }
+  realvec_t fmin(realvec_t y) const { return _mm512_min_ps(v, y.v); }
+  realvec_t fmod(realvec_t y) const { return MF::vml_fmod(*this, y); }
+  realvec_t frexp(intvec_t *r) const { return MF::vml_frexp(*this, r); }
+  realvec_t hypot(realvec_t y) const { return MF::vml_hypot(*this, y); }
+  intvec_t ilogb() const { return MF::vml_ilogb(*this); }
+  boolvec_t isfinite() const { return MF::vml_isfinite(*this); }
+  boolvec_t isinf() const { return MF::vml_isinf(*this); }
+  boolvec_t isnan() const {
+#ifdef VML_HAVE_NAN
+    return _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+#else
+    return BV(false);
+#endif
+  }
+  boolvec_t isnormal() const { return MF::vml_isnormal(*this); }
+  realvec_t ldexp(int_t n) const { return MF::vml_ldexp(*this, n); }
+  realvec_t ldexp(intvec_t n) const { return MF::vml_ldexp(*this, n); }
+  realvec_t log() const { return MF::vml_log(*this); }
+  realvec_t log10() const { return MF::vml_log10(*this); }
+  realvec_t log1p() const { return MF::vml_log1p(*this); }
+  realvec_t log2() const { return MF::vml_log2(*this); }
+  realvec_t mad(realvec_t y, realvec_t z) const {
+    return MF::vml_mad(*this, y, z);
+  }
+  realvec_t nextafter(realvec_t y) const { return MF::vml_nextafter(*this, y); }
+  realvec_t pow(realvec_t y) const { return MF::vml_pow(*this, y); }
+  realvec_t rcp() const {
+    realvec_t x = *this;
+    realvec_t r = _mm512_rcp14_ps(x); // this is only an approximation
+    r *= RV(2.0) - r * x;             // one Newton iteration (see vml_rcp)
+    return r;
+  }
+  realvec_t remainder(realvec_t y) const { return MF::vml_remainder(*this, y); }
+  realvec_t rint() const {
+    return _mm512_roundscale_ps(v,
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  realvec_t round() const { return MF::vml_round(*this); }
+  realvec_t rsqrt() const {
+    realvec_t x = *this;
+    realvec_t r = _mm512_rsqrt14_ps(x); // this is only an approximation
+    r *= RV(1.5) - RV(0.5) * x * r * r; // one Newton iteration (see vml_rsqrt)
+    return r;
+  }
+  boolvec_t signbit() const { return as_int().as_bool(); }
+  realvec_t sin() const { return MF::vml_sin(*this); }
+  realvec_t sinh() const { return MF::vml_sinh(*this); }
+  realvec_t sqrt() const { return _mm512_sqrt_ps(v); }
+  realvec_t tan() const { return MF::vml_tan(*this); }
+  realvec_t tanh() const { return MF::vml_tanh(*this); }
+  realvec_t trunc() const {
+    return _mm512_roundscale_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  }
+};
+
+// boolvec definitions
+
+inline intvec<float, 16> boolvec<float, 16>::as_int() const {
+  return _mm512_maskz_mov_epi32(v, _mm512_set1_epi32(-1));
+}
+
+inline intvec<float, 16> boolvec<float, 16>::convert_int() const {
+  return _mm512_maskz_mov_epi32(v, _mm512_set1_epi32(1));
+}
+
+inline intvec<float, 16> boolvec<float, 16>::ifthen(intvec_t x,
+                                                    intvec_t y) const {
+  return _mm512_mask_blend_epi32(v, y.v, x.v);
+}
+
+inline realvec<float, 16> boolvec<float, 16>::ifthen(realvec_t x,
+                                                     realvec_t y) const {
+  return _mm512_mask_blend_ps(v, y.v, x.v);
+}
+
+// intvec definitions
+
+inline intvec<float, 16> intvec<float, 16>::abs() const {
+  return _mm512_abs_epi32(v);
+}
+
+inline realvec<float, 16> intvec<float, 16>::as_float() const {
+  return _mm512_castsi512_ps(v);
+}
+
+inline intvec<float, 16> intvec<float, 16>::bitifthen(intvec_t x,
+                                                      intvec_t y) const {
+  // 0xca selects x where this has a bit set, and y elsewhere
+  return _mm512_ternarylogic_epi32(v, x.v, y.v, 0xca);
+}
+
+inline intvec<float, 16> intvec<float, 16>::clz() const {
+  return MF::vml_clz(*this);
+}
+
+inline realvec<float, 16> intvec<float, 16>::convert_float() const {
+  return _mm512_cvtepi32_ps(v);
+}
+
+inline intvec<float, 16> intvec<float, 16>::max(intvec_t x) const {
+  return _mm512_max_epi32(v, x.v);
+}
+
+inline intvec<float, 16> intvec<float, 16>::min(intvec_t x) const {
+  return _mm512_min_epi32(v, x.v);
+}
+
+inline intvec<float, 16> intvec<float, 16>::popcount() const {
+  return MF::vml_popcount(*this);
+}
+
+inline intvec<float, 16> intvec<float, 16>::rotate(int_t n) const {
+  return MF::vml_rotate(*this, n);
+}
+
+inline intvec<float, 16> intvec<float, 16>::rotate(intvec_t n) const {
+  return MF::vml_rotate(*this, n);
+}
+
+} // namespace vecmathlib
+
+#endif // #ifndef VEC_AVX512_FLOAT16_H
@@ -60,6 +60,15 @@
 #else
 #define VML_CONFIG_NAN " no-nan"
 #endif
+// VML_RELAXED_MATH selects the reduced-precision variants of some
+// functions: the float polynomials are shortened to the error bounds
+// OpenCL allows with -cl-fast-relaxed-math, and the special cases for
+// non-finite, zero and denormal arguments are not handled.
+#ifdef VML_RELAXED_MATH
+#define VML_CONFIG_RELAXED_MATH " relaxed-math"
+#else
+#define VML_CONFIG_RELAXED_MATH
+#endif
 
 // TODO: introduce mad, as fast version of fma (check FP_FAST_FMA)
 // TODO: introduce ieee_isnan and friends
@@ -146,7 +155,15 @@ class type_info;
 #define VML_CONFIG_AVX
 #endif
 
-#if defined __MIC__ // Intel MIC
+#if defined __AVX512F__ // Intel AVX-512
+#include "vec_avx512_float16.h"
+#include "vec_avx512_double8.h"
+#define VML_CONFIG_AVX512 " AVX512"
+#else
+#define VML_CONFIG_AVX512
+#endif
+
+#if defined __MIC__ && !defined __AVX512F__ // Intel MIC
 // TODO: single precision?
 #include "vec_mic_double8.h"
 #define VML_CONFIG_MIC " MIC"
@@ -179,9 +196,10 @@ class type_info;
 
 #define VECMATHLIB_CONFIGURATION                                               \
   "VecmathlibConfiguration" VML_CONFIG_DEBUG VML_CONFIG_DENORMALS              \
-      VML_CONFIG_FP_CONTRACT VML_CONFIG_INF VML_CONFIG_NAN VML_CONFIG_NEON     \
-          VML_CONFIG_SSE2 VML_CONFIG_AVX VML_CONFIG_MIC VML_CONFIG_ALTIVEC     \
-              VML_CONFIG_VSX VML_CONFIG_QPX
+      VML_CONFIG_FP_CONTRACT VML_CONFIG_INF VML_CONFIG_NAN                     \
+          VML_CONFIG_RELAXED_MATH VML_CONFIG_NEON VML_CONFIG_SSE2              \
+              VML_CONFIG_AVX VML_CONFIG_AVX512 VML_CONFIG_MIC                  \
+                  VML_CONFIG_ALTIVEC VML_CONFIG_VSX VML_CONFIG_QPX
 
 // Define "best" vector types
 namespace vecmathlib {
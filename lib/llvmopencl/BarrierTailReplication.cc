@@ -77,6 +77,10 @@ BarrierTailReplication::runOnFunction(Function &F)
 {
   if (!Workgroup::isKernelToProcess(F))
     return false;
+
+  /* There are no tails to replicate in kernels without barriers. */
+  if (!Workgroup::hasWorkgroupBarriers(F))
+    return false;
   
 #ifdef DEBUG_BARRIER_REPL
   std::cerr << "### BTR on " << F.getName().str() << std::endl;
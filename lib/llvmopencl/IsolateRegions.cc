@@ -100,6 +100,11 @@ bool IsolateRegions::runOnRegion(Region *R, llvm::RGPassManager&) {
   llvm::BasicBlock *exit = R->getExit();
   if (exit == NULL) return false;
 
+  /* The regions need to be isolated only for the tail replication,
+     which is not done for kernels without barriers. */
+  if (!Workgroup::hasWorkgroupBarriers(*exit->getParent()))
+    return false;
+
 #ifdef DEBUG_ISOLATE_REGIONS
   std::cerr << "### processing region:" << std::endl;
   R->dump();
@@ -24,6 +24,7 @@
 
 #include "pocl.h"
 
+#include <llvm/IR/Argument.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Metadata.h>
@@ -104,4 +105,76 @@ void eraseFunctionAndCallers(llvm::Function *Function) {
   Function->eraseFromParent();
 }
 
+llvm::Function *
+findVectorVariant(const llvm::Module &M, const llvm::Function &ScalarF,
+                  unsigned Width) {
+  llvm::FunctionType *FT = ScalarF.getFunctionType();
+  llvm::Type *T = FT->getReturnType();
+  unsigned NumParams = FT->getNumParams();
+  char Code;
+
+  if (T->isFloatTy())
+    Code = 'f';
+  else if (T->isDoubleTy())
+    Code = 'd';
+  else
+    return NULL;
+  if (NumParams < 1 || NumParams > 3 || FT->isVarArg())
+    return NULL;
+  for (unsigned i = 0; i < NumParams; ++i)
+    if (FT->getParamType(i) != T)
+      return NULL;
+
+  llvm::StringRef Name = ScalarF.getName();
+  if (!Name.startswith("_Z") || !Name.endswith(std::string(NumParams, Code)))
+    return NULL;
+
+  // The repeated vector parameters are mangled as substitutions.
+  std::string VecName = Name.drop_back(NumParams).str();
+  VecName += "Dv" + std::to_string(Width) + "_" + Code;
+  for (unsigned i = 1; i < NumParams; ++i)
+    VecName += "S_";
+
+  llvm::Function *VecF = M.getFunction(VecName);
+  if (VecF == NULL || VecF->isDeclaration())
+    return NULL;
+
+  llvm::Type *VecT = llvm::VectorType::get(T, Width);
+  llvm::FunctionType *VecFT = VecF->getFunctionType();
+  if (VecFT->getReturnType() != VecT || VecFT->getNumParams() != NumParams)
+    return NULL;
+  for (unsigned i = 0; i < NumParams; ++i)
+    if (VecFT->getParamType(i) != VecT)
+      return NULL;
+  return VecF;
+}
+
+llvm::Type *
+argBlobSlotType(const llvm::Argument &A)
+{
+  llvm::Type *T = A.getType();
+  if (A.hasByValAttr())
+    return T->getPointerElementType();
+  return T;
+}
+
+size_t
+layoutArgBlob(llvm::ArrayRef<llvm::Type *> SlotTypes,
+              const llvm::DataLayout &DL, std::vector<size_t> &Offsets)
+{
+  size_t Size = 0;
+  for (size_t i = 0; i < SlotTypes.size(); ++i) {
+    size_t SlotSize = DL.getTypeAllocSize(SlotTypes[i]);
+    if (SlotTypes[i]->isPointerTy() && SlotSize < sizeof(void *))
+      SlotSize = sizeof(void *);
+    size_t Align = 1;
+    while (Align < SlotSize && Align < MAX_EXTENDED_ALIGNMENT)
+      Align *= 2;
+    Size = (Size + Align - 1) & ~(Align - 1);
+    Offsets.push_back(Size);
+    Size += SlotSize;
+  }
+  return Size;
+}
+
 }
@@ -25,16 +25,20 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "pocl.h"
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/ADT/ArrayRef.h>
 
 #include "TargetAddressSpaces.h"
 
 namespace llvm {
+    class Argument;
     class Module;
     class Function;
     class GlobalVariable;
@@ -50,6 +54,29 @@ regenerate_kernel_metadata(llvm::Module &M, FunctionMapping &kernels);
 // Remove a function from a module, along with all callsites.
 void eraseFunctionAndCallers(llvm::Function *Function);
 
+// Returns the Width wide vector variant of a scalar kernel library builtin
+// in M, e.g. _Z7_cl_sinDv4_f for _Z7_cl_sinf, or NULL if there's none.
+// Only builtins taking one to three floats or doubles and returning the
+// same type are considered, and the variant must take and return the
+// corresponding vectors by value.
+llvm::Function *
+findVectorVariant(const llvm::Module &M, const llvm::Function &ScalarF,
+                  unsigned Width);
+
+// Returns the type of the value stored for the kernel argument A in the
+// argument blob of the _workgroup launchers: the pointee type of a byval
+// argument, the argument type otherwise.
+llvm::Type *argBlobSlotType(const llvm::Argument &A);
+
+// Lays out the argument blob slots of the given types, appending the
+// offset of each slot to Offsets. Returns the size of the blob. A slot is
+// aligned to its size rounded up to a power of two, at most
+// MAX_EXTENDED_ALIGNMENT. The pointer slots are at least as large as a
+// host pointer, as the runtime stores the object handles in them.
+size_t
+layoutArgBlob(llvm::ArrayRef<llvm::Type *> SlotTypes,
+              const llvm::DataLayout &DL, std::vector<size_t> &Offsets);
+
 inline bool
 isAutomaticLocal(const std::string &FuncName, llvm::GlobalVariable &Var) {
 #ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
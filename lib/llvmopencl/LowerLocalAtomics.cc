@@ -0,0 +1,207 @@
+// LLVM function pass to convert local memory atomics to plain memory
+// operations.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <vector>
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include "config.h"
+#include "pocl.h"
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Operator.h>
+
+#include "LowerLocalAtomics.h"
+#include "TargetAddressSpaces.h"
+
+POP_COMPILER_DIAGS
+
+using namespace llvm;
+
+namespace {
+  static
+  RegisterPass<pocl::LowerLocalAtomics> X("lower-local-atomics",
+                                          "Converts local memory atomics to "
+                                          "plain loads and stores.");
+}
+
+namespace pocl {
+
+char LowerLocalAtomics::ID = 0;
+
+LowerLocalAtomics::LowerLocalAtomics() : FunctionPass(ID) {
+}
+
+#ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
+// Returns true if the pointer is derived from a local address space
+// pointer. The kernel library casts the local pointers through an integer
+// to the default address space for some of the atomic builtins, thus
+// look through the casts and GEPs.
+static bool
+isLocalPointer(Value *Ptr) {
+  while (true) {
+    if (Ptr->getType()->isPointerTy() &&
+        Ptr->getType()->getPointerAddressSpace() == POCL_FAKE_AS_LOCAL)
+      return true;
+
+    Operator *Op = dyn_cast<Operator>(Ptr);
+    if (Op == NULL)
+      return false;
+    switch (Op->getOpcode()) {
+    case Instruction::BitCast:
+    case Instruction::AddrSpaceCast:
+    case Instruction::IntToPtr:
+    case Instruction::PtrToInt:
+    case Instruction::GetElementPtr:
+      Ptr = Op->getOperand(0);
+      break;
+    default:
+      return false;
+    }
+  }
+}
+
+static void
+markLowered(Instruction *I) {
+  I->setMetadata(POCL_LOWERED_ATOMIC_MD,
+                 MDNode::get(I->getContext(), ArrayRef<Metadata*>()));
+}
+
+static Value *
+lowerAtomicRMW(AtomicRMWInst *RMW) {
+  IRBuilder<> Builder(RMW);
+  Value *Ptr = RMW->getPointerOperand();
+  Value *Val = RMW->getValOperand();
+
+  // The volatile qualifier comes from the OpenCL atomic builtin prototypes,
+  // so it is dropped along with the atomicity.
+  Value *Old = Builder.CreateLoad(Ptr);
+  Value *New = NULL;
+  switch (RMW->getOperation()) {
+  case AtomicRMWInst::Xchg:
+    New = Val;
+    break;
+  case AtomicRMWInst::Add:
+    New = Builder.CreateAdd(Old, Val);
+    break;
+  case AtomicRMWInst::Sub:
+    New = Builder.CreateSub(Old, Val);
+    break;
+  case AtomicRMWInst::And:
+    New = Builder.CreateAnd(Old, Val);
+    break;
+  case AtomicRMWInst::Nand:
+    New = Builder.CreateNot(Builder.CreateAnd(Old, Val));
+    break;
+  case AtomicRMWInst::Or:
+    New = Builder.CreateOr(Old, Val);
+    break;
+  case AtomicRMWInst::Xor:
+    New = Builder.CreateXor(Old, Val);
+    break;
+  case AtomicRMWInst::Max:
+    New = Builder.CreateSelect(Builder.CreateICmpSGT(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::Min:
+    New = Builder.CreateSelect(Builder.CreateICmpSLT(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::UMax:
+    New = Builder.CreateSelect(Builder.CreateICmpUGT(Old, Val), Old, Val);
+    break;
+  case AtomicRMWInst::UMin:
+    New = Builder.CreateSelect(Builder.CreateICmpULT(Old, Val), Old, Val);
+    break;
+  default:
+    // Leave unknown operations atomic.
+    cast<Instruction>(Old)->eraseFromParent();
+    return NULL;
+  }
+  markLowered(cast<Instruction>(Old));
+  markLowered(Builder.CreateStore(New, Ptr));
+  return Old;
+}
+
+static Value *
+lowerAtomicCmpXchg(AtomicCmpXchgInst *CmpXchg) {
+  IRBuilder<> Builder(CmpXchg);
+  Value *Ptr = CmpXchg->getPointerOperand();
+
+  Value *Old = Builder.CreateLoad(Ptr);
+  Value *Equal = Builder.CreateICmpEQ(Old, CmpXchg->getCompareOperand());
+  Value *New = Builder.CreateSelect(Equal, CmpXchg->getNewValOperand(), Old);
+  markLowered(cast<Instruction>(Old));
+  markLowered(Builder.CreateStore(New, Ptr));
+
+  Value *Res = Builder.CreateInsertValue(UndefValue::get(CmpXchg->getType()),
+                                         Old, 0);
+  return Builder.CreateInsertValue(Res, Equal, 1);
+}
+#endif
+
+bool
+LowerLocalAtomics::runOnFunction(Function &F) {
+#ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
+  // Collect the atomics first as replacing them invalidates the iterators.
+  std::vector<Instruction*> Atomics;
+
+  for (Function::iterator I = F.begin(), E = F.end(); I != E; ++I) {
+    for (BasicBlock::iterator BI = I->begin(), BE = I->end(); BI != BE; ++BI) {
+      if (AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(BI)) {
+        if (isLocalPointer(RMW->getPointerOperand()))
+          Atomics.push_back(RMW);
+      } else if (AtomicCmpXchgInst *CX = dyn_cast<AtomicCmpXchgInst>(BI)) {
+        if (isLocalPointer(CX->getPointerOperand()))
+          Atomics.push_back(CX);
+      }
+    }
+  }
+
+  bool Changed = false;
+  for (auto A : Atomics) {
+    Value *Replacement = NULL;
+    if (AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(A))
+      Replacement = lowerAtomicRMW(RMW);
+    else
+      Replacement = lowerAtomicCmpXchg(cast<AtomicCmpXchgInst>(A));
+    if (Replacement == NULL)
+      continue;
+    A->replaceAllUsesWith(Replacement);
+    A->eraseFromParent();
+    Changed = true;
+  }
+  return Changed;
+#else
+  // Without the fake address space IDs the local address space cannot be
+  // recognized from the IR, see isAutomaticLocal().
+  return false;
+#endif
+}
+
+void
+LowerLocalAtomics::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesCFG();
+}
+
+}
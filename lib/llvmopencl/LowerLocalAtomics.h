@@ -0,0 +1,61 @@
+// Header for LowerLocalAtomics function pass.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _POCL_LOWER_LOCAL_ATOMICS_H
+#define _POCL_LOWER_LOCAL_ATOMICS_H
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include <llvm/IR/Function.h>
+#include <llvm/Pass.h>
+
+POP_COMPILER_DIAGS
+
+// The metadata kind marking the loads and stores the local atomics are
+// lowered to. The work-items of a work-group access the same locations
+// with them, so they must not be treated as independent across the
+// work-items, e.g. by the parallel loop metadata of the work-item loops.
+#define POCL_LOWERED_ATOMIC_MD "pocl.lowered_atomic"
+
+namespace pocl {
+
+// Converts the atomic read-modify-write and compare-exchange operations on
+// the local address space to plain loads and stores. Only valid for the
+// devices where all the work-items of a work-group are executed by one
+// thread of control, i.e. the non-SPMD targets: the local memory is then
+// never accessed concurrently.
+class LowerLocalAtomics : public llvm::FunctionPass {
+public:
+
+  static char ID;
+
+  LowerLocalAtomics();
+  virtual ~LowerLocalAtomics() {};
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+  virtual bool runOnFunction(llvm::Function &F);
+};
+
+}
+
+#endif
@@ -32,6 +32,7 @@
 #include "WorkitemHandlerChooser.h"
 #include "WorkitemLoops.h"
 #include "VariableUniformityAnalysis.h"
+#include "pocl_runtime_config.h"
 
 namespace {
   static
@@ -62,8 +63,16 @@ PHIsToAllocas::runOnFunction(Function &F) {
   /* Skip PHIsToAllocas when we are not creating the work item loops,
      as it leads to worse code without benefits for the full replication method.
   */
-  if (getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler() != 
-      pocl::WorkitemHandlerChooser::POCL_WIH_LOOPS)
+  if (getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler() ==
+      pocl::WorkitemHandlerChooser::POCL_WIH_FULL_REPLICATION)
+    return false;
+
+  /* Kernels without barriers get a single work-item loop nest around
+     the whole body, where the PHIs can stay as they are. This pass runs
+     before -implicit-loop-barriers, which adds barriers to exactly these
+     kernels with POCL_FORCE_PARALLEL_OUTER_LOOP. */
+  if (!pocl_get_bool_option("POCL_FORCE_PARALLEL_OUTER_LOOP", 0) &&
+      !Workgroup::hasWorkgroupBarriers(F))
     return false;
 
   typedef std::vector<llvm::Instruction* > InstructionVec;
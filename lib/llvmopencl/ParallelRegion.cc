@@ -38,6 +38,7 @@
 #include "Barrier.h"
 #include "Kernel.h"
 #include "DebugHelpers.h"
+#include "LowerLocalAtomics.h"
 
 using namespace std;
 using namespace llvm;
@@ -494,7 +495,10 @@ ParallelRegion::AddParallelLoopMetadata(llvm::MDNode *identifier) {
     BasicBlock* bb = *i;      
     for (BasicBlock::iterator ii = bb->begin(), ee = bb->end();
          ii != ee; ii++) {
-      if (ii->mayReadOrWriteMemory()) {
+      /* The lowered local atomics access the same location from all the
+         work-items. */
+      if (ii->mayReadOrWriteMemory() &&
+          ii->getMetadata(POCL_LOWERED_ATOMIC_MD) == NULL) {
         MDNode *newMD = MDNode::get(bb->getContext(), identifier);
         MDNode *oldMD = ii->getMetadata("llvm.mem.parallel_loop_access");
         if (oldMD != NULL) {
@@ -0,0 +1,325 @@
+// LLVM module pass to replace async copies to read-only local buffers
+// with prefetches of the global source.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cctype>
+#include <vector>
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include "config.h"
+#include "pocl.h"
+
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include "LLVMUtils.h"
+#include "PrefetchAsyncCopies.h"
+#include "TargetAddressSpaces.h"
+#include "Workgroup.h"
+
+#include "pocl_runtime_config.h"
+
+POP_COMPILER_DIAGS
+
+using namespace llvm;
+
+namespace {
+  static
+  RegisterPass<pocl::PrefetchAsyncCopies> X("prefetch-async-copies",
+                                            "Replaces async copies to "
+                                            "read-only local buffers with "
+                                            "prefetches.");
+}
+
+namespace pocl {
+
+char PrefetchAsyncCopies::ID = 0;
+
+PrefetchAsyncCopies::PrefetchAsyncCopies() : ModulePass(ID) {
+}
+
+#ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
+
+// Returns the unmangled name of an OpenCL builtin, e.g. "barrier" for
+// _Z7barrierj, or an empty string if the function is not a builtin.
+static StringRef
+builtinName(const Function *F) {
+  if (F == NULL || !F->getName().startswith("_Z"))
+    return StringRef();
+  StringRef Name = F->getName().drop_front(2);
+  size_t Digits = 0;
+  while (Digits < Name.size() && isdigit(Name[Digits]))
+    ++Digits;
+  unsigned Len = 0;
+  if (Name.substr(0, Digits).getAsInteger(10, Len) ||
+      Len > Name.size() - Digits)
+    return StringRef();
+  return Name.substr(Digits, Len);
+}
+
+static bool
+isAsyncCopy(const CallInst *Call, unsigned DstAS, unsigned SrcAS) {
+  if (builtinName(Call->getCalledFunction()) != "async_work_group_copy" ||
+      Call->getNumArgOperands() != 4)
+    return false;
+  Type *DstT = Call->getArgOperand(0)->getType();
+  Type *SrcT = Call->getArgOperand(1)->getType();
+  return DstT->isPointerTy() && DstT->getPointerAddressSpace() == DstAS &&
+    SrcT->isPointerTy() && SrcT->getPointerAddressSpace() == SrcAS;
+}
+
+// Returns the object the pointer is based on, looking through the casts
+// and the address computations.
+static Value *
+basePointer(Value *Ptr) {
+  while (true) {
+    Ptr = Ptr->stripPointerCasts();
+    if (GEPOperator *GEP = dyn_cast<GEPOperator>(Ptr))
+      Ptr = GEP->getPointerOperand();
+    else
+      return Ptr;
+  }
+}
+
+// Returns true if a write through Ptr might modify the object SrcBase
+// points to. SrcBase is a restrict kernel argument, or NULL if nothing is
+// known of the source.
+static bool
+mayWriteSource(Value *Ptr, Argument *SrcBase) {
+  unsigned AS = Ptr->getType()->getPointerAddressSpace();
+  if (AS == POCL_FAKE_AS_PRIVATE || AS == POCL_FAKE_AS_LOCAL)
+    return false;
+  if (SrcBase == NULL)
+    return true;
+  // Per the restrict semantics, the source can only be accessed through
+  // pointers based on it.
+  Value *Base = basePointer(Ptr);
+  if (Base == SrcBase)
+    return true;
+  return !(isa<Argument>(Base) || isa<GlobalVariable>(Base) ||
+           isa<AllocaInst>(Base));
+}
+
+// Returns true if the kernel might modify the memory the source of the
+// async copy points to.
+static bool
+mayModifySource(Function &F, Value *Src) {
+  Argument *SrcBase = dyn_cast<Argument>(basePointer(Src));
+  if (SrcBase != NULL && !SrcBase->hasNoAliasAttr())
+    SrcBase = NULL;
+
+  for (Function::iterator I = F.begin(), E = F.end(); I != E; ++I) {
+    for (BasicBlock::iterator BI = I->begin(), BE = I->end(); BI != BE; ++BI) {
+      Instruction *Inst = &*BI;
+      if (!Inst->mayWriteToMemory())
+        continue;
+      if (StoreInst *Store = dyn_cast<StoreInst>(Inst)) {
+        if (mayWriteSource(Store->getPointerOperand(), SrcBase))
+          return true;
+      } else if (AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(Inst)) {
+        if (mayWriteSource(RMW->getPointerOperand(), SrcBase))
+          return true;
+      } else if (AtomicCmpXchgInst *CX = dyn_cast<AtomicCmpXchgInst>(Inst)) {
+        if (mayWriteSource(CX->getPointerOperand(), SrcBase))
+          return true;
+      } else if (CallInst *Call = dyn_cast<CallInst>(Inst)) {
+        Function *Callee = Call->getCalledFunction();
+        if (isa<DbgInfoIntrinsic>(Call) || isAsyncCopy(Call,
+                                                       POCL_FAKE_AS_LOCAL,
+                                                       POCL_FAKE_AS_GLOBAL))
+          continue;
+        if (Callee != NULL && Callee->onlyReadsMemory())
+          continue;
+        StringRef Name = builtinName(Callee);
+        if (Name == "barrier" || Name == "wait_group_events" ||
+            Name == "prefetch" || Name.startswith("get_"))
+          continue;
+        if (SrcBase == NULL)
+          return true;
+        for (unsigned i = 0; i < Call->getNumArgOperands(); ++i) {
+          Value *Arg = Call->getArgOperand(i);
+          if (Arg->getType()->isPointerTy() && mayWriteSource(Arg, SrcBase))
+            return true;
+        }
+      } else {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Tries to replace the local buffer Local of the kernel F with the source
+// of the async copy filling it. Returns true on success.
+static bool
+prefetchLocal(Function &F, GlobalVariable *Local, DominatorTree &DT) {
+  CallInst *Copy = NULL;
+  std::vector<LoadInst *> Loads;
+
+  // Find the users of the buffer: the loads and one async copy to its
+  // start. Anything else, such as a store, disqualifies it.
+  std::vector<Value *> Worklist(1, Local);
+  while (!Worklist.empty()) {
+    Value *V = Worklist.back();
+    Worklist.pop_back();
+    for (Value::user_iterator UI = V->user_begin(), UE = V->user_end();
+         UI != UE; ++UI) {
+      User *U = *UI;
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(U)) {
+        if (CE->getOpcode() != Instruction::BitCast &&
+            CE->getOpcode() != Instruction::GetElementPtr)
+          return false;
+        Worklist.push_back(CE);
+        continue;
+      }
+      Instruction *I = dyn_cast<Instruction>(U);
+      if (I == NULL || I->getParent()->getParent() != &F)
+        return false;
+      if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+        Worklist.push_back(I);
+      } else if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+        if (Load->isVolatile() || !Load->isUnordered())
+          return false;
+        Loads.push_back(Load);
+      } else if (CallInst *Call = dyn_cast<CallInst>(I)) {
+        if (Copy != NULL ||
+            !isAsyncCopy(Call, POCL_FAKE_AS_LOCAL, POCL_FAKE_AS_GLOBAL) ||
+            Call->getArgOperand(0) != V ||
+            V->stripPointerCasts() != Local)
+          return false;
+        Copy = Call;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  if (Copy == NULL)
+    return false;
+  for (auto Load : Loads)
+    if (!DT.dominates(Copy, Load))
+      return false;
+
+  Value *Src = Copy->getArgOperand(1);
+  if (mayModifySource(F, Src))
+    return false;
+
+  IRBuilder<> Builder(Copy);
+  Type *LocalT = Local->getType()->getElementType();
+  Value *NewBase =
+    Builder.CreateBitCast(Src, PointerType::get(LocalT, POCL_FAKE_AS_GLOBAL));
+
+  // Start loading the first cache line of the source, the hardware
+  // prefetchers continue from there. The host memory is flat, so the
+  // pointer can be converted through an integer.
+  Module *M = F.getParent();
+  Value *PrefetchAddr =
+    Builder.CreateIntToPtr(Builder.CreatePtrToInt(Src, Builder.getInt64Ty()),
+                           Builder.getInt8PtrTy());
+  Builder.CreateCall(Intrinsic::getDeclaration(M, Intrinsic::prefetch),
+                     {PrefetchAddr, Builder.getInt32(0), Builder.getInt32(3),
+                      Builder.getInt32(1)});
+
+  Copy->replaceAllUsesWith(Copy->getArgOperand(3));
+  Copy->eraseFromParent();
+
+  // Recreate the address computations of each load on the global source.
+  for (auto Load : Loads) {
+    std::vector<Operator *> Path;
+    for (Value *V = Load->getPointerOperand(); V != Local;
+         V = cast<Operator>(V)->getOperand(0))
+      Path.push_back(cast<Operator>(V));
+
+    Builder.SetInsertPoint(Load);
+    Value *Ptr = NewBase;
+    for (auto I = Path.rbegin(), E = Path.rend(); I != E; ++I) {
+      Operator *Op = *I;
+      if (GEPOperator *GEP = dyn_cast<GEPOperator>(Op)) {
+        std::vector<Value *> Indices(GEP->idx_begin(), GEP->idx_end());
+        Ptr = GEP->isInBounds() ? Builder.CreateInBoundsGEP(Ptr, Indices)
+                                : Builder.CreateGEP(Ptr, Indices);
+      } else {
+        Type *ElemT = Op->getType()->getPointerElementType();
+        Ptr = Builder.CreateBitCast(
+          Ptr, PointerType::get(ElemT, POCL_FAKE_AS_GLOBAL));
+      }
+    }
+
+    LoadInst *NewLoad = Builder.CreateLoad(Ptr);
+    NewLoad->setAlignment(Load->getAlignment());
+    NewLoad->takeName(Load);
+    Value *OldPtr = Load->getPointerOperand();
+    Load->replaceAllUsesWith(NewLoad);
+    Load->eraseFromParent();
+    RecursivelyDeleteTriviallyDeadInstructions(OldPtr);
+  }
+
+  Local->removeDeadConstantUsers();
+  if (Local->use_empty())
+    Local->eraseFromParent();
+  return true;
+}
+#endif
+
+bool
+PrefetchAsyncCopies::runOnModule(Module &M) {
+  if (!pocl_get_bool_option("POCL_ASYNC_COPY_PREFETCH", 0))
+    return false;
+
+#ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
+  bool Changed = false;
+  for (Module::iterator MI = M.begin(), ME = M.end(); MI != ME; ++MI) {
+    Function &F = *MI;
+    if (!Workgroup::isKernelToProcess(F))
+      continue;
+
+    std::string FuncName = F.getName().str();
+    std::vector<GlobalVariable *> Locals;
+    for (Module::global_iterator GI = M.global_begin(), GE = M.global_end();
+         GI != GE; ++GI) {
+      if (isAutomaticLocal(FuncName, *GI))
+        Locals.push_back(&*GI);
+    }
+    if (Locals.empty())
+      continue;
+
+    DominatorTree DT;
+    DT.recalculate(F);
+    for (auto Local : Locals)
+      Changed |= prefetchLocal(F, Local, DT);
+  }
+  return Changed;
+#else
+  // Without the fake address space IDs the local buffers cannot be told
+  // apart from the global ones, see isAutomaticLocal().
+  return false;
+#endif
+}
+
+}
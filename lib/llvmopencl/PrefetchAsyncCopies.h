@@ -0,0 +1,57 @@
+// Header for PrefetchAsyncCopies module pass.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _POCL_PREFETCH_ASYNC_COPIES_H
+#define _POCL_PREFETCH_ASYNC_COPIES_H
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+POP_COMPILER_DIAGS
+
+namespace pocl {
+
+// Prefetch-only mode for async_work_group_copy() on the CPU devices,
+// enabled with POCL_ASYNC_COPY_PREFETCH. When an automatic local buffer
+// is filled by a single global to local async copy and otherwise only
+// read, the loads from the buffer are redirected to the global source,
+// and the copy is replaced with a prefetch. This is only done if the
+// source cannot be modified by the kernel, and if the copy dominates the
+// loads. The local and global memories must share an address space, which
+// holds for the non-SPMD targets.
+class PrefetchAsyncCopies : public llvm::ModulePass {
+public:
+
+  static char ID;
+
+  PrefetchAsyncCopies();
+  virtual ~PrefetchAsyncCopies() {};
+
+  virtual bool runOnModule(llvm::Module &M);
+};
+
+}
+
+#endif
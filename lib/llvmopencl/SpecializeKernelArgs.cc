@@ -0,0 +1,271 @@
+// LLVM function pass to specialize a kernel on the values of its scalar
+// arguments, the formats of its image arguments and the values of its
+// sampler arguments.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include <cstring>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include "config.h"
+#include "pocl_cl.h"
+
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include "SpecializeKernelArgs.h"
+#include "Workgroup.h"
+
+POP_COMPILER_DIAGS
+
+using namespace llvm;
+
+namespace {
+  static
+  RegisterPass<pocl::SpecializeKernelArgs> X("specialize-kernel-args",
+                                             "Specializes the kernel on the "
+                                             "argument values of a launch.");
+}
+
+namespace pocl {
+
+char SpecializeKernelArgs::ID = 0;
+
+const pocl_kernel_specialization *KernelSpecialization = NULL;
+
+SpecializeKernelArgs::SpecializeKernelArgs() : FunctionPass(ID) {
+}
+
+// The dev_image_t fields (see pocl_types.h) of the values of
+// pocl_arg_specialization, in the same order: _order, _data_type,
+// _num_channels and _elem_size.
+static const unsigned SpecializedImageFields[] = { 9, 10, 11, 12 };
+
+static StructType *
+devImageType(LLVMContext &C) {
+  std::vector<Type*> Fields(13, Type::getInt32Ty(C));
+  Fields[0] = Type::getInt8PtrTy(C);
+  return StructType::get(C, Fields);
+}
+
+// Collects the non-volatile loads through Ptr with their constant byte
+// offsets from it, looking through the pointer casts and the constant
+// index GEPs of the inlined builtins.
+static void
+findConstantOffsetLoads(Value *Ptr, const DataLayout &DL,
+                        std::vector<std::pair<LoadInst*, int64_t> > &Loads) {
+  std::vector<std::pair<Value*, int64_t> > Worklist;
+  Worklist.push_back(std::make_pair(Ptr, (int64_t)0));
+
+  while (!Worklist.empty()) {
+    Value *V = Worklist.back().first;
+    int64_t Offset = Worklist.back().second;
+    Worklist.pop_back();
+
+    for (User *U : V->users()) {
+      if (LoadInst *Load = dyn_cast<LoadInst>(U)) {
+        if (!Load->isVolatile())
+          Loads.push_back(std::make_pair(Load, Offset));
+      } else if (isa<BitCastInst>(U) || isa<AddrSpaceCastInst>(U)) {
+        Worklist.push_back(std::make_pair((Value*)U, Offset));
+      } else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(U)) {
+        APInt GEPOffset(
+          DL.getPointerSizeInBits(GEP->getPointerAddressSpace()), 0);
+        if (GEP->getPointerOperand() == V &&
+            GEP->accumulateConstantOffset(DL, GEPOffset))
+          Worklist.push_back(
+            std::make_pair((Value*)GEP, Offset + GEPOffset.getSExtValue()));
+      }
+    }
+  }
+}
+
+// Returns the constant of type Ty with the bytes of a specialized scalar
+// argument value, NULL if the sizes do not match.
+static Constant *
+scalarConstant(Type *Ty, const pocl_arg_specialization &Spec,
+               const DataLayout &DL) {
+  if (!(Ty->isIntegerTy() || Ty->isFloatingPointTy() || Ty->isVectorTy()) ||
+      DL.getTypeStoreSize(Ty) != Spec.size ||
+      DL.getTypeSizeInBits(Ty) != Spec.size * 8)
+    return NULL;
+
+  // The device is the host, read the value in the host byte order.
+  uint64_t Bits = 0;
+  switch (Spec.size) {
+  case 1: { uint8_t V; memcpy(&V, Spec.value, 1); Bits = V; break; }
+  case 2: { uint16_t V; memcpy(&V, Spec.value, 2); Bits = V; break; }
+  case 4: { uint32_t V; memcpy(&V, Spec.value, 4); Bits = V; break; }
+  case 8: { uint64_t V; memcpy(&V, Spec.value, 8); Bits = V; break; }
+  default:
+    return NULL;
+  }
+  Constant *C =
+    ConstantInt::get(IntegerType::get(Ty->getContext(), Spec.size * 8), Bits);
+  return ConstantExpr::getBitCast(C, Ty);
+}
+
+static void
+replaceWithConstant(Instruction *I, Constant *C,
+                    std::vector<Instruction*> &Users) {
+  for (User *U : I->users())
+    if (Instruction *UI = dyn_cast<Instruction>(U))
+      Users.push_back(UI);
+  I->replaceAllUsesWith(C);
+}
+
+// Propagates the constants to the users of the replaced loads so the
+// branches and switches on them fold away already before the work-item
+// passes.
+static void
+foldConstants(Function &F, std::vector<Instruction*> Worklist,
+              const DataLayout &DL) {
+  std::set<Instruction*> Folded;
+  std::vector<Instruction*> ToErase;
+  std::set<BasicBlock*> Terminators;
+
+  while (!Worklist.empty()) {
+    Instruction *I = Worklist.back();
+    Worklist.pop_back();
+    if (Folded.count(I))
+      continue;
+    if (I->isTerminator()) {
+      Terminators.insert(I->getParent());
+      continue;
+    }
+#ifdef LLVM_OLDER_THAN_3_7
+    Constant *C = ConstantFoldInstruction(I, &DL);
+#else
+    Constant *C = ConstantFoldInstruction(I, DL);
+#endif
+    if (C == NULL)
+      continue;
+    replaceWithConstant(I, C, Worklist);
+    Folded.insert(I);
+    ToErase.push_back(I);
+  }
+
+  for (auto I : ToErase)
+    I->eraseFromParent();
+
+  for (auto BB : Terminators)
+    ConstantFoldTerminator(BB, true);
+  removeUnreachableBlocks(F);
+}
+
+bool
+SpecializeKernelArgs::runOnFunction(Function &F) {
+  if (KernelSpecialization == NULL || !Workgroup::isKernelToProcess(F))
+    return false;
+
+  Module *M = F.getParent();
+#ifdef LLVM_OLDER_THAN_3_7
+  const DataLayout &DL = *M->getDataLayout();
+#else
+  const DataLayout &DL = M->getDataLayout();
+#endif
+  const StructLayout *ImageLayout =
+    DL.getStructLayout(devImageType(M->getContext()));
+
+  std::vector<Argument*> Args;
+  for (Function::arg_iterator A = F.arg_begin(), E = F.arg_end(); A != E; ++A)
+    Args.push_back(&*A);
+
+  std::vector<Instruction*> Users;
+  bool Changed = false;
+
+  for (unsigned i = 0; i < KernelSpecialization->num_args; ++i) {
+    const pocl_arg_specialization &Spec = KernelSpecialization->args[i];
+    if (Spec.arg_index >= Args.size())
+      continue;
+    Argument *Arg = Args[Spec.arg_index];
+
+    if (Spec.type == POCL_ARG_TYPE_NONE) {
+      Constant *C = scalarConstant(Arg->getType(), Spec, DL);
+      if (C == NULL)
+        continue;
+      for (User *U : Arg->users())
+        if (Instruction *UI = dyn_cast<Instruction>(U))
+          Users.push_back(UI);
+      Arg->replaceAllUsesWith(C);
+      Changed = true;
+      continue;
+    }
+
+    // Before Clang 4.0 the samplers are passed as plain integers.
+    if (Spec.type == POCL_ARG_TYPE_SAMPLER && Arg->getType()->isIntegerTy()) {
+      for (User *U : Arg->users())
+        if (Instruction *UI = dyn_cast<Instruction>(U))
+          Users.push_back(UI);
+      Arg->replaceAllUsesWith(ConstantInt::get(Arg->getType(), Spec.value[0]));
+      Changed = true;
+      continue;
+    }
+    if (!Arg->getType()->isPointerTy())
+      continue;
+
+    std::vector<std::pair<LoadInst*, int64_t> > Loads;
+    findConstantOffsetLoads(Arg, DL, Loads);
+
+    for (auto L : Loads) {
+      LoadInst *Load = L.first;
+      if (!Load->getType()->isIntegerTy(32))
+        continue;
+      int Value = 0;
+      bool Found = false;
+      if (Spec.type == POCL_ARG_TYPE_SAMPLER) {
+        Found = L.second == 0;
+        Value = Spec.value[0];
+      } else {
+        for (unsigned f = 0; f < 4 && !Found; ++f) {
+          Found = (uint64_t)L.second ==
+            ImageLayout->getElementOffset(SpecializedImageFields[f]);
+          Value = Spec.value[f];
+        }
+      }
+      if (!Found)
+        continue;
+      replaceWithConstant(Load, ConstantInt::get(Load->getType(), Value),
+                          Users);
+      Load->eraseFromParent();
+      Changed = true;
+    }
+  }
+
+  if (Changed)
+    foldConstants(F, Users, DL);
+  return Changed;
+}
+
+void
+SpecializeKernelArgs::getAnalysisUsage(AnalysisUsage &AU) const {
+}
+
+}
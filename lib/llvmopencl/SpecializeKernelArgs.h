@@ -0,0 +1,65 @@
+// Header for SpecializeKernelArgs function pass.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _POCL_SPECIALIZE_KERNEL_ARGS_H
+#define _POCL_SPECIALIZE_KERNEL_ARGS_H
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include <llvm/IR/Function.h>
+#include <llvm/Pass.h>
+
+POP_COMPILER_DIAGS
+
+#include "pocl.h"
+
+namespace pocl {
+
+// Replaces the specialized scalar arguments, the loads of the channel
+// order, the channel data type, the number of channels and the element
+// size of the image arguments, and the loads of the sampler arguments,
+// with the constant values of the launch the work-group function is
+// compiled for, see KernelSpecialization. The format and addressing mode
+// switches of the image builtins then fold away, and the loops bounded
+// by the scalars get known trip counts.
+//
+// Must run after the image builtins have been inlined to the kernel.
+class SpecializeKernelArgs : public llvm::FunctionPass {
+public:
+
+  static char ID;
+
+  SpecializeKernelArgs();
+  virtual ~SpecializeKernelArgs() {};
+
+  virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+  virtual bool runOnFunction(llvm::Function &F);
+};
+
+// The argument values the kernel is specialized on, NULL if the kernel
+// is not specialized.
+extern const pocl_kernel_specialization *KernelSpecialization;
+
+}
+
+#endif
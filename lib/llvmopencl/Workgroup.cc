@@ -104,6 +104,7 @@ namespace llvm {
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
              TypeBuilder<types::i<64>[3], xcompile>::get(Context),
+             TypeBuilder<types::i<8>*, xcompile>::get(Context),
              NULL);
 #else
           SmallVector<Type*, 8> Elements;
@@ -117,6 +118,8 @@ namespace llvm {
             TypeBuilder<types::i<64>[3], xcompile>::get(Context));
           Elements.push_back(
             TypeBuilder<types::i<64>[3], xcompile>::get(Context));
+          Elements.push_back(
+            TypeBuilder<types::i<8>*, xcompile>::get(Context));
           return StructType::get(Context, Elements);
 #endif
         }
@@ -129,6 +132,7 @@ namespace llvm {
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
              TypeBuilder<types::i<32>[3], xcompile>::get(Context),
+             TypeBuilder<types::i<8>*, xcompile>::get(Context),
              NULL);
 #else
           SmallVector<Type*, 8> Elements;
@@ -142,6 +146,8 @@ namespace llvm {
             TypeBuilder<types::i<32>[3], xcompile>::get(Context));
           Elements.push_back(
             TypeBuilder<types::i<32>[3], xcompile>::get(Context));
+          Elements.push_back(
+            TypeBuilder<types::i<8>*, xcompile>::get(Context));
           return StructType::get(Context, Elements);
 #endif
         }
@@ -169,7 +175,8 @@ namespace llvm {
       NUM_GROUPS,
       GROUP_ID,
       GLOBAL_OFFSET,
-      LOCAL_SIZE
+      LOCAL_SIZE,
+      CONTEXT_ARENA
     };
   private:
     static int size_t_width;
@@ -355,6 +362,21 @@ createLauncher(Module &M, Function *F) {
     builder.CreateStore(v, gv);
   }
 
+  // The context arrays of the work-item loops with the dynamic local size.
+  gv = M.getGlobalVariable("_context_arena");
+  if (gv != NULL) {
+    Value *ptr;
+#ifdef LLVM_OLDER_THAN_3_7
+    ptr =
+      builder.CreateStructGEP(ai, TypeBuilder<PoclContext, true>::CONTEXT_ARENA);
+#else
+    ptr =
+      builder.CreateStructGEP(ai->getType()->getPointerElementType(), &*ai,
+                              TypeBuilder<PoclContext, true>::CONTEXT_ARENA);
+#endif
+    builder.CreateStore(builder.CreateLoad(ptr), gv);
+  }
+
   int size_t_width = 32;
   if (currentPoclDevice->address_bits == 64)
     size_t_width = 64;
@@ -488,6 +510,19 @@ privatizeContext(Module &M, Function *F)
       ii->replaceUsesOfWith(gv[0], ai[0]);
     }
   }
+
+  // Privatize _context_arena
+  gv[0] = M.getGlobalVariable("_context_arena");
+  if (gv[0] != NULL) {
+    ai[0] = builder.CreateAlloca(gv[0]->getType()->getElementType(),
+                                 0, "_context_arena");
+    for (Function::iterator i = F->begin(), e = F->end(); i != e; ++i) {
+      for (BasicBlock::iterator ii = i->begin(), ee = i->end();
+           ii != ee; ++ii) {
+        ii->replaceUsesOfWith(gv[0], ai[0]);
+      }
+    }
+  }
   
   // Privatize _num_groups
   for (int i = 0; i < 3; ++i) {
@@ -555,8 +590,10 @@ privatizeContext(Module &M, Function *F)
 
 /**
  * Creates a work group launcher function (called KERNELNAME_workgroup)
- * that assumes kernel pointer arguments are stored as pointers to the
- * actual buffers and that scalar data is loaded from the default memory.
+ * that reads the kernel arguments from a single argument blob laid out
+ * by layoutArgBlob(): pointer arguments are stored in their slots as the
+ * pointers to the actual buffers, scalars and byval aggregates as the
+ * values themselves.
  */
 static void
 createWorkgroup(Module &M, Function *F)
@@ -564,7 +601,7 @@ createWorkgroup(Module &M, Function *F)
   IRBuilder<> builder(M.getContext());
 
   FunctionType *ft =
-    TypeBuilder<void(types::i<8>*[],
+    TypeBuilder<void(types::i<8>*,
 		     PoclContext*), true>::get(M.getContext());
 
   std::string funcName = "";
@@ -578,23 +615,38 @@ createWorkgroup(Module &M, Function *F)
 
   Function::arg_iterator ai = workgroup->arg_begin();
 
+  // The last argument of the launched function is the context, which is
+  // passed on as is.
+  std::vector<Type*> slotTypes;
+  for (Function::const_arg_iterator ii = F->arg_begin(), ee = F->arg_end();
+       ii != ee; ++ii)
+    slotTypes.push_back(argBlobSlotType(*ii));
+  slotTypes.pop_back();
+
+  std::vector<size_t> offsets;
+#ifdef LLVM_OLDER_THAN_3_7
+  layoutArgBlob(slotTypes, *M.getDataLayout(), offsets);
+#else
+  layoutArgBlob(slotTypes, M.getDataLayout(), offsets);
+#endif
+
   SmallVector<Value*, 8> arguments;
   int i = 0;
   for (Function::const_arg_iterator ii = F->arg_begin(), ee = F->arg_end();
-       ii != ee; ++ii) {
+       ii != ee && i < (int)offsets.size(); ++ii) {
     Type *t = ii->getType();
 
-    Value *gep = builder.CreateGEP(&*ai,
-            ConstantInt::get(IntegerType::get(M.getContext(), 32), i));
-    Value *pointer = builder.CreateLoad(gep);
+    Value *slot = builder.CreateGEP(&*ai,
+            ConstantInt::get(IntegerType::get(M.getContext(), 32),
+                             offsets[i]));
 
     /* If it's a pass by value pointer argument, we just pass the pointer
-     * as is to the function, no need to load form it first. */
+     * to the slot as is to the function, no need to load from it first. */
     Value *value;
     if (ii->hasByValAttr()) {
-        value = builder.CreatePointerCast(pointer, t);
+        value = builder.CreatePointerCast(slot, t);
     } else {
-        value = builder.CreatePointerCast(pointer, t->getPointerTo());
+        value = builder.CreatePointerCast(slot, t->getPointerTo());
         value = builder.CreateLoad(value);
     }
 
@@ -602,7 +654,7 @@ createWorkgroup(Module &M, Function *F)
     ++i;
   }
 
-  arguments.back() = &*(++ai);
+  arguments.push_back(&*(++ai));
 
   builder.CreateCall(F, ArrayRef<Value*>(arguments));
   builder.CreateRetVoid();
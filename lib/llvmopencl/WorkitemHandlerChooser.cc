@@ -34,6 +34,7 @@
 #include "Workgroup.h"
 #include "CanonicalizeBarriers.h"
 #include "Kernel.h"
+#include "pocl_runtime_config.h"
 
 using namespace llvm;
 using namespace pocl;
@@ -79,13 +80,15 @@ WorkitemHandlerChooser::runOnFunction(Function &F)
   Initialize(K);
 
   std::string method = "auto";
-  if (getenv("POCL_WORK_GROUP_METHOD") != NULL)
+  if (pocl_is_option_set("POCL_WORK_GROUP_METHOD"))
     {
-      method = getenv("POCL_WORK_GROUP_METHOD");
+      method = pocl_get_string_option("POCL_WORK_GROUP_METHOD", "auto");
       if (method == "repl" || method == "workitemrepl")
         chosenHandler_ = POCL_WIH_FULL_REPLICATION;
       else if (method == "loops" || method == "workitemloops" || method == "loopvec")
         chosenHandler_ = POCL_WIH_LOOPS;
+      else if (method == "wfv")
+        chosenHandler_ = POCL_WIH_VECTORIZED_LOOPS;
       else if (method != "auto")
         {
           std::cerr << "Unknown work group generation method. Using 'auto'." << std::endl;
@@ -95,11 +98,8 @@ WorkitemHandlerChooser::runOnFunction(Function &F)
 
   if (method == "auto") 
     {
-      unsigned ReplThreshold = 2;
-      if (getenv("POCL_FULL_REPLICATION_THRESHOLD") != NULL) 
-      {
-        ReplThreshold = atoi(getenv("POCL_FULL_REPLICATION_THRESHOLD"));
-      }
+      unsigned ReplThreshold =
+        pocl_get_int_option("POCL_FULL_REPLICATION_THRESHOLD", 2);
       
       if (WGLocalSizeX*WGLocalSizeY*WGLocalSizeZ <= ReplThreshold)
         {
@@ -34,7 +34,9 @@ namespace pocl {
     
     enum WorkitemHandlerType {
       POCL_WIH_FULL_REPLICATION,
-      POCL_WIH_LOOPS
+      POCL_WIH_LOOPS,
+      /* Work-item loops over vectorized parallel regions. */
+      POCL_WIH_VECTORIZED_LOOPS
     };
 
   WorkitemHandlerChooser() : pocl::WorkitemHandler(ID), 
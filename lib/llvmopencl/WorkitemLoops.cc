@@ -23,6 +23,8 @@
 
 #define DEBUG_TYPE "workitem-loops"
 
+#include <algorithm>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <sstream>
@@ -40,6 +42,12 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/ValueSymbolTable.h"
 #include "llvm/Analysis/PostDominators.h"
+#ifndef LLVM_OLDER_THAN_3_7
+#include "llvm/Analysis/TargetTransformInfo.h"
+#endif
+#ifndef LLVM_OLDER_THAN_3_9
+#include "llvm/Analysis/ValueTracking.h"
+#endif
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include "WorkitemLoops.h"
@@ -47,6 +55,7 @@
 #include "Barrier.h"
 #include "Kernel.h"
 #include "WorkitemHandlerChooser.h"
+#include "TargetAddressSpaces.h"
 
 //#define DUMP_CFGS
 
@@ -55,9 +64,15 @@
 //#define DEBUG_WORK_ITEM_LOOPS
 
 #include "VariableUniformityAnalysis.h"
+#include "WorkitemVectorizer.h"
+#include "pocl_runtime_config.h"
 
 #define CONTEXT_ARRAY_ALIGN 64
 
+/* The maximum number of instructions to recompute in place of a context
+   restore. */
+#define MAX_REMATERIALIZED_INSTRUCTIONS 8
+
 using namespace llvm;
 using namespace pocl;
 
@@ -91,6 +106,9 @@ WorkitemLoops::getAnalysisUsage(AnalysisUsage &AU) const
   AU.addRequired<pocl::WorkitemHandlerChooser>();
   AU.addPreserved<pocl::WorkitemHandlerChooser>();
 
+#ifndef LLVM_OLDER_THAN_3_7
+  AU.addRequired<TargetTransformInfoWrapperPass>();
+#endif
 }
 
 bool
@@ -99,8 +117,10 @@ WorkitemLoops::runOnFunction(Function &F)
   if (!Workgroup::isKernelToProcess(F))
     return false;
 
-  if (getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler() != 
-      pocl::WorkitemHandlerChooser::POCL_WIH_LOOPS)
+  pocl::WorkitemHandlerChooser::WorkitemHandlerType handler =
+    getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler();
+  if (handler != pocl::WorkitemHandlerChooser::POCL_WIH_LOOPS &&
+      handler != pocl::WorkitemHandlerChooser::POCL_WIH_VECTORIZED_LOOPS)
     return false;
 
   DTP = &getAnalysis<DominatorTreeWrapperPass>();
@@ -118,6 +138,8 @@ WorkitemLoops::runOnFunction(Function &F)
 #endif
 
   tempInstructionIndex = 0;
+  contextArenaPerWorkItem = 0;
+  contextArenaArrays = 0;
 
 //  F.viewCFGOnly();
 
@@ -140,6 +162,9 @@ WorkitemLoops::runOnFunction(Function &F)
   changed |= chopBBs(F, *this);
   F.viewCFG();
 #endif
+  if (contextArenaArrays > 0)
+    AddContextArenaLayout(F);
+
   contextArrays.clear();
   tempInstructionIds.clear();
 
@@ -151,7 +176,7 @@ WorkitemLoops::CreateLoopAround
 (ParallelRegion &region,
  llvm::BasicBlock *entryBB, llvm::BasicBlock *exitBB,
  bool peeledFirst, llvm::Value *localIdVar, size_t LocalSizeForDim,
- bool addIncBlock, llvm::Value *DynamicLocalSize)
+ bool addIncBlock, llvm::Value *DynamicLocalSize, size_t step)
 {
   assert (localIdVar != NULL);
 
@@ -275,7 +300,7 @@ WorkitemLoops::CreateLoopAround
   exitBB->getTerminator()->replaceUsesOfWith(oldExit, forCondBB);
   if (addIncBlock)
     {
-      AppendIncBlock(exitBB, localIdVar);
+      AppendIncBlock(exitBB, localIdVar, step);
     }
 
   builder.SetInsertPoint(forCondBB);
@@ -327,6 +352,67 @@ WorkitemLoops::CreateLoopAround
   return std::make_pair(forInitBB, loopEndBB);
 }
 
+/* Creates the work-item loops around the blocks L of the region,
+   x innermost. Returns the first and the last block of the loop nest. */
+std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
+WorkitemLoops::CreateLoopNest
+(ParallelRegion &region,
+ std::pair<llvm::BasicBlock *, llvm::BasicBlock *> l,
+ bool peelFirst, bool unrolled, size_t xStep)
+{
+  llvm::Module *M = region.entryBB()->getParent()->getParent();
+  if (WGDynamicLocalSize) {
+    GlobalVariable *gv;
+    gv = M->getGlobalVariable("_local_size_x");
+    auto *SizeT_Ty = Type::getIntNTy(M->getContext(), size_t_width);
+    if (gv == NULL) 
+      gv = new GlobalVariable(*M, SizeT_Ty, true, GlobalValue::CommonLinkage,
+                              NULL, "_local_size_x", NULL,
+                              GlobalValue::ThreadLocalMode::NotThreadLocal,
+                              0, true);
+
+    l = CreateLoopAround(region, l.first, l.second, peelFirst,
+                         localIdX, WGLocalSizeX, !unrolled, gv);
+
+    gv = M->getGlobalVariable("_local_size_y");
+    if (gv == NULL) 
+      gv = new GlobalVariable(*M, SizeT_Ty, false, GlobalValue::CommonLinkage,
+                              NULL, "_local_size_y");
+
+    l = CreateLoopAround(region, l.first, l.second,
+                         false, localIdY, WGLocalSizeY, !unrolled, gv);
+
+    gv = M->getGlobalVariable("_local_size_z");
+    if (gv == NULL) 
+      gv = new GlobalVariable(*M, SizeT_Ty, true, GlobalValue::CommonLinkage,
+                              NULL, "_local_size_z", NULL,
+                              GlobalValue::ThreadLocalMode::NotThreadLocal,
+                              0, true);
+
+    l = CreateLoopAround(region, l.first, l.second,
+                         false, localIdZ, WGLocalSizeZ, !unrolled, gv);
+
+  } else {
+    if (WGLocalSizeX > 1) {
+        l = CreateLoopAround(region, l.first, l.second, peelFirst,
+                             localIdX, WGLocalSizeX, !unrolled, NULL,
+                             xStep);
+      }
+
+    if (WGLocalSizeY > 1) {
+        l = CreateLoopAround(region, l.first, l.second, false,
+                             localIdY, WGLocalSizeY);
+      }
+
+    if (WGLocalSizeZ > 1) {
+        l = CreateLoopAround(region, l.first, l.second, false,
+                             localIdZ, WGLocalSizeZ);
+      }
+  }
+
+  return l;
+}
+
 ParallelRegion*
 WorkitemLoops::RegionOfBlock(llvm::BasicBlock *bb)
 {
@@ -358,6 +444,9 @@ WorkitemLoops::ProcessFunction(Function &F)
       return true;
     }
 
+  if (!Workgroup::hasWorkgroupBarriers(F))
+    return ProcessBarrierFreeFunction(F);
+
 #ifdef LLVM_OLDER_THAN_3_7
   original_parallel_regions = K->getParallelRegions(LI);
 #else
@@ -397,6 +486,7 @@ WorkitemLoops::ProcessFunction(Function &F)
   /* Count how many parallel regions share each entry node to
      detect diverging regions that need to be peeled. */
   std::map<llvm::BasicBlock*, int> entryCounts;
+  InstructionVec instructionsToFix;
 
   for (ParallelRegion::ParallelRegionVector::iterator
            i = original_parallel_regions->begin(), 
@@ -405,17 +495,42 @@ WorkitemLoops::ProcessFunction(Function &F)
   {
     ParallelRegion *region = (*i);
 #ifdef DEBUG_WORK_ITEM_LOOPS
-    std::cerr << "### Adding context save/restore for PR: ";
+    std::cerr << "### Finding the context saved variables of PR: ";
     region->dumpNames();    
 #endif
-    FixMultiRegionVariables(region);
+    FindMultiRegionVariables(region, instructionsToFix);
     entryCounts[region->entryBB()]++;
   }
 
+  /* All the context saved variables are needed before adding the
+     context arrays to find the ones that can share storage. */
+  FixMultiRegionVariables(instructionsToFix);
+
 #if 0
   std::cerr << "### After context code addition:" << std::endl;
   F.viewCFG();
 #endif
+  /* With the 'wfv' method, the regions are vectorized across the
+     work-items in the x dimension before creating the loops. The
+     vectorized regions access the context arrays with the local ids
+     of the lanes, thus they are fine for them. */
+  unsigned vectorWidth = 1;
+  std::set<llvm::Value*> contextStorage;
+#ifndef LLVM_OLDER_THAN_3_9
+  if (getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler() ==
+      pocl::WorkitemHandlerChooser::POCL_WIH_VECTORIZED_LOOPS)
+    {
+      vectorWidth = VectorizationWidth(F);
+      for (StrInstructionMap::iterator i = contextArrays.begin();
+           i != contextArrays.end(); ++i)
+        {
+          contextStorage.insert(i->second);
+          contextStorage.insert
+            (GetUnderlyingObject(i->second, M->getDataLayout(), 0));
+        }
+    }
+#endif
+
   std::map<ParallelRegion*, bool> peeledRegion;
   for (ParallelRegion::ParallelRegionVector::iterator
            i = original_parallel_regions->begin(), 
@@ -452,6 +567,7 @@ WorkitemLoops::ProcessFunction(Function &F)
     BasicBlockVector preds;
 
     bool unrolled = false;
+    size_t xStep = 1;
     if (peelFirst) 
       {
 #ifdef DEBUG_WORK_ITEM_LOOPS
@@ -480,11 +596,15 @@ WorkitemLoops::ProcessFunction(Function &F)
             preds.push_back(bb);
           }
 
+        if (vectorWidth > 1)
+          xStep = VectorizeRegion(*original, vectorWidth, contextStorage);
+
         unsigned unrollCount;
-        if (getenv("POCL_WILOOPS_MAX_UNROLL_COUNT") != NULL)
-            unrollCount = atoi(getenv("POCL_WILOOPS_MAX_UNROLL_COUNT"));
-        else
+        if (xStep > 1)
             unrollCount = 1;
+        else
+            unrollCount =
+              pocl_get_int_option("POCL_WILOOPS_MAX_UNROLL_COUNT", 1);
         /* Find a two's exponent unroll count, if available. */
         while (unrollCount >= 1)
           {
@@ -523,53 +643,7 @@ WorkitemLoops::ProcessFunction(Function &F)
         }
       }
 
-    if (WGDynamicLocalSize) {
-      GlobalVariable *gv;
-      gv = M->getGlobalVariable("_local_size_x");
-      auto *SizeT_Ty = Type::getIntNTy(M->getContext(), size_t_width);
-      if (gv == NULL) 
-        gv = new GlobalVariable(*M, SizeT_Ty, true, GlobalValue::CommonLinkage,
-                                NULL, "_local_size_x", NULL,
-                                GlobalValue::ThreadLocalMode::NotThreadLocal,
-                                0, true);
-
-      l = CreateLoopAround(*original, l.first, l.second, peelFirst,
-                           localIdX, WGLocalSizeX, !unrolled, gv);
-
-      gv = M->getGlobalVariable("_local_size_y");
-      if (gv == NULL) 
-        gv = new GlobalVariable(*M, SizeT_Ty, false, GlobalValue::CommonLinkage,
-                                NULL, "_local_size_y");
-
-      l = CreateLoopAround(*original, l.first, l.second,
-                           false, localIdY, WGLocalSizeY, !unrolled, gv);
-
-      gv = M->getGlobalVariable("_local_size_z");
-      if (gv == NULL) 
-        gv = new GlobalVariable(*M, SizeT_Ty, true, GlobalValue::CommonLinkage,
-                                NULL, "_local_size_z", NULL,
-                                GlobalValue::ThreadLocalMode::NotThreadLocal,
-                                0, true);
-
-      l = CreateLoopAround(*original, l.first, l.second,
-                           false, localIdZ, WGLocalSizeZ, !unrolled, gv);
-
-    } else {
-      if (WGLocalSizeX > 1) {
-          l = CreateLoopAround(*original, l.first, l.second, peelFirst,
-                               localIdX, WGLocalSizeX, !unrolled);
-        }
-
-      if (WGLocalSizeY > 1) {
-          l = CreateLoopAround(*original, l.first, l.second, false,
-                               localIdY, WGLocalSizeY);
-        }
-
-      if (WGLocalSizeZ > 1) {
-          l = CreateLoopAround(*original, l.first, l.second, false,
-                               localIdZ, WGLocalSizeZ);
-        }
-    }
+    l = CreateLoopNest(*original, l, peelFirst, unrolled, xStep);
 
     /* Loop edges coming from another region mean B-loops which means 
        we have to fix the loop edge to jump to the beginning of the wi-loop 
@@ -619,18 +693,98 @@ WorkitemLoops::ProcessFunction(Function &F)
 }
 
 /*
- * Add context save/restore code to variables that are defined in 
- * the given region and are used outside the region.
- *
- * Each such variable gets a slot in the stack frame. The variable
- * is restored from the stack whenever it's used.
- *
+ * Kernels without work-group barriers are a single parallel region
+ * covering the whole kernel. No variable lives across regions, thus
+ * there are no context arrays, and PHIsToAllocas has left the PHI nodes
+ * in place. The kernel body is wrapped to a plain x-y-z loop nest.
+ */
+bool
+WorkitemLoops::ProcessBarrierFreeFunction(Function &F)
+{
+  Kernel *K = cast<Kernel> (&F);
+  llvm::LLVMContext &C = F.getContext();
+
+  llvm::BasicBlock *entryBarrier = &F.getEntryBlock();
+  assert (Barrier::hasOnlyBarrier(entryBarrier) &&
+          "The implicit entry barrier is missing.");
+
+  /* Add an empty block to the beginning of the body so the PHI nodes of
+     its first block stay inside the loops. */
+  llvm::BasicBlock *bodyEntry =
+    entryBarrier->getTerminator()->getSuccessor(0);
+  llvm::BasicBlock *loopEntry =
+    BasicBlock::Create(C, "flat_entry", &F, bodyEntry);
+  BranchInst::Create(bodyEntry, loopEntry);
+  entryBarrier->getTerminator()->replaceUsesOfWith(bodyEntry, loopEntry);
+  for (BasicBlock::iterator i = bodyEntry->begin(); isa<PHINode>(i); ++i)
+    {
+      PHINode *phi = cast<PHINode>(i);
+      for (unsigned in = 0; in < phi->getNumIncomingValues(); ++in)
+        {
+          if (phi->getIncomingBlock(in) == entryBarrier)
+            phi->setIncomingBlock(in, loopEntry);
+        }
+    }
+
+  /* Join the kernel exits to get a single latch for the loops. */
+  SmallVector<BasicBlock *, 4> exits;
+  K->getExitBlocks(exits);
+  llvm::BasicBlock *exitBarrier = exits[0];
+  if (exits.size() > 1)
+    {
+      llvm::BasicBlock *loopExit = BasicBlock::Create(C, "flat_exit", &F);
+      exitBarrier = BasicBlock::Create(C, "exit.barrier", &F);
+      BranchInst::Create(exitBarrier, loopExit);
+      Barrier::Create(ReturnInst::Create(C, exitBarrier));
+
+      for (size_t i = 0; i < exits.size(); ++i)
+        {
+          llvm::BasicBlock *exit = exits[i];
+          exit->getTerminator()->eraseFromParent();
+          if (!exit->empty() && isa<Barrier>(exit->back()))
+            exit->back().eraseFromParent();
+          BranchInst::Create(loopExit, exit);
+        }
+    }
+
+  ParallelRegion *region = K->createParallelRegionBefore(exitBarrier);
+  original_parallel_regions = new ParallelRegion::ParallelRegionVector;
+  if (region != NULL)
+    {
+      original_parallel_regions->push_back(region);
+
+      size_t xStep = 1;
+      if (getAnalysis<pocl::WorkitemHandlerChooser>().chosenHandler() ==
+          pocl::WorkitemHandlerChooser::POCL_WIH_VECTORIZED_LOOPS)
+        {
+          unsigned vectorWidth = VectorizationWidth(F);
+          if (vectorWidth > 1)
+            xStep = VectorizeRegion(*region, vectorWidth,
+                                    std::set<llvm::Value*>());
+        }
+
+      CreateLoopNest(*region,
+                     std::make_pair(region->entryBB(), region->exitBB()),
+                     false, false, xStep);
+    }
+
+  if (!WGDynamicLocalSize)
+    K->addLocalSizeInitCode(WGLocalSizeX, WGLocalSizeY, WGLocalSizeZ);
+
+  ParallelRegion::insertLocalIdInit(&F.getEntryBlock(), 0, 0, 0);
+
+  return true;
+}
+
+/*
+ * Find the variables that are defined in the given region and are
+ * used outside the region, and thus need context save/restore code.
  */
 void
-WorkitemLoops::FixMultiRegionVariables(ParallelRegion *region)
+WorkitemLoops::FindMultiRegionVariables(ParallelRegion *region,
+                                        InstructionVec &instructionsToFix)
 {
   InstructionIndex instructionsInRegion;
-  InstructionVec instructionsToFix;
 
   /* Construct an index of the region's instructions so it's
      fast to figure out if the variable uses are all
@@ -682,11 +836,44 @@ WorkitemLoops::FixMultiRegionVariables(ParallelRegion *region)
             }
         }
     }  
+}
 
-  /* Finally, fix the instructions. */
+/*
+ * Add context save/restore code to the given variables.
+ *
+ * Variables that are cheap to compute from the local ids, uniform values
+ * and constant memory are recomputed at their uses instead. The others
+ * get a context array in the stack frame, from which the variable is
+ * restored whenever it's used. Variables that are never live in the same
+ * parallel region share the context array storage.
+ */
+void
+WorkitemLoops::FixMultiRegionVariables(InstructionVec &instructionsToFix)
+{
+  InstructionVec instructionsToSave;
   for (InstructionVec::iterator i = instructionsToFix.begin();
        i != instructionsToFix.end(); ++i)
     {
+      llvm::Instruction *instruction = *i;
+      unsigned budget = MAX_REMATERIALIZED_INSTRUCTIONS;
+      if (!isa<AllocaInst>(instruction) &&
+          CanBeRematerialized(instruction, budget))
+        {
+#ifdef DEBUG_WORK_ITEM_LOOPS
+          std::cerr << "### rematerializing" << std::endl;
+          instruction->dump();
+#endif
+          RematerializeUses(instruction);
+        }
+      else
+        instructionsToSave.push_back(instruction);
+    }
+
+  PackContextArrays(instructionsToSave);
+
+  for (InstructionVec::iterator i = instructionsToSave.begin();
+       i != instructionsToSave.end(); ++i)
+    {
 #ifdef DEBUG_WORK_ITEM_LOOPS
       std::cerr << "### adding context/save restore for" << std::endl;
       (*i)->dump();
@@ -696,6 +883,377 @@ WorkitemLoops::FixMultiRegionVariables(ParallelRegion *region)
     }
 }
 
+bool
+WorkitemLoops::IsLocalIdLoad(llvm::Value *val)
+{
+  llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(val);
+  return load != NULL &&
+    (load->getPointerOperand() == localIdZ ||
+     load->getPointerOperand() == localIdY ||
+     load->getPointerOperand() == localIdX);
+}
+
+/*
+ * Returns true if the value can be recomputed in any parallel region
+ * with at most 'budget' instructions. The leaves of the computation are
+ * constants, kernel arguments, uniform variables, which are used as is,
+ * and the local ids, which are reloaded in the region.
+ */
+bool
+WorkitemLoops::CanBeRematerialized(llvm::Value *val, unsigned &budget)
+{
+  if (isa<Constant>(val) || isa<Argument>(val))
+    return true;
+
+  llvm::Instruction *instr = dyn_cast<llvm::Instruction>(val);
+  if (instr == NULL)
+    return false;
+
+  if (IsLocalIdLoad(instr))
+    return true;
+
+  VariableUniformityAnalysis &VUA = 
+    getAnalysis<VariableUniformityAnalysis>();
+  if (!VUA.shouldBePrivatized(instr->getParent()->getParent(), instr))
+    return true;
+
+  if (budget == 0)
+    return false;
+  --budget;
+
+  if (llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(instr))
+    {
+#ifdef POCL_USE_FAKE_ADDR_SPACE_IDS
+      /* The constant memory cannot change during the kernel execution. */
+      if (load->isVolatile() || !load->isUnordered() ||
+          load->getPointerAddressSpace() != POCL_FAKE_AS_CONSTANT)
+        return false;
+      return CanBeRematerialized(load->getPointerOperand(), budget);
+#else
+      return false;
+#endif
+    }
+
+  /* Divisions are not cheap enough to be recomputed. */
+  if (llvm::BinaryOperator *binop = dyn_cast<llvm::BinaryOperator>(instr))
+    {
+      switch (binop->getOpcode())
+        {
+        case Instruction::UDiv:
+        case Instruction::SDiv:
+        case Instruction::URem:
+        case Instruction::SRem:
+        case Instruction::FDiv:
+        case Instruction::FRem:
+          return false;
+        default:
+          break;
+        }
+    }
+  else if (!isa<CastInst>(instr) && !isa<GetElementPtrInst>(instr) &&
+           !isa<CmpInst>(instr) && !isa<SelectInst>(instr))
+    return false;
+
+  for (unsigned opr = 0; opr < instr->getNumOperands(); ++opr)
+    {
+      if (!CanBeRematerialized(instr->getOperand(opr), budget))
+        return false;
+    }
+  return true;
+}
+
+/*
+ * Recomputes the value before the given instruction of the region,
+ * see CanBeRematerialized().
+ */
+llvm::Value *
+WorkitemLoops::Rematerialize(llvm::Value *val, llvm::Instruction *before,
+                             ParallelRegion *region,
+                             llvm::ValueToValueMapTy &clones)
+{
+  llvm::Instruction *instr = dyn_cast<llvm::Instruction>(val);
+  if (instr == NULL)
+    return val;
+
+  if (IsLocalIdLoad(instr))
+    {
+      llvm::Value *pointer = cast<LoadInst>(instr)->getPointerOperand();
+      if (pointer == localIdX)
+        return region->LocalIDXLoad();
+      if (pointer == localIdY)
+        return region->LocalIDYLoad();
+      return region->LocalIDZLoad();
+    }
+
+  VariableUniformityAnalysis &VUA = 
+    getAnalysis<VariableUniformityAnalysis>();
+  if (!VUA.shouldBePrivatized(instr->getParent()->getParent(), instr))
+    return val;
+
+  llvm::ValueToValueMapTy::iterator i = clones.find(instr);
+  if (i != clones.end())
+    return i->second;
+
+  llvm::Instruction *copy = instr->clone();
+  for (unsigned opr = 0; opr < instr->getNumOperands(); ++opr)
+    {
+      copy->setOperand
+        (opr, Rematerialize(instr->getOperand(opr), before, region, clones));
+    }
+  copy->insertBefore(before);
+  copy->setName(instr->getName() + ".remat");
+  clones[instr] = copy;
+  return copy;
+}
+
+/*
+ * Replaces the uses of the instruction in the other parallel regions with
+ * recomputations of its value. The uses in the defining region keep
+ * using the original value.
+ */
+void
+WorkitemLoops::RematerializeUses(llvm::Instruction *instruction)
+{
+  ParallelRegion *defRegion = RegionOfBlock(instruction->getParent());
+  InstructionVec uses;
+  for (Instruction::use_iterator ui = instruction->use_begin(),
+         ue = instruction->use_end();
+       ui != ue; ++ui) 
+    {
+      llvm::Instruction *user = cast<Instruction>(ui->getUser());
+      uses.push_back(user);
+    }
+
+  for (InstructionVec::iterator i = uses.begin(); i != uses.end(); ++i)
+    {
+      Instruction *user = *i;
+      ParallelRegion *region = RegionOfBlock(user->getParent());
+      /* Work group variables, see AddContextSaveRestore(). */
+      if (region == NULL || region == defRegion) continue;
+
+      if (PHINode *phi = dyn_cast<PHINode>(user))
+        {
+          /* Recompute in the incoming block, like the context restore.
+             The PHIs at the region entries are broken down earlier, thus
+             the incoming block is in the same region. */
+          for (unsigned incoming = 0; incoming < phi->getNumIncomingValues(); 
+               ++incoming)
+            {
+              if (phi->getIncomingValue(incoming) != instruction)
+                continue;
+              BasicBlock *bb = phi->getIncomingBlock(incoming);
+              llvm::ValueToValueMapTy clones;
+              phi->setIncomingValue
+                (incoming, Rematerialize(instruction, bb->getTerminator(),
+                                         region, clones));
+            }
+          continue;
+        }
+
+      llvm::ValueToValueMapTy clones;
+      user->replaceUsesOfWith
+        (instruction, Rematerialize(instruction, user, region, clones));
+    }
+}
+
+/*
+ * Finds the parallel regions on the paths from the definition of the
+ * context saved variable to its uses, that is, the regions where its
+ * context array might hold data that is still needed.
+ */
+void
+WorkitemLoops::ContextLiveRegions
+(llvm::Instruction *instruction,
+ std::map<llvm::BasicBlock*, RegionSet> &regionsOf, RegionSet &live)
+{
+  std::set<llvm::BasicBlock*> reachable;
+  std::deque<llvm::BasicBlock*> worklist;
+
+  worklist.push_back(instruction->getParent());
+  reachable.insert(instruction->getParent());
+  while (!worklist.empty())
+    {
+      llvm::BasicBlock *bb = worklist.front();
+      worklist.pop_front();
+      for (llvm::succ_iterator si = succ_begin(bb), se = succ_end(bb);
+           si != se; ++si)
+        {
+          if (reachable.insert(*si).second)
+            worklist.push_back(*si);
+        }
+    }
+
+  std::set<llvm::BasicBlock*> reaching;
+  for (Instruction::use_iterator ui = instruction->use_begin(),
+         ue = instruction->use_end();
+       ui != ue; ++ui) 
+    {
+      llvm::Instruction *user = cast<Instruction>(ui->getUser());
+      llvm::BasicBlock *bb = user->getParent();
+      if (PHINode *phi = dyn_cast<PHINode>(user))
+        bb = phi->getIncomingBlock(*ui);
+      if (reaching.insert(bb).second)
+        worklist.push_back(bb);
+    }
+  while (!worklist.empty())
+    {
+      llvm::BasicBlock *bb = worklist.front();
+      worklist.pop_front();
+      for (llvm::pred_iterator pi = pred_begin(bb), pe = pred_end(bb);
+           pi != pe; ++pi)
+        {
+          if (reaching.insert(*pi).second)
+            worklist.push_back(*pi);
+        }
+    }
+
+  for (std::set<llvm::BasicBlock*>::iterator i = reachable.begin();
+       i != reachable.end(); ++i)
+    {
+      if (reaching.find(*i) == reaching.end()) continue;
+      RegionSet &regions = regionsOf[*i];
+      live.insert(regions.begin(), regions.end());
+    }
+}
+
+static bool
+LargerContextFirst(const std::pair<uint64_t, llvm::Instruction *> &a,
+                   const std::pair<uint64_t, llvm::Instruction *> &b)
+{
+  return a.first > b.first;
+}
+
+/*
+ * Assigns the same storage to the context arrays of variables that are
+ * never live in the same parallel region. The work-items of a region
+ * execute one after another, so the context arrays live in a region
+ * cannot share storage even if the variables are not live at the same
+ * time in a single work-item.
+ *
+ * The private arrays (allocas) are not packed, as pointers to them
+ * might be stored to memory.
+ */
+void
+WorkitemLoops::PackContextArrays(InstructionVec &instructions)
+{
+  if (instructions.size() < 2) return;
+
+  std::map<llvm::BasicBlock*, RegionSet> regionsOf;
+  for (ParallelRegion::ParallelRegionVector::iterator
+           i = original_parallel_regions->begin(), 
+           e = original_parallel_regions->end();
+       i != e; ++i) 
+    {
+      ParallelRegion *region = *i;
+      for (BasicBlockVector::iterator bi = region->begin();
+           bi != region->end(); ++bi)
+        regionsOf[*bi].insert(region);
+    }
+
+  llvm::Module *M = instructions.front()->getParent()->getParent()->getParent();
+#ifdef LLVM_OLDER_THAN_3_7
+  const DataLayout &DL = *M->getDataLayout();
+#else
+  const DataLayout &DL = M->getDataLayout();
+#endif
+
+  struct ContextSlot {
+    RegionSet live;
+    uint64_t elementSize;
+    InstructionVec variables;
+  };
+  std::vector<ContextSlot> slots;
+
+  /* Assign the largest variables first to get the slot sizes to match
+     well. */
+  std::vector<std::pair<uint64_t, llvm::Instruction *> > candidates;
+  for (InstructionVec::iterator i = instructions.begin();
+       i != instructions.end(); ++i)
+    {
+      if (isa<AllocaInst>(*i)) continue;
+      candidates.push_back
+        (std::make_pair(DL.getTypeAllocSize((*i)->getType()), *i));
+    }
+  std::stable_sort(candidates.begin(), candidates.end(), LargerContextFirst);
+
+  for (size_t c = 0; c < candidates.size(); ++c)
+    {
+      llvm::Instruction *instruction = candidates[c].second;
+      RegionSet live;
+      ContextLiveRegions(instruction, regionsOf, live);
+
+      size_t s = 0;
+      for (; s < slots.size(); ++s)
+        {
+          RegionSet &used = slots[s].live;
+          bool overlaps = false;
+          for (RegionSet::iterator r = live.begin(); r != live.end(); ++r)
+            {
+              if (used.find(*r) != used.end())
+                {
+                  overlaps = true;
+                  break;
+                }
+            }
+          if (!overlaps) break;
+        }
+      if (s == slots.size())
+        {
+          slots.push_back(ContextSlot());
+          slots.back().elementSize = candidates[c].first;
+        }
+      slots[s].live.insert(live.begin(), live.end());
+      slots[s].variables.push_back(instruction);
+    }
+
+  BasicBlock &entry =
+    instructions.front()->getParent()->getParent()->getEntryBlock();
+  IRBuilder<> builder(&*(entry.getFirstInsertionPt()));
+  llvm::Type *byteType = Type::getInt8Ty(M->getContext());
+
+  for (size_t s = 0; s < slots.size(); ++s)
+    {
+      ContextSlot &slot = slots[s];
+      /* Variables alone in their slot get their own context array
+         in GetContextArray(). */
+      if (slot.variables.size() < 2) continue;
+
+      std::ostringstream name;
+      name << ".pocl_context_shared." << s;
+
+      llvm::Type *elementType = ArrayType::get(byteType, slot.elementSize);
+      llvm::Instruction *storage;
+      if (WGDynamicLocalSize)
+        storage = AllocateFromContextArena
+          (builder, M, elementType, name.str());
+      else
+        {
+          llvm::AllocaInst *Alloca = builder.CreateAlloca
+            (ArrayType::get(elementType,
+                            WGLocalSizeX * WGLocalSizeY * WGLocalSizeZ),
+             0, name.str());
+          Alloca->setAlignment(CONTEXT_ARRAY_ALIGN);
+          storage = Alloca;
+        }
+
+      for (InstructionVec::iterator i = slot.variables.begin();
+           i != slot.variables.end(); ++i)
+        {
+          llvm::Type *contextType = (*i)->getType();
+          if (!WGDynamicLocalSize)
+            contextType =
+              ArrayType::get(
+                ArrayType::get(
+                  ArrayType::get(contextType, WGLocalSizeX),
+                  WGLocalSizeY), WGLocalSizeZ);
+          std::string varName = ContextArrayName(*i);
+          contextArrays[varName] = cast<Instruction>
+            (builder.CreateBitCast(storage, contextType->getPointerTo(),
+                                   varName));
+        }
+    }
+}
+
 llvm::Value *
 WorkitemLoops::GetLinearWiIndex(llvm::IRBuilder<> &builder, llvm::Module *M,
                                ParallelRegion *region)
@@ -841,13 +1399,11 @@ WorkitemLoops::AddContextRestore
 }
 
 /**
- * Returns the context array (alloca) for the given Value, creates it if not
- * found.
+ * Returns the name of the context array of the given Value.
  */
-llvm::Instruction *
-WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
+std::string
+WorkitemLoops::ContextArrayName(llvm::Instruction *instruction)
 {
-  
   /*
    * Unnamed temp instructions need a generated name for the
    * context array. Create one using a running integer.
@@ -870,7 +1426,111 @@ WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
     }
 
   var << ".pocl_context";
-  std::string varName = var.str();
+  return var.str();
+}
+
+/**
+ * Returns the number of work-items in a work-group with the dynamic
+ * local size.
+ */
+llvm::Value *
+WorkitemLoops::NumberOfWorkItems(llvm::IRBuilder<> &builder, llvm::Module *M)
+{
+  char GlobalName[32];
+  GlobalVariable* LocalSize;
+  LoadInst* LocalSizeLoad[3];
+  auto *SizeT_Ty = Type::getIntNTy(M->getContext(), size_t_width);
+  for (int i = 0; i < 3; ++i) {
+    snprintf(GlobalName, 32, "_local_size_%c", 'x' + i);
+    LocalSize =
+      cast<GlobalVariable>(M->getOrInsertGlobal(GlobalName, SizeT_Ty));
+    LocalSizeLoad[i] = builder.CreateLoad(LocalSize);
+  }
+
+  Value* LocalXTimesY =
+    builder.CreateBinOp(Instruction::Mul, LocalSizeLoad[0],
+                        LocalSizeLoad[1], "tmp");
+  return builder.CreateBinOp(Instruction::Mul, LocalXTimesY,
+                             LocalSizeLoad[2], "num_wi");
+}
+
+/**
+ * Allocates a context array with the given element type from the context
+ * arena of the work-group function.
+ *
+ * The arrays are laid out one after another in the order of allocation,
+ * each starting at a CONTEXT_ARRAY_ALIGN boundary. The i:th array is at
+ * the offset align_up(num_wi * per_work_item, CONTEXT_ARRAY_ALIGN)
+ * + i * CONTEXT_ARRAY_ALIGN, where per_work_item is the total element
+ * size of the arrays before it. Thus, the arena needs at most
+ * num_wi * per_work_item + contextArenaArrays * CONTEXT_ARRAY_ALIGN bytes
+ * for all the arrays, which is recorded by AddContextArenaLayout().
+ */
+llvm::Instruction *
+WorkitemLoops::AllocateFromContextArena(llvm::IRBuilder<> &builder,
+                                        llvm::Module *M,
+                                        llvm::Type *elementType,
+                                        const std::string &name)
+{
+#ifdef LLVM_OLDER_THAN_3_7
+  const DataLayout &DL = *M->getDataLayout();
+#else
+  const DataLayout &DL = M->getDataLayout();
+#endif
+  llvm::LLVMContext &C = M->getContext();
+  llvm::IntegerType *SizeTType = IntegerType::get(C, size_t_width);
+  llvm::Type *arenaType = Type::getInt8PtrTy(C);
+  GlobalVariable *arenaPtr =
+    cast<GlobalVariable>(M->getOrInsertGlobal("_context_arena", arenaType));
+
+  Value *offset =
+    builder.CreateMul(NumberOfWorkItems(builder, M),
+                      ConstantInt::get(SizeTType, contextArenaPerWorkItem));
+  offset =
+    builder.CreateAnd(
+      builder.CreateAdd(offset,
+                        ConstantInt::get(SizeTType, CONTEXT_ARRAY_ALIGN - 1)),
+      ConstantInt::get(SizeTType, -CONTEXT_ARRAY_ALIGN, true));
+  offset =
+    builder.CreateAdd(offset,
+                      ConstantInt::get(SizeTType, contextArenaArrays *
+                                       CONTEXT_ARRAY_ALIGN));
+
+  contextArenaPerWorkItem += DL.getTypeAllocSize(elementType);
+  ++contextArenaArrays;
+
+  Value *array = builder.CreateGEP(builder.CreateLoad(arenaPtr), offset);
+  return cast<Instruction>
+    (builder.CreateBitCast(array, elementType->getPointerTo(), name));
+}
+
+/**
+ * Exports the context arena need of the kernel to the runtime as
+ * a struct pocl_context_arena_layout.
+ */
+void
+WorkitemLoops::AddContextArenaLayout(llvm::Function &F)
+{
+  Module *M = F.getParent();
+  llvm::Type *SizeTType = IntegerType::get(M->getContext(), size_t_width);
+  llvm::Constant *fields[] = {
+    ConstantInt::get(SizeTType, contextArenaPerWorkItem),
+    ConstantInt::get(SizeTType, contextArenaArrays * CONTEXT_ARRAY_ALIGN)
+  };
+  llvm::Constant *layout = ConstantStruct::getAnon(fields);
+  new GlobalVariable(*M, layout->getType(), true,
+                     GlobalValue::ExternalLinkage, layout,
+                     "_pocl_context_arena_" + F.getName().str());
+}
+
+/**
+ * Returns the context array (alloca) for the given Value, creates it if not
+ * found.
+ */
+llvm::Instruction *
+WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
+{
+  std::string varName = ContextArrayName(instruction);
 
   if (contextArrays.find(varName) != contextArrays.end())
     return contextArrays[varName];
@@ -897,43 +1557,29 @@ WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
       elementType = instruction->getType();
     }
 
-  llvm::AllocaInst *Alloca;
   Module* M = instruction->getParent()->getParent()->getParent();
   if (WGDynamicLocalSize)
     {
-      char GlobalName[32];
-      GlobalVariable* LocalSize;
-      LoadInst* LocalSizeLoad[3];
-      auto *SizeT_Ty = Type::getIntNTy(M->getContext(), size_t_width);
-      for (int i = 0; i < 3; ++i) {
-        snprintf(GlobalName, 32, "_local_size_%c", 'x' + i);
-        LocalSize =
-          cast<GlobalVariable>(M->getOrInsertGlobal(GlobalName, SizeT_Ty));
-        LocalSizeLoad[i] = builder.CreateLoad(LocalSize);
-      }
-
-      Value* LocalXTimesY =
-        builder.CreateBinOp(Instruction::Mul, LocalSizeLoad[0],
-                            LocalSizeLoad[1], "tmp");
-      Value* NumberOfWorkItems =
-        builder.CreateBinOp(Instruction::Mul, LocalXTimesY,
-                            LocalSizeLoad[2], "num_wi");
-
-      Alloca = builder.CreateAlloca(elementType, NumberOfWorkItems, varName);
+      /* The size of the context array is not known at compile time,
+         thus it cannot be put to the stack frame without risking
+         a stack overflow with large local sizes. */
+      llvm::Instruction *Array =
+        AllocateFromContextArena(builder, M, elementType, varName);
+      contextArrays[varName] = Array;
+      return Array;
     }
-  else
-    {
-      /* 3D context array. */
-      llvm::Type *contextArrayType =
+
+  /* 3D context array. */
+  llvm::Type *contextArrayType =
+    ArrayType::get(
+      ArrayType::get(
         ArrayType::get(
-          ArrayType::get(
-            ArrayType::get(
-                           elementType, WGLocalSizeX),
-            WGLocalSizeY), WGLocalSizeZ);
+                       elementType, WGLocalSizeX),
+        WGLocalSizeY), WGLocalSizeZ);
 
-      /* Allocate the context data array for the variable. */
-      Alloca = builder.CreateAlloca(contextArrayType, 0, varName);
-    }
+  /* Allocate the context data array for the variable. */
+  llvm::AllocaInst *Alloca =
+    builder.CreateAlloca(contextArrayType, 0, varName);
 
   /* Align the context arrays to stack to enable wide vectors
      accesses to them. Also, LLVM 3.3 seems to produce illegal
@@ -957,9 +1603,6 @@ WorkitemLoops::GetContextArray(llvm::Instruction *instruction)
  * TODO: ignore work group variables completely (the iteration variables)
  * The LLVM should optimize these away but it would improve
  * the readability of the output during debugging.
- * TODO: rematerialize some values such as extended values of global 
- * variables (especially global id which is computed from local id) or kernel 
- * argument values instead of allocating stack space for them
  */
 void
 WorkitemLoops::AddContextSaveRestore
@@ -1099,9 +1742,54 @@ WorkitemLoops::ShouldNotBeContextSaved(llvm::Instruction *instr)
     return false;
 }
 
+/* Vectorizes the region for the 'wfv' method. Returns the number of
+   work-items an execution of the region handles after it. */
+size_t
+WorkitemLoops::VectorizeRegion(ParallelRegion &region, unsigned width,
+                               const std::set<llvm::Value*> &contextStorage)
+{
+  WorkitemVectorizer vectorizer
+    (region, width, localIdX, localIdY, localIdZ, contextStorage,
+     getAnalysis<VariableUniformityAnalysis>());
+  bool vectorized = vectorizer.vectorize();
+  if (pocl_is_option_set("POCL_VECTORIZER_REMARKS"))
+    {
+      std::cerr << "pocl: parallel region of "
+                << region.entryBB()->getParent()->getName().str();
+      if (vectorized)
+        std::cerr << " vectorized with width " << width;
+      else
+        std::cerr << " not vectorized: " << vectorizer.failureReason();
+      std::cerr << std::endl;
+    }
+  return vectorized ? width : 1;
+}
+
+/* Returns the number of work-items the 'wfv' method executes at a time:
+   the number of 32b lanes in the vector registers of the target, halved
+   until it divides the local size x. The work-item loops of the dynamic
+   local size kernels step one work-item at a time, thus they are not
+   vectorized. */
+unsigned
+WorkitemLoops::VectorizationWidth(llvm::Function &F)
+{
+#ifdef LLVM_OLDER_THAN_3_7
+  return 1;
+#else
+  if (WGDynamicLocalSize)
+    return 1;
+  const TargetTransformInfo &TTI =
+    getAnalysis<TargetTransformInfoWrapperPass>().getTTI(F);
+  unsigned width = TTI.getRegisterBitWidth(true) / 32;
+  while (width > 1 && WGLocalSizeX % width != 0)
+    width /= 2;
+  return width > 0 ? width : 1;
+#endif
+}
+
 llvm::BasicBlock *
 WorkitemLoops::AppendIncBlock
-(llvm::BasicBlock* after, llvm::Value *localIdVar)
+(llvm::BasicBlock* after, llvm::Value *localIdVar, size_t step)
 {
   llvm::LLVMContext &C = after->getContext();
 
@@ -1120,7 +1808,7 @@ WorkitemLoops::AppendIncBlock
   builder.CreateStore
     (builder.CreateAdd
      (builder.CreateLoad(localIdVar),
-      ConstantInt::get(IntegerType::get(C, size_t_width), 1)),
+      ConstantInt::get(IntegerType::get(C, size_t_width), step)),
      localIdVar);
 
   builder.CreateBr(oldExit);
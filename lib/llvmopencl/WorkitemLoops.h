@@ -24,6 +24,7 @@
 #define _POCL_WORKITEM_LOOPS_H
 
 #include <map>
+#include <set>
 #include <vector>
 
 #include "pocl.h"
@@ -63,6 +64,7 @@ namespace pocl {
     typedef std::set<llvm::Instruction* > InstructionIndex;
     typedef std::vector<llvm::Instruction* > InstructionVec;
     typedef std::map<std::string, llvm::Instruction*> StrInstructionMap;
+    typedef std::set<ParallelRegion*> RegionSet;
 
     llvm::DominatorTree *DT;
 #ifdef LLVM_OLDER_THAN_3_7
@@ -85,9 +87,22 @@ namespace pocl {
 
     virtual bool ProcessFunction(llvm::Function &F);
 
-    void FixMultiRegionVariables(ParallelRegion *region);
+    void FindMultiRegionVariables(ParallelRegion *region,
+                                  InstructionVec &instructionsToFix);
+    void FixMultiRegionVariables(InstructionVec &instructionsToFix);
     void AddContextSaveRestore(llvm::Instruction *instruction);
 
+    bool CanBeRematerialized(llvm::Value *val, unsigned &budget);
+    llvm::Value *Rematerialize(llvm::Value *val, llvm::Instruction *before,
+                               ParallelRegion *region,
+                               llvm::ValueToValueMapTy &clones);
+    void RematerializeUses(llvm::Instruction *instruction);
+
+    void ContextLiveRegions(llvm::Instruction *instruction,
+                            std::map<llvm::BasicBlock*, RegionSet> &regionsOf,
+                            RegionSet &live);
+    void PackContextArrays(InstructionVec &instructions);
+
     llvm::Value *GetLinearWiIndex(llvm::IRBuilder<> &builder, llvm::Module *M,
                                   ParallelRegion *region);
     llvm::Instruction *AddContextSave(llvm::Instruction *instruction,
@@ -97,24 +112,50 @@ namespace pocl {
          llvm::Instruction *before=NULL, 
          bool isAlloca=false);
     llvm::Instruction *GetContextArray(llvm::Instruction *val);
+    std::string ContextArrayName(llvm::Instruction *instruction);
+    llvm::Value *NumberOfWorkItems(llvm::IRBuilder<> &builder,
+                                   llvm::Module *M);
+    llvm::Instruction *AllocateFromContextArena(llvm::IRBuilder<> &builder,
+                                                llvm::Module *M,
+                                                llvm::Type *elementType,
+                                                const std::string &name);
+    void AddContextArenaLayout(llvm::Function &F);
 
     std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
     CreateLoopAround
         (ParallelRegion &region, llvm::BasicBlock *entryBB, llvm::BasicBlock *exitBB, 
          bool peeledFirst, llvm::Value *localIdVar, size_t LocalSizeForDim,
-         bool addIncBlock=true, llvm::Value *DynamicLocalSize=NULL);
+         bool addIncBlock=true, llvm::Value *DynamicLocalSize=NULL,
+         size_t step=1);
 
     llvm::BasicBlock *
       AppendIncBlock
       (llvm::BasicBlock* after, 
-       llvm::Value *localIdVar);
+       llvm::Value *localIdVar,
+       size_t step=1);
+
+    std::pair<llvm::BasicBlock *, llvm::BasicBlock *>
+    CreateLoopNest
+        (ParallelRegion &region,
+         std::pair<llvm::BasicBlock *, llvm::BasicBlock *> l,
+         bool peelFirst, bool unrolled, size_t xStep);
+
+    bool ProcessBarrierFreeFunction(llvm::Function &F);
+
+    unsigned VectorizationWidth(llvm::Function &F);
+    size_t VectorizeRegion(ParallelRegion &region, unsigned width,
+                           const std::set<llvm::Value*> &contextStorage);
 
     ParallelRegion* RegionOfBlock(llvm::BasicBlock *bb);
 
     bool ShouldNotBeContextSaved(llvm::Instruction *instr);
+    bool IsLocalIdLoad(llvm::Value *val);
 
     std::map<llvm::Instruction*, unsigned> tempInstructionIds;
     size_t tempInstructionIndex;
+    // The context arena allocated so far, see AllocateFromContextArena().
+    uint64_t contextArenaPerWorkItem;
+    unsigned contextArenaArrays;
     // An alloca in the kernel which stores the first iteration to execute
     // in the inner (dimension 0) loop. This is set to 1 in an peeled iteration
     // to skip the 0, 0, 0 iteration in the loops.
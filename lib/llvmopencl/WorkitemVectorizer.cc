@@ -0,0 +1,1245 @@
+// Explicit vectorization of the parallel regions across the work-items.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include "config.h"
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+
+#include "LowerLocalAtomics.h"
+#include "ParallelRegion.h"
+#include "VariableUniformityAnalysis.h"
+#include "WorkitemVectorizer.h"
+
+POP_COMPILER_DIAGS
+
+using namespace llvm;
+using namespace pocl;
+
+/* The maximum number of rounds to find the shapes of the values in
+   regions with loops. */
+#define MAX_SHAPE_ITERATIONS 32
+
+WorkitemVectorizer::WorkitemVectorizer(ParallelRegion &region,
+                                       unsigned width,
+                                       llvm::Value *localIdX,
+                                       llvm::Value *localIdY,
+                                       llvm::Value *localIdZ,
+                                       const std::set<llvm::Value*> &contextArrays,
+                                       VariableUniformityAnalysis &VUA) :
+  region(region), width(width),
+  localIdX(localIdX), localIdY(localIdY), localIdZ(localIdZ),
+  contextArrays(contextArrays), VUA(VUA),
+  F(region.entryBB()->getParent()), DL(NULL),
+  hasLoops(false), linearize(false)
+{
+}
+
+bool
+WorkitemVectorizer::Fail(const std::string &reason)
+{
+  failureMessage = reason;
+  return false;
+}
+
+#ifdef LLVM_OLDER_THAN_3_9
+
+/* The masked memory access intrinsics needed to vectorize the regions
+   are not generated by the IRBuilder of the older LLVMs. */
+bool
+WorkitemVectorizer::vectorize()
+{
+  return Fail("LLVM 3.9 or newer is required");
+}
+
+#else
+
+WorkitemVectorizer::Shape
+WorkitemVectorizer::Uniform()
+{
+  Shape s = {Shape::UNIFORM, 0, true, true};
+  return s;
+}
+
+WorkitemVectorizer::Shape
+WorkitemVectorizer::Strided(int64_t stride, bool noSignedWrap,
+                            bool noUnsignedWrap)
+{
+  if (stride == 0)
+    return Uniform();
+  Shape s = {Shape::STRIDED, stride, noSignedWrap, noUnsignedWrap};
+  return s;
+}
+
+WorkitemVectorizer::Shape
+WorkitemVectorizer::Varying()
+{
+  Shape s = {Shape::VARYING, 0, false, false};
+  return s;
+}
+
+bool
+WorkitemVectorizer::SameShape(const Shape &a, const Shape &b)
+{
+  return a.kind == b.kind && a.stride == b.stride &&
+    a.noSignedWrap == b.noSignedWrap && a.noUnsignedWrap == b.noUnsignedWrap;
+}
+
+static bool
+IsLifetimeMarker(llvm::Value *V)
+{
+  llvm::IntrinsicInst *II = dyn_cast<llvm::IntrinsicInst>(V);
+  return II != NULL &&
+    (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+     II->getIntrinsicID() == Intrinsic::lifetime_end);
+}
+
+/* Instructions that do not affect the semantics and are left as is. */
+static bool
+IsIgnored(llvm::Instruction *I)
+{
+  return isa<DbgInfoIntrinsic>(I) || IsLifetimeMarker(I);
+}
+
+static bool
+IsDivRem(llvm::Instruction *I)
+{
+  switch (I->getOpcode())
+    {
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+      return true;
+    default:
+      return false;
+    }
+}
+
+/* Intrinsics that are overloaded only by their return type, which is
+   also the type of all the arguments, and have vector versions that
+   compute lane-wise. */
+static bool
+IsVectorizableIntrinsic(Intrinsic::ID id)
+{
+  switch (id)
+    {
+    case Intrinsic::sqrt:
+    case Intrinsic::fabs:
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint:
+    case Intrinsic::round:
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum:
+    case Intrinsic::copysign:
+    case Intrinsic::sin:
+    case Intrinsic::cos:
+    case Intrinsic::exp:
+    case Intrinsic::exp2:
+    case Intrinsic::log:
+    case Intrinsic::log2:
+    case Intrinsic::log10:
+    case Intrinsic::pow:
+    case Intrinsic::ctpop:
+    case Intrinsic::bswap:
+    case Intrinsic::bitreverse:
+      return true;
+    default:
+      return false;
+    }
+}
+
+bool
+WorkitemVectorizer::vectorize()
+{
+  if (width < 2)
+    return Fail("the vector width is 1");
+
+  DL = &F->getParent()->getDataLayout();
+
+  if (!AnalyzeControlFlow() || !ClassifyAllocas())
+    return false;
+
+  ComputeShapes();
+
+  bool divergent = false;
+  for (BasicBlockVector::iterator i = order.begin(); i != order.end(); ++i)
+    {
+      llvm::BasicBlock *BB = *i;
+      if (BB == region.exitBB())
+        continue;
+      llvm::Instruction *T = BB->getTerminator();
+      if (llvm::BranchInst *br = dyn_cast<llvm::BranchInst>(T))
+        {
+          if (br->isConditional() &&
+              ShapeOf(br->getCondition()).kind != Shape::UNIFORM)
+            divergent = true;
+        }
+      else if (llvm::SwitchInst *sw = dyn_cast<llvm::SwitchInst>(T))
+        {
+          if (ShapeOf(sw->getCondition()).kind != Shape::UNIFORM)
+            return Fail("divergent switch");
+        }
+    }
+
+  if (divergent)
+    {
+      if (hasLoops)
+        return Fail("divergent branch in a region with loops");
+      for (BasicBlockVector::iterator i = order.begin();
+           i != order.end(); ++i)
+        {
+          if (isa<llvm::SwitchInst>((*i)->getTerminator()))
+            return Fail("switch in a region with divergent branches");
+        }
+      linearize = true;
+      FindMaskedBlocks();
+      /* The loads and the divisions of the masked blocks cannot stay
+         scalar, as they might trap in the work-items not executing them. */
+      ComputeShapes();
+    }
+
+  if (!IsLegal())
+    return false;
+
+  /* The region is vectorizable, transform it. */
+  llvm::IRBuilder<> entryBuilder(&*F->getEntryBlock().getFirstInsertionPt());
+  for (std::set<llvm::AllocaInst*>::iterator i = privateAllocas.begin();
+       i != privateAllocas.end(); ++i)
+    {
+      llvm::AllocaInst *A = *i;
+      vectorAllocas[A] =
+        entryBuilder.CreateAlloca(VectorTypeOf(A->getAllocatedType()), NULL,
+                                  A->getName() + ".wfv");
+    }
+
+  for (BasicBlockVector::iterator i = order.begin(); i != order.end(); ++i)
+    {
+      llvm::BasicBlock *BB = *i;
+      if (linearize)
+        ComputeBlockMask(BB);
+
+      std::vector<llvm::Instruction*> instructions;
+      for (llvm::BasicBlock::iterator ii = BB->begin();
+           &*ii != BB->getTerminator(); ++ii)
+        instructions.push_back(&*ii);
+      for (size_t ii = 0; ii < instructions.size(); ++ii)
+        Widen(instructions[ii]);
+
+      if (linearize && BB != region.exitBB())
+        ComputeEdgeMasks(BB);
+    }
+
+  for (size_t i = 0; i < vectorPHIs.size(); ++i)
+    {
+      llvm::PHINode *phi = vectorPHIs[i];
+      llvm::PHINode *vectorPHI = cast<llvm::PHINode>(vectors[phi]);
+      for (unsigned in = 0; in < phi->getNumIncomingValues(); ++in)
+        {
+          llvm::BasicBlock *pred = phi->getIncomingBlock(in);
+          llvm::IRBuilder<> builder(pred->getTerminator());
+          vectorPHI->addIncoming
+            (VectorOf(phi->getIncomingValue(in), builder), pred);
+        }
+    }
+
+  for (size_t i = 0; i < toErase.size(); ++i)
+    {
+      llvm::Instruction *I = toErase[i];
+      if (!I->getType()->isVoidTy())
+        I->replaceAllUsesWith(UndefValue::get(I->getType()));
+    }
+  for (size_t i = toErase.size(); i > 0; --i)
+    toErase[i - 1]->eraseFromParent();
+
+  /* Chain the blocks of a linearized region in the topological order.
+     The masks take care of the work-items not executing a block. */
+  if (linearize)
+    {
+      for (size_t i = 0; i + 1 < order.size(); ++i)
+        {
+          llvm::BasicBlock *BB = order[i];
+          BB->getTerminator()->eraseFromParent();
+          BranchInst::Create(order[i + 1], BB);
+        }
+    }
+
+  return true;
+}
+
+/* Checks that the region has a single exit and orders its blocks. */
+bool
+WorkitemVectorizer::AnalyzeControlFlow()
+{
+  llvm::BasicBlock *entry = region.entryBB();
+  llvm::BasicBlock *exit = region.exitBB();
+
+  blocks.insert(region.begin(), region.end());
+
+  for (std::set<llvm::BasicBlock*>::iterator i = blocks.begin();
+       i != blocks.end(); ++i)
+    {
+      llvm::BasicBlock *BB = *i;
+      llvm::Instruction *T = BB->getTerminator();
+      if (BB == exit)
+        {
+          if (T->getNumSuccessors() != 1 ||
+              blocks.count(T->getSuccessor(0)))
+            return Fail("unexpected region exit");
+          continue;
+        }
+      if (!isa<llvm::BranchInst>(T) && !isa<llvm::SwitchInst>(T))
+        return Fail("unsupported terminator");
+      for (unsigned s = 0; s < T->getNumSuccessors(); ++s)
+        {
+          if (!blocks.count(T->getSuccessor(s)))
+            return Fail("region with multiple exits");
+        }
+    }
+
+  /* Depth first search for the reverse post order, and the back edges
+     which tell there are loops in the region. */
+  std::set<llvm::BasicBlock*> visited, onStack;
+  std::vector<std::pair<llvm::BasicBlock*, unsigned> > stack;
+  BasicBlockVector postOrder;
+
+  stack.push_back(std::make_pair(entry, 0u));
+  visited.insert(entry);
+  onStack.insert(entry);
+  while (!stack.empty())
+    {
+      llvm::BasicBlock *BB = stack.back().first;
+      unsigned next = stack.back().second;
+      llvm::Instruction *T = BB->getTerminator();
+      if (BB != exit && next < T->getNumSuccessors())
+        {
+          stack.back().second++;
+          llvm::BasicBlock *succ = T->getSuccessor(next);
+          if (onStack.count(succ))
+            hasLoops = true;
+          else if (visited.insert(succ).second)
+            {
+              onStack.insert(succ);
+              stack.push_back(std::make_pair(succ, 0u));
+            }
+          continue;
+        }
+      postOrder.push_back(BB);
+      onStack.erase(BB);
+      stack.pop_back();
+    }
+
+  if (visited.size() != blocks.size())
+    return Fail("region blocks unreachable from its entry");
+
+  order.assign(postOrder.rbegin(), postOrder.rend());
+  if (!hasLoops && order.back() != exit)
+    return Fail("region exit not reached from all blocks");
+  return true;
+}
+
+/* Finds the allocas the region accesses. Private scalar variables that
+   are only loaded and stored in the region can be vectorized, the other
+   private memory cannot, as it cannot be told apart per work-item.
+   The context arrays of WorkitemLoops are indexed with the local ids,
+   and thus are fine. */
+bool
+WorkitemVectorizer::ClassifyAllocas()
+{
+  for (BasicBlockVector::iterator i = order.begin(); i != order.end(); ++i)
+    {
+      for (llvm::BasicBlock::iterator ii = (*i)->begin(), ie = (*i)->end();
+           ii != ie; ++ii)
+        {
+          llvm::Instruction *I = &*ii;
+          if (isa<llvm::AllocaInst>(I))
+            return Fail("alloca in the region");
+          if (IsIgnored(I))
+            continue;
+
+          for (unsigned op = 0; op < I->getNumOperands(); ++op)
+            {
+              llvm::Value *V = I->getOperand(op);
+              if (!V->getType()->isPointerTy() ||
+                  contextArrays.count(V))
+                continue;
+
+              llvm::AllocaInst *A = dyn_cast<llvm::AllocaInst>(V);
+              if (A == NULL)
+                {
+                  llvm::Instruction *def = dyn_cast<llvm::Instruction>(V);
+                  if (def == NULL || blocks.count(def->getParent()))
+                    continue;
+                  llvm::Value *object = GetUnderlyingObject(V, *DL, 0);
+                  if (isa<llvm::AllocaInst>(object) &&
+                      !contextArrays.count(object))
+                    return Fail("private memory accessed through a pointer");
+                  continue;
+                }
+
+              if (allocas.count(A))
+                continue;
+              if (A->isArrayAllocation() ||
+                  !VectorType::isValidElementType(A->getAllocatedType()))
+                return Fail("private array accessed in the region");
+
+              for (llvm::Value::user_iterator ui = A->user_begin(),
+                     ue = A->user_end(); ui != ue; ++ui)
+                {
+                  llvm::Instruction *user = cast<llvm::Instruction>(*ui);
+                  if (llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(user))
+                    {
+                      if (blocks.count(load->getParent()) &&
+                          load->isSimple())
+                        continue;
+                    }
+                  else if (llvm::StoreInst *store =
+                           dyn_cast<llvm::StoreInst>(user))
+                    {
+                      if (blocks.count(store->getParent()) &&
+                          store->isSimple() &&
+                          store->getValueOperand() != A)
+                        continue;
+                    }
+                  else if (IsLifetimeMarker(user))
+                    continue;
+                  else if (isa<llvm::BitCastInst>(user))
+                    {
+                      bool markersOnly = true;
+                      for (llvm::Value::user_iterator bi =
+                             user->user_begin(); bi != user->user_end(); ++bi)
+                        markersOnly &= IsLifetimeMarker(*bi);
+                      if (markersOnly)
+                        continue;
+                    }
+                  return Fail("private variable accessed outside the region "
+                              "or through a pointer");
+                }
+
+              allocas.insert(A);
+              /* The variables proven uniform stay scalar, unless the
+                 region stores something varying to them. */
+              if (!VUA.isUniform(F, A))
+                privateAllocas.insert(A);
+            }
+        }
+    }
+  return true;
+}
+
+void
+WorkitemVectorizer::ComputeShapes()
+{
+  bool changed = true;
+  for (unsigned round = 0; changed; ++round)
+    {
+      changed = false;
+      if (round == MAX_SHAPE_ITERATIONS)
+        {
+          /* Give up with the precision, the shapes of all the values
+             still changing are not known. */
+          for (std::map<llvm::Value*, Shape>::iterator i = shapes.begin();
+               i != shapes.end(); ++i)
+            {
+              if (i->second.kind == Shape::STRIDED)
+                i->second = Varying();
+            }
+        }
+
+      for (BasicBlockVector::iterator i = order.begin();
+           i != order.end(); ++i)
+        {
+          llvm::BasicBlock *BB = *i;
+          for (llvm::BasicBlock::iterator ii = BB->begin(), ie = BB->end();
+               ii != ie; ++ii)
+            {
+              llvm::Instruction *I = &*ii;
+              if (llvm::StoreInst *store = dyn_cast<llvm::StoreInst>(I))
+                {
+                  llvm::AllocaInst *A =
+                    dyn_cast<llvm::AllocaInst>(store->getPointerOperand());
+                  if (A != NULL && allocas.count(A) &&
+                      !privateAllocas.count(A) &&
+                      (ShapeOf(store->getValueOperand()).kind !=
+                       Shape::UNIFORM || IsMasked(BB)))
+                    {
+                      privateAllocas.insert(A);
+                      changed = true;
+                    }
+                  continue;
+                }
+              if (I->getType()->isVoidTy())
+                continue;
+
+              Shape s = ComputeShape(I);
+              if (round >= MAX_SHAPE_ITERATIONS && s.kind == Shape::STRIDED)
+                s = Varying();
+              std::map<llvm::Value*, Shape>::iterator old = shapes.find(I);
+              if (old == shapes.end() ||
+                  !SameShape(old->second, s))
+                {
+                  shapes[I] = s;
+                  changed = true;
+                }
+            }
+        }
+    }
+}
+
+WorkitemVectorizer::Shape
+WorkitemVectorizer::ShapeOf(llvm::Value *V)
+{
+  std::map<llvm::Value*, Shape>::iterator i = shapes.find(V);
+  if (i != shapes.end())
+    return i->second;
+  /* Values defined outside the region are the same for all the
+     work-items, as the varying ones are restored from the context
+     arrays in the region. The values of the region not yet visited
+     are optimistically assumed to be uniform. */
+  return Uniform();
+}
+
+WorkitemVectorizer::Shape
+WorkitemVectorizer::ComputeShape(llvm::Instruction *I)
+{
+  bool masked = IsMasked(I->getParent());
+
+  if (llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(I))
+    {
+      llvm::Value *ptr = load->getPointerOperand();
+      if (ptr == localIdX)
+        return Strided(1, true, true);
+      if (ptr == localIdY || ptr == localIdZ)
+        return Uniform();
+      if (llvm::AllocaInst *A = dyn_cast<llvm::AllocaInst>(ptr))
+        {
+          if (allocas.count(A))
+            return privateAllocas.count(A) ? Varying() : Uniform();
+        }
+      if (ShapeOf(ptr).kind == Shape::UNIFORM && !masked)
+        return Uniform();
+      return Varying();
+    }
+
+  if (llvm::PHINode *phi = dyn_cast<llvm::PHINode>(I))
+    {
+      if (linearize)
+        return Varying();
+      for (unsigned in = 0; in < phi->getNumIncomingValues(); ++in)
+        {
+          if (ShapeOf(phi->getIncomingValue(in)).kind != Shape::UNIFORM)
+            return Varying();
+        }
+      return Uniform();
+    }
+
+  bool uniformOperands = true;
+  for (unsigned op = 0; op < I->getNumOperands(); ++op)
+    uniformOperands &= ShapeOf(I->getOperand(op)).kind == Shape::UNIFORM;
+
+  if (uniformOperands)
+    {
+      if (masked && IsDivRem(I))
+        return Varying();
+      return Uniform();
+    }
+
+  if (llvm::BinaryOperator *binop = dyn_cast<llvm::BinaryOperator>(I))
+    {
+      if (!I->getType()->isIntegerTy())
+        return Varying();
+      Shape a = ShapeOf(binop->getOperand(0));
+      Shape b = ShapeOf(binop->getOperand(1));
+      if (a.kind == Shape::VARYING || b.kind == Shape::VARYING)
+        return Varying();
+      llvm::ConstantInt *ca = dyn_cast<llvm::ConstantInt>(binop->getOperand(0));
+      llvm::ConstantInt *cb = dyn_cast<llvm::ConstantInt>(binop->getOperand(1));
+      /* The lanes do not wrap around if none of them wraps around in the
+         operands and the operation does not for any lane. */
+      bool nsw = a.noSignedWrap && b.noSignedWrap &&
+        binop->hasNoSignedWrap();
+      bool nuw = a.noUnsignedWrap && b.noUnsignedWrap &&
+        binop->hasNoUnsignedWrap();
+      switch (binop->getOpcode())
+        {
+        case Instruction::Add:
+          return Strided(a.stride + b.stride, nsw, nuw);
+        case Instruction::Sub:
+          return Strided(a.stride - b.stride, nsw, nuw);
+        case Instruction::Mul:
+          if (cb != NULL)
+            return Strided(a.stride * cb->getSExtValue(), nsw,
+                           nuw && !cb->isNegative());
+          if (ca != NULL)
+            return Strided(b.stride * ca->getSExtValue(), nsw,
+                           nuw && !ca->isNegative());
+          return Varying();
+        case Instruction::Shl:
+          if (cb != NULL && cb->getZExtValue() < 32)
+            return Strided(a.stride << cb->getZExtValue(), nsw, nuw);
+          return Varying();
+        default:
+          return Varying();
+        }
+    }
+
+  if (llvm::CastInst *castInst = dyn_cast<llvm::CastInst>(I))
+    {
+      Shape s = ShapeOf(castInst->getOperand(0));
+      if (s.kind != Shape::STRIDED)
+        return Varying();
+      switch (castInst->getOpcode())
+        {
+        case Instruction::SExt:
+          if (!s.noSignedWrap)
+            return Varying();
+          return Strided(s.stride, true, false);
+        case Instruction::ZExt:
+          if (!s.noUnsignedWrap)
+            return Varying();
+          /* Not wrapping as unsigned values, the extended lanes are
+             below the sign bit of the wider type. */
+          return Strided(s.stride, true, true);
+        case Instruction::Trunc:
+          return Strided(s.stride);
+        case Instruction::PtrToInt:
+        case Instruction::IntToPtr:
+          if (DL->getTypeSizeInBits(castInst->getType()) !=
+              DL->getTypeSizeInBits(castInst->getOperand(0)->getType()))
+            return Varying();
+          return s;
+        case Instruction::BitCast:
+          if (castInst->getType()->isPointerTy() &&
+              castInst->getOperand(0)->getType()->isPointerTy())
+            return s;
+          return Varying();
+        default:
+          return Varying();
+        }
+    }
+
+  if (llvm::GetElementPtrInst *gep = dyn_cast<llvm::GetElementPtrInst>(I))
+    {
+      Shape base = ShapeOf(gep->getPointerOperand());
+      if (base.kind == Shape::VARYING)
+        return Varying();
+      int64_t stride = base.stride;
+      llvm::Type *type = gep->getSourceElementType();
+      for (unsigned op = 1; op < gep->getNumOperands(); ++op)
+        {
+          llvm::Value *index = gep->getOperand(op);
+          if (op > 1)
+            {
+              if (llvm::StructType *ST = dyn_cast<llvm::StructType>(type))
+                {
+                  type = ST->getElementType
+                    (cast<llvm::ConstantInt>(index)->getZExtValue());
+                  continue;
+                }
+              if (llvm::ArrayType *AT = dyn_cast<llvm::ArrayType>(type))
+                type = AT->getElementType();
+              else
+                type = cast<llvm::VectorType>(type)->getElementType();
+            }
+          Shape s = ShapeOf(index);
+          if (s.kind == Shape::VARYING)
+            return Varying();
+          /* The narrower indices are sign extended to the pointer
+             width. */
+          if (s.kind == Shape::STRIDED && !s.noSignedWrap &&
+              index->getType()->getScalarSizeInBits() <
+              DL->getPointerSizeInBits(gep->getPointerAddressSpace()))
+            return Varying();
+          stride += s.stride * (int64_t)DL->getTypeAllocSize(type);
+        }
+      return Strided(stride);
+    }
+
+  return Varying();
+}
+
+/* Finds the blocks of the region not executed by all the work-items,
+   that is, the blocks the exit can be reached without. */
+void
+WorkitemVectorizer::FindMaskedBlocks()
+{
+  llvm::BasicBlock *entry = region.entryBB();
+  llvm::BasicBlock *exit = region.exitBB();
+
+  for (BasicBlockVector::iterator i = order.begin(); i != order.end(); ++i)
+    {
+      llvm::BasicBlock *skipped = *i;
+      if (skipped == entry || skipped == exit)
+        continue;
+
+      std::set<llvm::BasicBlock*> reached;
+      std::vector<llvm::BasicBlock*> worklist;
+      reached.insert(entry);
+      worklist.push_back(entry);
+      while (!worklist.empty())
+        {
+          llvm::BasicBlock *BB = worklist.back();
+          worklist.pop_back();
+          if (BB == exit)
+            break;
+          for (llvm::succ_iterator si = succ_begin(BB), se = succ_end(BB);
+               si != se; ++si)
+            {
+              if (*si != skipped && reached.insert(*si).second)
+                worklist.push_back(*si);
+            }
+        }
+      if (reached.count(exit))
+        maskedBlocks.insert(skipped);
+    }
+}
+
+bool
+WorkitemVectorizer::IsMasked(llvm::BasicBlock *BB) const
+{
+  return linearize && maskedBlocks.count(BB);
+}
+
+bool
+WorkitemVectorizer::IsLegal()
+{
+  for (BasicBlockVector::iterator i = order.begin(); i != order.end(); ++i)
+    {
+      llvm::BasicBlock *BB = *i;
+      for (llvm::BasicBlock::iterator ii = BB->begin(), ie = BB->end();
+           ii != ie; ++ii)
+        {
+          llvm::Instruction *I = &*ii;
+          if (IsIgnored(I) || I->isTerminator())
+            continue;
+
+          if (isa<llvm::AtomicRMWInst>(I) || isa<llvm::AtomicCmpXchgInst>(I) ||
+              isa<llvm::FenceInst>(I) ||
+              I->getMetadata(POCL_LOWERED_ATOMIC_MD) != NULL)
+            return Fail("atomic operation");
+
+          if (llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(I))
+            {
+              if (!load->isSimple())
+                return Fail("atomic or volatile load");
+            }
+          else if (llvm::StoreInst *store = dyn_cast<llvm::StoreInst>(I))
+            {
+              llvm::Value *ptr = store->getPointerOperand();
+              if (!store->isSimple())
+                return Fail("atomic or volatile store");
+              if (ptr == localIdX || ptr == localIdY || ptr == localIdZ)
+                return Fail("local id written in the region");
+              if (!VectorType::isValidElementType
+                  (store->getValueOperand()->getType()))
+                return Fail("store of a non-scalar value");
+              continue;
+            }
+          else if (llvm::CallInst *call = dyn_cast<llvm::CallInst>(I))
+            {
+              /* Calls with side effects would have to be executed once
+                 per work-item, in order. */
+              if (!call->doesNotAccessMemory())
+                return Fail("call with side effects");
+            }
+
+          if (I->getType()->isVoidTy())
+            continue;
+
+          Shape s = ShapeOf(I);
+          if (s.kind == Shape::UNIFORM)
+            continue;
+
+          if (!VectorType::isValidElementType(I->getType()))
+            return Fail("non-scalar value varying across the work-items");
+
+          for (llvm::Value::user_iterator ui = I->user_begin(),
+                 ue = I->user_end(); ui != ue; ++ui)
+            {
+              llvm::Instruction *user = dyn_cast<llvm::Instruction>(*ui);
+              if (user != NULL && !blocks.count(user->getParent()) &&
+                  !IsIgnored(user))
+                return Fail("varying value used outside the region");
+            }
+
+          if (s.kind == Shape::STRIDED)
+            continue;
+
+          if (!isa<llvm::BinaryOperator>(I) && !isa<llvm::CastInst>(I) &&
+              !isa<llvm::CmpInst>(I) && !isa<llvm::SelectInst>(I) &&
+              !isa<llvm::GetElementPtrInst>(I) && !isa<llvm::LoadInst>(I) &&
+              !isa<llvm::PHINode>(I) && !isa<llvm::CallInst>(I))
+            return Fail(std::string("unsupported varying instruction ") +
+                        I->getOpcodeName());
+
+          for (unsigned op = 0; op < I->getNumOperands(); ++op)
+            {
+              llvm::Value *V = I->getOperand(op);
+              if (isa<llvm::Function>(V) || isa<llvm::BasicBlock>(V))
+                continue;
+              if (!VectorType::isValidElementType(V->getType()))
+                return Fail("non-scalar operand of a varying instruction");
+            }
+        }
+    }
+  return true;
+}
+
+llvm::VectorType *
+WorkitemVectorizer::VectorTypeOf(llvm::Type *type)
+{
+  return VectorType::get(type, width);
+}
+
+unsigned
+WorkitemVectorizer::AlignmentOf(unsigned align, llvm::Type *type)
+{
+  return align != 0 ? align : DL->getABITypeAlignment(type);
+}
+
+/* Returns true if the lanes of the pointer access adjacent elements of
+   the type, and thus a vector can be loaded from the lane 0 pointer. */
+bool
+WorkitemVectorizer::IsConsecutive(llvm::Value *ptr, llvm::Type *elementType)
+{
+  Shape s = ShapeOf(ptr);
+  return s.kind == Shape::STRIDED &&
+    s.stride == (int64_t)DL->getTypeAllocSize(elementType) &&
+    DL->getTypeSizeInBits(elementType) ==
+    DL->getTypeAllocSizeInBits(elementType);
+}
+
+/* Returns the vector of the lane values of the value. */
+llvm::Value *
+WorkitemVectorizer::VectorOf(llvm::Value *V, llvm::IRBuilder<> &builder)
+{
+  std::map<llvm::Value*, llvm::Value*>::iterator i = vectors.find(V);
+  if (i != vectors.end())
+    return i->second;
+
+  Shape s = ShapeOf(V);
+  assert (s.kind != Shape::VARYING &&
+          "Varying value used before it was vectorized.");
+
+  llvm::Type *type = V->getType();
+  if (s.kind == Shape::UNIFORM)
+    return builder.CreateVectorSplat(width, V);
+
+  /* The scalar of a strided value holds the value of the lane 0. */
+  llvm::Type *stepType = type;
+  if (type->isPointerTy())
+    stepType = DL->getIntPtrType(type);
+  std::vector<llvm::Constant*> steps;
+  for (unsigned lane = 0; lane < width; ++lane)
+    steps.push_back(ConstantInt::get(stepType, lane * s.stride, true));
+  llvm::Value *offsets = ConstantVector::get(steps);
+
+  if (type->isPointerTy())
+    {
+      llvm::Type *bytePtr =
+        builder.getInt8PtrTy(type->getPointerAddressSpace());
+      llvm::Value *base =
+        builder.CreateVectorSplat(width,
+                                  builder.CreateBitCast(V, bytePtr));
+      llvm::Value *lanes =
+        builder.CreateGEP(builder.getInt8Ty(), base, offsets);
+      return builder.CreateBitCast(lanes, VectorTypeOf(type));
+    }
+  return builder.CreateAdd(builder.CreateVectorSplat(width, V), offsets);
+}
+
+/* Returns the mask of the work-items executing the block, NULL if all
+   of them do. */
+llvm::Value *
+WorkitemVectorizer::MaskOf(llvm::BasicBlock *BB)
+{
+  if (!linearize)
+    return NULL;
+  std::map<llvm::BasicBlock*, llvm::Value*>::iterator i =
+    blockMasks.find(BB);
+  return i != blockMasks.end() ? i->second : NULL;
+}
+
+llvm::Value *
+WorkitemVectorizer::AndMasks(llvm::Value *a, llvm::Value *b,
+                             llvm::IRBuilder<> &builder)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  return builder.CreateAnd(a, b);
+}
+
+llvm::Value *
+WorkitemVectorizer::OrMasks(llvm::Value *a, llvm::Value *b,
+                            llvm::IRBuilder<> &builder)
+{
+  if (a == NULL || b == NULL)
+    return NULL;
+  return builder.CreateOr(a, b);
+}
+
+void
+WorkitemVectorizer::ComputeBlockMask(llvm::BasicBlock *BB)
+{
+  if (!maskedBlocks.count(BB))
+    {
+      blockMasks[BB] = NULL;
+      return;
+    }
+
+  llvm::IRBuilder<> builder(&*BB->getFirstInsertionPt());
+  llvm::Value *mask = NULL;
+  bool first = true;
+  for (llvm::pred_iterator pi = pred_begin(BB), pe = pred_end(BB);
+       pi != pe; ++pi)
+    {
+      llvm::Value *edge = edgeMasks[Edge(*pi, BB)];
+      mask = first ? edge : OrMasks(mask, edge, builder);
+      first = false;
+    }
+  blockMasks[BB] = mask;
+}
+
+void
+WorkitemVectorizer::ComputeEdgeMasks(llvm::BasicBlock *BB)
+{
+  llvm::BranchInst *br = cast<llvm::BranchInst>(BB->getTerminator());
+  llvm::IRBuilder<> builder(br);
+  llvm::Value *mask = MaskOf(BB);
+
+  if (br->isUnconditional() || br->getSuccessor(0) == br->getSuccessor(1))
+    {
+      edgeMasks[Edge(BB, br->getSuccessor(0))] = mask;
+      return;
+    }
+
+  llvm::Value *cond = VectorOf(br->getCondition(), builder);
+  edgeMasks[Edge(BB, br->getSuccessor(0))] = AndMasks(mask, cond, builder);
+  edgeMasks[Edge(BB, br->getSuccessor(1))] =
+    AndMasks(mask, builder.CreateNot(cond), builder);
+}
+
+void
+WorkitemVectorizer::Widen(llvm::Instruction *I)
+{
+  if (IsIgnored(I))
+    return;
+
+  if (llvm::StoreInst *store = dyn_cast<llvm::StoreInst>(I))
+    {
+      WidenStore(store);
+      return;
+    }
+  if (llvm::LoadInst *load = dyn_cast<llvm::LoadInst>(I))
+    {
+      WidenLoad(load);
+      return;
+    }
+
+  if (I->getType()->isVoidTy() || ShapeOf(I).kind != Shape::VARYING)
+    return;
+
+  if (llvm::PHINode *phi = dyn_cast<llvm::PHINode>(I))
+    {
+      WidenPHI(phi);
+      return;
+    }
+  if (llvm::CallInst *call = dyn_cast<llvm::CallInst>(I))
+    {
+      WidenCall(call);
+      return;
+    }
+
+  llvm::IRBuilder<> builder(I);
+  llvm::Value *V = NULL;
+
+  if (llvm::BinaryOperator *binop = dyn_cast<llvm::BinaryOperator>(I))
+    {
+      llvm::Value *a = VectorOf(binop->getOperand(0), builder);
+      llvm::Value *b = VectorOf(binop->getOperand(1), builder);
+      llvm::Value *mask = MaskOf(I->getParent());
+      if (mask != NULL && IsDivRem(I))
+        b = builder.CreateSelect
+          (mask, b, ConstantInt::get(b->getType(), 1));
+      V = builder.CreateBinOp(binop->getOpcode(), a, b);
+      if (llvm::BinaryOperator *vbinop = dyn_cast<llvm::BinaryOperator>(V))
+        vbinop->copyIRFlags(binop);
+    }
+  else if (llvm::CastInst *castInst = dyn_cast<llvm::CastInst>(I))
+    {
+      V = builder.CreateCast(castInst->getOpcode(),
+                             VectorOf(castInst->getOperand(0), builder),
+                             VectorTypeOf(castInst->getType()));
+    }
+  else if (llvm::CmpInst *cmp = dyn_cast<llvm::CmpInst>(I))
+    {
+      llvm::Value *a = VectorOf(cmp->getOperand(0), builder);
+      llvm::Value *b = VectorOf(cmp->getOperand(1), builder);
+      if (isa<llvm::ICmpInst>(cmp))
+        V = builder.CreateICmp(cmp->getPredicate(), a, b);
+      else
+        V = builder.CreateFCmp(cmp->getPredicate(), a, b);
+    }
+  else if (llvm::SelectInst *select = dyn_cast<llvm::SelectInst>(I))
+    {
+      llvm::Value *cond = select->getCondition();
+      if (ShapeOf(cond).kind != Shape::UNIFORM)
+        cond = VectorOf(cond, builder);
+      V = builder.CreateSelect(cond,
+                               VectorOf(select->getTrueValue(), builder),
+                               VectorOf(select->getFalseValue(), builder));
+    }
+  else if (llvm::GetElementPtrInst *gep =
+           dyn_cast<llvm::GetElementPtrInst>(I))
+    {
+      /* The struct member indices must stay scalar constants. */
+      llvm::Value *base = VectorOf(gep->getPointerOperand(), builder);
+      std::vector<llvm::Value*> indices;
+      llvm::Type *type = gep->getSourceElementType();
+      for (unsigned op = 1; op < gep->getNumOperands(); ++op)
+        {
+          llvm::Value *index = gep->getOperand(op);
+          if (op > 1)
+            {
+              if (llvm::StructType *ST = dyn_cast<llvm::StructType>(type))
+                {
+                  indices.push_back(index);
+                  type = ST->getElementType
+                    (cast<llvm::ConstantInt>(index)->getZExtValue());
+                  continue;
+                }
+              if (llvm::ArrayType *AT = dyn_cast<llvm::ArrayType>(type))
+                type = AT->getElementType();
+              else
+                type = cast<llvm::VectorType>(type)->getElementType();
+            }
+          indices.push_back(VectorOf(index, builder));
+        }
+      if (gep->isInBounds())
+        V = builder.CreateInBoundsGEP(gep->getSourceElementType(), base,
+                                      indices);
+      else
+        V = builder.CreateGEP(gep->getSourceElementType(), base, indices);
+    }
+
+  assert (V != NULL);
+  V->setName(I->getName() + ".wfv");
+  vectors[I] = V;
+  toErase.push_back(I);
+}
+
+void
+WorkitemVectorizer::WidenLoad(llvm::LoadInst *load)
+{
+  llvm::Value *ptr = load->getPointerOperand();
+  llvm::Type *type = load->getType();
+  llvm::IRBuilder<> builder(load);
+  llvm::Value *V;
+
+  llvm::AllocaInst *A = dyn_cast<llvm::AllocaInst>(ptr);
+  if (A != NULL && privateAllocas.count(A))
+    {
+      V = builder.CreateLoad(vectorAllocas[A]);
+    }
+  else
+    {
+      if (ShapeOf(load).kind != Shape::VARYING)
+        return;
+
+      unsigned align = AlignmentOf(load->getAlignment(), type);
+      llvm::Value *mask = MaskOf(load->getParent());
+      if (IsConsecutive(ptr, type))
+        {
+          llvm::Value *vectorPtr =
+            builder.CreateBitCast
+            (ptr, VectorTypeOf(type)->getPointerTo
+             (ptr->getType()->getPointerAddressSpace()));
+          if (mask != NULL)
+            V = builder.CreateMaskedLoad(vectorPtr, align, mask);
+          else
+            V = builder.CreateAlignedLoad(vectorPtr, align);
+        }
+      else
+        {
+          V = builder.CreateMaskedGather(VectorOf(ptr, builder), align, mask);
+        }
+    }
+
+  V->setName(load->getName() + ".wfv");
+  vectors[load] = V;
+  toErase.push_back(load);
+}
+
+void
+WorkitemVectorizer::WidenStore(llvm::StoreInst *store)
+{
+  llvm::Value *value = store->getValueOperand();
+  llvm::Value *ptr = store->getPointerOperand();
+  llvm::Type *type = value->getType();
+  llvm::Value *mask = MaskOf(store->getParent());
+  llvm::IRBuilder<> builder(store);
+
+  llvm::AllocaInst *A = dyn_cast<llvm::AllocaInst>(ptr);
+  if (A != NULL && privateAllocas.count(A))
+    {
+      llvm::AllocaInst *vectorAlloca = vectorAllocas[A];
+      llvm::Value *V = VectorOf(value, builder);
+      if (mask != NULL)
+        builder.CreateMaskedStore
+          (V, vectorAlloca,
+           AlignmentOf(vectorAlloca->getAlignment(), V->getType()), mask);
+      else
+        builder.CreateStore(V, vectorAlloca);
+      toErase.push_back(store);
+      return;
+    }
+
+  /* The uniform variables are stored only in the unmasked blocks. */
+  if (A != NULL && allocas.count(A))
+    return;
+
+  if (mask == NULL && ShapeOf(value).kind == Shape::UNIFORM &&
+      ShapeOf(ptr).kind == Shape::UNIFORM)
+    return;
+
+  unsigned align = AlignmentOf(store->getAlignment(), type);
+  llvm::Value *V = VectorOf(value, builder);
+  if (IsConsecutive(ptr, type))
+    {
+      llvm::Value *vectorPtr =
+        builder.CreateBitCast
+        (ptr, VectorTypeOf(type)->getPointerTo
+         (ptr->getType()->getPointerAddressSpace()));
+      if (mask != NULL)
+        builder.CreateMaskedStore(V, vectorPtr, align, mask);
+      else
+        builder.CreateAlignedStore(V, vectorPtr, align);
+    }
+  else
+    {
+      /* The stores of the lanes to the same address are done in the lane
+         order, as the work-items would do them. */
+      builder.CreateMaskedScatter(V, VectorOf(ptr, builder), align, mask);
+    }
+  toErase.push_back(store);
+}
+
+void
+WorkitemVectorizer::WidenCall(llvm::CallInst *call)
+{
+  llvm::IRBuilder<> builder(call);
+  llvm::VectorType *vectorType = VectorTypeOf(call->getType());
+  llvm::Value *V;
+
+  bool sameTypes = true;
+  for (unsigned arg = 0; arg < call->getNumArgOperands(); ++arg)
+    sameTypes &= call->getArgOperand(arg)->getType() == call->getType();
+
+  llvm::IntrinsicInst *II = dyn_cast<llvm::IntrinsicInst>(call);
+  if (II != NULL && sameTypes && IsVectorizableIntrinsic(II->getIntrinsicID()))
+    {
+      llvm::Function *vectorF =
+        Intrinsic::getDeclaration(F->getParent(), II->getIntrinsicID(),
+                                  vectorType);
+      std::vector<llvm::Value*> args;
+      for (unsigned arg = 0; arg < call->getNumArgOperands(); ++arg)
+        args.push_back(VectorOf(call->getArgOperand(arg), builder));
+      V = builder.CreateCall(vectorF, args);
+    }
+  else
+    {
+      /* Call the function for each lane. The called functions do not
+         access memory, thus it is fine to call them also for the lanes
+         masked off. */
+      V = UndefValue::get(vectorType);
+      for (unsigned lane = 0; lane < width; ++lane)
+        {
+          std::vector<llvm::Value*> args;
+          for (unsigned arg = 0; arg < call->getNumArgOperands(); ++arg)
+            {
+              llvm::Value *A = call->getArgOperand(arg);
+              if (ShapeOf(A).kind != Shape::UNIFORM)
+                A = builder.CreateExtractElement(VectorOf(A, builder),
+                                                 builder.getInt32(lane));
+              args.push_back(A);
+            }
+          llvm::CallInst *laneCall =
+            builder.CreateCall(call->getCalledValue(), args);
+          laneCall->setCallingConv(call->getCallingConv());
+          laneCall->setAttributes(call->getAttributes());
+          V = builder.CreateInsertElement(V, laneCall,
+                                          builder.getInt32(lane));
+        }
+    }
+
+  V->setName(call->getName() + ".wfv");
+  vectors[call] = V;
+  toErase.push_back(call);
+}
+
+void
+WorkitemVectorizer::WidenPHI(llvm::PHINode *phi)
+{
+  if (!linearize)
+    {
+      /* The incoming values are added when all the values are
+         vectorized. */
+      vectors[phi] =
+        PHINode::Create(VectorTypeOf(phi->getType()),
+                        phi->getNumIncomingValues(),
+                        phi->getName() + ".wfv", phi);
+      vectorPHIs.push_back(phi);
+      toErase.push_back(phi);
+      return;
+    }
+
+  /* Blend the incoming values by the masks of the incoming edges. Each
+     work-item executing the block comes from one of them. */
+  llvm::IRBuilder<> builder(&*phi->getParent()->getFirstInsertionPt());
+  llvm::Value *V = VectorOf(phi->getIncomingValue(0), builder);
+  for (unsigned in = 1; in < phi->getNumIncomingValues(); ++in)
+    {
+      llvm::Value *edge =
+        edgeMasks[Edge(phi->getIncomingBlock(in), phi->getParent())];
+      llvm::Value *incoming = VectorOf(phi->getIncomingValue(in), builder);
+      V = edge == NULL ? incoming :
+        builder.CreateSelect(edge, incoming, V);
+    }
+  V->setName(phi->getName() + ".wfv");
+  vectors[phi] = V;
+  toErase.push_back(phi);
+}
+
+#endif
@@ -0,0 +1,166 @@
+// Header for WorkitemVectorizer, the explicit work-item vectorizer of
+// the parallel regions.
+//
+// Copyright (c) 2017 pocl developers
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef _POCL_WORKITEM_VECTORIZER_H
+#define _POCL_WORKITEM_VECTORIZER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "CompilerWarnings.h"
+IGNORE_COMPILER_WARNING("-Wunused-parameter")
+
+#include "config.h"
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+
+POP_COMPILER_DIAGS
+
+namespace pocl {
+
+  class ParallelRegion;
+  class VariableUniformityAnalysis;
+
+  // Vectorizes a parallel region across the work-items for the 'wfv'
+  // work-group method: after the transformation, one execution of the
+  // region executes 'width' work-items with consecutive x ids, the first
+  // of which is in the local id x variable.
+  //
+  // The values that are the same for all the work-items stay scalar. So
+  // do the values that are a linear function of the local id x, which
+  // then hold the value of the first work-item. Only the remaining
+  // values are computed in vectors. Memory accesses with consecutive
+  // addresses become vector loads and stores, the others gathers and
+  // scatters. The private variables in allocas get an alloca per lane.
+  //
+  // Regions with divergent branches are linearized: the blocks are
+  // executed one after another with the work-items not taking the block
+  // masked off. Regions with loops are only vectorized if all their
+  // branches are uniform.
+  //
+  // Regions that cannot be vectorized are left untouched, see
+  // failureReason().
+  class WorkitemVectorizer {
+  public:
+    WorkitemVectorizer(ParallelRegion &region, unsigned width,
+                       llvm::Value *localIdX, llvm::Value *localIdY,
+                       llvm::Value *localIdZ,
+                       const std::set<llvm::Value*> &contextArrays,
+                       VariableUniformityAnalysis &VUA);
+
+    bool vectorize();
+
+    const std::string &failureReason() const { return failureMessage; }
+
+  private:
+    // How a value varies across the lanes.
+    struct Shape {
+      enum Kind { UNIFORM, STRIDED, VARYING } kind;
+      // The difference of the values of consecutive lanes of a STRIDED
+      // value. In bytes for pointers.
+      int64_t stride;
+      // True if the lane values of a STRIDED value are known not to wrap
+      // around as signed, respectively unsigned, integers of the type.
+      // Only then the stride is kept when the value is sign or zero
+      // extended, as the stride of the other ones holds modulo the width
+      // of the type only.
+      bool noSignedWrap;
+      bool noUnsignedWrap;
+    };
+
+    typedef std::vector<llvm::BasicBlock*> BasicBlockVector;
+    typedef std::pair<llvm::BasicBlock*, llvm::BasicBlock*> Edge;
+
+    bool AnalyzeControlFlow();
+    bool ClassifyAllocas();
+    void ComputeShapes();
+    Shape ComputeShape(llvm::Instruction *I);
+    bool IsLegal();
+    void FindMaskedBlocks();
+    bool IsMasked(llvm::BasicBlock *BB) const;
+
+    Shape ShapeOf(llvm::Value *V);
+    static Shape Uniform();
+    static Shape Strided(int64_t stride, bool noSignedWrap = false,
+                         bool noUnsignedWrap = false);
+    static Shape Varying();
+    static bool SameShape(const Shape &a, const Shape &b);
+
+    void Widen(llvm::Instruction *I);
+    void WidenLoad(llvm::LoadInst *load);
+    void WidenStore(llvm::StoreInst *store);
+    void WidenCall(llvm::CallInst *call);
+    void WidenPHI(llvm::PHINode *phi);
+
+    llvm::Value *VectorOf(llvm::Value *V, llvm::IRBuilder<> &builder);
+    llvm::Value *MaskOf(llvm::BasicBlock *BB);
+    llvm::Value *AndMasks(llvm::Value *a, llvm::Value *b,
+                          llvm::IRBuilder<> &builder);
+    llvm::Value *OrMasks(llvm::Value *a, llvm::Value *b,
+                         llvm::IRBuilder<> &builder);
+    void ComputeBlockMask(llvm::BasicBlock *BB);
+    void ComputeEdgeMasks(llvm::BasicBlock *BB);
+    bool IsConsecutive(llvm::Value *ptr, llvm::Type *elementType);
+    unsigned AlignmentOf(unsigned align, llvm::Type *type);
+    llvm::VectorType *VectorTypeOf(llvm::Type *type);
+
+    bool Fail(const std::string &reason);
+
+    ParallelRegion &region;
+    unsigned width;
+    llvm::Value *localIdX, *localIdY, *localIdZ;
+    const std::set<llvm::Value*> &contextArrays;
+    VariableUniformityAnalysis &VUA;
+    llvm::Function *F;
+    const llvm::DataLayout *DL;
+
+    std::set<llvm::BasicBlock*> blocks;
+    // The region blocks in a reverse post order, the exit block last.
+    BasicBlockVector order;
+    bool hasLoops;
+    bool linearize;
+    // The blocks of a linearized region not executed by all work-items.
+    std::set<llvm::BasicBlock*> maskedBlocks;
+
+    std::map<llvm::Value*, Shape> shapes;
+    // The allocas accessed by the region with scalar loads and stores.
+    // The uniform ones stay scalar, the private ones get a lane each.
+    std::set<llvm::AllocaInst*> allocas;
+    std::set<llvm::AllocaInst*> privateAllocas;
+    std::map<llvm::AllocaInst*, llvm::AllocaInst*> vectorAllocas;
+
+    std::map<llvm::Value*, llvm::Value*> vectors;
+    std::map<llvm::BasicBlock*, llvm::Value*> blockMasks;
+    std::map<Edge, llvm::Value*> edgeMasks;
+    std::vector<llvm::PHINode*> vectorPHIs;
+    std::vector<llvm::Instruction*> toErase;
+
+    std::string failureMessage;
+  };
+}
+
+#endif
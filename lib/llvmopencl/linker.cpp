@@ -46,6 +46,7 @@
 #include "pocl_cl.h"
 
 #include "linker.h"
+#include "LLVMUtils.h"
 
 #include "TargetAddressSpaces.h"
 
@@ -337,6 +338,23 @@ link(llvm::Module *krn, const llvm::Module *lib)
     // TODO: is there no direct way?
     find_called_functions(&*fi, declared);
   }
+
+  // Bring in also the vector variants of the called math builtins, so the
+  // loop vectorizer can widen the calls to them.
+  std::list<llvm::StringRef> variants;
+  std::list<llvm::StringRef>::iterator vi, ve;
+  for (vi = declared.begin(), ve = declared.end(); vi != ve; vi++) {
+    llvm::Function *ScalarF = lib->getFunction(*vi);
+    if (ScalarF == NULL || ScalarF->isDeclaration())
+      continue;
+    for (unsigned width = 2; width <= 16; width *= 2) {
+      llvm::Function *VecF = pocl::findVectorVariant(*lib, *ScalarF, width);
+      if (VecF != NULL)
+        variants.push_back(VecF->getName());
+    }
+  }
+  declared.splice(declared.end(), variants);
+
   declared.sort(stringref_cmp);
   declared.unique(stringref_equal);
 
@@ -0,0 +1,107 @@
+// Variables used across barriers are either recomputed in the later
+// parallel regions or saved to context arrays, which are shared by the
+// variables never live in the same region. Check the values stay correct
+// for a recomputed variable, for two variables that can share a context
+// array and for two that are live at the same time and cannot.
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define WG_SIZE 64
+#define NUM_OUTPUTS 4
+
+const char *SOURCE = R"CLC(
+#define NUM_OUTPUTS 4
+
+__kernel void
+context_variables(__global const int *in, __global int *out, int offset)
+{
+  __local int shared[64];
+  int lid = get_local_id(0);
+  __global int *res = out + get_global_id(0) * NUM_OUTPUTS;
+
+  /* Recomputed from the local id and the argument after the barrier. */
+  int remat = lid * 3 + offset;
+  /* Loaded from the global memory, thus saved to context arrays. a, b
+     and neighbour are live in the same regions, c only after a and b
+     are dead. */
+  int a = in[get_global_id(0)];
+  int b = in[get_global_id(0)] / 7 + lid;
+  shared[lid] = a;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  int neighbour = shared[(lid + 1) % 64];
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  res[0] = remat + shared[lid];
+  res[1] = a - b;
+  res[2] = b * 2;
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+  int c = in[get_global_id(0)] % 5 + neighbour;
+  shared[lid] = c;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  res[3] = c + shared[(lid + 63) % 64];
+}
+)CLC";
+
+int main(int, char **)
+{
+  try {
+    int NumGroups = 4;
+    int N = NumGroups * WG_SIZE;
+    int Offset = 1000;
+
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl_int>
+      (program, "context_variables");
+
+    std::vector<int> input(N);
+    for (int i = 0; i < N; i++)
+      input[i] = i * 13 + 5;
+
+    cl::Buffer in_buffer(input.begin(), input.end(), true);
+    cl::Buffer out_buffer(CL_MEM_WRITE_ONLY, N * NUM_OUTPUTS * sizeof(cl_int));
+    kernel(cl::EnqueueArgs(queue, cl::NDRange(N), cl::NDRange(WG_SIZE)),
+           in_buffer, out_buffer, Offset);
+
+    std::vector<int> output(N * NUM_OUTPUTS);
+    queue.enqueueReadBuffer(out_buffer, CL_TRUE, 0,
+                            N * NUM_OUTPUTS * sizeof(cl_int), &output[0]);
+
+    for (int i = 0; i < N; i++) {
+      int lid = i % WG_SIZE;
+      int group = i - lid;
+      int a = input[i];
+      int b = input[i] / 7 + lid;
+      int neighbour = input[group + (lid + 1) % WG_SIZE];
+      int c = input[i] % 5 + neighbour;
+      /* The neighbour of the work-item on the left is this one. */
+      int c_left = input[group + (lid + WG_SIZE - 1) % WG_SIZE] % 5 + a;
+      int expected[NUM_OUTPUTS] = { lid * 3 + Offset + a, a - b, b * 2,
+                                    c + c_left };
+      for (int o = 0; o < NUM_OUTPUTS; o++) {
+        if (output[i * NUM_OUTPUTS + o] != expected[o]) {
+          std::cout << "FAIL: work-item " << i << " output " << o << " is "
+                    << output[i * NUM_OUTPUTS + o] << ", should be "
+                    << expected[o] << std::endl;
+          return 0;
+        }
+      }
+    }
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+// A kernel without barriers, with PHI nodes in a loop with a uniform
+// iteration count and after a divergent branch. Run with the workitemloops
+// method, with and without POCL_FORCE_PARALLEL_OUTER_LOOP=1 which adds
+// implicit barriers to the loop.
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+
+using namespace std;
+
+const char *SOURCE = R"CLC(
+__kernel void phis(__global const int *in, __global int *out, int n)
+{
+  int gid = (int)get_global_id(0);
+  int v = in[gid];
+  int s = 0;
+  for (int i = 0; i < n; ++i)
+    s += v * i + gid;
+  if (v & 1)
+    s = s - v;
+  else
+    s = s * 2;
+  out[gid] = s;
+}
+)CLC";
+
+static int expected(int v, int gid, int n)
+{
+  int s = 0;
+  for (int i = 0; i < n; ++i)
+    s += v * i + gid;
+  if (v & 1)
+    s = s - v;
+  else
+    s = s * 2;
+  return s;
+}
+
+int main(int, char **)
+{
+  const int N = 64;
+  const int n = 5;
+  try {
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer, cl::Buffer, int>
+      (program, "phis");
+
+    std::vector<int> input(N);
+    for (int i = 0; i < N; i++)
+      input[i] = i * 5 + 1;
+
+    cl::Buffer in_buffer(input.begin(), input.end(), true);
+    cl::Buffer out_buffer(CL_MEM_WRITE_ONLY, N*sizeof(cl_int));
+    kernel(cl::EnqueueArgs(queue, cl::NDRange(N), cl::NDRange(8)),
+           in_buffer, out_buffer, n);
+
+    queue.finish();
+
+    cl_int *output = (cl_int*)queue.enqueueMapBuffer(
+      out_buffer, CL_TRUE, CL_MAP_READ, 0, N*sizeof(cl_int));
+    for (int i = 0; i < N; i++) {
+      int e = expected(input[i], i, n);
+      if (output[i] != e) {
+        std::cout << "FAIL: element " << i << " is " << output[i]
+                  << ", expected " << e << std::endl;
+        break;
+      }
+    }
+    queue.enqueueUnmapMemObject(out_buffer, output);
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,81 @@
+// All the work-items increment one local counter atomically. The plain
+// loads and stores the local atomics are lowered to must not be vectorized
+// across the work-items, or the increments of the other lanes are lost.
+// Run with POCL_WORK_GROUP_METHOD=loopvec and wfv.
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+#define WG_SIZE 64
+
+const char *SOURCE = R"CLC(
+__kernel void
+local_counter(__global int *__restrict__ tickets,
+              __global int *__restrict__ totals)
+{
+  __local int counter;
+  int lid = get_local_id(0);
+
+  if (lid == 0)
+    counter = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  tickets[get_global_id(0)] = atomic_inc(&counter);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (lid == 0)
+    totals[get_group_id(0)] = counter;
+}
+)CLC";
+
+int main(int, char **)
+{
+  try {
+    int NumGroups = 4;
+    int N = NumGroups * WG_SIZE;
+
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer, cl::Buffer>
+      (program, "local_counter");
+
+    cl::Buffer tickets(CL_MEM_WRITE_ONLY, N * sizeof(cl_int));
+    cl::Buffer totals(CL_MEM_WRITE_ONLY, NumGroups * sizeof(cl_int));
+    kernel(cl::EnqueueArgs(queue, cl::NDRange(N), cl::NDRange(WG_SIZE)),
+           tickets, totals);
+
+    std::vector<int> t(N), sums(NumGroups);
+    queue.enqueueReadBuffer(tickets, CL_TRUE, 0, N * sizeof(cl_int), &t[0]);
+    queue.enqueueReadBuffer(totals, CL_TRUE, 0, NumGroups * sizeof(cl_int),
+                            &sums[0]);
+
+    for (int g = 0; g < NumGroups; ++g) {
+      if (sums[g] != WG_SIZE)
+        std::cout << "FAIL: group " << g << " counted " << sums[g]
+                  << " increments, should be " << WG_SIZE << std::endl;
+      // Each work-item must have got a different old value.
+      std::vector<bool> seen(WG_SIZE, false);
+      for (int i = 0; i < WG_SIZE; ++i) {
+        int ticket = t[g * WG_SIZE + i];
+        if (ticket < 0 || ticket >= WG_SIZE || seen[ticket]) {
+          std::cout << "FAIL: group " << g << " work-item " << i
+                    << " got the old value " << ticket << std::endl;
+          break;
+        }
+        seen[ticket] = true;
+      }
+    }
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
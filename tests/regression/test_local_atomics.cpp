@@ -0,0 +1,102 @@
+// Local memory atomics are converted to plain loads and stores for the
+// devices that execute a work-group in one thread. Check the results of
+// the different atomic operations on local memory stay correct.
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+
+using namespace std;
+
+#define WG_SIZE 64
+#define NUM_BINS 8
+
+const char *SOURCE = R"CLC(
+#define NUM_BINS 8
+
+__kernel void
+local_atomics(__global int *__restrict__ out)
+{
+  __local int bins[NUM_BINS];
+  __local int max_id, swaps, xchg;
+  int lid = get_local_id(0);
+
+  if (lid == 0) {
+    for (int i = 0; i < NUM_BINS; ++i)
+      bins[i] = 0;
+    max_id = 0;
+    swaps = 0;
+    xchg = -1;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  atomic_inc(&bins[lid % NUM_BINS]);
+  atomic_add(&bins[0], 2);
+  atomic_sub(&bins[1], 1);
+  atomic_max(&max_id, lid);
+  /* only the first work-item to get here succeeds */
+  if (atomic_cmpxchg(&swaps, 0, lid + 1) == 0)
+    atomic_or(&swaps, 0x1000);
+  atomic_xchg(&xchg, lid);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (lid == 0) {
+    for (int i = 0; i < NUM_BINS; ++i)
+      out[get_group_id(0) * (NUM_BINS + 3) + i] = bins[i];
+    out[get_group_id(0) * (NUM_BINS + 3) + NUM_BINS] = max_id;
+    out[get_group_id(0) * (NUM_BINS + 3) + NUM_BINS + 1] = swaps & 0x1000;
+    out[get_group_id(0) * (NUM_BINS + 3) + NUM_BINS + 2] = xchg;
+  }
+}
+)CLC";
+
+int main(int, char **)
+{
+  try {
+    int NumGroups = 4;
+    int N = NumGroups * (NUM_BINS + 3);
+
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer>
+      (program, "local_atomics");
+
+    cl::Buffer buffer(CL_MEM_WRITE_ONLY, N*sizeof(cl_int));
+    kernel(cl::EnqueueArgs(queue, cl::NDRange(NumGroups * WG_SIZE),
+                           cl::NDRange(WG_SIZE)), buffer);
+
+    queue.finish();
+
+    cl_int *output = (cl_int*)queue.enqueueMapBuffer(
+      buffer, CL_TRUE, CL_MAP_READ, 0, N*sizeof(int));
+    for (int g = 0; g < NumGroups; g++) {
+      cl_int *res = output + g * (NUM_BINS + 3);
+      for (int i = 0; i < NUM_BINS; i++) {
+        int expected = WG_SIZE / NUM_BINS;
+        if (i == 0)
+          expected += 2 * WG_SIZE;
+        if (i == 1)
+          expected -= WG_SIZE;
+        if (res[i] != expected)
+          std::cout << "FAIL: bin " << i << " is " << res[i]
+                    << " should be " << expected << std::endl;
+      }
+      if (res[NUM_BINS] != WG_SIZE - 1)
+        std::cout << "FAIL: atomic_max gave " << res[NUM_BINS] << std::endl;
+      if (res[NUM_BINS + 1] != 0x1000)
+        std::cout << "FAIL: atomic_cmpxchg did not succeed once" << std::endl;
+      if (res[NUM_BINS + 2] < 0 || res[NUM_BINS + 2] >= WG_SIZE)
+        std::cout << "FAIL: atomic_xchg gave " << res[NUM_BINS + 2]
+                  << std::endl;
+    }
+    queue.enqueueUnmapMemObject(buffer, output);
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
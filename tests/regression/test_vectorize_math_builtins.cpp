@@ -0,0 +1,64 @@
+// The work-item loops calling math builtins should be vectorized by calling
+// the vector variants of the builtins in the kernel library. Run with
+// POCL_VECTORIZER_REMARKS=1, the test checks the remark about the call to
+// the vector variant of sin() or exp().
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+#include <cmath>
+
+using namespace std;
+
+#define WG_SIZE 64
+
+const char *SOURCE = R"CLC(
+__kernel void __attribute__ ((reqd_work_group_size(64, 1, 1)))
+math_builtins(__global const float *__restrict__ in,
+              __global float *__restrict__ out)
+{
+  size_t gid = get_global_id(0);
+  out[gid] = sin(in[gid]) + exp(in[gid]);
+}
+)CLC";
+
+int main(int, char **)
+{
+  try {
+    int N = 4 * WG_SIZE;
+
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer, cl::Buffer>
+      (program, "math_builtins");
+
+    std::vector<float> input(N);
+    for (int i = 0; i < N; i++)
+      input[i] = (float)i / N;
+
+    cl::Buffer in_buffer(input.begin(), input.end(), true);
+    cl::Buffer out_buffer(CL_MEM_WRITE_ONLY, N*sizeof(cl_float));
+    kernel(cl::EnqueueArgs(queue, cl::NDRange(N), cl::NDRange(WG_SIZE)),
+           in_buffer, out_buffer);
+
+    queue.finish();
+
+    cl_float *output = (cl_float*)queue.enqueueMapBuffer(
+      out_buffer, CL_TRUE, CL_MAP_READ, 0, N*sizeof(cl_float));
+    for (int i = 0; i < N; i++) {
+      float expected = std::sin(input[i]) + std::exp(input[i]);
+      if (std::fabs(output[i] - expected) > 1e-5f * std::fabs(expected) + 1e-6f)
+        std::cout << "FAIL: " << output[i] << " should be " << expected
+                  << std::endl;
+    }
+    queue.enqueueUnmapMemObject(out_buffer, output);
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
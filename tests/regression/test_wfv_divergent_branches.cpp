@@ -0,0 +1,85 @@
+// Divergent branches in regions vectorized by the 'wfv' work-group method,
+// with local sizes that are not a multiple of the vector width. Run with
+// POCL_WORK_GROUP_METHOD=wfv.
+
+#define CL_HPP_ENABLE_EXCEPTIONS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_CL_1_2_DEFAULT_BUILD
+#include <CL/cl2.hpp>
+#include <iostream>
+
+using namespace std;
+
+const char *SOURCE = R"CLC(
+__kernel void divergent(__global const int *in, __global int *out)
+{
+  int gid = (int)get_global_id(0);
+  int lid = (int)get_local_id(0);
+  int v = in[gid];
+  if (lid % 3 == 0)
+    v = v * 2;
+  else if (v & 1)
+    v = v + lid;
+  else
+    v = -v;
+  for (int i = 0; i < 4; ++i)
+    v += i;
+  out[gid] = v;
+}
+)CLC";
+
+static int expected(int in, int lid)
+{
+  int v = in;
+  if (lid % 3 == 0)
+    v = v * 2;
+  else if (v & 1)
+    v = v + lid;
+  else
+    v = -v;
+  return v + 6;
+}
+
+int main(int, char **)
+{
+  int local_sizes[] = { 6, 7, 12 };
+  try {
+    cl::CommandQueue queue((cl_command_queue_properties)0);
+    cl::Program program(SOURCE, true);
+
+    auto kernel = cl::KernelFunctor<cl::Buffer, cl::Buffer>
+      (program, "divergent");
+
+    for (int local_size : local_sizes) {
+      int N = 16 * local_size;
+      std::vector<int> input(N);
+      for (int i = 0; i < N; i++)
+        input[i] = i * 7 + 3;
+
+      cl::Buffer in_buffer(input.begin(), input.end(), true);
+      cl::Buffer out_buffer(CL_MEM_WRITE_ONLY, N*sizeof(cl_int));
+      kernel(cl::EnqueueArgs(queue, cl::NDRange(N), cl::NDRange(local_size)),
+             in_buffer, out_buffer);
+
+      queue.finish();
+
+      cl_int *output = (cl_int*)queue.enqueueMapBuffer(
+        out_buffer, CL_TRUE, CL_MAP_READ, 0, N*sizeof(cl_int));
+      for (int i = 0; i < N; i++) {
+        int e = expected(input[i], i % local_size);
+        if (output[i] != e) {
+          std::cout << "FAIL: local size " << local_size << " element "
+                    << i << " is " << output[i] << ", expected " << e
+                    << std::endl;
+          break;
+        }
+      }
+      queue.enqueueUnmapMemObject(out_buffer, output);
+    }
+  }
+  catch (cl::Error& err) {
+    std::cout << "FAIL with OpenCL error = " << err.err() << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* Tests async_work_group_copy and async_work_group_strided_copy from a
+   restrict global source into local tiles that are then only read. Run
+   with and without POCL_ASYNC_COPY_PREFETCH, which replaces such copies
+   with prefetches of the source.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define GLOBAL_SIZE 256
+#define LOCAL_SIZE 16
+
+static const char *kernel_source =
+"#define LS 16\n"
+"kernel void tiles (global const int *restrict src, global int *out) {\n"
+"  local int tile[LS];\n"
+"  local int strided[LS];\n"
+"  size_t lid = get_local_id (0);\n"
+"  size_t base = get_group_id (0) * LS;\n"
+"  event_t events[2];\n"
+"  events[0] = async_work_group_copy (tile, src + base, LS, 0);\n"
+"  events[1] = async_work_group_strided_copy (strided, src + 2 * base,\n"
+"                                             LS, 2, 0);\n"
+"  wait_group_events (2, events);\n"
+"  out[base + lid] = tile[lid] + 3 * tile[(lid + 1) % LS]\n"
+"                    + 5 * strided[LS - 1 - lid];\n"
+"}\n";
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem src_buf, out_buf;
+  cl_int src[2 * GLOBAL_SIZE];
+  cl_int out[GLOBAL_SIZE];
+  size_t global_size = GLOBAL_SIZE, local_size = LOCAL_SIZE;
+  int i;
+
+  for (i = 0; i < 2 * GLOBAL_SIZE; ++i)
+    src[i] = i * 7 - 100;
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "tiles", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+
+  src_buf = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                            sizeof (src), src, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  out_buf = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (out), NULL,
+                            &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &src_buf));
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &out_buf));
+  CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                          &global_size, &local_size, 0, NULL,
+                                          NULL));
+  CHECK_CL_ERROR (clEnqueueReadBuffer (queue, out_buf, CL_TRUE, 0,
+                                       sizeof (out), out, 0, NULL, NULL));
+
+  for (i = 0; i < GLOBAL_SIZE; ++i)
+    {
+      int base = i - i % LOCAL_SIZE;
+      int lid = i % LOCAL_SIZE;
+      int expected = src[base + lid] + 3 * src[base + (lid + 1) % LOCAL_SIZE]
+                     + 5 * src[2 * base + 2 * (LOCAL_SIZE - 1 - lid)];
+      if (out[i] != expected)
+        {
+          printf ("FAIL: element %d is %d, expected %d\n", i, out[i],
+                  expected);
+          return EXIT_FAILURE;
+        }
+    }
+
+  CHECK_CL_ERROR (clReleaseMemObject (src_buf));
+  CHECK_CL_ERROR (clReleaseMemObject (out_buf));
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/* Tests the allocation, freeing and coalescing of the chunks of the custom
+   buffer allocator (bufalloc).
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bufalloc.h"
+
+#define REGION_START 0x10000
+#define REGION_SIZE 4096
+
+#define CHECK(cond)                                                     \
+  do                                                                    \
+    {                                                                   \
+      if (!(cond))                                                      \
+        {                                                               \
+          printf ("FAIL: %s:%d: %s\n", __FILE__, __LINE__, #cond);      \
+          return 1;                                                     \
+        }                                                               \
+    }                                                                   \
+  while (0)
+
+/* Fills a 4 KiB region with three 1088 byte buffers and one of 832 bytes
+   (the chunks are 64 byte aligned), frees and reallocates them. */
+static int
+test_strategy (enum allocation_strategy strategy)
+{
+  memory_region_t *region = calloc (1, sizeof (memory_region_t));
+  chunk_info_t *a, *b, *c, *d, *e;
+  struct mem_region_stats stats;
+
+  CHECK (region != NULL);
+  init_mem_region (region, REGION_START, REGION_SIZE);
+  region->strategy = strategy;
+
+  a = alloc_buffer_from_region (region, 1088);
+  b = alloc_buffer_from_region (region, 1088);
+  c = alloc_buffer_from_region (region, 1088);
+  d = alloc_buffer_from_region (region, 832);
+  CHECK (a != NULL && b != NULL && c != NULL && d != NULL);
+  CHECK (a->start_address == REGION_START);
+  CHECK (b->start_address == a->start_address + 1088);
+  CHECK (c->start_address == b->start_address + 1088);
+  CHECK (d->start_address == c->start_address + 1088);
+  CHECK (alloc_buffer_from_region (region, 64) == NULL);
+
+  /* A freed chunk of exactly the requested size is reused. */
+  free_chunk (b);
+  e = alloc_buffer_from_region (region, 1088);
+  CHECK (e != NULL);
+  CHECK (e->start_address == a->start_address + 1088);
+  b = e;
+
+  /* A smaller request splits the freed chunk. */
+  free_chunk (b);
+  e = alloc_buffer_from_region (region, 100);
+  CHECK (e != NULL);
+  CHECK (e->start_address == a->start_address + 1088);
+  CHECK (e->size == 128);
+  free_chunk (e);
+
+  /* Freeing the neighbours coalesces them to a single chunk. */
+  free_chunk (a);
+  free_chunk (c);
+  get_mem_region_stats (region, &stats);
+  CHECK (stats.free_chunks == 1);
+  CHECK (stats.allocated_chunks == 1);
+  e = alloc_buffer_from_region (region, 3 * 1088);
+  CHECK (e != NULL);
+  CHECK (e->start_address == REGION_START);
+  CHECK (alloc_buffer_from_region (region, 64) == NULL);
+
+  /* With everything freed, the whole region is available again. */
+  free_chunk (e);
+  free_chunk (d);
+  get_mem_region_stats (region, &stats);
+  CHECK (stats.allocated_chunks == 0);
+  CHECK (stats.allocated_bytes == 0);
+  CHECK (stats.free_bytes == REGION_SIZE);
+  e = alloc_buffer_from_region (region, REGION_SIZE);
+  CHECK (e != NULL);
+  CHECK (e->start_address == REGION_START);
+  free_chunk (e);
+
+  uninit_mem_region (region);
+  free (region);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  if (test_strategy (BALLOCS_WASTEFUL) || test_strategy (BALLOCS_TIGHT))
+    return EXIT_FAILURE;
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
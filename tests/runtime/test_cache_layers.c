@@ -0,0 +1,252 @@
+/* Tests the read-only kernel cache layers (POCL_CACHE_LAYERS): a child
+   process fills a cache directory, which is then used as a read-only layer
+   below an empty writable cache. The binaries of the layer are copied up to
+   the writable cache, and a launch with a local size the layer has no
+   binary for uses the dynamic local size binary of the layer.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define GLOBAL_SIZE 64
+/* The local size the layer has a binary for. */
+#define LAYER_LOCAL_SIZE 4
+/* The local size only the dynamic local size binary of the layer covers. */
+#define OTHER_LOCAL_SIZE 8
+
+static const char *kernel_source =
+"kernel void scale (global int *out, int factor) {\n"
+"  out[get_global_id (0)] = factor * (int)get_global_id (0);\n"
+"}\n";
+
+/* Returns 1 if a program of the cache directory CACHE_DIR has a binary of
+   the "scale" kernel for the local size directory LOCAL. The program
+   directories are two levels deep, "<2 hash chars>/<rest of the hash>". */
+static int
+has_binary (const char *cache_dir, const char *local)
+{
+  char path[4096];
+  DIR *top, *sub;
+  struct dirent *first, *rest;
+  int found = 0;
+
+  top = opendir (cache_dir);
+  if (top == NULL)
+    return 0;
+  while (!found && (first = readdir (top)))
+    {
+      if (first->d_name[0] == '.')
+        continue;
+      snprintf (path, sizeof (path), "%s/%s", cache_dir, first->d_name);
+      sub = opendir (path);
+      if (sub == NULL)
+        continue;
+      while (!found && (rest = readdir (sub)))
+        {
+          if (rest->d_name[0] == '.')
+            continue;
+          snprintf (path, sizeof (path), "%s/%s/%s/scale/%s/scale.so",
+                    cache_dir, first->d_name, rest->d_name, local);
+          found = access (path, F_OK) == 0;
+        }
+      closedir (sub);
+    }
+  closedir (top);
+  return found;
+}
+
+/* Removes the directory tree PATH. */
+static void
+remove_tree (const char *path)
+{
+  char subpath[4096];
+  struct dirent *entry;
+  struct stat st;
+  DIR *d = opendir (path);
+
+  if (d != NULL)
+    {
+      while ((entry = readdir (d)))
+        {
+          if (strcmp (entry->d_name, ".") == 0
+              || strcmp (entry->d_name, "..") == 0)
+            continue;
+          snprintf (subpath, sizeof (subpath), "%s/%s", path, entry->d_name);
+          if (lstat (subpath, &st) == 0 && S_ISDIR (st.st_mode))
+            remove_tree (subpath);
+          else
+            unlink (subpath);
+        }
+      closedir (d);
+    }
+  rmdir (path);
+}
+
+/* Builds the program, and launches the kernel with the local size
+   LOCAL_SIZE and checks the results. With DYNAMIC, also builds the dynamic
+   local size binaries. */
+static int
+run_scale (size_t local_size, int dynamic)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buffer;
+  cl_int host_buf[GLOBAL_SIZE];
+  cl_int factor = 3;
+  size_t global_size = GLOBAL_SIZE;
+  size_t binary_size;
+  int i;
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+  /* Querying the binaries builds the dynamic local size binaries. */
+  if (dynamic)
+    CHECK_CL_ERROR (clGetProgramInfo (program, CL_PROGRAM_BINARY_SIZES,
+                                      sizeof (binary_size), &binary_size,
+                                      NULL));
+  kernel = clCreateKernel (program, "scale", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+  buffer = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (host_buf),
+                           NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &buffer));
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_int), &factor));
+  CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                          &global_size, &local_size, 0,
+                                          NULL, NULL));
+  CHECK_CL_ERROR (clEnqueueReadBuffer (queue, buffer, CL_TRUE, 0,
+                                       sizeof (host_buf), host_buf, 0,
+                                       NULL, NULL));
+  for (i = 0; i < GLOBAL_SIZE; ++i)
+    if (host_buf[i] != factor * i)
+      {
+        printf ("FAIL: local size %d, element %d is %d, expected %d\n",
+                (int)local_size, i, host_buf[i], factor * i);
+        return EXIT_FAILURE;
+      }
+
+  CHECK_CL_ERROR (clReleaseMemObject (buffer));
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+  return EXIT_SUCCESS;
+}
+
+/* Checks the layer and writable cache directories after the runs. */
+static int
+check_caches (const char *layer_dir, const char *top_dir)
+{
+  char local[64], other_local[64];
+
+  snprintf (local, sizeof (local), "%d-1-1", LAYER_LOCAL_SIZE);
+  snprintf (other_local, sizeof (other_local), "%d-1-1", OTHER_LOCAL_SIZE);
+
+  if (!has_binary (layer_dir, local) || !has_binary (layer_dir, "0-0-0"))
+    {
+      printf ("FAIL: the layer was not filled\n");
+      return EXIT_FAILURE;
+    }
+  if (has_binary (layer_dir, other_local))
+    {
+      printf ("FAIL: the read-only layer was written to\n");
+      return EXIT_FAILURE;
+    }
+  if (!has_binary (top_dir, local))
+    {
+      printf ("FAIL: the binary for the local size %s was not copied up\n",
+              local);
+      return EXIT_FAILURE;
+    }
+  if (!has_binary (top_dir, "0-0-0") || has_binary (top_dir, other_local))
+    {
+      printf ("FAIL: the local size %s did not use the dynamic local size "
+              "binary of the layer\n", other_local);
+      return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+  char layer_dir[] = "/tmp/pocl_cache_layer_XXXXXX";
+  char top_dir[] = "/tmp/pocl_cache_top_XXXXXX";
+  int status;
+  pid_t pid;
+
+  TEST_ASSERT (mkdtemp (layer_dir) != NULL);
+  TEST_ASSERT (mkdtemp (top_dir) != NULL);
+  setenv ("POCL_KERNEL_CACHE", "1", 1);
+
+  /* pocl reads the cache directories once per process: fill the layer in a
+     child process. */
+  pid = fork ();
+  TEST_ASSERT (pid >= 0);
+  if (pid == 0)
+    {
+      setenv ("POCL_CACHE_DIR", layer_dir, 1);
+      exit (run_scale (LAYER_LOCAL_SIZE, 1));
+    }
+  TEST_ASSERT (waitpid (pid, &status, 0) == pid);
+  if (!WIFEXITED (status) || WEXITSTATUS (status) != EXIT_SUCCESS)
+    {
+      printf ("FAIL: filling the cache layer failed\n");
+      remove_tree (layer_dir);
+      remove_tree (top_dir);
+      return EXIT_FAILURE;
+    }
+
+  setenv ("POCL_CACHE_DIR", top_dir, 1);
+  setenv ("POCL_CACHE_LAYERS", layer_dir, 1);
+  if (run_scale (LAYER_LOCAL_SIZE, 0) != EXIT_SUCCESS
+      || run_scale (OTHER_LOCAL_SIZE, 0) != EXIT_SUCCESS
+      || check_caches (layer_dir, top_dir) != EXIT_SUCCESS)
+    {
+      remove_tree (layer_dir);
+      remove_tree (top_dir);
+      return EXIT_FAILURE;
+    }
+
+  remove_tree (layer_dir);
+  remove_tree (top_dir);
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
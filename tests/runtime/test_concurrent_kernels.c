@@ -0,0 +1,124 @@
+/* Tests that kernels in flight on several command queues all complete
+   with correct results when they share the workers.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define NUM_QUEUES 2
+#define ROUNDS 50
+#define LOCAL_SIZE 4
+#define GLOBAL_SIZE 256
+
+static const char *kernel_source =
+"kernel void scale (global int *buf, int factor) {\n"
+"  size_t i = get_global_id (0);\n"
+"  buf[i] = (int)i * factor;\n"
+"}\n";
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queues[NUM_QUEUES];
+  cl_program program;
+  cl_kernel kernels[NUM_QUEUES];
+  cl_mem buffers[NUM_QUEUES];
+  cl_int host_buf[GLOBAL_SIZE];
+  size_t global_size = GLOBAL_SIZE, local_size = LOCAL_SIZE;
+  int q, round, i;
+
+  poclu_get_any_device (&context, &device, &queues[0]);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queues[0]);
+
+  for (q = 1; q < NUM_QUEUES; ++q)
+    {
+      queues[q] = clCreateCommandQueue (context, device, 0, &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateCommandQueue");
+    }
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+
+  for (q = 0; q < NUM_QUEUES; ++q)
+    {
+      kernels[q] = clCreateKernel (program, "scale", &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+      buffers[q] = clCreateBuffer (context, CL_MEM_READ_WRITE,
+                                   sizeof (host_buf), NULL, &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+      CHECK_CL_ERROR (clSetKernelArg (kernels[q], 0, sizeof (cl_mem),
+                                      &buffers[q]));
+    }
+
+  /* Many short NDRanges in flight on all queues at once, so that workers
+     leave a kernel between chunks while it still has work-groups left. */
+  for (round = 0; round < ROUNDS; ++round)
+    {
+      for (q = 0; q < NUM_QUEUES; ++q)
+        {
+          cl_int factor = round * NUM_QUEUES + q + 1;
+          CHECK_CL_ERROR (clSetKernelArg (kernels[q], 1, sizeof (cl_int),
+                                          &factor));
+          CHECK_CL_ERROR (clEnqueueNDRangeKernel (queues[q], kernels[q], 1,
+                                                  NULL, &global_size,
+                                                  &local_size, 0, NULL,
+                                                  NULL));
+          CHECK_CL_ERROR (clFlush (queues[q]));
+        }
+    }
+
+  for (q = 0; q < NUM_QUEUES; ++q)
+    {
+      cl_int factor = (ROUNDS - 1) * NUM_QUEUES + q + 1;
+      CHECK_CL_ERROR (clEnqueueReadBuffer (queues[q], buffers[q], CL_TRUE, 0,
+                                           sizeof (host_buf), host_buf, 0,
+                                           NULL, NULL));
+      for (i = 0; i < GLOBAL_SIZE; ++i)
+        if (host_buf[i] != i * factor)
+          {
+            printf ("FAIL: queue %d element %d is %d, expected %d\n", q, i,
+                    host_buf[i], i * factor);
+            return EXIT_FAILURE;
+          }
+    }
+
+  for (q = 0; q < NUM_QUEUES; ++q)
+    {
+      CHECK_CL_ERROR (clReleaseMemObject (buffers[q]));
+      CHECK_CL_ERROR (clReleaseKernel (kernels[q]));
+      CHECK_CL_ERROR (clReleaseCommandQueue (queues[q]));
+    }
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseContext (context));
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
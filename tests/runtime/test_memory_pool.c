@@ -0,0 +1,123 @@
+/* Tests the pool of the freed large buffers of the CPU devices: buffers of
+   slightly different sizes of the same size class are created, used and
+   released in a loop. The pool hits and evictions are checked from the
+   memory statistics printed with POCL_DEBUG=memory.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define ITERATIONS 8
+/* 768 kB, in the size class of 768 kB. With POCL_MEMORY_POOL_LIMIT=1 the
+   pool holds only one of the two buffers released in an iteration. */
+#define MAX_ELEMENTS (192 * 1024)
+/* Each iteration uses 4 kB less, which rounds up to the same class. */
+#define ELEMENTS_STEP 1024
+
+static const char *kernel_source =
+"kernel void add (global const int *in, global int *out, int n) {\n"
+"  out[get_global_id (0)] = in[get_global_id (0)] + n;\n"
+"}\n";
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem in, out;
+  cl_int *host_in, *host_out;
+  cl_int n;
+  size_t elements;
+  int i;
+
+  host_in = malloc (MAX_ELEMENTS * sizeof (cl_int));
+  host_out = malloc (MAX_ELEMENTS * sizeof (cl_int));
+  TEST_ASSERT (host_in != NULL && host_out != NULL);
+  for (i = 0; i < MAX_ELEMENTS; ++i)
+    host_in[i] = i;
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "add", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+
+  for (n = 0; n < ITERATIONS; ++n)
+    {
+      elements = MAX_ELEMENTS - n * ELEMENTS_STEP;
+      in = clCreateBuffer (context, CL_MEM_READ_ONLY,
+                           elements * sizeof (cl_int), NULL, &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+      out = clCreateBuffer (context, CL_MEM_WRITE_ONLY,
+                            elements * sizeof (cl_int), NULL, &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+
+      CHECK_CL_ERROR (clEnqueueWriteBuffer (queue, in, CL_FALSE, 0,
+                                            elements * sizeof (cl_int),
+                                            host_in, 0, NULL, NULL));
+      CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &in));
+      CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &out));
+      CHECK_CL_ERROR (clSetKernelArg (kernel, 2, sizeof (cl_int), &n));
+      CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                              &elements, NULL, 0, NULL,
+                                              NULL));
+      CHECK_CL_ERROR (clEnqueueReadBuffer (queue, out, CL_TRUE, 0,
+                                           elements * sizeof (cl_int),
+                                           host_out, 0, NULL, NULL));
+      CHECK_CL_ERROR (clFinish (queue));
+
+      /* A reused block must not leak the contents of the previous
+         iteration. */
+      for (i = 0; i < (int)elements; ++i)
+        if (host_out[i] != i + n)
+          {
+            printf ("FAIL: iteration %d, element %d is %d, expected %d\n",
+                    n, i, host_out[i], i + n);
+            return EXIT_FAILURE;
+          }
+
+      CHECK_CL_ERROR (clReleaseMemObject (in));
+      CHECK_CL_ERROR (clReleaseMemObject (out));
+    }
+
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  /* Prints the pool statistics with POCL_DEBUG=memory. */
+  CHECK_CL_ERROR (clReleaseContext (context));
+  free (host_in);
+  free (host_out);
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
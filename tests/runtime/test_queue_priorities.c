@@ -0,0 +1,188 @@
+/* Tests that a high priority kernel preempts a long low priority one
+   between work-group chunks, finishing first, and that the results of both
+   stay correct.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+#include "poclu.h"
+
+#define LOW_SIZE (64 * 1024)
+#define HIGH_SIZE 256
+#define LOCAL_SIZE 4
+#define ITERATIONS 1000
+
+static const char *kernel_source =
+"kernel void sum (global int *buf, int n) {\n"
+"  size_t i = get_global_id (0);\n"
+"  int s = 0;\n"
+"  for (int j = 0; j < n; ++j)\n"
+"    s += (int)i + j;\n"
+"  buf[i] = s;\n"
+"}\n";
+
+static int
+check (const char *name, cl_int *buf, int size, int n)
+{
+  int i;
+  for (i = 0; i < size; ++i)
+    {
+      int expected = i * n + n * (n - 1) / 2;
+      if (buf[i] != expected)
+        {
+          printf ("FAIL: %s element %d is %d, expected %d\n", name, i,
+                  buf[i], expected);
+          return 0;
+        }
+    }
+  return 1;
+}
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_platform_id platform;
+  cl_device_id device;
+  cl_context context;
+  cl_command_queue low_queue, high_queue;
+  cl_program program;
+  cl_kernel low_kernel, high_kernel;
+  cl_mem low_buf, high_buf;
+  static cl_int low_host[LOW_SIZE];
+  cl_int high_host[HIGH_SIZE];
+  size_t low_size = LOW_SIZE, high_size = HIGH_SIZE, local_size = LOCAL_SIZE;
+  cl_int iterations = ITERATIONS;
+  cl_event low_event, high_event;
+  cl_ulong low_end, high_end;
+  cl_queue_priority_khr priority;
+  cl_queue_properties low_props[] = { CL_QUEUE_PROPERTIES,
+                                      CL_QUEUE_PROFILING_ENABLE,
+                                      CL_QUEUE_PRIORITY_KHR,
+                                      CL_QUEUE_PRIORITY_LOW_KHR, 0 };
+  cl_queue_properties high_props[] = { CL_QUEUE_PROPERTIES,
+                                       CL_QUEUE_PROFILING_ENABLE,
+                                       CL_QUEUE_PRIORITY_KHR,
+                                       CL_QUEUE_PRIORITY_HIGH_KHR, 0 };
+
+  CHECK_CL_ERROR (clGetPlatformIDs (1, &platform, NULL));
+  CHECK_CL_ERROR (clGetDeviceIDs (platform, CL_DEVICE_TYPE_ALL, 1, &device,
+                                  NULL));
+  context = clCreateContext (NULL, 1, &device, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateContext");
+
+  low_queue = clCreateCommandQueueWithProperties (context, device, low_props,
+                                                  &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateCommandQueueWithProperties");
+  high_queue = clCreateCommandQueueWithProperties (context, device,
+                                                   high_props, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateCommandQueueWithProperties");
+
+  CHECK_CL_ERROR (clGetCommandQueueInfo (low_queue, CL_QUEUE_PRIORITY_KHR,
+                                         sizeof (priority), &priority,
+                                         NULL));
+  TEST_ASSERT (priority == CL_QUEUE_PRIORITY_LOW_KHR);
+  CHECK_CL_ERROR (clGetCommandQueueInfo (high_queue, CL_QUEUE_PRIORITY_KHR,
+                                         sizeof (priority), &priority,
+                                         NULL));
+  TEST_ASSERT (priority == CL_QUEUE_PRIORITY_HIGH_KHR);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+
+  low_kernel = clCreateKernel (program, "sum", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+  high_kernel = clCreateKernel (program, "sum", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+
+  low_buf = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (low_host),
+                            NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  high_buf = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (high_host),
+                             NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+
+  CHECK_CL_ERROR (clSetKernelArg (low_kernel, 0, sizeof (cl_mem), &low_buf));
+  CHECK_CL_ERROR (clSetKernelArg (low_kernel, 1, sizeof (cl_int),
+                                  &iterations));
+  CHECK_CL_ERROR (clSetKernelArg (high_kernel, 0, sizeof (cl_mem),
+                                  &high_buf));
+  CHECK_CL_ERROR (clSetKernelArg (high_kernel, 1, sizeof (cl_int),
+                                  &iterations));
+
+  /* Get the long kernel running first so that the high priority one
+     arrives while it still has work-groups left. */
+  CHECK_CL_ERROR (clEnqueueNDRangeKernel (low_queue, low_kernel, 1, NULL,
+                                          &low_size, &local_size, 0, NULL,
+                                          &low_event));
+  CHECK_CL_ERROR (clFlush (low_queue));
+  CHECK_CL_ERROR (clEnqueueNDRangeKernel (high_queue, high_kernel, 1, NULL,
+                                          &high_size, &local_size, 0, NULL,
+                                          &high_event));
+  CHECK_CL_ERROR (clFlush (high_queue));
+
+  CHECK_CL_ERROR (clEnqueueReadBuffer (high_queue, high_buf, CL_TRUE, 0,
+                                       sizeof (high_host), high_host, 0,
+                                       NULL, NULL));
+  CHECK_CL_ERROR (clEnqueueReadBuffer (low_queue, low_buf, CL_TRUE, 0,
+                                       sizeof (low_host), low_host, 0, NULL,
+                                       NULL));
+
+  if (!check ("high priority", high_host, HIGH_SIZE, ITERATIONS)
+      || !check ("low priority", low_host, LOW_SIZE, ITERATIONS))
+    return EXIT_FAILURE;
+
+  /* The high priority kernel must not wait for the end of the low
+     priority one. */
+  CHECK_CL_ERROR (clGetEventProfilingInfo (low_event,
+                                           CL_PROFILING_COMMAND_END,
+                                           sizeof (cl_ulong), &low_end,
+                                           NULL));
+  CHECK_CL_ERROR (clGetEventProfilingInfo (high_event,
+                                           CL_PROFILING_COMMAND_END,
+                                           sizeof (cl_ulong), &high_end,
+                                           NULL));
+  if (high_end >= low_end)
+    {
+      printf ("FAIL: the high priority kernel ended %llu ns after the low "
+              "priority one\n", (unsigned long long)(high_end - low_end));
+      return EXIT_FAILURE;
+    }
+
+  CHECK_CL_ERROR (clReleaseEvent (low_event));
+  CHECK_CL_ERROR (clReleaseEvent (high_event));
+
+  CHECK_CL_ERROR (clReleaseMemObject (low_buf));
+  CHECK_CL_ERROR (clReleaseMemObject (high_buf));
+  CHECK_CL_ERROR (clReleaseKernel (low_kernel));
+  CHECK_CL_ERROR (clReleaseKernel (high_kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (low_queue));
+  CHECK_CL_ERROR (clReleaseCommandQueue (high_queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/* Tests the launches of a kernel built with -pocl-specialize-args, and that
+   the number of specialized variants in the kernel cache stays within
+   POCL_SPECIALIZE_MAX_VARIANTS.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define GLOBAL_SIZE 16
+#define LOCAL_SIZE 4
+/* More distinct values than the variant cap the test is run with. */
+#define NUM_VALUES 6
+
+static const char *kernel_source =
+"kernel void repeat (global int *out, int n) {\n"
+"  int s = 0;\n"
+"  for (int i = 0; i < n; ++i)\n"
+"    s += i * (int)get_global_id (0);\n"
+"  out[get_global_id (0)] = s;\n"
+"}\n";
+
+/* Counts the entries starting with PREFIX in the directory PATH. */
+static unsigned
+count_entries (const char *path, const char *prefix)
+{
+  DIR *d = opendir (path);
+  struct dirent *entry;
+  unsigned count = 0;
+
+  if (d == NULL)
+    return 0;
+  while ((entry = readdir (d)))
+    if (strncmp (entry->d_name, prefix, strlen (prefix)) == 0)
+      ++count;
+  closedir (d);
+  return count;
+}
+
+/* Counts the specialized variants of the "repeat" kernel for the local
+   size in the programs of the cache directory CACHE_DIR. The program
+   directories are two levels deep, "<2 hash chars>/<rest of the hash>". */
+static unsigned
+count_variants (const char *cache_dir)
+{
+  char prefix[64];
+  char path[4096];
+  DIR *top, *sub;
+  struct dirent *first, *rest;
+  unsigned count = 0;
+
+  snprintf (prefix, sizeof (prefix), "%d-1-1-", LOCAL_SIZE);
+  top = opendir (cache_dir);
+  if (top == NULL)
+    return 0;
+  while ((first = readdir (top)))
+    {
+      if (first->d_name[0] == '.')
+        continue;
+      snprintf (path, sizeof (path), "%s/%s", cache_dir, first->d_name);
+      sub = opendir (path);
+      if (sub == NULL)
+        continue;
+      while ((rest = readdir (sub)))
+        {
+          if (rest->d_name[0] == '.')
+            continue;
+          snprintf (path, sizeof (path), "%s/%s/%s/repeat", cache_dir,
+                    first->d_name, rest->d_name);
+          count += count_entries (path, prefix);
+        }
+      closedir (sub);
+    }
+  closedir (top);
+  return count;
+}
+
+/* Removes the directory tree PATH. */
+static void
+remove_tree (const char *path)
+{
+  char subpath[4096];
+  struct dirent *entry;
+  struct stat st;
+  DIR *d = opendir (path);
+
+  if (d != NULL)
+    {
+      while ((entry = readdir (d)))
+        {
+          if (strcmp (entry->d_name, ".") == 0
+              || strcmp (entry->d_name, "..") == 0)
+            continue;
+          snprintf (subpath, sizeof (subpath), "%s/%s", path, entry->d_name);
+          if (lstat (subpath, &st) == 0 && S_ISDIR (st.st_mode))
+            remove_tree (subpath);
+          else
+            unlink (subpath);
+        }
+      closedir (d);
+    }
+  rmdir (path);
+}
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem buffer;
+  cl_int host_buf[GLOBAL_SIZE];
+  size_t global_size = GLOBAL_SIZE, local_size = LOCAL_SIZE;
+  char cache_dir[] = "/tmp/pocl_specialize_XXXXXX";
+  const char *max_variants_env = getenv ("POCL_SPECIALIZE_MAX_VARIANTS");
+  int max_variants = max_variants_env ? atoi (max_variants_env) : 8;
+  unsigned expected_variants, variants;
+  int n, i;
+
+  if (max_variants < 0)
+    max_variants = 0;
+  expected_variants = max_variants < NUM_VALUES ? max_variants : NUM_VALUES;
+
+  /* A fresh cache, so that only the variants of this run are counted. */
+  TEST_ASSERT (mkdtemp (cache_dir) != NULL);
+  setenv ("POCL_CACHE_DIR", cache_dir, 1);
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device,
+                                  "-pocl-specialize-args=n", NULL, NULL));
+  kernel = clCreateKernel (program, "repeat", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+  buffer = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (host_buf),
+                           NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &buffer));
+
+  /* Each value twice: the second launch of a value must find its variant,
+     or the generic function once the cap is reached. */
+  for (n = 1; n <= 2 * NUM_VALUES; ++n)
+    {
+      cl_int value = (n - 1) % NUM_VALUES + 1;
+      CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_int), &value));
+      CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                              &global_size, &local_size, 0,
+                                              NULL, NULL));
+      CHECK_CL_ERROR (clEnqueueReadBuffer (queue, buffer, CL_TRUE, 0,
+                                           sizeof (host_buf), host_buf, 0,
+                                           NULL, NULL));
+      for (i = 0; i < GLOBAL_SIZE; ++i)
+        if (host_buf[i] != i * value * (value - 1) / 2)
+          {
+            printf ("FAIL: n = %d, element %d is %d, expected %d\n", value,
+                    i, host_buf[i], i * value * (value - 1) / 2);
+            return EXIT_FAILURE;
+          }
+    }
+
+  variants = count_variants (cache_dir);
+  if (variants != expected_variants)
+    {
+      printf ("FAIL: %u specialized variants in the cache, expected %u\n",
+              variants, expected_variants);
+      remove_tree (cache_dir);
+      return EXIT_FAILURE;
+    }
+
+  CHECK_CL_ERROR (clReleaseMemObject (buffer));
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+
+  remove_tree (cache_dir);
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
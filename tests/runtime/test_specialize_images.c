@@ -0,0 +1,156 @@
+/* Tests a kernel launched with images of two formats and two samplers
+   with POCL_SPECIALIZE_IMAGES, so that each combination gets its own
+   specialized variant. A variant reused for the wrong format or sampler
+   gives wrong pixels.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define WIDTH 8
+/* One pixel out of the image on each side. */
+#define NUM_READS (WIDTH + 2)
+
+static const char *kernel_source =
+"kernel void read_row (read_only image2d_t img, sampler_t smp,\n"
+"                      global float4 *out) {\n"
+"  int x = (int)get_global_id (0);\n"
+"  out[x] = read_imagef (img, smp, (int2)(x - 1, 0));\n"
+"}\n";
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem images[2], out_buf;
+  cl_sampler samplers[2];
+  cl_image_format formats[2] = { { CL_RGBA, CL_UNORM_INT8 },
+                                 { CL_RGBA, CL_FLOAT } };
+  cl_addressing_mode modes[2] = { CL_ADDRESS_CLAMP_TO_EDGE,
+                                  CL_ADDRESS_CLAMP };
+  cl_image_desc desc = { CL_MEM_OBJECT_IMAGE2D, WIDTH, 1 };
+  cl_uchar pixels_unorm[WIDTH * 4];
+  cl_float pixels_float[WIDTH * 4];
+  void *pixels[2] = { pixels_unorm, pixels_float };
+  cl_float out[NUM_READS * 4];
+  cl_float texels[WIDTH * 4];
+  size_t global_size = NUM_READS;
+  int i, f, s, round, c;
+
+  for (i = 0; i < WIDTH * 4; ++i)
+    {
+      pixels_unorm[i] = (cl_uchar)(i * 8 + 3);
+      /* Values a UNORM_INT8 image cannot hold. */
+      pixels_float[i] = (cl_float)i * 1.5f - 4.0f;
+    }
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "read_row", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+
+  for (f = 0; f < 2; ++f)
+    {
+      images[f] = clCreateImage (context,
+                                 CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                 &formats[f], &desc, pixels[f], &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateImage");
+    }
+  for (s = 0; s < 2; ++s)
+    {
+      samplers[s] = clCreateSampler (context, CL_FALSE, modes[s],
+                                     CL_FILTER_NEAREST, &err);
+      CHECK_OPENCL_ERROR_IN ("clCreateSampler");
+    }
+  out_buf = clCreateBuffer (context, CL_MEM_WRITE_ONLY, sizeof (out), NULL,
+                            &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 2, sizeof (cl_mem), &out_buf));
+
+  /* Every combination twice, the second round finding the variants of the
+     first one. */
+  for (round = 0; round < 2; ++round)
+    for (f = 0; f < 2; ++f)
+      for (s = 0; s < 2; ++s)
+        {
+          CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem),
+                                          &images[f]));
+          CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_sampler),
+                                          &samplers[s]));
+          CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                                  &global_size, NULL, 0,
+                                                  NULL, NULL));
+          CHECK_CL_ERROR (clEnqueueReadBuffer (queue, out_buf, CL_TRUE, 0,
+                                               sizeof (out), out, 0, NULL,
+                                               NULL));
+
+          for (i = 0; i < WIDTH * 4; ++i)
+            texels[i] = f == 0 ? pixels_unorm[i] / 255.0f : pixels_float[i];
+          for (i = 0; i < NUM_READS; ++i)
+            for (c = 0; c < 4; ++c)
+              {
+                int x = i - 1;
+                float expected, diff;
+                if (x >= 0 && x < WIDTH)
+                  expected = texels[x * 4 + c];
+                else if (modes[s] == CL_ADDRESS_CLAMP)
+                  /* The border color of CL_RGBA is (0, 0, 0, 0). */
+                  expected = 0.0f;
+                else
+                  expected = texels[(x < 0 ? 0 : WIDTH - 1) * 4 + c];
+                diff = out[i * 4 + c] - expected;
+                if (diff > 1e-5f || diff < -1e-5f)
+                  {
+                    printf ("FAIL: format %d, sampler %d: pixel %d channel "
+                            "%d is %f, expected %f\n", f, s, x, c,
+                            out[i * 4 + c], expected);
+                    return EXIT_FAILURE;
+                  }
+              }
+        }
+
+  for (f = 0; f < 2; ++f)
+    CHECK_CL_ERROR (clReleaseMemObject (images[f]));
+  for (s = 0; s < 2; ++s)
+    CHECK_CL_ERROR (clReleaseSampler (samplers[s]));
+  CHECK_CL_ERROR (clReleaseMemObject (out_buf));
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
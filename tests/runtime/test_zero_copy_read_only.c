@@ -0,0 +1,149 @@
+/* Tests the read-only buffers created from the host memory without a copy
+   (POCL_ZERO_COPY_READ_ONLY): kernels read the host array, and the commands
+   writing to the buffer fail.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "poclu.h"
+
+#define N 256
+
+static const char *kernel_source =
+"kernel void twice (global const int *in, global int *out) {\n"
+"  out[get_global_id (0)] = 2 * in[get_global_id (0)];\n"
+"}\n";
+
+int main (int argc, char **argv)
+{
+  cl_int err;
+  cl_context context;
+  cl_device_id device;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem in, out, other;
+  cl_uint align_bits;
+  cl_int *host_in, *mapped;
+  cl_int host_out[N];
+  cl_int pattern = 7;
+  size_t global_size = N;
+  int i;
+
+  poclu_get_any_device (&context, &device, &queue);
+  TEST_ASSERT (context);
+  TEST_ASSERT (device);
+  TEST_ASSERT (queue);
+
+  /* The host array can be used in place only if it is aligned as the
+     device requires. */
+  CHECK_CL_ERROR (clGetDeviceInfo (device, CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+                                   sizeof (align_bits), &align_bits, NULL));
+  TEST_ASSERT (posix_memalign ((void **)&host_in, align_bits / 8,
+                               N * sizeof (cl_int)) == 0);
+  for (i = 0; i < N; ++i)
+    host_in[i] = i * 3 + 1;
+
+  in = clCreateBuffer (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                       N * sizeof (cl_int), host_in, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  out = clCreateBuffer (context, CL_MEM_WRITE_ONLY, N * sizeof (cl_int),
+                        NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+  other = clCreateBuffer (context, CL_MEM_READ_WRITE, N * sizeof (cl_int),
+                          NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateBuffer");
+
+  program = clCreateProgramWithSource (context, 1, &kernel_source, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateProgramWithSource");
+  CHECK_CL_ERROR (clBuildProgram (program, 1, &device, NULL, NULL, NULL));
+  kernel = clCreateKernel (program, "twice", &err);
+  CHECK_OPENCL_ERROR_IN ("clCreateKernel");
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &in));
+  CHECK_CL_ERROR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &out));
+  CHECK_CL_ERROR (clEnqueueNDRangeKernel (queue, kernel, 1, NULL,
+                                          &global_size, NULL, 0, NULL, NULL));
+  CHECK_CL_ERROR (clEnqueueReadBuffer (queue, out, CL_TRUE, 0,
+                                       sizeof (host_out), host_out, 0,
+                                       NULL, NULL));
+  for (i = 0; i < N; ++i)
+    if (host_out[i] != 2 * (i * 3 + 1))
+      {
+        printf ("FAIL: element %d is %d, expected %d\n", i, host_out[i],
+                2 * (i * 3 + 1));
+        return EXIT_FAILURE;
+      }
+
+  /* Mapping for reading still works, and gives the host array itself. */
+  mapped = clEnqueueMapBuffer (queue, in, CL_TRUE, CL_MAP_READ, 0,
+                               N * sizeof (cl_int), 0, NULL, NULL, &err);
+  CHECK_OPENCL_ERROR_IN ("clEnqueueMapBuffer");
+  if (mapped != host_in)
+    {
+      printf ("FAIL: the buffer is not in the host array\n");
+      return EXIT_FAILURE;
+    }
+  CHECK_CL_ERROR (clEnqueueUnmapMemObject (queue, in, mapped, 0, NULL, NULL));
+
+  /* The commands writing to the buffer are rejected. */
+  err = clEnqueueWriteBuffer (queue, in, CL_TRUE, 0, sizeof (host_out),
+                              host_out, 0, NULL, NULL);
+  TEST_ASSERT (err == CL_INVALID_OPERATION);
+  err = clEnqueueFillBuffer (queue, in, &pattern, sizeof (pattern), 0,
+                             N * sizeof (cl_int), 0, NULL, NULL);
+  TEST_ASSERT (err == CL_INVALID_OPERATION);
+  err = clEnqueueCopyBuffer (queue, other, in, 0, 0, N * sizeof (cl_int), 0,
+                             NULL, NULL);
+  TEST_ASSERT (err == CL_INVALID_OPERATION);
+  mapped = clEnqueueMapBuffer (queue, in, CL_TRUE, CL_MAP_WRITE, 0,
+                               N * sizeof (cl_int), 0, NULL, NULL, &err);
+  TEST_ASSERT (err == CL_INVALID_OPERATION);
+  TEST_ASSERT (mapped == NULL);
+
+  /* Copying from the buffer is allowed. */
+  CHECK_CL_ERROR (clEnqueueCopyBuffer (queue, in, other, 0, 0,
+                                       N * sizeof (cl_int), 0, NULL, NULL));
+  CHECK_CL_ERROR (clEnqueueReadBuffer (queue, other, CL_TRUE, 0,
+                                       sizeof (host_out), host_out, 0,
+                                       NULL, NULL));
+  for (i = 0; i < N; ++i)
+    if (host_out[i] != i * 3 + 1)
+      {
+        printf ("FAIL: copied element %d is %d, expected %d\n", i,
+                host_out[i], i * 3 + 1);
+        return EXIT_FAILURE;
+      }
+
+  CHECK_CL_ERROR (clReleaseKernel (kernel));
+  CHECK_CL_ERROR (clReleaseProgram (program));
+  CHECK_CL_ERROR (clReleaseMemObject (other));
+  CHECK_CL_ERROR (clReleaseMemObject (out));
+  CHECK_CL_ERROR (clReleaseMemObject (in));
+  CHECK_CL_ERROR (clReleaseCommandQueue (queue));
+  CHECK_CL_ERROR (clReleaseContext (context));
+  free (host_in);
+
+  printf ("OK\n");
+  return EXIT_SUCCESS;
+}
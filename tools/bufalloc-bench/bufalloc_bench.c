@@ -0,0 +1,130 @@
+/* bufalloc_bench - A stress benchmark of the bufalloc buffer allocator.
+
+   Copyright (c) 2017 pocl developers
+
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+   THE SOFTWARE.
+*/
+
+/* Keeps a number of buffers of random sizes live in a region and replaces
+   a random one at a time, with both allocation strategies. The region is
+   only address space, no memory is touched.
+
+   Build from the source root, with BUILD the pocl build directory:
+
+     cc -O2 -I include -I lib/CL -I lib/CL/devices -I BUILD \
+        tools/bufalloc-bench/bufalloc_bench.c lib/CL/devices/bufalloc.c \
+        -o bufalloc_bench -lpthread
+
+   To compare with another version of the allocator, build it with that
+   version of bufalloc.c and bufalloc.h. Allocators with a fixed number of
+   chunk infos per region need -DMAX_CHUNKS_IN_REGION=<n> with n above
+   twice the number of live buffers.
+
+   Usage: bufalloc_bench [live buffers] [replacements] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bufalloc.h"
+
+#define REGION_SIZE ((size_t)1 << 34)
+#define MAX_BUFFER_SIZE (256 * 1024)
+
+static unsigned long long
+now_ns ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t
+random_size ()
+{
+  /* Mostly small buffers with an occasional large one. */
+  if (rand () % 16 == 0)
+    return 1 + rand () % MAX_BUFFER_SIZE;
+  return 1 + rand () % 4096;
+}
+
+static int
+run (enum allocation_strategy strategy, const char *name, unsigned live,
+     unsigned replacements)
+{
+  memory_region_t *region = calloc (1, sizeof (memory_region_t));
+  chunk_info_t **chunks = calloc (live, sizeof (chunk_info_t *));
+  unsigned long long start, end;
+  unsigned i, failures = 0;
+
+  if (region == NULL || chunks == NULL)
+    return 1;
+
+  srand (1);
+  init_mem_region (region, 0, REGION_SIZE);
+  region->strategy = strategy;
+
+  start = now_ns ();
+  for (i = 0; i < live; ++i)
+    if ((chunks[i] = alloc_buffer_from_region (region, random_size ())) == NULL)
+      ++failures;
+  end = now_ns ();
+  printf ("%-8s %u allocations: %8.1f ns each\n", name, live,
+          (double)(end - start) / live);
+
+  start = now_ns ();
+  for (i = 0; i < replacements; ++i)
+    {
+      unsigned victim = rand () % live;
+      if (chunks[victim] != NULL)
+        free_chunk (chunks[victim]);
+      if ((chunks[victim] = alloc_buffer_from_region (region, random_size ()))
+          == NULL)
+        ++failures;
+    }
+  end = now_ns ();
+  printf ("%-8s %u replacements: %8.1f ns each, %u failed\n", name,
+          replacements, (double)(end - start) / replacements, failures);
+
+#ifdef BA_SL_COUNT
+  print_mem_region_stats (region);
+#endif
+
+  for (i = 0; i < live; ++i)
+    if (chunks[i] != NULL)
+      free_chunk (chunks[i]);
+#ifdef BA_SL_COUNT
+  uninit_mem_region (region);
+#endif
+  free (chunks);
+  free (region);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  unsigned live = argc > 1 ? atoi (argv[1]) : 4096;
+  unsigned replacements = argc > 2 ? atoi (argv[2]) : 200000;
+
+  if (live == 0)
+    return 1;
+  return run (BALLOCS_WASTEFUL, "wasteful", live, replacements)
+         || run (BALLOCS_TIGHT, "tight", live, replacements);
+}